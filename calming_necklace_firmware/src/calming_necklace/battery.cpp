@@ -0,0 +1,291 @@
+// battery.cpp
+#include "battery.h"
+#include "settings.h"
+#include "led_patterns.h"
+#include "time_service.h"
+
+// Resting LiPo voltage against remaining charge, highest first
+struct DischargePoint {
+    uint16_t millivolts;
+    uint8_t percent;
+};
+
+static const DischargePoint DISCHARGE_CURVE[] = {
+    {4200, 100}, {4100, 90}, {4000, 80}, {3900, 65}, {3800, 50}, {3750, 40},
+    {3700, 30}, {3650, 20}, {3600, 12}, {3500, 5}, {3300, 0},
+};
+static const byte DISCHARGE_POINTS = sizeof(DISCHARGE_CURVE) / sizeof(DISCHARGE_CURVE[0]);
+
+// Per policy level
+static const uint8_t INTERVAL_SCALE[POWER_POLICY_LEVEL_COUNT] = {1, 2, 4, 8};
+static const uint8_t DURATION_PERCENT[POWER_POLICY_LEVEL_COUNT] = {100, 75, 50, 25};
+static const uint16_t ADVERTISING_INTERVAL[POWER_POLICY_LEVEL_COUNT] = {160, 400, 800, 1600};  // 0.625 ms units
+
+static const char* const POLICY_NAMES[POWER_POLICY_LEVEL_COUNT] = {"normal", "reduced", "low", "critical"};
+
+static uint16_t batteryMillivolts = 0;
+static uint8_t batteryPercent = 100;
+static byte policyLevel = POWER_POLICY_NORMAL;
+static bool measuring = false;
+static bool measureDue = false;
+static unsigned long lastMeasurement = 0;
+static uint32_t measureStart = 0;
+static BatteryStats batteryStats = {0, 0, 0, 0, 0xFFFF, 100, POWER_POLICY_NORMAL};
+
+#if BATTERY_HARDWARE
+
+// EasyDMA target; the SAADC writes here while the CPU does other work
+static volatile int16_t sampleBuffer[BATTERY_DMA_SAMPLES];
+
+static void configureSaadc() {
+    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+    NRF_SAADC->OVERSAMPLE = BATTERY_OVERSAMPLE;
+    NRF_SAADC->SAMPLERATE = SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos;
+    // Burst runs all the oversampled conversions from one SAMPLE task; the
+    // long acquisition time suits the divider's high source impedance
+    NRF_SAADC->CH[0].CONFIG =
+        (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+        (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+        (SAADC_CH_CONFIG_TACQ_40us << SAADC_CH_CONFIG_TACQ_Pos) |
+        (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos) |
+        (SAADC_CH_CONFIG_BURST_Enabled << SAADC_CH_CONFIG_BURST_Pos);
+    NRF_SAADC->CH[0].PSELP = BATTERY_SAADC_INPUT;
+    NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+
+    // Each result starts the next sample until the buffer is full
+    NRF_PPI->CH[BATTERY_PPI_CHANNEL].EEP = (uint32_t)&NRF_SAADC->EVENTS_RESULTDONE;
+    NRF_PPI->CH[BATTERY_PPI_CHANNEL].TEP = (uint32_t)&NRF_SAADC->TASKS_SAMPLE;
+
+    // Offset calibration, once. Stopping afterwards keeps the calibration
+    // from leaving a stray sample for the next START (errata 86).
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+    NRF_SAADC->EVENTS_CALIBRATEDONE = 0;
+    NRF_SAADC->TASKS_CALIBRATEOFFSET = 1;
+    while (!NRF_SAADC->EVENTS_CALIBRATEDONE) {}
+    NRF_SAADC->EVENTS_CALIBRATEDONE = 0;
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->TASKS_STOP = 1;
+    while (!NRF_SAADC->EVENTS_STOPPED) {}
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+}
+
+static void startMeasurement(unsigned long now) {
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+    NRF_SAADC->RESULT.PTR = (uint32_t)sampleBuffer;
+    NRF_SAADC->RESULT.MAXCNT = BATTERY_DMA_SAMPLES;
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NRF_SAADC->EVENTS_END = 0;
+    NRF_SAADC->EVENTS_RESULTDONE = 0;
+    NRF_PPI->CHENSET = (1UL << BATTERY_PPI_CHANNEL);
+    NRF_SAADC->TASKS_START = 1;
+    while (!NRF_SAADC->EVENTS_STARTED) {}  // A few clock cycles
+    NRF_SAADC->TASKS_SAMPLE = 1;
+}
+
+// The sample PPI starts after the last result finds no buffer and is
+// dropped; the converter is off again before the next pass
+static bool finishMeasurement(unsigned long now, uint16_t& millivolts) {
+    if (!NRF_SAADC->EVENTS_END) {
+        return false;
+    }
+    NRF_PPI->CHENCLR = (1UL << BATTERY_PPI_CHANNEL);
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->TASKS_STOP = 1;
+    while (!NRF_SAADC->EVENTS_STOPPED) {}
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->EVENTS_END = 0;
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+
+    int32_t sum = 0;
+    for (byte i = 0; i < BATTERY_DMA_SAMPLES; i++) {
+        sum += max((int16_t)sampleBuffer[i], (int16_t)0);  // Noise can read just below zero
+    }
+    // 12 bits with gain 1/6 against the 0.6 V reference: 3.6 V full scale
+    millivolts = (uint16_t)((sum * 3600L * BATTERY_DIVIDER_RATIO) / (4096L * BATTERY_DMA_SAMPLES));
+    return true;
+}
+
+#else
+
+// Simulated cell: a steady, nearly full battery unless a curve is set
+static const BatteryCurvePoint DEFAULT_CURVE[] = {{0, 4050}};
+static const BatteryCurvePoint* simulatedCurve = DEFAULT_CURVE;
+static byte simulatedPoints = 1;
+
+void setSimulatedBatteryCurve(const BatteryCurvePoint* points, byte count) {
+    if (points == nullptr || count == 0) {
+        points = DEFAULT_CURVE;
+        count = 1;
+    }
+    simulatedCurve = points;
+    simulatedPoints = count;
+    measureDue = true;  // Measure again on the next pass
+}
+
+static uint16_t simulatedMillivolts(unsigned long now) {
+    if (now <= simulatedCurve[0].time) {
+        return simulatedCurve[0].millivolts;
+    }
+    for (byte i = 1; i < simulatedPoints; i++) {
+        const BatteryCurvePoint& from = simulatedCurve[i - 1];
+        const BatteryCurvePoint& to = simulatedCurve[i];
+        if (now < to.time) {
+            long span = to.time - from.time;
+            long delta = (long)to.millivolts - from.millivolts;
+            return from.millivolts + delta * (long)(now - from.time) / span;
+        }
+    }
+    return simulatedCurve[simulatedPoints - 1].millivolts;
+}
+
+static void configureSaadc() {
+}
+
+static void startMeasurement(unsigned long now) {
+}
+
+static bool finishMeasurement(unsigned long now, uint16_t& millivolts) {
+    millivolts = simulatedMillivolts(now);
+    return true;
+}
+
+#endif
+
+static uint8_t percentForMillivolts(uint16_t millivolts) {
+    if (millivolts >= DISCHARGE_CURVE[0].millivolts) {
+        return DISCHARGE_CURVE[0].percent;
+    }
+    for (byte i = 1; i < DISCHARGE_POINTS; i++) {
+        const DischargePoint& upper = DISCHARGE_CURVE[i - 1];
+        const DischargePoint& lower = DISCHARGE_CURVE[i];
+        if (millivolts >= lower.millivolts) {
+            return lower.percent + (uint32_t)(upper.percent - lower.percent) * (millivolts - lower.millivolts) /
+                                       (upper.millivolts - lower.millivolts);
+        }
+    }
+    return 0;
+}
+
+// A level is entered at its threshold and only left above it plus the
+// hysteresis
+static byte policyForPercent(uint8_t percent, byte current) {
+    const byte thresholds[POWER_POLICY_LEVEL_COUNT - 1] = {batteryReducedThreshold, batteryLowThreshold,
+                                                          batteryCriticalThreshold};
+    byte level = POWER_POLICY_NORMAL;
+    for (byte i = 0; i < POWER_POLICY_LEVEL_COUNT - 1; i++) {
+        uint16_t limit = thresholds[i] + (current > i ? BATTERY_POLICY_HYSTERESIS : 0);
+        if (percent <= limit) {
+            level = i + 1;
+        }
+    }
+    return level;
+}
+
+static void applyPolicy(byte level) {
+    if (level == policyLevel) {
+        return;
+    }
+    debugPrintf(DEBUG_POWER, "Battery %d%%: power policy %s -> %s\n", batteryPercent, POLICY_NAMES[policyLevel],
+                POLICY_NAMES[level]);
+    policyLevel = level;
+    batteryStats.policyChanges++;
+    setLedStatus(LED_STATUS_LOW_BATTERY, level >= POWER_POLICY_LOW);
+}
+
+static void recordMeasurement(uint16_t millivolts) {
+    uint8_t percent = percentForMillivolts(millivolts);
+    if (percent != batteryPercent || batteryStats.measurements == 0) {
+        debugPrintf(DEBUG_POWER, "Battery %u mV, %d%%\n", millivolts, percent);
+    }
+    batteryMillivolts = millivolts;
+    batteryPercent = percent;
+    batteryStats.measurements++;
+    batteryStats.measureMicros = micros() - measureStart;
+    batteryStats.millivolts = millivolts;
+    batteryStats.minMillivolts = min(batteryStats.minMillivolts, millivolts);
+    batteryStats.percent = batteryPercent;
+    applyPolicy(policyForPercent(batteryPercent, policyLevel));
+    batteryStats.policyLevel = policyLevel;
+}
+
+// Takes the first reading straight away, so the policy and the Battery
+// Service are right before BLE starts
+void initBattery() {
+    configureSaadc();
+    unsigned long now = getLoopMillis();
+    uint16_t millivolts;
+    measureStart = micros();
+    startMeasurement(now);
+    while (!finishMeasurement(now, millivolts)) {}
+    lastMeasurement = now;
+    recordMeasurement(millivolts);
+}
+
+bool updateBattery(unsigned long now) {
+    if (!measuring) {
+        if (!measureDue && now - lastMeasurement < BATTERY_SAMPLE_INTERVAL) {
+            return false;
+        }
+        measureDue = false;
+        lastMeasurement = now;
+        measureStart = micros();
+        startMeasurement(now);
+        measuring = true;
+    }
+
+    uint16_t millivolts;
+    if (!finishMeasurement(now, millivolts)) {
+        return false;
+    }
+    measuring = false;
+    uint8_t previous = batteryPercent;
+    recordMeasurement(millivolts);
+    return batteryPercent != previous;
+}
+
+uint8_t getBatteryPercent() {
+    return batteryPercent;
+}
+
+uint16_t getBatteryMillivolts() {
+    return batteryMillivolts;
+}
+
+byte getPowerPolicyLevel() {
+    return policyLevel;
+}
+
+unsigned long scaleHeartRateInterval(unsigned long interval) {
+    return interval * INTERVAL_SCALE[policyLevel];
+}
+
+unsigned long scaleEmissionDuration(unsigned long duration) {
+    return (unsigned long)((uint64_t)duration * DURATION_PERCENT[policyLevel] / 100);
+}
+
+uint16_t getPolicyAdvertisingInterval() {
+    return ADVERTISING_INTERVAL[policyLevel];
+}
+
+bool setPowerPolicyThresholds(byte reduced, byte low, byte critical) {
+    if (reduced > 100 || low >= reduced || critical >= low) {
+        return false;
+    }
+    batteryReducedThreshold = reduced;
+    batteryLowThreshold = low;
+    batteryCriticalThreshold = critical;
+    applyPolicy(policyForPercent(batteryPercent, policyLevel));
+    batteryStats.policyLevel = policyLevel;
+    return true;
+}
+
+void getBatteryStats(BatteryStats& stats) {
+    stats = batteryStats;
+}
+
+void resetBatteryStats() {
+    batteryStats.measurements = 0;
+    batteryStats.policyChanges = 0;
+    batteryStats.minMillivolts = batteryMillivolts;
+}
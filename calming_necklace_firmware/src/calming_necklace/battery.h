@@ -0,0 +1,89 @@
+// battery.h
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Battery monitoring and the power policy that follows it.
+//
+// The cell is measured through a divider on A0 by the SAADC. Once per
+// BATTERY_SAMPLE_INTERVAL the converter is switched on, takes
+// BATTERY_DMA_SAMPLES results into RAM over EasyDMA and is switched off
+// again. Each result averages 2^BATTERY_OVERSAMPLE conversions in burst
+// mode, and PPI starts the next sample from the last one's RESULTDONE, so
+// the CPU only starts the run and picks up the buffer a pass or two later.
+//
+// The charge estimate steps the power policy down as it falls:
+//
+//   level      heart rate interval  emission duration  advertising
+//   normal     x1                   100%               100 ms
+//   reduced    x2                   75%                250 ms
+//   low        x4                   50%                500 ms
+//   critical   x8                   25%                1 s
+//
+// The thresholds are settings; a level is only left again once the charge
+// is BATTERY_POLICY_HYSTERESIS above its threshold, so a sagging cell under
+// an emission doesn't flip the policy back and forth. From the low level on
+// the low battery LED pattern is shown.
+//
+// The host build has no converter; its cell follows a scripted discharge
+// curve set with setSimulatedBatteryCurve().
+#if defined(NRF52840_XXAA)
+#define BATTERY_HARDWARE 1
+#define BATTERY_SAADC_INPUT SAADC_CH_PSELP_PSELP_AnalogInput2  // A0, P0.04
+#define BATTERY_PPI_CHANNEL 13
+#define BATTERY_DIVIDER_RATIO 2  // Two equal resistors
+#else
+#define BATTERY_HARDWARE 0
+#endif
+
+#define BATTERY_SAMPLE_INTERVAL 60000  // ms
+#define BATTERY_DMA_SAMPLES 4
+#define BATTERY_OVERSAMPLE 4           // 16 conversions per result
+
+// Power policy levels
+#define POWER_POLICY_NORMAL 0
+#define POWER_POLICY_REDUCED 1
+#define POWER_POLICY_LOW 2
+#define POWER_POLICY_CRITICAL 3
+#define POWER_POLICY_LEVEL_COUNT 4
+
+#define BATTERY_POLICY_HYSTERESIS 3  // Percent
+
+// Power policy record: [reduced %][low %][critical %], each below the last
+#define POWER_POLICY_CONFIG_LENGTH 3
+
+// One point of a scripted discharge curve for the host build
+struct BatteryCurvePoint {
+    uint32_t time;        // ms of uptime
+    uint16_t millivolts;
+};
+
+struct BatteryStats {
+    uint32_t measurements;
+    uint32_t policyChanges;
+    uint32_t measureMicros;   // Converter on to buffer collected, last run
+    uint16_t millivolts;
+    uint16_t minMillivolts;   // Lowest since the reset
+    uint8_t percent;
+    uint8_t policyLevel;      // POWER_POLICY_*
+};
+
+// Function declarations
+void initBattery();
+bool updateBattery(unsigned long now);  // True when the percentage changed
+uint8_t getBatteryPercent();
+uint16_t getBatteryMillivolts();
+byte getPowerPolicyLevel();
+unsigned long scaleHeartRateInterval(unsigned long interval);
+unsigned long scaleEmissionDuration(unsigned long duration);
+uint16_t getPolicyAdvertisingInterval();
+bool setPowerPolicyThresholds(byte reduced, byte low, byte critical);
+void getBatteryStats(BatteryStats& stats);
+void resetBatteryStats();
+#if !BATTERY_HARDWARE
+void setSimulatedBatteryCurve(const BatteryCurvePoint* points, byte count);
+#endif
+
+#endif // BATTERY_H
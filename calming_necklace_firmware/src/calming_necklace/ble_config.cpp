@@ -1,27 +1,113 @@
 // ble_config.cpp
 
 #include "ble_config.h"
+#include "gatt_schema.h"
 #include "led_control.h"
 #include "settings.h"
 #include "timing.h"
 #include "heart_rate.h"
 #include "debug.h"
 #include "emission_control.h"
+#include "diagnostics.h"
+#include "wall_clock.h"
+#include "emission_schedule.h"
+#include "rule_engine.h"
+#include "emission_analytics.h"
+#include "led_patterns.h"
+#include "gpio_hal.h"
+#include "time_service.h"
+#include "energy_model.h"
+#include "latency_trace.h"
+#include "memory_monitor.h"
+#include "dfu.h"
+#include "battery.h"
 
-BLEService settingsService("19B10000-E8F2-537E-4F6C-D104768A1214");  // Settings service
-BLEService ledService("19b10000-e8f2-537e-4f6c-d104768a1214");  // LED control service
+// The layout comes from tools/gatt_schema.json through gatt_schema.h
+BLEService necklaceService(GATT_SERVICE_UUID);
 
-BLEByteCharacteristic switchCharacteristic("19B10001-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify | BLEWriteWithoutResponse);
-BLEByteCharacteristic keepAliveCharacteristic("2A3B", BLERead | BLEWrite | BLENotify);
-BLELongCharacteristic emission1Characteristic("2A19", BLERead | BLEWrite | BLENotify);
-BLELongCharacteristic interval1Characteristic("2A1B", BLERead | BLEWrite | BLENotify);
-BLEByteCharacteristic periodic1Characteristic("2A1D", BLERead | BLEWrite | BLENotify);
-BLEByteCharacteristic heartrateCharacteristic("2A1F", BLERead | BLEWrite | BLENotify);
-BLEByteCharacteristic heartRateEnabledCharacteristic("19B10002-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify);
-BLEByteCharacteristic highHeartRateThresholdCharacteristic("19B10003-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify);
-BLEByteCharacteristic lowHeartRateThresholdCharacteristic("19B10004-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify);
+BLEByteCharacteristic switchCharacteristic(GATT_UUID(GATT_SWITCH), GATT_PROPERTIES(GATT_SWITCH));
+BLEByteCharacteristic keepAliveCharacteristic(GATT_UUID(GATT_KEEPALIVE), GATT_PROPERTIES(GATT_KEEPALIVE));
+BLELongCharacteristic emission1Characteristic(GATT_UUID(GATT_EMISSION), GATT_PROPERTIES(GATT_EMISSION));
+BLELongCharacteristic interval1Characteristic(GATT_UUID(GATT_INTERVAL), GATT_PROPERTIES(GATT_INTERVAL));
+BLEByteCharacteristic periodic1Characteristic(GATT_UUID(GATT_PERIODIC), GATT_PROPERTIES(GATT_PERIODIC));
+BLEByteCharacteristic heartrateCharacteristic(GATT_UUID(GATT_HEART_RATE), GATT_PROPERTIES(GATT_HEART_RATE));
+BLEByteCharacteristic heartRateEnabledCharacteristic(GATT_UUID(GATT_HEART_RATE_ENABLED), GATT_PROPERTIES(GATT_HEART_RATE_ENABLED));
+BLEByteCharacteristic highHeartRateThresholdCharacteristic(GATT_UUID(GATT_HIGH_HEART_RATE_THRESHOLD), GATT_PROPERTIES(GATT_HIGH_HEART_RATE_THRESHOLD));
+BLEByteCharacteristic lowHeartRateThresholdCharacteristic(GATT_UUID(GATT_LOW_HEART_RATE_THRESHOLD), GATT_PROPERTIES(GATT_LOW_HEART_RATE_THRESHOLD));
+BLEByteCharacteristic predictiveEnabledCharacteristic(GATT_UUID(GATT_PREDICTIVE_ENABLED), GATT_PROPERTIES(GATT_PREDICTIVE_ENABLED));
+BLEUnsignedShortCharacteristic predictionHorizonCharacteristic(GATT_UUID(GATT_PREDICTION_HORIZON), GATT_PROPERTIES(GATT_PREDICTION_HORIZON));
+BLEByteCharacteristic predictionHysteresisCharacteristic(GATT_UUID(GATT_PREDICTION_HYSTERESIS), GATT_PROPERTIES(GATT_PREDICTION_HYSTERESIS));
+BLECharacteristic diagnosticsCharacteristic(GATT_UUID(GATT_DIAGNOSTICS), GATT_PROPERTIES(GATT_DIAGNOSTICS), DIAG_MAX_RESPONSE);
+BLEUnsignedShortCharacteristic heartRateMinIntervalCharacteristic(GATT_UUID(GATT_HEART_RATE_MIN_INTERVAL), GATT_PROPERTIES(GATT_HEART_RATE_MIN_INTERVAL));
+BLEUnsignedShortCharacteristic heartRateMaxIntervalCharacteristic(GATT_UUID(GATT_HEART_RATE_MAX_INTERVAL), GATT_PROPERTIES(GATT_HEART_RATE_MAX_INTERVAL));
+BLECharacteristic channelConfigCharacteristic(GATT_UUID(GATT_CHANNEL_CONFIG), GATT_PROPERTIES(GATT_CHANNEL_CONFIG), CHANNEL_CONFIG_PROFILE_LENGTH);
+BLECharacteristic arbitrationConfigCharacteristic(GATT_UUID(GATT_ARBITRATION_CONFIG), GATT_PROPERTIES(GATT_ARBITRATION_CONFIG), ARBITRATION_CONFIG_LENGTH, true);
+BLECharacteristic budgetConfigCharacteristic(GATT_UUID(GATT_BUDGET_CONFIG), GATT_PROPERTIES(GATT_BUDGET_CONFIG), BUDGET_CONFIG_LENGTH, true);
+BLECharacteristic currentTimeCharacteristic(GATT_UUID(GATT_CURRENT_TIME), GATT_PROPERTIES(GATT_CURRENT_TIME), CURRENT_TIME_LENGTH, true);
+BLECharacteristic scheduleCharacteristic(GATT_UUID(GATT_SCHEDULE), GATT_PROPERTIES(GATT_SCHEDULE), SCHEDULE_ENTRY_LENGTH);
+BLECharacteristic ruleCharacteristic(GATT_UUID(GATT_RULE), GATT_PROPERTIES(GATT_RULE), RULE_RECORD_LENGTH);
+BLECharacteristic analyticsCharacteristic(GATT_UUID(GATT_ANALYTICS), GATT_PROPERTIES(GATT_ANALYTICS), ANALYTICS_SUMMARY_LENGTH, true);
+BLECharacteristic adaptiveConfigCharacteristic(GATT_UUID(GATT_ADAPTIVE_CONFIG), GATT_PROPERTIES(GATT_ADAPTIVE_CONFIG), ADAPTIVE_CONFIG_LENGTH, true);
+BLECharacteristic energyConfigCharacteristic(GATT_UUID(GATT_ENERGY_CONFIG), GATT_PROPERTIES(GATT_ENERGY_CONFIG), ENERGY_CONFIG_LENGTH);
+BLECharacteristic dfuControlCharacteristic(GATT_UUID(GATT_DFU_CONTROL), GATT_PROPERTIES(GATT_DFU_CONTROL), DFU_CONTROL_LENGTH);
+BLECharacteristic dfuDataCharacteristic(GATT_UUID(GATT_DFU_DATA), GATT_PROPERTIES(GATT_DFU_DATA), DFU_DATA_LENGTH);
+BLECharacteristic powerPolicyCharacteristic(GATT_UUID(GATT_POWER_POLICY), GATT_PROPERTIES(GATT_POWER_POLICY), POWER_POLICY_CONFIG_LENGTH, true);
 
-bool isConnected = false;
+BLEService batteryService(BATTERY_SERVICE_UUID);
+BLEByteCharacteristic batteryLevelCharacteristic(BATTERY_LEVEL_UUID, BLERead | BLENotify);
+
+bool isConnected = false;  // At least one central
+
+#define NO_SLOT 0xFF
+
+// Connected centrals by slot; the slot indexes their timers in timing.cpp
+static BLEDevice centrals[MAX_CENTRALS];
+static bool slotUsed[MAX_CENTRALS] = {false};
+static uint8_t centralCount = 0;
+
+// Notifications each central subscribed to. A subscribed central is
+// listening to the device, so it isn't dropped for being idle.
+static uint8_t subscriptions[MAX_CENTRALS] = {0};
+
+// The connect and disconnect events run inside the BLE poll, where the
+// stack must not be sent further commands, so advertising changes and
+// refusals wait for the next updateConnections()
+static bool advertisingChanged = false;
+static BLEDevice refusedCentral;
+static bool refusePending = false;
+
+// Addresses of the connected centrals, kept for the disconnect log
+static char centralAddress[MAX_CENTRALS][18];
+
+// ArduinoBLE keeps a device's raw address private and hands it out only
+// formatted into a heap String, which would allocate on every connection.
+// Names in an explicit template instantiation are exempt from access
+// checks, so instantiating this accessor with the member reaches the bytes
+// without one.
+typedef uint8_t DeviceAddress[6];
+const uint8_t* rawDeviceAddress(const BLEDevice& device);
+
+template <DeviceAddress BLEDevice::*Member>
+struct DeviceAddressAccess {
+    friend const uint8_t* rawDeviceAddress(const BLEDevice& device) {
+        return device.*Member;
+    }
+};
+template struct DeviceAddressAccess<&BLEDevice::_address>;
+
+// Same format as BLEDevice::address(), most significant byte first
+static void formatCentralAddress(const BLEDevice& central, char* text, size_t size) {
+    const uint8_t* address = rawDeviceAddress(central);
+    snprintf(text, size, "%02x:%02x:%02x:%02x:%02x:%02x",
+             address[5], address[4], address[3], address[2], address[1], address[0]);
+}
+
+// Follows the power policy; applied when advertising next starts
+static uint16_t advertisingInterval = ADVERTISING_BASE_INTERVAL;
+
+static uint16_t advertisingPowerLevel() {
+    return (uint32_t)POWER_LEVEL_FULL * ADVERTISING_BASE_INTERVAL / advertisingInterval;
+}
 
 bool setupBLE(uint8_t maxAttempts) {
     debugPrintln(DEBUG_BLE, "\nInitializing BLE...");
@@ -30,10 +116,18 @@ bool setupBLE(uint8_t maxAttempts) {
     while (attempts < maxAttempts) {
         if (BLE.begin()) {
             setupServices();
+            BLE.setEventHandler(BLEConnected, onCentralConnected);
+            BLE.setEventHandler(BLEDisconnected, onCentralDisconnected);
+            BLE.setConnectionInterval(CONNECTION_INTERVAL_MIN, CONNECTION_INTERVAL_MAX);
+            BLE.setSupervisionTimeout(LINK_SUPERVISION_TIMEOUT);
             BLE.setDeviceName("Calming Necklace");
             BLE.setLocalName("Calming Necklace");
-            BLE.setAdvertisedService(ledService);
+            BLE.setAdvertisedService(necklaceService);
+            advertisingInterval = getPolicyAdvertisingInterval();
+            BLE.setAdvertisingInterval(advertisingInterval);
             BLE.advertise();
+            setLedStatus(LED_STATUS_ADVERTISING, true);
+            setPowerLevel(POWER_ADVERTISING, advertisingPowerLevel());
             debugPrintln(DEBUG_BLE, "Advertising as 'Calming Necklace'");
             return true;
         }
@@ -45,25 +139,112 @@ bool setupBLE(uint8_t maxAttempts) {
     }
 
     debugPrintln(DEBUG_BLE, "ERROR: BLE initialization failed after max attempts");
-    handleLEDs(CMD_LED_ON);  // Visual error indication
+    setLedStatus(LED_STATUS_BLE_FAILURE, true);  // Visual error indication
     return false;
 }
 
-void setupServices() {
-    ledService.addCharacteristic(switchCharacteristic);
-    ledService.addCharacteristic(keepAliveCharacteristic);
+static uint8_t findSlot(const BLEDevice& central) {
+    for (uint8_t slot = 0; slot < MAX_CENTRALS; slot++) {
+        if (slotUsed[slot] && centrals[slot] == central) {
+            return slot;
+        }
+    }
+    return NO_SLOT;
+}
 
-    settingsService.addCharacteristic(emission1Characteristic);
-    settingsService.addCharacteristic(interval1Characteristic);
-    settingsService.addCharacteristic(periodic1Characteristic);
-    settingsService.addCharacteristic(heartrateCharacteristic);
-    settingsService.addCharacteristic(heartRateEnabledCharacteristic);
-    settingsService.addCharacteristic(highHeartRateThresholdCharacteristic);
-    settingsService.addCharacteristic(lowHeartRateThresholdCharacteristic);
+// Write handlers know which central wrote, so they keep its timer alive
+static void noteActivity(const BLEDevice& central) {
+    uint8_t slot = findSlot(central);
+    if (slot != NO_SLOT) {
+        resetActivityTimer(slot);
+    }
+}
+
+static void onSubscribed(BLEDevice central, BLECharacteristic characteristic) {
+    uint8_t slot = findSlot(central);
+    if (slot != NO_SLOT) {
+        subscriptions[slot]++;
+    }
+}
+
+static void onUnsubscribed(BLEDevice central, BLECharacteristic characteristic) {
+    uint8_t slot = findSlot(central);
+    if (slot != NO_SLOT && subscriptions[slot] > 0) {
+        subscriptions[slot]--;
+        resetActivityTimer(slot);  // Idle time counts from here
+    }
+}
+
+static void trackSubscriptions(BLECharacteristic& characteristic) {
+    characteristic.setEventHandler(BLESubscribed, onSubscribed);
+    characteristic.setEventHandler(BLEUnsubscribed, onUnsubscribed);
+}
+
+// Runs from the BLE stack's poll as soon as the write is received, before
+// the next handlePeripheralLoop() pass sees it
+static void onSwitchWritten(BLEDevice central, BLECharacteristic characteristic) {
+    markLatencyPoint(LATENCY_POINT_ARRIVAL);
+    noteActivity(central);
+}
+
+// Update chunks come as writes without response, several per connection
+// event, so each is decoded as it arrives instead of waiting for the loop,
+// which would only see the last one
+static void onDfuDataWritten(BLEDevice central, BLECharacteristic characteristic) {
+    onDfuData(dfuDataCharacteristic.value(), dfuDataCharacteristic.valueLength());
+    noteActivity(central);
+}
+
+static void sendDfuResponse(const uint8_t* data, size_t length) {
+    dfuControlCharacteristic.writeValue(data, length);
+}
+
+void setupServices() {
+    switchCharacteristic.setEventHandler(BLEWritten, onSwitchWritten);
+    keepAliveCharacteristic.setEventHandler(BLEWritten, onKeepAliveReceived);
+    trackSubscriptions(emission1Characteristic);
+    trackSubscriptions(interval1Characteristic);
+    trackSubscriptions(periodic1Characteristic);
+    trackSubscriptions(heartrateCharacteristic);
+    trackSubscriptions(diagnosticsCharacteristic);
+    trackSubscriptions(analyticsCharacteristic);
+    trackSubscriptions(dfuControlCharacteristic);
+    trackSubscriptions(batteryLevelCharacteristic);
+    dfuDataCharacteristic.setEventHandler(BLEWritten, onDfuDataWritten);
+    necklaceService.addCharacteristic(switchCharacteristic);
+    necklaceService.addCharacteristic(keepAliveCharacteristic);
+    necklaceService.addCharacteristic(emission1Characteristic);
+    necklaceService.addCharacteristic(interval1Characteristic);
+    necklaceService.addCharacteristic(periodic1Characteristic);
+    necklaceService.addCharacteristic(heartrateCharacteristic);
+    necklaceService.addCharacteristic(heartRateEnabledCharacteristic);
+    necklaceService.addCharacteristic(highHeartRateThresholdCharacteristic);
+    necklaceService.addCharacteristic(lowHeartRateThresholdCharacteristic);
+    necklaceService.addCharacteristic(predictiveEnabledCharacteristic);
+    necklaceService.addCharacteristic(predictionHorizonCharacteristic);
+    necklaceService.addCharacteristic(predictionHysteresisCharacteristic);
+    necklaceService.addCharacteristic(diagnosticsCharacteristic);
+    necklaceService.addCharacteristic(heartRateMinIntervalCharacteristic);
+    necklaceService.addCharacteristic(heartRateMaxIntervalCharacteristic);
+    necklaceService.addCharacteristic(channelConfigCharacteristic);
+    necklaceService.addCharacteristic(arbitrationConfigCharacteristic);
+    necklaceService.addCharacteristic(budgetConfigCharacteristic);
+    necklaceService.addCharacteristic(currentTimeCharacteristic);
+    necklaceService.addCharacteristic(scheduleCharacteristic);
+    necklaceService.addCharacteristic(ruleCharacteristic);
+    necklaceService.addCharacteristic(analyticsCharacteristic);
+    necklaceService.addCharacteristic(adaptiveConfigCharacteristic);
+    necklaceService.addCharacteristic(energyConfigCharacteristic);
+    necklaceService.addCharacteristic(dfuControlCharacteristic);
+    necklaceService.addCharacteristic(dfuDataCharacteristic);
+    necklaceService.addCharacteristic(powerPolicyCharacteristic);
 
-    BLE.addService(ledService);
-    BLE.addService(settingsService);
+    BLE.addService(necklaceService);
+    batteryService.addCharacteristic(batteryLevelCharacteristic);
+    BLE.addService(batteryService);
+    debugPrintf(DEBUG_BLE, "GATT table: %d attributes\n", gattAttributeCount());
 
+    initDfu(sendDfuResponse);
     initializeCharacteristics();
 }
 
@@ -77,68 +258,164 @@ void initializeCharacteristics() {
     heartRateEnabledCharacteristic.writeValue(0);
     highHeartRateThresholdCharacteristic.writeValue(highHeartRateThreshold);
     lowHeartRateThresholdCharacteristic.writeValue(lowHeartRateThreshold);
+    predictiveEnabledCharacteristic.writeValue(getPredictiveReleaseEnabled());
+    predictionHorizonCharacteristic.writeValue(getPredictionHorizon() / 1000);
+    predictionHysteresisCharacteristic.writeValue(getPredictionHysteresis());
+    heartRateMinIntervalCharacteristic.writeValue(getHeartRateMinInterval() / 1000);
+    heartRateMaxIntervalCharacteristic.writeValue(getHeartRateMaxInterval() / 1000);
+    const uint8_t thresholds[POWER_POLICY_CONFIG_LENGTH] = {batteryReducedThreshold, batteryLowThreshold,
+                                                            batteryCriticalThreshold};
+    powerPolicyCharacteristic.writeValue(thresholds, sizeof(thresholds));
+    batteryLevelCharacteristic.writeValue(getBatteryPercent());
+    updateAnalyticsCharacteristic();
 }
 
+// Runs from the BLE poll for every central that connects
 void onCentralConnected(BLEDevice central) {
-    debugPrint(DEBUG_BLE, "Connected to central: ");
-    debugPrintln(DEBUG_BLE, central.address().c_str());  // Now using the parameter
-    digitalWrite(LED_BUILTIN, HIGH);
-    resetActivityTimer();
-    resetKeepAliveTimer();
-    resetHeartRateTimer();
-    isConnected = true;
+    uint8_t slot = 0;
+    while (slot < MAX_CENTRALS && slotUsed[slot]) {
+        slot++;
+    }
+    if (slot == MAX_CENTRALS) {
+        debugPrintln(DEBUG_BLE, "Central refused, all connection slots in use");
+        refusedCentral = central;
+        refusePending = true;
+        return;
+    }
+
+    centrals[slot] = central;
+    slotUsed[slot] = true;
+    centralCount++;
+    formatCentralAddress(central, centralAddress[slot], sizeof(centralAddress[slot]));
+    debugPrintf(DEBUG_BLE, "Connected to central %d: %s (%d of %d)\n", slot, centralAddress[slot],
+                centralCount, MAX_CENTRALS);
+    subscriptions[slot] = 0;
+    resetActivityTimer(slot);
+    advertisingChanged = true;
+
+    if (centralCount == 1) {
+        BuiltinLed::set();
+        resetHeartRateTimer();
+        setLedStatus(LED_STATUS_ADVERTISING, false);
+        setLedStatus(LED_STATUS_CONNECTED, true);
+        setPowerLevel(POWER_CONNECTED, POWER_LEVEL_FULL);
+        isConnected = true;
+    }
 }
 
 void onCentralDisconnected(BLEDevice central) {
-    debugPrint(DEBUG_BLE, "Disconnected from central: ");
-    debugPrintln(DEBUG_BLE, central.address().c_str());  // Now using the parameter
-    digitalWrite(LED_BUILTIN, LOW);
-    handleLEDs(CMD_LED_OFF);
-    BLE.advertise();
-    isConnected = false;
+    uint8_t slot = findSlot(central);
+    if (slot == NO_SLOT) {
+        return;  // One that was refused
+    }
+    debugPrintf(DEBUG_BLE, "Disconnected from central %d: %s\n", slot, centralAddress[slot]);
+    slotUsed[slot] = false;
+    centrals[slot] = BLEDevice();
+    centralCount--;
+    advertisingChanged = true;
+
+    // The link status follows the last connection. Emissions run on to
+    // their cutoff: button, schedule and rule emissions don't need the app.
+    if (centralCount == 0) {
+        BuiltinLed::clear();
+        setLedStatus(LED_STATUS_CONNECTED, false);
+        setLedStatus(LED_STATUS_ADVERTISING, true);
+        setPowerLevel(POWER_CONNECTED, 0);
+        isConnected = false;
+    }
+}
+
+// Keeps advertising while there is a free slot, refuses centrals beyond
+// MAX_CENTRALS and drops the ones that neither write nor listen
+void updateConnections(unsigned long now) {
+    if (refusePending) {
+        refusePending = false;
+        refusedCentral.disconnect();
+    }
+
+    uint16_t interval = getPolicyAdvertisingInterval();
+    if (interval != advertisingInterval) {
+        advertisingInterval = interval;
+        BLE.setAdvertisingInterval(interval);
+        debugPrintf(DEBUG_BLE, "Advertising interval %u ms\n", (unsigned)(interval * 5 / 8));
+        if (centralCount < MAX_CENTRALS) {
+            BLE.stopAdvertise();  // The new interval applies from the next start
+            advertisingChanged = true;
+        }
+    }
+
+    if (advertisingChanged) {
+        advertisingChanged = false;
+        if (centralCount < MAX_CENTRALS) {
+            BLE.advertise();
+            setPowerLevel(POWER_ADVERTISING, advertisingPowerLevel());
+        } else {
+            BLE.stopAdvertise();
+            setPowerLevel(POWER_ADVERTISING, 0);
+            debugPrintln(DEBUG_BLE, "All connection slots in use, advertising stopped");
+        }
+    }
+
+    for (uint8_t slot = 0; slot < MAX_CENTRALS; slot++) {
+        if (slotUsed[slot] && subscriptions[slot] == 0 && isConnectionTimedOut(slot, now)) {
+            debugPrintf(DEBUG_BLE, "Idle timeout on central %d\n", slot);
+            centrals[slot].disconnect();
+            resetActivityTimer(slot);  // The disconnect event frees the slot; until then, don't repeat
+        }
+    }
+}
+
+uint8_t getConnectedCentralCount() {
+    return centralCount;
 }
 
-void handlePeripheralLoop(BLEDevice central) {
+// Handles what the connected centrals wrote since the last pass. Writes
+// from every central land in the same characteristics, so one pass
+// serves them all.
+void handlePeripheralLoop(unsigned long now) {
     if (switchCharacteristic.written()) {
-        resetActivityTimer();
         byte command = switchCharacteristic.value();
+        markLatencyPoint(LATENCY_POINT_DISPATCH);
 
         debugPrintf(DEBUG_BLE, "Received command: %d\n", command);
 
         if (command == CMD_LED_ON) {
+            // Ends the trace either way
             triggerEmission(TRIGGER_MANUAL);
         } else if (command >= CMD_EMISSION_DURATION && command <= CMD_LOW_HEART_RATE_THRESHOLD) {
             // For settings commands, we need a second byte for the value
             // This would typically be handled in a separate characteristic or protocol
             // For now, we'll just log that we received a settings command
             debugPrintf(DEBUG_BLE, "Received settings command: %d (needs value)\n", command);
+            abandonLatencyTrace();
+        } else if (command == CMD_LED_OFF) {
+            // A running emitter pin belongs to its GPIOTE cutoff or PWM, so
+            // a plain LED write wouldn't reach it; stop it where it started
+            stopEmission();
+            markLatencyPoint(LATENCY_POINT_ACTUATION);
         } else {
             handleLEDs(command);
+            markLatencyPoint(LATENCY_POINT_ACTUATION);
         }
     }
 
-    if (keepAliveCharacteristic.written()) {
-        resetKeepAliveTimer();
-        onKeepAliveReceived(central, keepAliveCharacteristic);
-    }
-
     // Handle settings characteristics
     if (emission1Characteristic.written()) {
         long value = emission1Characteristic.value();
-        emission1Duration = value;
-        debugPrintf(DEBUG_SETTINGS, "Emission duration updated: %lu ms\n", emission1Duration);
+        emissionDuration[0] = value;
+        debugPrintf(DEBUG_SETTINGS, "Emission duration updated: %lu ms\n", emissionDuration[0]);
     }
 
     if (interval1Characteristic.written()) {
         long value = interval1Characteristic.value();
-        releaseInterval1 = value;
-        debugPrintf(DEBUG_SETTINGS, "Release interval updated: %lu ms\n", releaseInterval1);
+        releaseInterval[0] = value;
+        debugPrintf(DEBUG_SETTINGS, "Release interval updated: %lu ms\n", releaseInterval[0]);
     }
 
     if (periodic1Characteristic.written()) {
         byte value = periodic1Characteristic.value();
-        periodicEmissionEnabled = (value == 1);
-        debugPrintf(DEBUG_SETTINGS, "Periodic emission %s\n", periodicEmissionEnabled ? "enabled" : "disabled");
+        periodicEmissionEnabled[0] = (value == 1);
+        debugPrintf(DEBUG_SETTINGS, "Periodic emission %s\n", periodicEmissionEnabled[0] ? "enabled" : "disabled");
     }
 
     if (heartRateEnabledCharacteristic.written()) {
@@ -159,28 +436,250 @@ void handlePeripheralLoop(BLEDevice central) {
         debugPrintf(DEBUG_SETTINGS, "Low heart rate threshold updated: %d BPM\n", lowHeartRateThreshold);
     }
 
-    // Update settings and emission state
-    handleSettingsUpdate();
-    updateEmissionState();
+    if (predictiveEnabledCharacteristic.written()) {
+        byte value = predictiveEnabledCharacteristic.value();
+        predictiveReleaseEnabled = (value == 1);
+        debugPrintf(DEBUG_SETTINGS, "Predictive release %s\n", predictiveReleaseEnabled ? "enabled" : "disabled");
+    }
+
+    if (predictionHorizonCharacteristic.written()) {
+        unsigned short value = predictionHorizonCharacteristic.value();
+        predictionHorizon = value * 1000UL; // Convert seconds to milliseconds
+        debugPrintf(DEBUG_SETTINGS, "Prediction horizon updated: %lu ms\n", predictionHorizon);
+    }
+
+    if (predictionHysteresisCharacteristic.written()) {
+        byte value = predictionHysteresisCharacteristic.value();
+        predictionHysteresis = value;
+        debugPrintf(DEBUG_SETTINGS, "Prediction hysteresis updated: %d BPM\n", predictionHysteresis);
+    }
+
+    if (heartRateMinIntervalCharacteristic.written()) {
+        unsigned short value = heartRateMinIntervalCharacteristic.value();
+        heartRateMinInterval = max(value, (unsigned short)1) * 1000UL; // Convert seconds to milliseconds
+        debugPrintf(DEBUG_SETTINGS, "Heart rate min interval updated: %lu ms\n", heartRateMinInterval);
+    }
 
-    // Check for timeouts
-    if (isConnectionTimedOut() || isKeepAliveTimedOut()) {
-        if (isConnected) {
-            debugPrintln(DEBUG_BLE, "Connection or keep-alive timeout");
-            central.disconnect();
+    if (heartRateMaxIntervalCharacteristic.written()) {
+        unsigned short value = heartRateMaxIntervalCharacteristic.value();
+        heartRateMaxInterval = max(value, (unsigned short)1) * 1000UL; // Convert seconds to milliseconds
+        debugPrintf(DEBUG_SETTINGS, "Heart rate max interval updated: %lu ms\n", heartRateMaxInterval);
+    }
+
+    if (channelConfigCharacteristic.written()) {
+        onChannelConfigReceived();
+    }
+
+    if (arbitrationConfigCharacteristic.written()) {
+        onArbitrationConfigReceived();
+    }
+
+    if (budgetConfigCharacteristic.written()) {
+        onBudgetConfigReceived();
+    }
+
+    if (currentTimeCharacteristic.written()) {
+        if (syncWallClock(currentTimeCharacteristic.value(), currentTimeCharacteristic.valueLength())) {
+            rebuildSchedule();
         }
     }
+
+    if (scheduleCharacteristic.written()) {
+        onScheduleEntryReceived();
+    }
+
+    if (ruleCharacteristic.written()) {
+        onRuleReceived();
+    }
+
+    if (adaptiveConfigCharacteristic.written()) {
+        onAdaptiveConfigReceived();
+    }
+
+    if (energyConfigCharacteristic.written()) {
+        onEnergyConfigReceived();
+    }
+
+    if (powerPolicyCharacteristic.written()) {
+        onPowerPolicyReceived();
+    }
+
+    // Any write to the summary clears it
+    if (analyticsCharacteristic.written()) {
+        resetEmissionAnalytics();
+        debugPrintln(DEBUG_SETTINGS, "Emission analytics reset");
+    }
+
+    if (diagnosticsCharacteristic.written() && diagnosticsCharacteristic.valueLength() > 0) {
+        handleDiagnosticsRequest(diagnosticsCharacteristic.value()[0]);
+    }
+
+    if (dfuControlCharacteristic.written()) {
+        onDfuControl(dfuControlCharacteristic.value(), dfuControlCharacteristic.valueLength());
+    }
+
+    handleSettingsUpdate();
 }
 
+// Optional heartbeat for apps that stay connected without subscribing to
+// anything; it only counts as activity and is not echoed
 void onKeepAliveReceived(BLEDevice central, BLECharacteristic characteristic) {
-    uint8_t value = keepAliveCharacteristic.value();
-    keepAliveCharacteristic.writeValue(value); // Echo back the value
-    resetKeepAliveTimer();
+    noteActivity(central);
+}
+
+void onChannelConfigReceived() {
+    if (channelConfigCharacteristic.valueLength() < CHANNEL_CONFIG_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Channel config too short, ignoring");
+        return;
+    }
+
+    const uint8_t* data = channelConfigCharacteristic.value();
+    unsigned long duration = (data[1] | (data[2] << 8)) * 1000UL;  // Convert seconds to milliseconds
+    unsigned long interval = (data[3] | (data[4] << 8)) * 1000UL;
+    if (!setChannelConfig(data[0], duration, interval, data[5] == 1, data[6], data[7])) {
+        return;
+    }
+    if (channelConfigCharacteristic.valueLength() >= CHANNEL_CONFIG_PROFILE_LENGTH) {
+        setChannelProfile(data[0], data[8], data[9]);
+    }
+
+    // Keep the legacy channel 0 characteristics in sync
+    if (data[0] == 0) {
+        emission1Characteristic.writeValue(getEmission1Duration());
+        interval1Characteristic.writeValue(getInterval1());
+        periodic1Characteristic.writeValue(getPeriodic1Enabled());
+    }
+}
+
+void onArbitrationConfigReceived() {
+    if (arbitrationConfigCharacteristic.valueLength() < ARBITRATION_CONFIG_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Arbitration config too short, ignoring");
+        return;
+    }
+
+    const uint8_t* data = arbitrationConfigCharacteristic.value();
+    minEmissionGap = (data[0] | (data[1] << 8)) * 1000UL;  // Convert seconds to milliseconds
+    debugPrintf(DEBUG_SETTINGS, "Minimum emission gap updated: %lu ms\n", minEmissionGap);
+    for (byte source = 1; source <= TRIGGER_SOURCE_COUNT; source++) {
+        setTriggerPolicy(source, data[1 + source]);
+    }
+}
+
+void onBudgetConfigReceived() {
+    if (budgetConfigCharacteristic.valueLength() < BUDGET_CONFIG_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Budget config too short, ignoring");
+        return;
+    }
+
+    const uint8_t* data = budgetConfigCharacteristic.value();
+    emissionBudget = (data[0] | (data[1] << 8)) * 1000UL;  // Convert seconds to milliseconds
+    emissionBudgetPeriod = max((data[2] | (data[3] << 8)), 1) * 60000UL;  // Convert minutes to milliseconds
+    emissionBudgetEnabled = data[4] & 0x01;
+    manualBudgetExempt = data[4] & 0x02;
+    debugPrintf(DEBUG_SETTINGS, "Emission budget %s: %lu ms per %lu ms, manual %s\n",
+                emissionBudgetEnabled ? "enabled" : "disabled", emissionBudget, emissionBudgetPeriod,
+                manualBudgetExempt ? "exempt" : "counted");
+}
+
+void onScheduleEntryReceived() {
+    const uint8_t* data = scheduleCharacteristic.value();
+    if (scheduleCharacteristic.valueLength() >= 1 && data[0] == SCHEDULE_CLEAR) {
+        clearSchedule();
+        debugPrintln(DEBUG_SETTINGS, "Schedule cleared");
+        return;
+    }
+    if (scheduleCharacteristic.valueLength() < SCHEDULE_ENTRY_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Schedule entry too short, ignoring");
+        return;
+    }
+
+    ScheduleEntry entry;
+    entry.startMinute = data[1] | (data[2] << 8);
+    entry.endMinute = data[3] | (data[4] << 8);
+    entry.weekdays = data[5] & 0x7F;
+    entry.channel = data[6];
+    setScheduleEntry(data[0], entry);
+}
+
+void onRuleReceived() {
+    const uint8_t* data = ruleCharacteristic.value();
+    int length = ruleCharacteristic.valueLength();
+    if (length >= 1 && data[0] == RULE_CLEAR) {
+        clearRules();
+        debugPrintln(DEBUG_SETTINGS, "Rules cleared");
+        return;
+    }
+    if (length < RULE_HEADER_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Rule record too short, ignoring");
+        return;
+    }
+
+    setRule(data[0], data[1], data + RULE_HEADER_LENGTH, length - RULE_HEADER_LENGTH);
+}
+
+void onAdaptiveConfigReceived() {
+    if (adaptiveConfigCharacteristic.valueLength() < ADAPTIVE_CONFIG_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Adaptive duration config too short, ignoring");
+        return;
+    }
+
+    const uint8_t* data = adaptiveConfigCharacteristic.value();
+    unsigned long minDuration = (data[2] | (data[3] << 8)) * 1000UL;  // Convert seconds to milliseconds
+    unsigned long maxDuration = (data[4] | (data[5] << 8)) * 1000UL;
+    unsigned long target = max((data[6] | (data[7] << 8)), 1) * 1000UL;
+    setAdaptiveDuration(data[0], data[1] != 0, minDuration, maxDuration, target);
+}
+
+void onEnergyConfigReceived() {
+    const uint8_t* data = energyConfigCharacteristic.value();
+    int length = energyConfigCharacteristic.valueLength();
+    if (length >= 1 && data[0] == ENERGY_RESET) {
+        resetEnergyStats();
+        debugPrintln(DEBUG_SETTINGS, "Energy accounting reset");
+        return;
+    }
+    if (length < ENERGY_CONFIG_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Energy config too short, ignoring");
+        return;
+    }
+
+    uint32_t current = data[1] | (data[2] << 8) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 24);
+    setPowerCoefficient(data[0], current);
+}
+
+void onPowerPolicyReceived() {
+    if (powerPolicyCharacteristic.valueLength() < POWER_POLICY_CONFIG_LENGTH) {
+        debugPrintln(DEBUG_BLE, "Power policy too short, ignoring");
+        return;
+    }
+
+    const uint8_t* data = powerPolicyCharacteristic.value();
+    if (setPowerPolicyThresholds(data[0], data[1], data[2])) {
+        debugPrintf(DEBUG_SETTINGS, "Power policy thresholds: %d%%, %d%%, %d%%\n", data[0], data[1], data[2]);
+    } else {
+        debugPrintln(DEBUG_SETTINGS, "Power policy thresholds must fall from reduced to critical, ignoring");
+        const uint8_t thresholds[POWER_POLICY_CONFIG_LENGTH] = {batteryReducedThreshold, batteryLowThreshold,
+                                                                batteryCriticalThreshold};
+        powerPolicyCharacteristic.writeValue(thresholds, sizeof(thresholds));
+    }
+}
+
+// Republishes the effectiveness summary after an emission's windows close
+void updateAnalyticsCharacteristic() {
+    if (!consumeAnalyticsUpdate()) {
+        return;
+    }
+    uint8_t summary[ANALYTICS_SUMMARY_LENGTH];
+    analyticsCharacteristic.writeValue(summary, buildAnalyticsSummary(summary, sizeof(summary)));
 }
 
 void resetBLEState() {
     isConnected = false;
-    resetActivityTimer();
-    resetKeepAliveTimer();
+    centralCount = 0;
+    for (uint8_t slot = 0; slot < MAX_CENTRALS; slot++) {
+        slotUsed[slot] = false;
+        subscriptions[slot] = 0;
+        resetActivityTimer(slot);
+    }
     resetHeartRateTimer();
 }
@@ -16,12 +16,38 @@
 #define CMD_HIGH_HEART_RATE_THRESHOLD 7
 #define CMD_LOW_HEART_RATE_THRESHOLD 8
 
-// Service and characteristic UUIDs
-#define LED_SERVICE_UUID "19B10000-E8F2-537E-4F6C-D104768A1214"
+// Channel config record: [channel][duration s, LE16][interval s, LE16][periodic][triggers][priority]
+// optionally followed by [profile][intensity %]
+#define CHANNEL_CONFIG_LENGTH 8
+#define CHANNEL_CONFIG_PROFILE_LENGTH 10
 
-// Services
-extern BLEService ledService;
-extern BLEService settingsService;
+// Arbitration record: [min gap s, LE16][policy per trigger source, TRIGGER_SOURCE_COUNT bytes]
+#define ARBITRATION_CONFIG_LENGTH 8
+
+// Budget record: [budget s, LE16][period min, LE16][flags: bit 0 enabled, bit 1 manual exempt]
+#define BUDGET_CONFIG_LENGTH 5
+
+// Adaptive duration record: [channel][enabled][min s, LE16][max s, LE16][recovery target s, LE16]
+#define ADAPTIVE_CONFIG_LENGTH 8
+
+// Connection parameters asked of each central. A dead link is noticed by
+// the link layer once the supervision timeout passes without a packet, so
+// neither side needs an application keep-alive for that.
+#define CONNECTION_INTERVAL_MIN 24     // 1.25 ms units, 30 ms
+#define CONNECTION_INTERVAL_MAX 48     // 60 ms
+#define LINK_SUPERVISION_TIMEOUT 400   // 10 ms units, 4 s
+
+// The advertising energy coefficient is for this interval; slower
+// advertising under the power policy scales the level down
+#define ADVERTISING_BASE_INTERVAL 160  // 0.625 ms units, 100 ms
+
+// Standard Battery Service, next to the generated one
+#define BATTERY_SERVICE_UUID "180F"
+#define BATTERY_LEVEL_UUID "2A19"
+
+// Service; UUIDs and properties are generated into gatt_schema.h
+extern BLEService necklaceService;
+extern BLEService batteryService;
 
 // Characteristics
 extern BLEByteCharacteristic switchCharacteristic;
@@ -33,13 +59,43 @@ extern BLEByteCharacteristic heartrateCharacteristic;
 extern BLEByteCharacteristic heartRateEnabledCharacteristic;
 extern BLEByteCharacteristic highHeartRateThresholdCharacteristic;
 extern BLEByteCharacteristic lowHeartRateThresholdCharacteristic;
+extern BLEByteCharacteristic predictiveEnabledCharacteristic;
+extern BLEUnsignedShortCharacteristic predictionHorizonCharacteristic;
+extern BLEByteCharacteristic predictionHysteresisCharacteristic;
+extern BLECharacteristic diagnosticsCharacteristic;
+extern BLEUnsignedShortCharacteristic heartRateMinIntervalCharacteristic;
+extern BLEUnsignedShortCharacteristic heartRateMaxIntervalCharacteristic;
+extern BLECharacteristic channelConfigCharacteristic;
+extern BLECharacteristic arbitrationConfigCharacteristic;
+extern BLECharacteristic budgetConfigCharacteristic;
+extern BLECharacteristic currentTimeCharacteristic;
+extern BLECharacteristic scheduleCharacteristic;
+extern BLECharacteristic ruleCharacteristic;
+extern BLECharacteristic analyticsCharacteristic;
+extern BLECharacteristic adaptiveConfigCharacteristic;
+extern BLECharacteristic energyConfigCharacteristic;
+extern BLECharacteristic dfuControlCharacteristic;
+extern BLECharacteristic dfuDataCharacteristic;
+extern BLECharacteristic powerPolicyCharacteristic;
+extern BLEByteCharacteristic batteryLevelCharacteristic;
 
 bool setupBLE(uint8_t maxAttempts = 3);
 void setupServices();
 void initializeCharacteristics();
 void onCentralConnected(BLEDevice central);
 void onCentralDisconnected(BLEDevice central);
-void handlePeripheralLoop(BLEDevice central);
+void updateConnections(unsigned long now);
+uint8_t getConnectedCentralCount();
+void handlePeripheralLoop(unsigned long now);
 void onKeepAliveReceived(BLEDevice central, BLECharacteristic characteristic);
+void onChannelConfigReceived();
+void onArbitrationConfigReceived();
+void onBudgetConfigReceived();
+void onScheduleEntryReceived();
+void onRuleReceived();
+void onAdaptiveConfigReceived();
+void onEnergyConfigReceived();
+void onPowerPolicyReceived();
+void updateAnalyticsCharacteristic();
 
 #endif // BLE_CONFIG_H
\ No newline at end of file
@@ -0,0 +1,334 @@
+// button.cpp
+#include "button.h"
+#include "spsc_queue.h"
+#include "emission_control.h"
+#include "settings.h"
+
+#define GESTURE_PRESS 0
+#define GESTURE_DOUBLE_PRESS 1
+#define GESTURE_LONG_PRESS 2
+
+#define DEADLINE_DEBOUNCE 0
+#define DEADLINE_LONG_PRESS 1
+#define DEADLINE_COUNT 2
+
+struct ButtonGesture {
+    uint32_t time;  // micros() of the first edge of the press
+    byte kind;
+};
+
+// Interrupt side. The GPIOTE and RTC interrupts share a priority, so they
+// run one after the other and are together the queue's single producer.
+static SpscQueue<ButtonGesture, BUTTON_QUEUE_CAPACITY> gestureQueue;
+static bool rawPressed = false;              // Level of the latest edge
+static volatile bool stablePressed = false;  // Debounced level
+static bool burstOpen = false;               // Edges seen since the level last held
+static uint32_t burstStart = 0;              // First edge of the burst
+static byte burstEdges = 0;
+static uint32_t pressStart = 0;
+static bool pressHandled = false;            // Long or double press already decided
+static bool doubleArmed = false;             // Last release was a short press
+static uint32_t lastRelease = 0;
+static ButtonStats buttonStats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static void armDeadline(byte deadline, uint32_t at);
+static void cancelDeadline(byte deadline);
+
+static void postGesture(byte kind, uint32_t time) {
+    ButtonGesture gesture = {time, kind};
+    if (!gestureQueue.push(gesture)) {
+        buttonStats.overflows++;
+    }
+}
+
+static void onButtonEdge(bool pressed, uint32_t time) {
+    if (pressed == rawPressed) {
+        return;  // Bounced back before the interrupt read it
+    }
+    if (!burstOpen) {
+        burstOpen = true;
+        burstStart = time;
+        burstEdges = 0;
+    }
+    if (burstEdges < 255) {
+        burstEdges++;
+    }
+    rawPressed = pressed;
+    armDeadline(DEADLINE_DEBOUNCE, time + BUTTON_DEBOUNCE);
+}
+
+static void onPress(uint32_t time) {
+    pressStart = time;
+    if (doubleArmed && time - lastRelease <= BUTTON_DOUBLE_PRESS_WINDOW) {
+        doubleArmed = false;
+        pressHandled = true;
+        buttonStats.doublePresses++;
+        postGesture(GESTURE_DOUBLE_PRESS, time);
+        return;
+    }
+
+    // Acted on at once rather than on release, so a short press costs no
+    // more than the debounce; a long press adds to this emission
+    pressHandled = false;
+    postGesture(GESTURE_PRESS, time);
+    armDeadline(DEADLINE_LONG_PRESS, time + BUTTON_LONG_PRESS);
+}
+
+static void onRelease(uint32_t time) {
+    cancelDeadline(DEADLINE_LONG_PRESS);
+    doubleArmed = !pressHandled;
+    lastRelease = time;
+    if (!pressHandled) {
+        buttonStats.shortPresses++;
+    }
+}
+
+// The level has held for BUTTON_DEBOUNCE: everything in the burst but a
+// real change was contact bounce
+static void onDebounced(uint32_t now) {
+    burstOpen = false;
+    if (rawPressed == stablePressed) {
+        buttonStats.bounces += burstEdges;
+        return;
+    }
+    buttonStats.bounces += burstEdges - 1;
+    uint32_t decision = now - burstStart;
+    buttonStats.lastDecisionMicros = decision;
+    if (decision > buttonStats.maxDecisionMicros) {
+        buttonStats.maxDecisionMicros = decision;
+    }
+    stablePressed = rawPressed;
+    if (stablePressed) {
+        onPress(burstStart);
+    } else {
+        onRelease(burstStart);
+    }
+}
+
+static void onLongPressHeld() {
+    if (stablePressed && !pressHandled) {
+        pressHandled = true;
+        buttonStats.longPresses++;
+        postGesture(GESTURE_LONG_PRESS, pressStart);
+    }
+}
+
+static void onDeadline(byte deadline, uint32_t now) {
+    if (deadline == DEADLINE_DEBOUNCE) {
+        onDebounced(now);
+    } else {
+        onLongPressHeld();
+    }
+}
+
+#if BUTTON_HARDWARE
+
+#define BUTTON_RTC NRF_RTC2
+#define BUTTON_RTC_IRQn RTC2_IRQn
+#define BUTTON_RTC_FREQUENCY 32768
+#define BUTTON_RTC_MIN_TICKS 2  // A compare closer than this to COUNTER may not fire
+
+static NRF_GPIO_Type* buttonPort = NRF_P0;
+static uint32_t buttonPinIndex = 0;
+
+static bool readButtonLevel() {
+    return !((buttonPort->IN >> buttonPinIndex) & 1);  // Pressed pulls it low
+}
+
+// Sense the level the pin would change to next. If it already has, DETECT
+// rises at once and the PORT event fires again, so no edge is missed.
+static void senseNextEdge(bool pressed) {
+    uint32_t config = buttonPort->PIN_CNF[buttonPinIndex] & ~GPIO_PIN_CNF_SENSE_Msk;
+    config |= (pressed ? GPIO_PIN_CNF_SENSE_High : GPIO_PIN_CNF_SENSE_Low) << GPIO_PIN_CNF_SENSE_Pos;
+    buttonPort->PIN_CNF[buttonPinIndex] = config;
+}
+
+// Rounded up to whole ticks, so a deadline never fires early
+static void armDeadline(byte deadline, uint32_t at) {
+    int32_t remaining = (int32_t)(at - micros());
+    uint32_t ticks = remaining > 0 ? (uint32_t)(((uint64_t)remaining * BUTTON_RTC_FREQUENCY + 999999) / 1000000) : 0;
+    ticks = max(ticks, (uint32_t)BUTTON_RTC_MIN_TICKS);
+    uint32_t mask = RTC_INTENSET_COMPARE0_Msk << deadline;
+    BUTTON_RTC->INTENCLR = mask;
+    BUTTON_RTC->CC[deadline] = (BUTTON_RTC->COUNTER + ticks) & RTC_COUNTER_COUNTER_Msk;
+    BUTTON_RTC->EVENTS_COMPARE[deadline] = 0;
+    BUTTON_RTC->INTENSET = mask;
+}
+
+static void cancelDeadline(byte deadline) {
+    BUTTON_RTC->INTENCLR = RTC_INTENSET_COMPARE0_Msk << deadline;
+    BUTTON_RTC->EVENTS_COMPARE[deadline] = 0;
+}
+
+static void buttonIrqHandler() {
+    NRF_GPIOTE->EVENTS_PORT = 0;
+    (void)NRF_GPIOTE->EVENTS_PORT;  // Let the clear land before returning
+    bool pressed = readButtonLevel();
+    senseNextEdge(pressed);
+    onButtonEdge(pressed, micros());
+}
+
+static void buttonTimerIrqHandler() {
+    uint32_t now = micros();
+    for (byte deadline = 0; deadline < DEADLINE_COUNT; deadline++) {
+        uint32_t mask = RTC_INTENSET_COMPARE0_Msk << deadline;
+        if (BUTTON_RTC->EVENTS_COMPARE[deadline] && (BUTTON_RTC->INTENSET & mask)) {
+            BUTTON_RTC->EVENTS_COMPARE[deadline] = 0;
+            BUTTON_RTC->INTENCLR = mask;
+            onDeadline(deadline, now);
+        }
+    }
+    (void)BUTTON_RTC->EVENTS_COMPARE[0];  // Let the clears land before returning
+}
+
+void initButton() {
+    uint32_t pinName = digitalPinToPinName(BUTTON_PIN);
+    buttonPort = (pinName >> 5) ? NRF_P1 : NRF_P0;
+    buttonPinIndex = pinName & 0x1F;
+    buttonPort->PIN_CNF[buttonPinIndex] =
+        (GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos) |
+        (GPIO_PIN_CNF_INPUT_Connect << GPIO_PIN_CNF_INPUT_Pos) |
+        (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos);
+    delayMicroseconds(10);  // Let the pull-up settle
+
+    // A button held through startup isn't a press
+    stablePressed = rawPressed = readButtonLevel();
+    pressHandled = true;
+    senseNextEdge(stablePressed);
+
+    // mbed's low-power ticker keeps LFCLK running; start it in case it isn't
+    if (!(NRF_CLOCK->LFCLKSTAT & CLOCK_LFCLKSTAT_STATE_Msk)) {
+        NRF_CLOCK->TASKS_LFCLKSTART = 1;
+    }
+    BUTTON_RTC->TASKS_STOP = 1;
+    BUTTON_RTC->PRESCALER = 0;
+    BUTTON_RTC->INTENCLR = 0xFFFFFFFF;
+    NVIC_SetVector(BUTTON_RTC_IRQn, (uint32_t)buttonTimerIrqHandler);
+    NVIC_SetPriority(BUTTON_RTC_IRQn, BUTTON_IRQ_PRIORITY);
+    NVIC_ClearPendingIRQ(BUTTON_RTC_IRQn);
+    NVIC_EnableIRQ(BUTTON_RTC_IRQn);
+    BUTTON_RTC->TASKS_START = 1;
+
+    // Replaces mbed's handler; see button.h
+    NRF_GPIOTE->EVENTS_PORT = 0;
+    NRF_GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Msk;
+    NVIC_SetVector(GPIOTE_IRQn, (uint32_t)buttonIrqHandler);
+    NVIC_SetPriority(GPIOTE_IRQn, BUTTON_IRQ_PRIORITY);
+    NVIC_ClearPendingIRQ(GPIOTE_IRQn);
+    NVIC_EnableIRQ(GPIOTE_IRQn);
+    debugPrintf(DEBUG_GENERAL, "Button on pin %d\n", BUTTON_PIN);
+}
+
+#else
+
+static bool deadlineArmed[DEADLINE_COUNT] = {false, false};
+static uint32_t deadlineAt[DEADLINE_COUNT] = {0, 0};
+
+static void armDeadline(byte deadline, uint32_t at) {
+    deadlineArmed[deadline] = true;
+    deadlineAt[deadline] = at;
+}
+
+static void cancelDeadline(byte deadline) {
+    deadlineArmed[deadline] = false;
+}
+
+void initButton() {
+    stablePressed = rawPressed = false;
+    burstOpen = false;
+    pressHandled = true;
+    doubleArmed = false;
+    cancelDeadline(DEADLINE_DEBOUNCE);
+    cancelDeadline(DEADLINE_LONG_PRESS);
+    debugPrintln(DEBUG_GENERAL, "Simulated button");
+}
+
+// Stands in for the GPIOTE interrupt
+void injectButtonEdge(bool pressed, unsigned long atMicros) {
+    onButtonEdge(pressed, atMicros);
+}
+
+// Stands in for the RTC interrupt: fires every deadline due by now, in
+// order and at its own time, as the compare would have
+void runButtonTimers(unsigned long now) {
+    while (true) {
+        int due = -1;
+        for (byte deadline = 0; deadline < DEADLINE_COUNT; deadline++) {
+            if (deadlineArmed[deadline] && (int32_t)(now - deadlineAt[deadline]) >= 0 &&
+                (due < 0 || (int32_t)(deadlineAt[deadline] - deadlineAt[due]) < 0)) {
+                due = deadline;
+            }
+        }
+        if (due < 0) {
+            return;
+        }
+        deadlineArmed[due] = false;
+        onDeadline(due, deadlineAt[due]);
+    }
+}
+
+#endif
+
+static void recordLatency(uint32_t since) {
+    uint32_t latency = micros() - since;
+    noInterrupts();
+    buttonStats.lastLatencyMicros = latency;
+    if (latency > buttonStats.maxLatencyMicros) {
+        buttonStats.maxLatencyMicros = latency;
+    }
+    interrupts();
+    debugPrintf(DEBUG_GENERAL, "Button to emission: %lu us\n", (unsigned long)latency);
+}
+
+static void startLongPressEmissions() {
+    debugPrintln(DEBUG_GENERAL, "Button long press: manual emission on every other channel");
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        if (!isChannelActive(channel)) {
+            triggerChannelEmission(channel, TRIGGER_MANUAL);
+        }
+    }
+}
+
+// Gestures are already decided; this only starts or stops the emissions
+void updateButton() {
+#if !BUTTON_HARDWARE
+    runButtonTimers(micros());
+#endif
+    ButtonGesture gesture;
+    while (gestureQueue.pop(gesture)) {
+        switch (gesture.kind) {
+            case GESTURE_PRESS: {
+                // Only a press that started an emission has a latency; one
+                // merged, queued or held back by the gap doesn't
+                bool wasActive = isEmissionActive();
+                if (triggerEmission(TRIGGER_MANUAL) && !wasActive && isEmissionActive()) {
+                    recordLatency(gesture.time);
+                }
+                break;
+            }
+            case GESTURE_DOUBLE_PRESS:
+                debugPrintln(DEBUG_GENERAL, "Button double press: stopping emissions");
+                stopEmission();
+                break;
+            case GESTURE_LONG_PRESS:
+                startLongPressEmissions();
+                break;
+        }
+    }
+}
+
+bool isButtonPressed() {
+    return stablePressed;
+}
+
+void getButtonStats(ButtonStats& stats) {
+    noInterrupts();
+    stats = buttonStats;
+    interrupts();
+}
+
+void resetButtonStats() {
+    noInterrupts();
+    buttonStats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    interrupts();
+}
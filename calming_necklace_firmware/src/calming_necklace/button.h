@@ -0,0 +1,75 @@
+// button.h
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Local button, so an emission can be started without the phone. The
+// button pulls the pin low. Edges are caught in the GPIOTE interrupt and
+// timestamped there; each edge restarts a debounce deadline on an RTC
+// compare, and the RTC interrupt decides the gesture once the level has
+// held, so neither waits for the main loop:
+//
+//   press         - manual emission, the same as the app's command; starts
+//                   as soon as the press has debounced, not on release
+//   double press  - stops every emission, including the one the first
+//                   press started
+//   long press    - keeps holding: every other channel gets a manual
+//                   emission too, including those not set up for manual
+//                   triggers. Beyond EMISSION_MAX_ACTIVE_CHANNELS they
+//                   queue and run after the first
+//
+// The decision is made BUTTON_DEBOUNCE after the last bounce, give or take
+// an RTC tick (31 us), whatever the loop is doing. The gesture then goes
+// through a lock-free queue to updateButton(), which starts or stops the
+// emission; it runs at the top of each loop pass, ahead of BLE.poll(), so
+// the emission waits at most one more loop pass. Both the decision and the
+// emission latency are measured from the first edge of the press and
+// served on the diagnostics button page.
+//
+// The interrupt uses the GPIOTE PORT event with pin SENSE rather than an
+// IN channel, which would keep the high-frequency clock running. initButton()
+// takes the GPIOTE vector over from mbed, so attachInterrupt() and
+// InterruptIn stop working on every pin; nothing else in the sketch uses
+// them. The deadlines run on RTC2, which mbed leaves alone (its tickers use
+// RTC1 and TIMER1). The host build has no interrupts: injectButtonEdge()
+// stands in for the GPIOTE one and runButtonTimers() for the RTC one, which
+// updateButton() also calls.
+#if defined(NRF52840_XXAA)
+#define BUTTON_HARDWARE 1
+#define BUTTON_IRQ_PRIORITY 2            // GPIOTE and RTC2 alike, so they never nest
+#else
+#define BUTTON_HARDWARE 0
+#endif
+
+#define BUTTON_PIN 2                     // D2, P1.11 on the Nano 33 BLE
+#define BUTTON_DEBOUNCE 10000            // us the level must hold
+#define BUTTON_LONG_PRESS 1000000        // us held
+#define BUTTON_DOUBLE_PRESS_WINDOW 400000  // us from release to the next press
+#define BUTTON_QUEUE_CAPACITY 8          // Gestures waiting for the loop
+
+struct ButtonStats {
+    uint32_t shortPresses;
+    uint32_t doublePresses;
+    uint32_t longPresses;
+    uint32_t bounces;             // Edges that didn't hold for BUTTON_DEBOUNCE
+    uint32_t overflows;           // Gestures lost to a full queue
+    uint32_t lastDecisionMicros;  // First edge to the gesture decided
+    uint32_t maxDecisionMicros;
+    uint32_t lastLatencyMicros;   // First edge to emission started
+    uint32_t maxLatencyMicros;
+};
+
+// Function declarations
+void initButton();
+void updateButton();
+bool isButtonPressed();
+void getButtonStats(ButtonStats& stats);
+void resetButtonStats();
+#if !BUTTON_HARDWARE
+void injectButtonEdge(bool pressed, unsigned long atMicros);
+void runButtonTimers(unsigned long now);
+#endif
+
+#endif // BUTTON_H
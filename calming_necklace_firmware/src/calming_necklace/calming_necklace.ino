@@ -6,43 +6,85 @@
 #include "heart_rate.h"
 #include "debug.h"
 #include "emission_control.h"
+#include "persistent_store.h"
+#include "led_patterns.h"
+#include "time_service.h"
+#include "energy_model.h"
+#include "memory_monitor.h"
+#include "dfu.h"
+#include "recovery.h"
+#include "button.h"
+#include "battery.h"
 
 void setup() {
     Serial.begin(9600);
+    initTimeService();
+    initRecovery();
+    initMemoryMonitor();
     debugInit();
+    initEnergyModel();
     debugPrintln(DEBUG_GENERAL, "\n=== Calming Necklace Startup ===");
 
     setupPins();
+    initLedPatterns();
+    initPersistentStore();
     setupEmissionControl();
     initHeartRate();
+    initButton();
+    // Before BLE, so a restored emission doesn't wait for a connection
+    restoreRetainedState();
+    // After the restore, for the thresholds, and before BLE, so the first
+    // advertising already follows the power policy
+    initBattery();
 
     if (!setupBLE()) {
         // Continue with limited functionality if BLE fails
         debugPrintln(DEBUG_GENERAL, "Operating in limited mode without BLE");
+    } else {
+        attachBleStack();
     }
 
     resetHeartRateTimer();
+    sealAllocations();
+    startWatchdog();
     debugPrintln(DEBUG_GENERAL, "\nDevice Ready!");
     debugPrintln(DEBUG_GENERAL, "=== Setup Complete ===\n");
 }
 
 void loop() {
-    BLEDevice central = BLE.central();
-    
-    if (isHeartRateUpdateTime()) {
-        updateHeartRate();
-        heartrateCharacteristic.writeValue(getCurrentHeartRate());
-        //Serial.print("Heart rate: "); Serial.print(getCurrentHeartRate()); Serial.println(" BPM");
-    }
+    // One timestamp for the whole pass
+    updateLoopTime();
+    unsigned long now = getLoopMillis();
 
-    updateEmissionState();
-    if (central) {
-        onCentralConnected(central);
+    // Ahead of BLE.poll(), so a button press never waits behind BLE traffic
+    updateButton();
 
-        while (central.connected()) {
-            handlePeripheralLoop(central);
-        }
+    // Connections, disconnections and write events are dispatched from here
+    BLE.poll();
 
-        onCentralDisconnected(central);
+    // Commands and emission control come before anything that notifies:
+    // each notification goes out once per subscribed central
+    if (getConnectedCentralCount() > 0) {
+        handlePeripheralLoop(now);
     }
+    updateEmissionState(now);
+    updateLedPatterns(now);
+    updateEnergyModel(now);
+    updateMemoryMonitor(now);
+    updateDfu(now);
+
+    if (isHeartRateUpdateTime(now)) {
+        updateHeartRate(now);
+        resetHeartRateTimer();
+        heartrateCharacteristic.writeValue(getCurrentHeartRate());
+        //Serial.print("Heart rate: "); Serial.print(getCurrentHeartRate()); Serial.println(" BPM");
+    }
+    if (updateBattery(now)) {
+        batteryLevelCharacteristic.writeValue(getBatteryPercent());
+    }
+    updateAnalyticsCharacteristic();
+    updateConnections(now);
+
+    // Last, so only a pass that gets this far feeds the watchdog
+    updateRetainedState(now);
 }
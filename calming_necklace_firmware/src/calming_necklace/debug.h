@@ -11,6 +11,8 @@
 #define DEBUG_LED       0x08
 #define DEBUG_SETTINGS  0x10
 #define DEBUG_TIMING    0x20
+#define DEBUG_POWER     0x40
+#define DEBUG_MEMORY    0x80
 #define DEBUG_ALL       0xFF
 
 // Initialize debug system
@@ -0,0 +1,504 @@
+// dfu.cpp
+#include "dfu.h"
+#include "time_service.h"
+#include "sha256.h"
+
+#define DFU_STATE_IDLE 0
+#define DFU_STATE_RECEIVING 1
+#define DFU_STATE_RECEIVED 2   // Whole stream in, not verified yet
+#define DFU_STATE_VERIFIED 3
+#define DFU_STATE_APPLYING 4
+
+// Decoder states, one per field of the heatshrink bit stream
+#define DECODE_TAG 0
+#define DECODE_LITERAL 1
+#define DECODE_INDEX 2
+#define DECODE_COUNT 3
+
+static const uint32_t ERASED_WORD = 0xFFFFFFFF;
+
+static DfuResponder respond = nullptr;
+static byte state = DFU_STATE_IDLE;
+static uint32_t imageSize = 0;
+static uint32_t streamSize = 0;
+static uint32_t imageCrc = 0;
+static uint8_t imageMac[DFU_MAC_LENGTH];
+static byte receiptInterval = 0;
+static byte chunksSinceReceipt = 0;
+static bool offsetReported = false;  // One BAD_OFFSET per gap, not per chunk
+static unsigned long applyTime = 0;
+
+static uint32_t streamOffset = 0;
+static uint32_t imageOffset = 0;
+static uint32_t pendingWord = ERASED_WORD;  // Image bytes not programmed yet
+
+static byte decodeState = DECODE_TAG;
+static uint16_t decodeBits = 0;
+static byte decodeBitCount = 0;
+static uint16_t backrefDistance = 0;
+
+#if DFU_FLASH_HARDWARE
+
+static void writeBankWord(uint32_t offset, uint32_t value) {
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen;
+    while (!NRF_NVMC->READY) {}
+    *(volatile uint32_t*)(DFU_BANK_ADDRESS + offset) = value;
+    while (!NRF_NVMC->READY) {}
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+}
+
+static void eraseBankPage(uint32_t offset) {
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een;
+    while (!NRF_NVMC->READY) {}
+    NRF_NVMC->ERASEPAGE = DFU_BANK_ADDRESS + offset;
+    while (!NRF_NVMC->READY) {}
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+}
+
+uint8_t readDfuBankByte(uint32_t offset) {
+    return *(volatile uint8_t*)(DFU_BANK_ADDRESS + offset);
+}
+
+// False while UICR is still erased
+static bool loadKey(uint8_t* key) {
+    uint32_t erased = ERASED_WORD;
+    for (byte i = 0; i < DFU_KEY_LENGTH / 4; i++) {
+        uint32_t word = NRF_UICR->CUSTOMER[i];
+        erased &= word;
+        memcpy(key + 4 * i, &word, 4);
+    }
+    return erased != ERASED_WORD;
+}
+
+// Copies the bank over the application and resets. It runs from RAM with
+// interrupts off, since the flash it would otherwise execute from is what
+// it overwrites, and so it may not call anything else.
+__attribute__((noinline, long_call, section(".data.dfu_copy")))
+static void copyBankAndReset(uint32_t length) {
+    for (uint32_t page = 0; page < length; page += DFU_PAGE_SIZE) {
+        // A large image takes longer than the watchdog timeout to copy.
+        // Written directly, as feedWatchdog() lives in the flash being erased.
+        NRF_WDT->RR[0] = WDT_RR_RR_Reload;
+        NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een;
+        while (!NRF_NVMC->READY) {}
+        NRF_NVMC->ERASEPAGE = DFU_PRIMARY_ADDRESS + page;
+        while (!NRF_NVMC->READY) {}
+
+        NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen;
+        volatile uint32_t* source = (volatile uint32_t*)(DFU_BANK_ADDRESS + page);
+        volatile uint32_t* target = (volatile uint32_t*)(DFU_PRIMARY_ADDRESS + page);
+        for (uint32_t word = 0; word < DFU_PAGE_SIZE / 4 && page + word * 4 < length; word++) {
+            target[word] = source[word];
+            while (!NRF_NVMC->READY) {}
+        }
+    }
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+    SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+    while (true) {}
+}
+
+static void applyUpdate() {
+    debugPrintln(DEBUG_GENERAL, "Applying firmware update");
+    Serial.flush();
+    __disable_irq();
+    copyBankAndReset(imageSize);
+}
+
+#else
+
+// Simulated bank: writes can only clear bits, like the real thing
+static uint8_t simulatedBank[DFU_BANK_SIZE];
+
+static void writeBankWord(uint32_t offset, uint32_t value) {
+    for (byte i = 0; i < 4; i++) {
+        simulatedBank[offset + i] &= (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static void eraseBankPage(uint32_t offset) {
+    memset(simulatedBank + offset, 0xFF, DFU_PAGE_SIZE);
+}
+
+uint8_t readDfuBankByte(uint32_t offset) {
+    return simulatedBank[offset];
+}
+
+static uint8_t simulatedKey[DFU_KEY_LENGTH];
+static bool simulatedKeySet = false;
+
+void setDfuKey(const uint8_t* key) {
+    simulatedKeySet = key != nullptr;
+    if (simulatedKeySet) {
+        memcpy(simulatedKey, key, DFU_KEY_LENGTH);
+    }
+}
+
+static bool loadKey(uint8_t* key) {
+    memcpy(key, simulatedKey, DFU_KEY_LENGTH);
+    return simulatedKeySet;
+}
+
+static void applyUpdate() {
+    debugPrintf(DEBUG_GENERAL, "Firmware update of %lu bytes would be applied now\n", (unsigned long)imageSize);
+    state = DFU_STATE_IDLE;
+}
+
+#endif
+
+uint16_t dfuCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (byte bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// CRC-32 as in zlib, a nibble at a time
+static uint32_t crc32Update(uint32_t crc, uint8_t value) {
+    static const uint32_t TABLE[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    crc ^= value;
+    crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+    return crc;
+}
+
+static uint32_t readLE32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint32_t readBankWord(uint32_t offset) {
+    return readDfuBankByte(offset) | (readDfuBankByte(offset + 1) << 8) |
+           ((uint32_t)readDfuBankByte(offset + 2) << 16) | ((uint32_t)readDfuBankByte(offset + 3) << 24);
+}
+
+// Compares without an early exit, so the reply time doesn't tell how much
+// of a forged MAC was right
+static bool macEqual(const uint8_t* a, const uint8_t* b) {
+    uint8_t difference = 0;
+    for (byte i = 0; i < DFU_MAC_LENGTH; i++) {
+        difference |= a[i] ^ b[i];
+    }
+    return difference == 0;
+}
+
+// The image must start like an application linked for DFU_PRIMARY_ADDRESS,
+// or the copy would leave nothing the bootloader can start
+static bool checkVectorTable() {
+    if (imageSize < 8 || DFU_PRIMARY_ADDRESS + imageSize > DFU_BANK_ADDRESS) {
+        return false;
+    }
+    uint32_t initialStack = readBankWord(0);
+    uint32_t resetHandler = readBankWord(4);
+    uint32_t resetAddress = resetHandler & ~1UL;
+    bool stackInRam = initialStack > DFU_RAM_START && initialStack <= DFU_RAM_END && (initialStack & 7) == 0;
+    bool resetInImage = (resetHandler & 1) && resetAddress >= DFU_PRIMARY_ADDRESS + 8 &&
+                        resetAddress < DFU_PRIMARY_ADDRESS + imageSize;
+    if (!stackInRam || !resetInImage) {
+        debugPrintf(DEBUG_GENERAL, "Firmware update has a bad vector table: SP %08lx, reset %08lx\n",
+                    (unsigned long)initialStack, (unsigned long)resetHandler);
+        return false;
+    }
+    return true;
+}
+
+static void sendResponse(byte command, byte status) {
+    if (respond == nullptr) {
+        return;
+    }
+    uint8_t response[DFU_RESPONSE_LENGTH] = {
+        command, status,
+        (uint8_t)streamOffset, (uint8_t)(streamOffset >> 8), (uint8_t)(streamOffset >> 16), (uint8_t)(streamOffset >> 24),
+        (uint8_t)imageOffset, (uint8_t)(imageOffset >> 8), (uint8_t)(imageOffset >> 16), (uint8_t)(imageOffset >> 24),
+    };
+    respond(response, sizeof(response));
+}
+
+// Image bytes come from the bank once programmed and from the pending
+// word until then
+static uint8_t readImageByte(uint32_t offset) {
+    if (offset >= (imageOffset & ~3UL)) {
+        return (pendingWord >> (8 * (offset & 3))) & 0xFF;
+    }
+    return readDfuBankByte(offset);
+}
+
+static void emitImageByte(uint8_t value) {
+    if ((imageOffset & (DFU_PAGE_SIZE - 1)) == 0) {
+        eraseBankPage(imageOffset);
+    }
+    byte shift = 8 * (imageOffset & 3);
+    pendingWord = (pendingWord & ~(0xFFUL << shift)) | ((uint32_t)value << shift);
+    imageOffset++;
+    if ((imageOffset & 3) == 0 || imageOffset == imageSize) {
+        writeBankWord((imageOffset - 1) & ~3UL, pendingWord);
+        pendingWord = ERASED_WORD;
+    }
+}
+
+// Feeds one bit of the stream; false when the stream is corrupt
+static bool decodeBit(byte bit) {
+    if (imageOffset == imageSize) {
+        return true;  // Padding after the last byte
+    }
+    if (decodeState == DECODE_TAG) {
+        decodeState = bit ? DECODE_LITERAL : DECODE_INDEX;
+        decodeBits = 0;
+        decodeBitCount = 0;
+        return true;
+    }
+
+    decodeBits = (decodeBits << 1) | bit;
+    decodeBitCount++;
+    switch (decodeState) {
+        case DECODE_LITERAL:
+            if (decodeBitCount == 8) {
+                emitImageByte(decodeBits);
+                decodeState = DECODE_TAG;
+            }
+            break;
+        case DECODE_INDEX:
+            if (decodeBitCount == DFU_WINDOW_BITS) {
+                backrefDistance = decodeBits + 1;
+                if (backrefDistance > imageOffset) {
+                    return false;
+                }
+                decodeState = DECODE_COUNT;
+                decodeBits = 0;
+                decodeBitCount = 0;
+            }
+            break;
+        case DECODE_COUNT:
+            if (decodeBitCount == DFU_LOOKAHEAD_BITS) {
+                for (uint16_t i = 0; i <= decodeBits && imageOffset < imageSize; i++) {
+                    emitImageByte(readImageByte(imageOffset - backrefDistance));
+                }
+                decodeState = DECODE_TAG;
+            }
+            break;
+    }
+    return true;
+}
+
+static void startSession(uint32_t size, uint32_t stream, uint32_t crc, const uint8_t* mac) {
+    imageSize = size;
+    streamSize = stream;
+    imageCrc = crc;
+    memcpy(imageMac, mac, DFU_MAC_LENGTH);
+    streamOffset = 0;
+    imageOffset = 0;
+    pendingWord = ERASED_WORD;
+    decodeState = DECODE_TAG;
+    offsetReported = false;
+    state = DFU_STATE_RECEIVING;
+    debugPrintf(DEBUG_GENERAL, "Firmware update started: %lu bytes in a %lu byte stream\n",
+                (unsigned long)imageSize, (unsigned long)streamSize);
+}
+
+static void onStart(const uint8_t* data, size_t length) {
+    if (length < DFU_START_LENGTH) {
+        sendResponse(DFU_CMD_START, DFU_STATUS_BAD_REQUEST);
+        return;
+    }
+    uint32_t size = readLE32(data + 1);
+    uint32_t stream = readLE32(data + 5);
+    uint32_t crc = readLE32(data + 9);
+    const uint8_t* mac = data + 14;
+    if (size == 0 || size > DFU_BANK_SIZE || stream == 0) {
+        sendResponse(DFU_CMD_START, DFU_STATUS_TOO_LARGE);
+        return;
+    }
+    uint8_t key[DFU_KEY_LENGTH];
+    if (!loadKey(key)) {
+        debugPrintln(DEBUG_GENERAL, "Firmware update refused: no device key provisioned");
+        sendResponse(DFU_CMD_START, DFU_STATUS_UNAUTHORIZED);
+        return;
+    }
+
+    // The same image again resumes where the last connection left off
+    bool resume = (state == DFU_STATE_RECEIVING || state == DFU_STATE_RECEIVED || state == DFU_STATE_VERIFIED)
+                  && size == imageSize && stream == streamSize && crc == imageCrc && macEqual(mac, imageMac);
+    if (resume) {
+        offsetReported = false;
+        debugPrintf(DEBUG_GENERAL, "Firmware update resumed at %lu\n", (unsigned long)streamOffset);
+    } else {
+        startSession(size, stream, crc, mac);
+    }
+    receiptInterval = data[13];
+    chunksSinceReceipt = 0;
+    sendResponse(DFU_CMD_START, DFU_STATUS_OK);
+}
+
+static void onVerify() {
+    if (state != DFU_STATE_RECEIVED && state != DFU_STATE_VERIFIED) {
+        sendResponse(DFU_CMD_VERIFY, DFU_STATUS_NOT_READY);
+        return;
+    }
+    if (imageOffset != imageSize) {
+        state = DFU_STATE_IDLE;
+        sendResponse(DFU_CMD_VERIFY, DFU_STATUS_BAD_STREAM);
+        return;
+    }
+
+    // The CRC catches a transfer gone wrong, the HMAC an image that wasn't
+    // signed with this device's key
+    uint8_t key[DFU_KEY_LENGTH];
+    if (!loadKey(key)) {
+        state = DFU_STATE_IDLE;
+        sendResponse(DFU_CMD_VERIFY, DFU_STATUS_UNAUTHORIZED);
+        return;
+    }
+    Sha256 hmac;
+    hmacSha256Init(hmac, key, sizeof(key));
+    uint8_t block[SHA256_BLOCK_SIZE];
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t offset = 0; offset < imageSize; offset += sizeof(block)) {
+        size_t length = min((uint32_t)sizeof(block), imageSize - offset);
+        for (size_t i = 0; i < length; i++) {
+            block[i] = readDfuBankByte(offset + i);
+            crc = crc32Update(crc, block[i]);
+        }
+        sha256Update(hmac, block, length);
+    }
+    crc = ~crc;
+    uint8_t mac[DFU_MAC_LENGTH];
+    hmacSha256Final(hmac, key, sizeof(key), mac);
+    memset(key, 0, sizeof(key));
+
+    if (crc != imageCrc) {
+        debugPrintf(DEBUG_GENERAL, "Firmware update failed verification: CRC %08lx, expected %08lx\n",
+                    (unsigned long)crc, (unsigned long)imageCrc);
+        state = DFU_STATE_IDLE;
+        sendResponse(DFU_CMD_VERIFY, DFU_STATUS_VERIFY_FAILED);
+        return;
+    }
+    if (!macEqual(mac, imageMac)) {
+        debugPrintln(DEBUG_GENERAL, "Firmware update failed authentication");
+        state = DFU_STATE_IDLE;
+        sendResponse(DFU_CMD_VERIFY, DFU_STATUS_UNAUTHORIZED);
+        return;
+    }
+    if (!checkVectorTable()) {
+        state = DFU_STATE_IDLE;
+        sendResponse(DFU_CMD_VERIFY, DFU_STATUS_BAD_IMAGE);
+        return;
+    }
+    state = DFU_STATE_VERIFIED;
+    debugPrintln(DEBUG_GENERAL, "Firmware update verified");
+    sendResponse(DFU_CMD_VERIFY, DFU_STATUS_OK);
+}
+
+void initDfu(DfuResponder responder) {
+    respond = responder;
+    state = DFU_STATE_IDLE;
+}
+
+void onDfuControl(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    switch (data[0]) {
+        case DFU_CMD_START:
+            onStart(data, length);
+            break;
+        case DFU_CMD_STATUS:
+            sendResponse(DFU_CMD_STATUS, DFU_STATUS_OK);
+            break;
+        case DFU_CMD_VERIFY:
+            onVerify();
+            break;
+        case DFU_CMD_APPLY:
+            if (state != DFU_STATE_VERIFIED) {
+                sendResponse(DFU_CMD_APPLY, DFU_STATUS_NOT_READY);
+                break;
+            }
+            // Nothing writes the bank once verified, but the copy can't be
+            // undone, so look at what it is about to start once more
+            if (!checkVectorTable()) {
+                state = DFU_STATE_IDLE;
+                sendResponse(DFU_CMD_APPLY, DFU_STATUS_BAD_IMAGE);
+                break;
+            }
+            state = DFU_STATE_APPLYING;
+            applyTime = getLoopMillis();
+            sendResponse(DFU_CMD_APPLY, DFU_STATUS_OK);
+            break;
+        case DFU_CMD_ABORT:
+            state = DFU_STATE_IDLE;
+            sendResponse(DFU_CMD_ABORT, DFU_STATUS_OK);
+            break;
+        default:
+            sendResponse(data[0], DFU_STATUS_BAD_REQUEST);
+            break;
+    }
+}
+
+void onDfuData(const uint8_t* data, size_t length) {
+    if (state != DFU_STATE_RECEIVING) {
+        sendResponse(DFU_RECEIPT, DFU_STATUS_NOT_READY);
+        return;
+    }
+    if (length <= DFU_CHUNK_HEADER) {
+        sendResponse(DFU_RECEIPT, DFU_STATUS_BAD_REQUEST);
+        return;
+    }
+
+    uint32_t offset = readLE32(data);
+    uint16_t crc = data[4] | (data[5] << 8);
+    const uint8_t* payload = data + DFU_CHUNK_HEADER;
+    size_t payloadLength = length - DFU_CHUNK_HEADER;
+
+    // A lost chunk makes every following one arrive at the wrong offset;
+    // the app only needs to hear about it once
+    if (offset != streamOffset) {
+        if (!offsetReported) {
+            offsetReported = true;
+            sendResponse(DFU_RECEIPT, DFU_STATUS_BAD_OFFSET);
+        }
+        return;
+    }
+    if (offset + payloadLength > streamSize) {
+        offsetReported = true;
+        sendResponse(DFU_RECEIPT, DFU_STATUS_TOO_LARGE);
+        return;
+    }
+    if (dfuCrc16(payload, payloadLength) != crc) {
+        offsetReported = true;
+        sendResponse(DFU_RECEIPT, DFU_STATUS_BAD_CRC);
+        return;
+    }
+    offsetReported = false;
+
+    for (size_t i = 0; i < payloadLength; i++) {
+        for (int8_t bit = 7; bit >= 0; bit--) {
+            if (!decodeBit((payload[i] >> bit) & 1)) {
+                debugPrintln(DEBUG_GENERAL, "Firmware update stream corrupt");
+                state = DFU_STATE_IDLE;
+                sendResponse(DFU_RECEIPT, DFU_STATUS_BAD_STREAM);
+                return;
+            }
+        }
+    }
+    streamOffset += payloadLength;
+
+    bool complete = streamOffset == streamSize;
+    if (complete) {
+        state = DFU_STATE_RECEIVED;
+    }
+    chunksSinceReceipt++;
+    if (complete || (receiptInterval > 0 && chunksSinceReceipt >= receiptInterval)) {
+        chunksSinceReceipt = 0;
+        sendResponse(DFU_RECEIPT, DFU_STATUS_OK);
+    }
+}
+
+void updateDfu(unsigned long now) {
+    if (state == DFU_STATE_APPLYING && now - applyTime >= DFU_APPLY_DELAY) {
+        applyUpdate();
+    }
+}
@@ -0,0 +1,93 @@
+// dfu.h
+#ifndef DFU_H
+#define DFU_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Over-the-air firmware update. The app streams a heatshrink-compressed
+// image (tools/dfu.py builds it) in chunks that each carry their stream
+// offset and a CRC-16. The device decompresses every chunk straight into
+// the update bank in the upper half of flash; back-references read the
+// bytes already written there, so the decoder keeps no window in RAM.
+//
+// Chunks must arrive in order. After a disconnect the app repeats START
+// with the same image and continues from the stream offset in the reply.
+// VERIFY checks the CRC-32 of the whole image read back from the bank and
+// its HMAC-SHA256 under the device key, then the vector table: the initial
+// stack pointer has to lie in RAM, the reset handler inside the image, and
+// the image has to end below the bank. APPLY repeats the vector table check
+// and copies the bank over the running firmware from RAM and resets. A
+// reset during that copy leaves the board to the bootloader, which still
+// accepts an upload over USB.
+//
+// The key is 32 bytes in UICR CUSTOMER[0..7], written when the necklace is
+// provisioned; tools/dfu.py package signs with the same key. A device with
+// erased UICR refuses every update. The host build has no UICR and takes
+// its key from setDfuKey().
+#define DFU_PRIMARY_ADDRESS 0x00010000  // Application, after the bootloader
+#define DFU_BANK_ADDRESS 0x00080000
+#define DFU_RAM_START 0x20000000
+#define DFU_RAM_END 0x20040000          // 256 KB
+#if defined(NRF52840_XXAA)
+#define DFU_FLASH_HARDWARE 1
+#else
+#define DFU_FLASH_HARDWARE 0
+#endif
+#define DFU_BANK_SIZE 0x70000  // 448 KB, ending below the persistent store
+#define DFU_PAGE_SIZE 4096
+
+// heatshrink parameters; tools/dfu.py has to use the same
+#define DFU_WINDOW_BITS 12
+#define DFU_LOOKAHEAD_BITS 4
+
+// Control: [command][arguments], answered with a notification of
+// [command][status][stream offset, LE32][image offset, LE32]
+#define DFU_CMD_START 0x01   // [image size, LE32][stream size, LE32][image CRC-32, LE32][receipt interval][HMAC]
+#define DFU_CMD_STATUS 0x02
+#define DFU_CMD_VERIFY 0x03
+#define DFU_CMD_APPLY 0x04
+#define DFU_CMD_ABORT 0x05
+#define DFU_RECEIPT 0x10     // Sent unasked every receipt interval chunks
+#define DFU_MAC_LENGTH 32    // HMAC-SHA256 of the image
+#define DFU_KEY_LENGTH 32
+#define DFU_START_LENGTH (14 + DFU_MAC_LENGTH)
+#define DFU_CONTROL_LENGTH DFU_START_LENGTH
+#define DFU_RESPONSE_LENGTH 10
+
+#define DFU_STATUS_OK 0
+#define DFU_STATUS_BAD_REQUEST 1
+#define DFU_STATUS_TOO_LARGE 2     // Image larger than the bank, or a chunk past the stream end
+#define DFU_STATUS_BAD_OFFSET 3     // The stream offset is the one expected next
+#define DFU_STATUS_BAD_CRC 4
+#define DFU_STATUS_BAD_STREAM 5
+#define DFU_STATUS_VERIFY_FAILED 6
+#define DFU_STATUS_NOT_READY 7
+#define DFU_STATUS_UNAUTHORIZED 8   // No device key, or the HMAC doesn't match
+#define DFU_STATUS_BAD_IMAGE 9      // The vector table doesn't fit the application
+
+// Data: [stream offset, LE32][CRC-16/CCITT of the payload, LE16][payload].
+// A chunk fills at most one write, so the app sizes the payload from the
+// negotiated MTU: MTU - 3 - DFU_CHUNK_HEADER, up to DFU_MAX_CHUNK_PAYLOAD.
+#define DFU_CHUNK_HEADER 6
+#define DFU_MAX_CHUNK_PAYLOAD 238  // Fills a 247 byte MTU
+#define DFU_DATA_LENGTH (DFU_CHUNK_HEADER + DFU_MAX_CHUNK_PAYLOAD)
+
+// Time for the APPLY reply to go out before the copy stops everything
+#define DFU_APPLY_DELAY 500  // ms
+
+// Sends a control response; BLE notifies it, a host build can capture it
+typedef void (*DfuResponder)(const uint8_t* data, size_t length);
+
+// Function declarations
+void initDfu(DfuResponder responder);
+void onDfuControl(const uint8_t* data, size_t length);
+void onDfuData(const uint8_t* data, size_t length);
+void updateDfu(unsigned long now);
+uint16_t dfuCrc16(const uint8_t* data, size_t length);
+uint8_t readDfuBankByte(uint32_t offset);
+#if !DFU_FLASH_HARDWARE
+void setDfuKey(const uint8_t* key);  // nullptr leaves the device unprovisioned
+#endif
+
+#endif // DFU_H
@@ -0,0 +1,169 @@
+// diagnostics.cpp
+#include "diagnostics.h"
+#include "ble_config.h"
+#include "emission_control.h"
+#include "heart_rate.h"
+#include "emission_timer.h"
+#include "rule_engine.h"
+#include "duration_controller.h"
+#include "energy_model.h"
+#include "latency_trace.h"
+#include "memory_monitor.h"
+#include "recovery.h"
+#include "button.h"
+#include "battery.h"
+
+// Copies a stats struct into the response after the page id byte
+template <typename T>
+static size_t packPage(byte page, const T& stats, uint8_t* buffer, size_t maxLength) {
+    if (maxLength < 1 + sizeof(T)) {
+        return 0;
+    }
+    buffer[0] = page;
+    memcpy(buffer + 1, &stats, sizeof(T));
+    return 1 + sizeof(T);
+}
+
+size_t buildDiagnosticsPage(byte page, uint8_t* buffer, size_t maxLength) {
+    switch (page) {
+        case DIAG_PAGE_PREDICTION: {
+            PredictionStats stats;
+            getPredictionStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_SAMPLING: {
+            SamplingStats stats;
+            getSamplingStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_EMISSION_TIMING: {
+            EmissionTimingStats stats;
+            getEmissionTimingStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_ARBITRATION: {
+            ArbitrationStats stats;
+            getArbitrationStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_BUDGET: {
+            BudgetStats stats;
+            getBudgetStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_RULES: {
+            RuleStats stats;
+            getRuleStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_DURATION_CONTROL: {
+            DurationControlStats stats;
+            getDurationControlStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_ENERGY: {
+            EnergyStats stats;
+            getEnergyStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_LATENCY: {
+            LatencyStats stats;
+            getLatencyStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_MEMORY: {
+            MemoryStats stats;
+            getMemoryStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_RECOVERY: {
+            RecoveryStats stats;
+            getRecoveryStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_BUTTON: {
+            ButtonStats stats;
+            getButtonStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        case DIAG_PAGE_BATTERY: {
+            BatteryStats stats;
+            getBatteryStats(stats);
+            return packPage(page, stats, buffer, maxLength);
+        }
+        default:
+            if (page >= DIAG_PAGE_LATENCY_HISTOGRAM && page <= DIAG_PAGE_LATENCY_HISTOGRAM_LAST) {
+                LatencyHistogram histogram;
+                getLatencyHistogram(page - DIAG_PAGE_LATENCY_HISTOGRAM, histogram);
+                return packPage(page, histogram, buffer, maxLength);
+            }
+            return 0;
+    }
+}
+
+void resetDiagnosticsPage(byte page) {
+    switch (page) {
+        case DIAG_PAGE_PREDICTION:
+            resetPredictionStats();
+            break;
+        case DIAG_PAGE_SAMPLING:
+            resetSamplingStats();
+            break;
+        case DIAG_PAGE_EMISSION_TIMING:
+            resetEmissionTimingStats();
+            break;
+        case DIAG_PAGE_ARBITRATION:
+            resetArbitrationStats();
+            break;
+        case DIAG_PAGE_BUDGET:
+            resetBudgetStats();
+            break;
+        case DIAG_PAGE_RULES:
+            resetRuleStats();
+            break;
+        case DIAG_PAGE_DURATION_CONTROL:
+            resetDurationControlStats();
+            break;
+        case DIAG_PAGE_ENERGY:
+            resetEnergyStats();
+            break;
+        case DIAG_PAGE_LATENCY:
+            resetLatencyStats();
+            break;
+        case DIAG_PAGE_MEMORY:
+            resetMemoryStats();
+            break;
+        case DIAG_PAGE_RECOVERY:
+            resetRecoveryStats();
+            break;
+        case DIAG_PAGE_BUTTON:
+            resetButtonStats();
+            break;
+        case DIAG_PAGE_BATTERY:
+            resetBatteryStats();
+            break;
+        default:
+            if (page >= DIAG_PAGE_LATENCY_HISTOGRAM && page <= DIAG_PAGE_LATENCY_HISTOGRAM_LAST) {
+                resetLatencyStats();
+            }
+            break;
+    }
+}
+
+void handleDiagnosticsRequest(byte request) {
+    byte page = request & ~DIAG_RESET_FLAG;
+    uint8_t response[DIAG_MAX_RESPONSE];
+
+    size_t length = buildDiagnosticsPage(page, response, sizeof(response));
+    if (length == 0) {
+        debugPrintf(DEBUG_BLE, "Unknown diagnostics page: %d\n", page);
+        return;
+    }
+
+    diagnosticsCharacteristic.writeValue(response, length);
+    debugPrintf(DEBUG_BLE, "Diagnostics page %d sent (%d bytes)\n", page, (int)length);
+
+    if (request & DIAG_RESET_FLAG) {
+        resetDiagnosticsPage(page);
+    }
+}
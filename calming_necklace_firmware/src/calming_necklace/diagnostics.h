@@ -0,0 +1,43 @@
+// diagnostics.h
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <Arduino.h>
+#include "debug.h"
+#include "latency_trace.h"
+
+// Diagnostics pages. The central writes a page id to the diagnostics
+// characteristic and the device answers on the same characteristic with
+// [page id][page payload].
+#define DIAG_PAGE_PREDICTION 1
+#define DIAG_PAGE_SAMPLING 2
+#define DIAG_PAGE_EMISSION_TIMING 3
+#define DIAG_PAGE_ARBITRATION 4
+#define DIAG_PAGE_BUDGET 5
+#define DIAG_PAGE_RULES 6
+#define DIAG_PAGE_DURATION_CONTROL 7
+#define DIAG_PAGE_ENERGY 8
+#define DIAG_PAGE_LATENCY 9
+// Raw latency histograms, one page each from DIAG_PAGE_LATENCY_HISTOGRAM
+// in LATENCY_STAGE_* order. Resetting any latency page clears all of them.
+#define DIAG_PAGE_LATENCY_HISTOGRAM 10
+#define DIAG_PAGE_LATENCY_HISTOGRAM_LAST (DIAG_PAGE_LATENCY_HISTOGRAM + LATENCY_HISTOGRAM_COUNT - 1)
+// Resetting the memory page repaints the stacks, restarting the peaks
+#define DIAG_PAGE_MEMORY 14
+// Resetting the recovery page clears the reset counters
+#define DIAG_PAGE_RECOVERY 15
+#define DIAG_PAGE_BUTTON 16
+#define DIAG_PAGE_BATTERY 17
+
+// Set on a request to clear the page's counters after reporting them
+#define DIAG_RESET_FLAG 0x80
+
+// Largest response, including the page id byte
+#define DIAG_MAX_RESPONSE 64
+
+// Function declarations
+void handleDiagnosticsRequest(byte request);
+size_t buildDiagnosticsPage(byte page, uint8_t* buffer, size_t maxLength);
+void resetDiagnosticsPage(byte page);
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,86 @@
+// duration_controller.cpp
+#include "duration_controller.h"
+#include "emission_analytics.h"
+
+static long previousError[EMISSION_CHANNEL_COUNT];
+static byte hasPreviousError = 0;  // Bit per channel
+static uint32_t adaptedDuration[EMISSION_CHANNEL_COUNT];  // 0 until the controller first runs
+
+static uint32_t controlUpdates = 0;
+static uint32_t controlSaturated = 0;
+static int32_t lastControlError = 0;
+
+void initDurationController() {
+    hasPreviousError = 0;
+    memset(adaptedDuration, 0, sizeof(adaptedDuration));
+    resetDurationControlStats();
+}
+
+// Unscaled; the user's setting unless adaptation is on, and always within
+// the current bounds when it is
+unsigned long getEmissionDuration(byte channel) {
+    if (channel >= EMISSION_CHANNEL_COUNT) {
+        return 0;
+    }
+    if (!adaptiveDurationEnabled[channel]) {
+        return emissionDuration[channel];
+    }
+    unsigned long duration = adaptedDuration[channel] ? adaptedDuration[channel] : emissionDuration[channel];
+    return constrain(duration, adaptiveDurationMin[channel], adaptiveDurationMax[channel]);
+}
+
+void adaptEmissionDuration(byte channel, bool recovered, unsigned long recoveryTime) {
+    if (channel >= EMISSION_CHANNEL_COUNT || !adaptiveDurationEnabled[channel]) {
+        return;
+    }
+
+    // An emission that never brought the heart rate down counts as the
+    // slowest recovery the analytics window can see
+    long error = (long)(recovered ? recoveryTime : ANALYTICS_POST_WINDOW) - (long)recoveryTarget[channel];
+
+    long step = error >> DURATION_KI_SHIFT;
+    if (hasPreviousError & (1 << channel)) {
+        step += (error - previousError[channel]) >> DURATION_KP_SHIFT;
+    }
+    if (step < 0) {
+        step /= 2;
+    }
+    step = constrain(step, -DURATION_MAX_STEP, DURATION_MAX_STEP);
+    previousError[channel] = error;
+    hasPreviousError |= (1 << channel);
+
+    long duration = (long)getEmissionDuration(channel) + step;
+    long clamped = constrain(duration, (long)adaptiveDurationMin[channel], (long)adaptiveDurationMax[channel]);
+    if (clamped != duration) {
+        controlSaturated++;
+    }
+    adaptedDuration[channel] = clamped;
+
+    controlUpdates++;
+    lastControlError = error;
+    debugPrintf(DEBUG_SETTINGS, "Channel %d: recovery error %ld ms, duration now %lu ms\n",
+                channel, error, (unsigned long)adaptedDuration[channel]);
+}
+
+void getDurationControlStats(DurationControlStats& stats) {
+    stats.updates = controlUpdates;
+    stats.saturated = controlSaturated;
+    stats.lastError = lastControlError;
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        stats.duration[channel] = getEmissionDuration(channel);
+    }
+}
+
+void captureAdaptedDurations(uint32_t* durations) {
+    memcpy(durations, adaptedDuration, sizeof(adaptedDuration));
+}
+
+void restoreAdaptedDurations(const uint32_t* durations) {
+    memcpy(adaptedDuration, durations, sizeof(adaptedDuration));
+}
+
+void resetDurationControlStats() {
+    controlUpdates = 0;
+    controlSaturated = 0;
+    lastControlError = 0;
+}
@@ -0,0 +1,41 @@
+// duration_controller.h
+#ifndef DURATION_CONTROLLER_H
+#define DURATION_CONTROLLER_H
+
+#include <Arduino.h>
+#include "debug.h"
+#include "settings.h"
+
+// Closed-loop emission duration. After each emission that started above
+// the high heart rate threshold, the channel's duration is nudged by a
+// velocity-form PI controller on the recovery error (time to drop below
+// the threshold minus the channel's recoveryTarget). Because the controller
+// output is the duration itself, clamping it to the user's bounds keeps the
+// integral from winding up. Shortening uses half the gain of lengthening,
+// so the duration settles on the short side only once recoveries are
+// reliable.
+//
+// The controlled duration is kept apart from emissionDuration, which stays
+// what the user set: the controller starts from it, and it applies again
+// as soon as adaptation is turned off.
+#define DURATION_KP_SHIFT 3          // Proportional gain 1/8
+#define DURATION_KI_SHIFT 4          // Integral gain 1/16
+#define DURATION_MAX_STEP 3000       // Largest change per emission, ms
+
+struct DurationControlStats {
+    uint32_t updates;
+    uint32_t saturated;  // Updates clamped at a bound
+    int32_t lastError;   // ms, positive when recovery was too slow
+    uint32_t duration[EMISSION_CHANNEL_COUNT];  // What the next emission will run for
+};
+
+// Function declarations
+void initDurationController();
+void adaptEmissionDuration(byte channel, bool recovered, unsigned long recoveryTime);
+unsigned long getEmissionDuration(byte channel);
+void captureAdaptedDurations(uint32_t* durations);
+void restoreAdaptedDurations(const uint32_t* durations);
+void getDurationControlStats(DurationControlStats& stats);
+void resetDurationControlStats();
+
+#endif // DURATION_CONTROLLER_H
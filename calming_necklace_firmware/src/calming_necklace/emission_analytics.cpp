@@ -0,0 +1,190 @@
+// emission_analytics.cpp
+#include "emission_analytics.h"
+#include "heart_rate.h"
+#include "duration_controller.h"
+
+// Sums over the last ANALYTICS_PRE_WINDOW, one bucket per span, reused
+// once the span has left the window
+struct SampleBucket {
+    unsigned long start;  // Timestamp of the span's start
+    uint32_t sum;         // BPM
+    uint16_t count;
+};
+static SampleBucket buckets[ANALYTICS_BUCKET_COUNT];
+static byte latestRate = 0;
+static bool hasLatest = false;
+
+// Emission being measured on each channel
+struct EmissionTrack {
+    unsigned long startTime;
+    uint16_t preMean;     // 0.1 BPM
+    uint16_t postSum;     // BPM
+    uint8_t postCount;
+    uint8_t triggerSource;
+    bool needsRecovery;
+    unsigned long recoveryTime;  // ms after start, 0 until recovered
+};
+static EmissionTrack tracks[EMISSION_CHANNEL_COUNT];
+static byte trackingChannels = 0;  // Bit per channel with a track open
+
+static SourceEffectiveness sourceStats[TRIGGER_SOURCE_COUNT];
+static bool summaryChanged = false;
+
+void resetEmissionAnalytics() {
+    memset(sourceStats, 0, sizeof(sourceStats));
+    summaryChanged = true;
+}
+
+void initEmissionAnalytics() {
+    memset(buckets, 0, sizeof(buckets));
+    hasLatest = false;
+    trackingChannels = 0;
+    resetEmissionAnalytics();
+}
+
+// Folds a finished track into its source's aggregates. A track cut short
+// by the next emission still counts, but only a full window can tell the
+// duration controller that the heart rate failed to recover.
+static void closeTrack(byte channel, bool complete) {
+    trackingChannels &= ~(1 << channel);
+    EmissionTrack& track = tracks[channel];
+    if (track.postCount == 0 || track.triggerSource < 1 || track.triggerSource > TRIGGER_SOURCE_COUNT) {
+        return;
+    }
+
+    int postMean = (track.postSum * 10 + track.postCount / 2) / track.postCount;
+    int delta = postMean - track.preMean;
+
+    SourceEffectiveness& stats = sourceStats[track.triggerSource - 1];
+    stats.emissions++;
+    stats.deltaSum += delta;
+    if (delta < 0) {
+        stats.lowered++;
+    }
+    if (track.needsRecovery) {
+        stats.needRecovery++;
+        if (track.recoveryTime > 0) {
+            stats.recovered++;
+            stats.recoverySum += track.recoveryTime;
+        }
+        if (complete || track.recoveryTime > 0) {
+            adaptEmissionDuration(channel, track.recoveryTime > 0, track.recoveryTime);
+        }
+    }
+    summaryChanged = true;
+
+    debugPrintf(DEBUG_HEART, "Emission on channel %d: %d.%d -> %d.%d BPM\n", channel,
+                track.preMean / 10, track.preMean % 10, postMean / 10, postMean % 10);
+}
+
+void onAnalyticsEmissionStart(byte channel, byte triggerSource, unsigned long startTime) {
+    if (channel >= EMISSION_CHANNEL_COUNT) {
+        return;
+    }
+    // A new emission cuts the previous one's post window short
+    if (trackingChannels & (1 << channel)) {
+        closeTrack(channel, false);
+    }
+
+    // Baseline from the spans inside the pre window
+    uint32_t sum = 0;
+    uint32_t count = 0;
+    for (byte i = 0; i < ANALYTICS_BUCKET_COUNT; i++) {
+        if (buckets[i].count > 0 && startTime - buckets[i].start < ANALYTICS_PRE_WINDOW) {
+            sum += buckets[i].sum;
+            count += buckets[i].count;
+        }
+    }
+    if (count == 0 || !hasLatest) {
+        debugPrintln(DEBUG_HEART, "No heart rate baseline, emission not measured");
+        return;
+    }
+
+    EmissionTrack& track = tracks[channel];
+    track.startTime = startTime;
+    track.preMean = (sum * 10 + count / 2) / count;
+    track.postSum = 0;
+    track.postCount = 0;
+    track.triggerSource = triggerSource;
+    track.needsRecovery = latestRate >= highHeartRateThreshold;
+    track.recoveryTime = 0;
+    trackingChannels |= (1 << channel);
+}
+
+void onAnalyticsSample(unsigned long timestamp, byte heartRate) {
+    unsigned long spanStart = timestamp - timestamp % ANALYTICS_BUCKET_SPAN;
+    SampleBucket& bucket = buckets[(timestamp / ANALYTICS_BUCKET_SPAN) % ANALYTICS_BUCKET_COUNT];
+    if (bucket.count == 0 || bucket.start != spanStart) {
+        bucket.start = spanStart;
+        bucket.sum = 0;
+        bucket.count = 0;
+    }
+    if (bucket.count < 0xFFFF) {
+        bucket.sum += heartRate;
+        bucket.count++;
+    }
+    latestRate = heartRate;
+    hasLatest = true;
+
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        if (!(trackingChannels & (1 << channel))) {
+            continue;
+        }
+        EmissionTrack& track = tracks[channel];
+        unsigned long elapsed = timestamp - track.startTime;
+        if (elapsed > ANALYTICS_POST_WINDOW) {
+            closeTrack(channel, true);
+            continue;
+        }
+
+        track.postSum += heartRate;
+        track.postCount++;
+        if (track.needsRecovery && track.recoveryTime == 0 && heartRate < highHeartRateThreshold) {
+            track.recoveryTime = max(elapsed, 1UL);
+        }
+        if (track.postCount == 0xFF) {
+            closeTrack(channel, true);
+        }
+    }
+}
+
+void getSourceEffectiveness(byte triggerSource, SourceEffectiveness& stats) {
+    if (triggerSource < 1 || triggerSource > TRIGGER_SOURCE_COUNT) {
+        stats = SourceEffectiveness{0, 0, 0, 0, 0, 0};
+        return;
+    }
+    stats = sourceStats[triggerSource - 1];
+}
+
+size_t buildAnalyticsSummary(uint8_t* buffer, size_t maxLength) {
+    if (maxLength < ANALYTICS_SUMMARY_LENGTH) {
+        return 0;
+    }
+
+    for (byte i = 0; i < TRIGGER_SOURCE_COUNT; i++) {
+        const SourceEffectiveness& stats = sourceStats[i];
+        int16_t meanDelta = stats.emissions ? stats.deltaSum / stats.emissions : 0;
+        byte loweredPercent = stats.emissions ? stats.lowered * 100UL / stats.emissions : 0;
+        byte recoveredPercent = stats.needRecovery ? stats.recovered * 100UL / stats.needRecovery : 0;
+        uint16_t meanRecovery = stats.recovered ? stats.recoverySum / stats.recovered / 1000 : 0;
+
+        uint8_t* record = buffer + i * ANALYTICS_SOURCE_RECORD_LENGTH;
+        record[0] = stats.emissions & 0xFF;
+        record[1] = stats.emissions >> 8;
+        record[2] = meanDelta & 0xFF;
+        record[3] = (meanDelta >> 8) & 0xFF;
+        record[4] = loweredPercent;
+        record[5] = recoveredPercent;
+        record[6] = meanRecovery & 0xFF;
+        record[7] = meanRecovery >> 8;
+    }
+    return ANALYTICS_SUMMARY_LENGTH;
+}
+
+// True once after each change to the aggregates, so the summary
+// characteristic is only rewritten when there is something new
+bool consumeAnalyticsUpdate() {
+    bool changed = summaryChanged;
+    summaryChanged = false;
+    return changed;
+}
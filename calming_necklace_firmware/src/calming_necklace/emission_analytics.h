@@ -0,0 +1,46 @@
+// emission_analytics.h
+#ifndef EMISSION_ANALYTICS_H
+#define EMISSION_ANALYTICS_H
+
+#include <Arduino.h>
+#include "debug.h"
+#include "emission_control.h"
+
+// Emission effectiveness. Each emission compares the mean heart rate over
+// the pre-emission window with the mean over the post-emission window
+// (measured from the start of the emission), and, when it started above the
+// high threshold, how long the heart rate took to drop back below it.
+// Results are folded into per trigger source aggregates as they complete.
+// The pre window is kept as running sums over fixed spans of time rather
+// than as samples, so it covers the whole minute however fast the heart
+// rate is being sampled; its start is only as exact as one span.
+#define ANALYTICS_PRE_WINDOW 60000    // 1 minute
+#define ANALYTICS_POST_WINDOW 180000  // 3 minutes
+#define ANALYTICS_BUCKET_SPAN 5000    // ms of samples summed together
+#define ANALYTICS_BUCKET_COUNT (ANALYTICS_PRE_WINDOW / ANALYTICS_BUCKET_SPAN)
+
+// Summary record, one per trigger source in source order:
+// [emissions, LE16][mean delta in 0.1 BPM, signed LE16][% lowered][% recovered][mean recovery s, LE16]
+#define ANALYTICS_SOURCE_RECORD_LENGTH 8
+#define ANALYTICS_SUMMARY_LENGTH (TRIGGER_SOURCE_COUNT * ANALYTICS_SOURCE_RECORD_LENGTH)
+
+// Running aggregates for one trigger source
+struct SourceEffectiveness {
+    uint16_t emissions;      // Emissions with a complete pre and post window
+    uint16_t lowered;        // Post mean below pre mean
+    int32_t deltaSum;        // 0.1 BPM, post mean minus pre mean
+    uint16_t needRecovery;   // Started at or above the high threshold
+    uint16_t recovered;      // ...and dropped below it inside the post window
+    uint32_t recoverySum;    // ms
+};
+
+// Function declarations
+void initEmissionAnalytics();
+void onAnalyticsEmissionStart(byte channel, byte triggerSource, unsigned long startTime);
+void onAnalyticsSample(unsigned long timestamp, byte heartRate);
+void getSourceEffectiveness(byte triggerSource, SourceEffectiveness& stats);
+size_t buildAnalyticsSummary(uint8_t* buffer, size_t maxLength);
+bool consumeAnalyticsUpdate();
+void resetEmissionAnalytics();
+
+#endif // EMISSION_ANALYTICS_H
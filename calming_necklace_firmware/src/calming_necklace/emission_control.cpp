@@ -1,87 +1,485 @@
 // emission_control.cpp
 #include "emission_control.h"
+#include "heart_rate_trend.h"
+#include "emission_timer.h"
+#include "emitter_pwm.h"
+#include "persistent_store.h"
+#include "emission_schedule.h"
+#include "rule_engine.h"
+#include "emission_analytics.h"
+#include "duration_controller.h"
+#include "led_patterns.h"
+#include "time_service.h"
+#include "energy_model.h"
+#include "latency_trace.h"
+#include "battery.h"
 
-// Emission state variables
-static byte emissionState = EMISSION_IDLE;
-static unsigned long emissionStartTime = 0;
+// Per-channel emission state, kept as parallel arrays so each update is a
+// single pass over the channels
+static byte channelState[EMISSION_CHANNEL_COUNT];
+static unsigned long channelStartTime[EMISSION_CHANNEL_COUNT];
+static unsigned long channelRunTime[EMISSION_CHANNEL_COUNT];  // Duration of the current emission, including extensions
+static unsigned long channelEndTime[EMISSION_CHANNEL_COUNT];
+static unsigned long channelLastEmissionTime[EMISSION_CHANNEL_COUNT];
+static byte channelTriggerSource[EMISSION_CHANNEL_COUNT];
+static byte queuedChannels = 0;  // Bit per channel with a pending entry
+static byte endedChannels = 0;   // Bit per channel that has finished an emission
+static byte chargedChannels = 0; // Bit per active channel paid for from the budget
+static byte activeChannelCount = 0;
+
+// Most recent emission across all channels
 static unsigned long lastEmissionTime = 0;
 static byte lastTriggerSource = 0;
+
+// Pending emissions, a binary min-heap ordered by deadline, then priority
+struct PendingEmission {
+    unsigned long deadline;
+    byte channel;
+    byte triggerSource;
+    byte priority;
+};
+static PendingEmission pendingQueue[EMISSION_QUEUE_CAPACITY];
+static byte pendingCount = 0;
+
 static bool heartRateHighTriggered = false;
 static bool heartRateLowTriggered = false;
 
+// Predictive trigger state, kept per side so a high and a low prediction
+// don't confirm or cancel each other
+struct PredictionSide {
+    bool triggered;       // Accepted and latched until the projection recedes
+    bool pending;         // Waiting to be confirmed or called a false alarm
+    unsigned long time;   // When the trigger was accepted
+};
+static PredictionSide highPrediction = {false, false, 0};
+static PredictionSide lowPrediction = {false, false, 0};
+static PredictionStats predictionStats = {0, 0, 0, 0, 0};
+
+static ArbitrationStats arbitrationStats = {0, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0}};
+
+// Emission budget: a token bucket of emission time shared by all
+// channels, refilled at emissionBudget per emissionBudgetPeriod
+static unsigned long budgetTokens = 0;
+static unsigned long budgetRefillTime = 0;
+static unsigned long long budgetRefillRemainder = 0;
+static unsigned long budgetSaveTime = 0;
+static bool budgetDirty = false;
+static uint32_t budgetDenied = 0;
+static uint32_t budgetShortened = 0;
+
+static void saveBudget(unsigned long currentTime) {
+    uint32_t tokens = budgetTokens;
+    saveRecord(STORE_RECORD_BUDGET, &tokens, sizeof(tokens));
+    budgetSaveTime = currentTime;
+    budgetDirty = false;
+}
+
+static void loadBudget(unsigned long currentTime) {
+    uint32_t tokens;
+    if (loadRecord(STORE_RECORD_BUDGET, &tokens, sizeof(tokens))) {
+        // Time spent powered off is unknown, so no refill is credited for it
+        budgetTokens = min((unsigned long)tokens, emissionBudget);
+        debugPrintf(DEBUG_GENERAL, "Emission budget restored: %lu ms\n", budgetTokens);
+    } else {
+        budgetTokens = emissionBudget;
+    }
+    budgetRefillTime = currentTime;
+    budgetRefillRemainder = 0;
+    budgetSaveTime = currentTime;
+}
+
+static void refillBudget(unsigned long currentTime) {
+    unsigned long elapsed = currentTime - budgetRefillTime;
+    budgetRefillTime = currentTime;
+    if (budgetTokens >= emissionBudget) {
+        budgetTokens = emissionBudget;
+        budgetRefillRemainder = 0;
+        return;
+    }
+
+    // Fractions of a ms carry over so slow refill rates don't round away
+    unsigned long long refill = (unsigned long long)elapsed * emissionBudget + budgetRefillRemainder;
+    unsigned long period = max(emissionBudgetPeriod, 1UL);
+    budgetRefillRemainder = refill % period;
+    budgetTokens = min(budgetTokens + (unsigned long)(refill / period), emissionBudget);
+    budgetDirty = true;
+}
+
+static bool isBudgetExempt(byte triggerSource) {
+    return !emissionBudgetEnabled || (triggerSource == TRIGGER_MANUAL && manualBudgetExempt);
+}
+
+// Returns how much of the requested emission time the budget allows and
+// charges it, or 0 if the bucket is too low to be worth starting
+static unsigned long chargeBudget(byte triggerSource, unsigned long requested, unsigned long currentTime) {
+    if (isBudgetExempt(triggerSource)) {
+        return requested;
+    }
+
+    refillBudget(currentTime);
+    unsigned long granted = min(requested, budgetTokens);
+    if (granted < min(requested, (unsigned long)EMISSION_MIN_BUDGET_GRANT)) {
+        budgetDenied++;
+        debugPrintf(DEBUG_GENERAL, "Emission budget exhausted (%lu ms left)\n", budgetTokens);
+        return 0;
+    }
+    if (granted < requested) {
+        budgetShortened++;
+        debugPrintf(DEBUG_GENERAL, "Emission shortened to remaining budget: %lu ms\n", granted);
+    }
+
+    budgetTokens -= granted;
+    saveBudget(currentTime);
+    return granted;
+}
+
+static void refundBudget(unsigned long unused) {
+    budgetTokens = min(budgetTokens + unused, emissionBudget);
+    budgetDirty = true;
+}
+
+// Deadlines are compared as signed differences so the order survives
+// the 32-bit millisecond wrap
+static bool pendingBefore(const PendingEmission& a, const PendingEmission& b) {
+    long difference = (long)(a.deadline - b.deadline);
+    if (difference != 0) {
+        return difference < 0;
+    }
+    return a.priority > b.priority;
+}
+
+static void swapPending(byte i, byte j) {
+    PendingEmission temp = pendingQueue[i];
+    pendingQueue[i] = pendingQueue[j];
+    pendingQueue[j] = temp;
+}
+
+static bool pushPending(unsigned long deadline, byte channel, byte triggerSource) {
+    if (pendingCount >= EMISSION_QUEUE_CAPACITY) {
+        debugPrintln(DEBUG_GENERAL, "Emission queue full, dropping trigger");
+        return false;
+    }
+
+    byte i = pendingCount++;
+    pendingQueue[i] = {deadline, channel, triggerSource, channelPriority[channel]};
+    while (i > 0) {
+        byte parent = (i - 1) / 2;
+        if (!pendingBefore(pendingQueue[i], pendingQueue[parent])) {
+            break;
+        }
+        swapPending(i, parent);
+        i = parent;
+    }
+    queuedChannels |= (1 << channel);
+    return true;
+}
+
+static PendingEmission popPending() {
+    PendingEmission top = pendingQueue[0];
+    pendingQueue[0] = pendingQueue[--pendingCount];
+
+    byte i = 0;
+    while (true) {
+        byte left = 2 * i + 1;
+        byte right = left + 1;
+        byte smallest = i;
+        if (left < pendingCount && pendingBefore(pendingQueue[left], pendingQueue[smallest])) {
+            smallest = left;
+        }
+        if (right < pendingCount && pendingBefore(pendingQueue[right], pendingQueue[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        swapPending(i, smallest);
+        i = smallest;
+    }
+    queuedChannels &= ~(1 << top.channel);
+    return top;
+}
+
+// Each running emitter at its profile's average duty
+static void updateEmitterPower() {
+    uint16_t level = 0;
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        if (channelState[channel] == EMISSION_ACTIVE) {
+            level += getEmitterPowerLevel(channel);
+        }
+    }
+    setPowerLevel(POWER_EMITTER, level);
+}
+
+static void startChannelEmission(byte channel, byte triggerSource, unsigned long runTime, unsigned long currentTime) {
+    debugPrintf(DEBUG_GENERAL, "Starting emission on channel %d from source %d\n", channel, triggerSource);
+
+    channelState[channel] = EMISSION_ACTIVE;
+    channelStartTime[channel] = currentTime;
+    channelRunTime[channel] = runTime;
+    channelLastEmissionTime[channel] = currentTime;
+    channelTriggerSource[channel] = triggerSource;
+    activeChannelCount++;
+    setLedStatus(LED_STATUS_EMITTING, true);
+    updateEmitterPower();
+
+    lastEmissionTime = currentTime;
+    lastTriggerSource = triggerSource;
+    onAnalyticsEmissionStart(channel, triggerSource, currentTime);
+
+    // Turn on the channel's emitter (channel 0 is shown on the red LED); the
+    // emitter layer plays its profile and arms the cutoff
+    startEmitter(channel, channelRunTime[channel]);
+    if (triggerSource == TRIGGER_MANUAL) {
+        markLatencyPoint(LATENCY_POINT_ACTUATION);
+    }
+}
+
+static void endChannelEmission(byte channel) {
+    unsigned long currentTime = getLoopMillis();
+    stopEmitter(channel);
+
+    // An emission stopped early gives its unused time back to the budget
+    unsigned long elapsed = currentTime - channelStartTime[channel];
+    if ((chargedChannels & (1 << channel)) && elapsed < channelRunTime[channel]) {
+        refundBudget(channelRunTime[channel] - elapsed);
+    }
+    chargedChannels &= ~(1 << channel);
+
+    channelState[channel] = EMISSION_IDLE;
+    channelEndTime[channel] = currentTime;
+    endedChannels |= (1 << channel);
+    activeChannelCount--;
+    setLedStatus(LED_STATUS_EMITTING, activeChannelCount > 0);
+    updateEmitterPower();
+}
+
+// Earliest time a new emission may start on the channel given the
+// minimum gap after the previous one
+static unsigned long earliestStartTime(byte channel, unsigned long currentTime) {
+    if (!(endedChannels & (1 << channel))) {
+        return currentTime;
+    }
+    unsigned long gapEnd = channelEndTime[channel] + minEmissionGap;
+    return ((long)(gapEnd - currentTime) > 0) ? gapEnd : currentTime;
+}
+
+// Starts due entries while there is capacity. An entry whose channel is
+// still running, or inside its minimum gap, waits at the head of the queue.
+static void dispatchPendingEmissions(unsigned long currentTime) {
+    while (pendingCount > 0 && activeChannelCount < EMISSION_MAX_ACTIVE_CHANNELS) {
+        if ((long)(currentTime - pendingQueue[0].deadline) < 0) {
+            break;
+        }
+        byte channel = pendingQueue[0].channel;
+        if (channelState[channel] == EMISSION_ACTIVE ||
+            (long)(currentTime - earliestStartTime(channel, currentTime)) < 0) {
+            break;
+        }
+        PendingEmission next = popPending();
+        unsigned long duration = scaleEmissionDuration(getEmissionDuration(next.channel));
+        unsigned long runTime = chargeBudget(next.triggerSource, duration, currentTime);
+        if (runTime == 0) {
+            // Periodic emissions wait a full interval before asking again
+            channelLastEmissionTime[next.channel] = currentTime;
+            continue;
+        }
+        if (!isBudgetExempt(next.triggerSource)) {
+            chargedChannels |= (1 << next.channel);
+        }
+        startChannelEmission(next.channel, next.triggerSource, runTime, currentTime);
+    }
+}
+
 void setupEmissionControl() {
     debugPrintln(DEBUG_GENERAL, "Initializing emission control system");
-    emissionState = EMISSION_IDLE;
-    emissionStartTime = 0;
+    initEmissionTimer();
+    initEmitterPwm();
+    initEmissionSchedule();
+    initRuleEngine();
+    initEmissionAnalytics();
+    initDurationController();
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        channelState[channel] = EMISSION_IDLE;
+        channelStartTime[channel] = 0;
+        channelRunTime[channel] = 0;
+        channelEndTime[channel] = 0;
+        channelLastEmissionTime[channel] = 0;
+        channelTriggerSource[channel] = 0;
+    }
+    pendingCount = 0;
+    queuedChannels = 0;
+    endedChannels = 0;
+    chargedChannels = 0;
+    activeChannelCount = 0;
+    loadBudget(getLoopMillis());
     lastEmissionTime = 0;
     lastTriggerSource = 0;
 }
 
-void updateEmissionState() {
-    unsigned long currentTime = millis();
-    
-    // Check if an active emission should be stopped
-    if (emissionState == EMISSION_ACTIVE) {
-        if (currentTime - emissionStartTime >= emission1Duration) {
-            debugPrintln(DEBUG_GENERAL, "Emission complete, turning off");
-            handleLEDs(CMD_LED_OFF);
-            emissionState = EMISSION_IDLE;
+void updateEmissionState(unsigned long now) {
+    // Scheduled and rule emissions go through the same queue as other triggers
+    updateEmissionSchedule();
+    updateRuleEngine(now);
+
+    unsigned long currentTime = now;
+
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        // Check if an active emission should be stopped
+        if (channelState[channel] == EMISSION_ACTIVE) {
+            unsigned long elapsed = currentTime - channelStartTime[channel];
+            if (elapsed >= channelRunTime[channel]) {
+                debugPrintf(DEBUG_GENERAL, "Emission complete on channel %d, turning off\n", channel);
+                recordEmissionCutoff(channel, elapsed, channelRunTime[channel]);
+                endChannelEmission(channel);
+            }
+            continue;
+        }
+
+        // Queue periodic emissions that have come due, either always or
+        // inside a schedule window
+        bool periodic = periodicEmissionEnabled[channel] || isScheduleWindowOpen(channel);
+        if (periodic && !(queuedChannels & (1 << channel)) &&
+            currentTime - channelLastEmissionTime[channel] >= releaseInterval[channel]) {
+            pushPending(earliestStartTime(channel, currentTime), channel, TRIGGER_PERIODIC);
         }
     }
-    
-    // Check for periodic emissions if enabled
-    if (periodicEmissionEnabled && emissionState == EMISSION_IDLE) {
-        if (currentTime - lastEmissionTime >= releaseInterval1) {
-            triggerEmission(TRIGGER_PERIODIC);
+
+    dispatchPendingEmissions(currentTime);
+
+    // Write refills back now and then; charges were saved as they happened
+    if (budgetDirty && currentTime - budgetSaveTime >= EMISSION_BUDGET_SAVE_INTERVAL) {
+        refillBudget(currentTime);
+        saveBudget(currentTime);
+    }
+}
+
+// Decides what happens to a trigger for a channel that is already
+// emitting or has an emission pending, following the source's policy
+static bool arbitrateTrigger(byte channel, byte triggerSource, unsigned long currentTime) {
+    bool active = channelState[channel] == EMISSION_ACTIVE;
+    bool pending = queuedChannels & (1 << channel);
+    byte policy = (triggerSource >= 1 && triggerSource <= TRIGGER_SOURCE_COUNT)
+                  ? triggerPolicy[triggerSource - 1] : TRIGGER_POLICY_MERGE;
+
+    if (triggerSource >= 1 && triggerSource <= TRIGGER_SOURCE_COUNT) {
+        arbitrationStats.collisions[triggerSource - 1]++;
+    }
+
+    if (policy == TRIGGER_POLICY_EXTEND && active) {
+        unsigned long elapsed = currentTime - channelStartTime[channel];
+        unsigned long duration = scaleEmissionDuration(getEmissionDuration(channel));
+        unsigned long runTime = min(elapsed + duration, duration * EMISSION_MAX_EXTENSION_FACTOR);
+        if (runTime > channelRunTime[channel]) {
+            runTime = channelRunTime[channel] + chargeBudget(triggerSource, runTime - channelRunTime[channel], currentTime);
+            if (!isBudgetExempt(triggerSource)) {
+                chargedChannels |= (1 << channel);
+            }
+        }
+        if (runTime > channelRunTime[channel]) {
+            channelRunTime[channel] = runTime;
+            extendEmitter(channel, runTime - elapsed);
+            arbitrationStats.extended++;
+            debugPrintf(DEBUG_GENERAL, "Extended emission on channel %d to %lu ms\n", channel, runTime);
+            return true;
+        }
+    }
+
+    if (policy == TRIGGER_POLICY_QUEUE && active && !pending) {
+        unsigned long deadline = channelStartTime[channel] + channelRunTime[channel] + minEmissionGap;
+        if (!pushPending(deadline, channel, triggerSource)) {
+            arbitrationStats.dropped++;
+            return false;
         }
+        arbitrationStats.queued++;
+        debugPrintf(DEBUG_GENERAL, "Queued emission on channel %d after the active one\n", channel);
+        return true;
     }
+
+    arbitrationStats.merged++;
+    debugPrintf(DEBUG_GENERAL, "Trigger merged into %s emission on channel %d\n", active ? "active" : "pending", channel);
+    return false;
 }
 
-bool triggerEmission(byte triggerSource) {
-    // Don't trigger a new emission if one is already active
-    if (emissionState == EMISSION_ACTIVE) {
-        debugPrintln(DEBUG_GENERAL, "Emission already active, ignoring trigger");
+bool triggerChannelEmission(byte channel, byte triggerSource) {
+    if (channel >= EMISSION_CHANNEL_COUNT) {
         return false;
     }
-    
+
+    unsigned long currentTime = getLoopMillis();
+
+    // Overlapping triggers go through arbitration instead of being ignored
+    if (channelState[channel] == EMISSION_ACTIVE || (queuedChannels & (1 << channel))) {
+        return arbitrateTrigger(channel, triggerSource, currentTime);
+    }
+
     debugPrint(DEBUG_GENERAL, "Triggering emission from source: ");
-    debugPrintf(DEBUG_GENERAL, "%d\n", triggerSource);
-    
-    // Start the emission
-    emissionState = EMISSION_ACTIVE;
-    emissionStartTime = millis();
-    lastEmissionTime = emissionStartTime;
-    lastTriggerSource = triggerSource;
-    
-    // Turn on the LED (representing the fan)
-    handleLEDs(CMD_LED_ON);
-    
+    debugPrintf(DEBUG_GENERAL, "%d on channel %d\n", triggerSource, channel);
+
+    if (!pushPending(earliestStartTime(channel, currentTime), channel, triggerSource)) {
+        arbitrationStats.dropped++;
+        return false;
+    }
+    arbitrationStats.accepted++;
+    dispatchPendingEmissions(currentTime);
     return true;
 }
 
+bool triggerEmission(byte triggerSource) {
+    if (triggerSource == TRIGGER_MANUAL) {
+        markLatencyPoint(LATENCY_POINT_TRIGGER);
+    }
+    bool triggered = false;
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        if (channelTriggers[channel] & TRIGGER_BIT(triggerSource)) {
+            triggered |= triggerChannelEmission(channel, triggerSource);
+        }
+    }
+    // A command whose emitter didn't start in this pass (dropped, merged,
+    // queued, waiting out the gap or extending one already on) has no
+    // actuation to time; a later start would belong to another pass
+    if (triggerSource == TRIGGER_MANUAL) {
+        abandonLatencyTrace();
+    }
+    return triggered;
+}
+
 bool isEmissionActive() {
-    return (emissionState == EMISSION_ACTIVE);
+    return activeChannelCount > 0;
+}
+
+bool isChannelActive(byte channel) {
+    return channel < EMISSION_CHANNEL_COUNT && channelState[channel] == EMISSION_ACTIVE;
+}
+
+void stopChannelEmission(byte channel) {
+    if (isChannelActive(channel)) {
+        endChannelEmission(channel);
+        debugPrintf(DEBUG_GENERAL, "Emission manually stopped on channel %d\n", channel);
+    }
 }
 
 void stopEmission() {
-    if (emissionState == EMISSION_ACTIVE) {
-        handleLEDs(CMD_LED_OFF);
-        emissionState = EMISSION_IDLE;
-        debugPrintln(DEBUG_GENERAL, "Emission manually stopped");
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        stopChannelEmission(channel);
     }
+    pendingCount = 0;
+    queuedChannels = 0;
 }
 
 void checkHeartRateBasedEmission(byte currentHeartRate) {
-    if (!heartRateBasedReleaseEnabled || emissionState == EMISSION_ACTIVE) {
+    if (!heartRateBasedReleaseEnabled) {
         return;
     }
     
-    // Check for high heart rate threshold crossing
+    // Check for high heart rate threshold crossing. A crossing that was
+    // already answered by the predictive trigger doesn't fire again.
     if (currentHeartRate > highHeartRateThreshold && !heartRateHighTriggered) {
         debugPrint(DEBUG_GENERAL, "Heart rate above threshold: ");
         debugPrintf(DEBUG_GENERAL, "%d > %d\n", currentHeartRate, highHeartRateThreshold);
         heartRateHighTriggered = true;
-        triggerEmission(TRIGGER_HEART_RATE);
+        if (!highPrediction.triggered) {
+            triggerEmission(TRIGGER_HEART_RATE);
+        }
     } else if (currentHeartRate <= highHeartRateThreshold) {
         heartRateHighTriggered = false;
     }
@@ -91,20 +489,160 @@ void checkHeartRateBasedEmission(byte currentHeartRate) {
         debugPrint(DEBUG_GENERAL, "Heart rate below threshold: ");
         debugPrintf(DEBUG_GENERAL, "%d < %d\n", currentHeartRate, lowHeartRateThreshold);
         heartRateLowTriggered = true;
-        triggerEmission(TRIGGER_HEART_RATE);
+        if (!lowPrediction.triggered) {
+            triggerEmission(TRIGGER_HEART_RATE);
+        }
     } else if (currentHeartRate >= lowHeartRateThreshold) {
         heartRateLowTriggered = false;
     }
 }
 
+static void recordPredictionOutcome(PredictionSide& side, bool confirmed) {
+    if (!side.pending) {
+        return;
+    }
+    side.pending = false;
+
+    if (confirmed) {
+        unsigned long leadTime = getLoopMillis() - side.time;
+        predictionStats.confirmed++;
+        predictionStats.totalLeadTime += leadTime;
+        if (leadTime > predictionStats.maxLeadTime) {
+            predictionStats.maxLeadTime = leadTime;
+        }
+        debugPrintf(DEBUG_HEART, "Prediction confirmed, lead time: %lu ms\n", leadTime);
+    } else {
+        predictionStats.falseAlarms++;
+        debugPrintln(DEBUG_HEART, "Prediction receded without threshold crossing");
+    }
+}
+
+// Only an accepted trigger latches the side. One that was dropped (channel
+// disabled, cooling down, queue full) is retried on the next reading, and
+// the reactive trigger still answers the crossing if it comes to that.
+static void firePredictiveTrigger(PredictionSide& side, int projectedHeartRate) {
+    if (!triggerEmission(TRIGGER_HEART_RATE_PREDICTED)) {
+        return;
+    }
+    debugPrintf(DEBUG_GENERAL, "Projected heart rate %d BPM in %lu ms, triggered early\n",
+                projectedHeartRate, predictionHorizon);
+    side.triggered = true;
+    side.pending = true;
+    side.time = getLoopMillis();
+    predictionStats.predictions++;
+}
+
+void checkPredictiveEmission(byte currentHeartRate) {
+    if (!heartRateBasedReleaseEnabled || !predictiveReleaseEnabled || !isHeartRateTrendValid()) {
+        return;
+    }
+
+    int projectedHeartRate = getProjectedHeartRate(predictionHorizon);
+
+    // High side: fire once while the projection is above the threshold, and
+    // re-arm only after it falls back below threshold minus hysteresis
+    if (!highPrediction.triggered) {
+        if (projectedHeartRate > highHeartRateThreshold && currentHeartRate <= highHeartRateThreshold) {
+            firePredictiveTrigger(highPrediction, projectedHeartRate);
+        }
+    } else if (currentHeartRate > highHeartRateThreshold) {
+        recordPredictionOutcome(highPrediction, true);
+    } else if (projectedHeartRate < highHeartRateThreshold - predictionHysteresis) {
+        highPrediction.triggered = false;
+        recordPredictionOutcome(highPrediction, false);
+    }
+
+    // Low side mirrors the high side
+    if (!lowPrediction.triggered) {
+        if (projectedHeartRate < lowHeartRateThreshold && currentHeartRate >= lowHeartRateThreshold) {
+            firePredictiveTrigger(lowPrediction, projectedHeartRate);
+        }
+    } else if (currentHeartRate < lowHeartRateThreshold) {
+        recordPredictionOutcome(lowPrediction, true);
+    } else if (projectedHeartRate > lowHeartRateThreshold + predictionHysteresis) {
+        lowPrediction.triggered = false;
+        recordPredictionOutcome(lowPrediction, false);
+    }
+}
+
+void getPredictionStats(PredictionStats& stats) {
+    stats = predictionStats;
+}
+
+void resetPredictionStats() {
+    predictionStats = PredictionStats{0, 0, 0, 0, 0};
+    highPrediction.pending = false;
+    lowPrediction.pending = false;
+}
+
+void getArbitrationStats(ArbitrationStats& stats) {
+    stats = arbitrationStats;
+}
+
+void resetArbitrationStats() {
+    arbitrationStats = ArbitrationStats{0, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0}};
+}
+
+void getBudgetStats(BudgetStats& stats) {
+    refillBudget(getLoopMillis());
+    stats.remaining = budgetTokens;
+    stats.capacity = emissionBudget;
+    stats.denied = budgetDenied;
+    stats.shortened = budgetShortened;
+}
+
+void resetBudgetStats() {
+    budgetDenied = 0;
+    budgetShortened = 0;
+}
+
 unsigned long getLastEmissionTime() {
     return lastEmissionTime;
 }
 
 byte getEmissionState() {
-    return emissionState;
+    return isEmissionActive() ? EMISSION_ACTIVE : EMISSION_IDLE;
 }
 
 byte getLastTriggerSource() {
     return lastTriggerSource;
 }
+
+void captureEmissionState(EmissionSnapshot& snapshot, unsigned long now) {
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        unsigned long elapsed = now - channelStartTime[channel];
+        snapshot.remaining[channel] = (channelState[channel] == EMISSION_ACTIVE && elapsed < channelRunTime[channel])
+                                      ? channelRunTime[channel] - elapsed : 0;
+        snapshot.sinceChannelEmission[channel] = now - channelLastEmissionTime[channel];
+        snapshot.triggerSource[channel] = channelTriggerSource[channel];
+    }
+    snapshot.sinceLastEmission = now - lastEmissionTime;
+    snapshot.chargedChannels = chargedChannels;
+    snapshot.lastTriggerSource = lastTriggerSource;
+}
+
+// Picks emissions back up where a reset cut them off. They were charged to
+// the budget and counted by analytics when they first started, so neither
+// happens again. Returns how many were resumed.
+byte restoreEmissionState(const EmissionSnapshot& snapshot, unsigned long now) {
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        channelLastEmissionTime[channel] = now - snapshot.sinceChannelEmission[channel];
+        if (snapshot.remaining[channel] == 0 || activeChannelCount >= EMISSION_MAX_ACTIVE_CHANNELS) {
+            continue;
+        }
+        debugPrintf(DEBUG_GENERAL, "Resuming emission on channel %d, %lu ms left\n",
+                    channel, (unsigned long)snapshot.remaining[channel]);
+        channelState[channel] = EMISSION_ACTIVE;
+        channelStartTime[channel] = now;
+        channelRunTime[channel] = snapshot.remaining[channel];
+        channelTriggerSource[channel] = snapshot.triggerSource[channel];
+        chargedChannels |= snapshot.chargedChannels & (1 << channel);
+        activeChannelCount++;
+        startEmitter(channel, channelRunTime[channel]);
+    }
+    setLedStatus(LED_STATUS_EMITTING, activeChannelCount > 0);
+    updateEmitterPower();
+    lastEmissionTime = now - snapshot.sinceLastEmission;
+    lastTriggerSource = snapshot.lastTriggerSource;
+    return activeChannelCount;
+}
@@ -15,16 +15,96 @@
 #define TRIGGER_MANUAL 1
 #define TRIGGER_PERIODIC 2
 #define TRIGGER_HEART_RATE 3
+#define TRIGGER_HEART_RATE_PREDICTED 4
+#define TRIGGER_SCHEDULED 5
+#define TRIGGER_RULE 6
+#define TRIGGER_BIT(source) (1 << (source))
+#define TRIGGER_SOURCE_COUNT 6
+
+// Arbitration policies for a trigger that arrives while its channel is
+// already emitting or has an emission pending
+#define TRIGGER_POLICY_MERGE 0   // Absorbed by the emission already running or pending
+#define TRIGGER_POLICY_EXTEND 1  // Restart the duration from now, capped below
+#define TRIGGER_POLICY_QUEUE 2   // Run again once the minimum gap has passed
+#define TRIGGER_POLICY_COUNT 3
+
+// Longest an extended emission may run, as a multiple of its duration
+#define EMISSION_MAX_EXTENSION_FACTOR 3
+
+// Emission budget: shortest emission worth granting from a nearly empty
+// bucket, and how often refills are written back to flash (charges are
+// saved immediately so a restart can't restore spent budget)
+#define EMISSION_MIN_BUDGET_GRANT 1000    // 1 second
+#define EMISSION_BUDGET_SAVE_INTERVAL 600000  // 10 minutes
+
+// Channels allowed to emit at the same time. Each channel has its own pin,
+// cutoff and PWM, so all of them may; lower this to cap the peak current.
+// Further triggers wait in the pending queue ordered by deadline, then
+// channel priority.
+#define EMISSION_MAX_ACTIVE_CHANNELS EMISSION_CHANNEL_COUNT
+#define EMISSION_QUEUE_CAPACITY 8
+
+// Predictive trigger statistics. Lead time is measured from the predictive
+// trigger to the sample where the reactive threshold check would have fired.
+struct PredictionStats {
+    uint32_t predictions;    // Predictive triggers accepted
+    uint32_t confirmed;      // Followed by an actual threshold crossing
+    uint32_t falseAlarms;    // Projection receded without a crossing
+    uint32_t totalLeadTime;  // ms, summed over confirmed predictions
+    uint32_t maxLeadTime;    // ms
+};
+
+// Arbitration decisions, plus how often each source collided with an
+// active or pending emission
+struct ArbitrationStats {
+    uint32_t accepted;   // Queued for an idle channel
+    uint32_t extended;
+    uint32_t queued;     // Queued behind an active emission
+    uint32_t merged;
+    uint32_t dropped;    // Queue full
+    uint16_t collisions[TRIGGER_SOURCE_COUNT];
+};
+
+// Emission budget state; times in ms of emission
+struct BudgetStats {
+    uint32_t remaining;
+    uint32_t capacity;
+    uint32_t denied;     // Emissions refused for lack of budget
+    uint32_t shortened;  // Emissions or extensions cut to the remaining budget
+};
+
+// Emission state carried across a watchdog reset; times are relative to
+// the moment it was captured
+struct EmissionSnapshot {
+    uint32_t remaining[EMISSION_CHANNEL_COUNT];  // ms left of an active emission, 0 when idle
+    uint32_t sinceChannelEmission[EMISSION_CHANNEL_COUNT];
+    uint32_t sinceLastEmission;
+    byte triggerSource[EMISSION_CHANNEL_COUNT];
+    byte chargedChannels;
+    byte lastTriggerSource;
+};
 
 // Function declarations
 void setupEmissionControl();
-void updateEmissionState();
+void updateEmissionState(unsigned long now);
 bool triggerEmission(byte triggerSource);
+bool triggerChannelEmission(byte channel, byte triggerSource);
 bool isEmissionActive();
+bool isChannelActive(byte channel);
 void stopEmission();
+void stopChannelEmission(byte channel);
 void checkHeartRateBasedEmission(byte currentHeartRate);
+void checkPredictiveEmission(byte currentHeartRate);
+void getPredictionStats(PredictionStats& stats);
+void resetPredictionStats();
+void getArbitrationStats(ArbitrationStats& stats);
+void resetArbitrationStats();
+void getBudgetStats(BudgetStats& stats);
+void resetBudgetStats();
 unsigned long getLastEmissionTime();
 byte getEmissionState();
 byte getLastTriggerSource();
+void captureEmissionState(EmissionSnapshot& snapshot, unsigned long now);
+byte restoreEmissionState(const EmissionSnapshot& snapshot, unsigned long now);
 
 #endif // EMISSION_CONTROL_H
@@ -0,0 +1,203 @@
+// emission_schedule.cpp
+#include "emission_schedule.h"
+#include "emission_control.h"
+#include "wall_clock.h"
+
+static ScheduleEntry scheduleEntries[SCHEDULE_CAPACITY];
+static bool entryUsed[SCHEDULE_CAPACITY];
+
+// Every start and window end expanded to minute-of-week and kept sorted,
+// so the next event is a binary search away
+struct ScheduleEvent {
+    uint16_t weekMinute;
+    uint8_t entry;
+    bool windowEnd;
+};
+static ScheduleEvent scheduleEvents[SCHEDULE_CAPACITY * 7 * 2];
+static byte eventCount = 0;
+
+static uint64_t nextEventMillis = 0;
+static byte nextEventIndex = 0;
+static bool nextEventValid = false;
+static byte windowOpenChannels = 0;  // Bit per channel inside a schedule window
+
+#define MINUTES_PER_WEEK (7 * MINUTES_PER_DAY)
+
+static bool isWindow(const ScheduleEntry& entry) {
+    return entry.endMinute != entry.startMinute;
+}
+
+// The window ends on the day after it started
+static bool wrapsMidnight(const ScheduleEntry& entry) {
+    return entry.endMinute < entry.startMinute;
+}
+
+static uint16_t weekMinuteOf(uint64_t wallMillis) {
+    return getWeekday(wallMillis) * MINUTES_PER_DAY + getMinuteOfDay(wallMillis);
+}
+
+// First event strictly after the given minute of the week, wrapping
+static byte findEventAfter(uint16_t weekMinute) {
+    byte low = 0, high = eventCount;
+    while (low < high) {
+        byte middle = (low + high) / 2;
+        if (scheduleEvents[middle].weekMinute <= weekMinute) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void scheduleNextEvent(uint64_t wallMillis) {
+    nextEventValid = false;
+    if (eventCount == 0 || !isWallClockSynced()) {
+        return;
+    }
+
+    uint16_t nowMinute = weekMinuteOf(wallMillis);
+    uint64_t weekStart = (wallMillis / MILLIS_PER_DAY - getWeekday(wallMillis)) * MILLIS_PER_DAY;
+
+    byte index = findEventAfter(nowMinute);
+    if (index == eventCount) {
+        index = 0;
+        weekStart += 7 * MILLIS_PER_DAY;
+    }
+    nextEventIndex = index;
+    nextEventMillis = weekStart + scheduleEvents[index].weekMinute * MILLIS_PER_MINUTE;
+    nextEventValid = true;
+}
+
+// Window state for the current time, derived from the table after a clock
+// sync or a table change
+static void refreshWindowState(uint64_t wallMillis) {
+    windowOpenChannels = 0;
+    if (!isWallClockSynced()) {
+        return;
+    }
+
+    byte weekday = getWeekday(wallMillis);
+    byte yesterday = (weekday + 6) % 7;
+    uint16_t minute = getMinuteOfDay(wallMillis);
+    for (byte i = 0; i < SCHEDULE_CAPACITY; i++) {
+        const ScheduleEntry& entry = scheduleEntries[i];
+        if (!entryUsed[i] || !isWindow(entry)) {
+            continue;
+        }
+        bool startedToday = (entry.weekdays & (1 << weekday)) && minute >= entry.startMinute;
+        bool open = wrapsMidnight(entry)
+            ? startedToday || ((entry.weekdays & (1 << yesterday)) && minute < entry.endMinute)
+            : startedToday && minute < entry.endMinute;
+        if (open) {
+            windowOpenChannels |= (1 << entry.channel);
+        }
+    }
+}
+
+void initEmissionSchedule() {
+    debugPrintln(DEBUG_TIMING, "Initializing emission schedule");
+    clearSchedule();
+}
+
+bool setScheduleEntry(byte index, const ScheduleEntry& entry) {
+    if (index >= SCHEDULE_CAPACITY || entry.startMinute >= MINUTES_PER_DAY ||
+        entry.endMinute > MINUTES_PER_DAY || entry.channel >= EMISSION_CHANNEL_COUNT) {
+        debugPrintf(DEBUG_SETTINGS, "Invalid schedule entry %d\n", index);
+        return false;
+    }
+
+    scheduleEntries[index] = entry;
+    entryUsed[index] = entry.weekdays != 0;
+    debugPrintf(DEBUG_SETTINGS, "Schedule %d: %02d:%02d-%02d:%02d days 0x%02X channel %d\n", index,
+                entry.startMinute / 60, entry.startMinute % 60, entry.endMinute / 60, entry.endMinute % 60,
+                entry.weekdays, entry.channel);
+    rebuildSchedule();
+    return true;
+}
+
+void clearSchedule() {
+    for (byte i = 0; i < SCHEDULE_CAPACITY; i++) {
+        entryUsed[i] = false;
+    }
+    rebuildSchedule();
+}
+
+// Expands the table into the sorted event list; run after any table
+// change or clock sync
+void rebuildSchedule() {
+    eventCount = 0;
+    for (byte i = 0; i < SCHEDULE_CAPACITY; i++) {
+        if (!entryUsed[i]) {
+            continue;
+        }
+        const ScheduleEntry& entry = scheduleEntries[i];
+        for (byte day = 0; day < 7; day++) {
+            if (!(entry.weekdays & (1 << day))) {
+                continue;
+            }
+            scheduleEvents[eventCount++] = {(uint16_t)(day * MINUTES_PER_DAY + entry.startMinute), i, false};
+            if (isWindow(entry)) {
+                byte endDay = wrapsMidnight(entry) ? day + 1 : day;
+                uint16_t endMinute = (endDay * MINUTES_PER_DAY + entry.endMinute) % MINUTES_PER_WEEK;
+                scheduleEvents[eventCount++] = {endMinute, i, true};
+            }
+        }
+    }
+
+    // Insertion sort: the list is small and only rebuilt on changes. Within
+    // a minute, window ends go first, so one window can follow another.
+    for (byte i = 1; i < eventCount; i++) {
+        ScheduleEvent event = scheduleEvents[i];
+        byte j = i;
+        while (j > 0 && (scheduleEvents[j - 1].weekMinute > event.weekMinute ||
+                         (scheduleEvents[j - 1].weekMinute == event.weekMinute &&
+                          !scheduleEvents[j - 1].windowEnd && event.windowEnd))) {
+            scheduleEvents[j] = scheduleEvents[j - 1];
+            j--;
+        }
+        scheduleEvents[j] = event;
+    }
+
+    uint64_t wallMillis = getWallClockMillis();
+    refreshWindowState(wallMillis);
+    scheduleNextEvent(wallMillis);
+}
+
+static void fireEvent(const ScheduleEvent& event) {
+    const ScheduleEntry& entry = scheduleEntries[event.entry];
+    if (event.windowEnd) {
+        windowOpenChannels &= ~(1 << entry.channel);
+        debugPrintf(DEBUG_GENERAL, "Schedule window closed on channel %d\n", entry.channel);
+        return;
+    }
+
+    if (isWindow(entry)) {
+        windowOpenChannels |= (1 << entry.channel);
+    }
+    debugPrintf(DEBUG_GENERAL, "Scheduled emission on channel %d\n", entry.channel);
+    triggerChannelEmission(entry.channel, TRIGGER_SCHEDULED);
+}
+
+// Cheap enough for every loop pass: one comparison until an event is due
+void updateEmissionSchedule() {
+    if (!nextEventValid) {
+        return;
+    }
+
+    uint64_t wallMillis = getWallClockMillis();
+    if (wallMillis < nextEventMillis) {
+        return;
+    }
+
+    // Fire every event sharing this minute, then look up the next one
+    uint16_t weekMinute = scheduleEvents[nextEventIndex].weekMinute;
+    for (byte i = nextEventIndex; i < eventCount && scheduleEvents[i].weekMinute == weekMinute; i++) {
+        fireEvent(scheduleEvents[i]);
+    }
+    scheduleNextEvent(wallMillis);
+}
+
+bool isScheduleWindowOpen(byte channel) {
+    return windowOpenChannels & (1 << channel);
+}
@@ -0,0 +1,36 @@
+// emission_schedule.h
+#ifndef EMISSION_SCHEDULE_H
+#define EMISSION_SCHEDULE_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Time-of-day schedule. Each entry fires a scheduled emission on its
+// channel at its start time on the selected weekdays. An entry with an end
+// time other than its start also keeps the channel's periodic emission
+// running until the end of the window; an end before the start wraps past
+// midnight, like the rule engine's ranges, so 22:00-06:00 selected on
+// Friday runs into Saturday morning.
+#define SCHEDULE_CAPACITY 16
+
+// Schedule entry record: [index][start minute, LE16][end minute, LE16][weekdays][channel]
+// Weekday bit 0 is Monday. Writing index SCHEDULE_CLEAR empties the table.
+#define SCHEDULE_ENTRY_LENGTH 7
+#define SCHEDULE_CLEAR 0xFF
+
+struct ScheduleEntry {
+    uint16_t startMinute;  // Minute of day
+    uint16_t endMinute;    // Equal to startMinute for a single emission, before it to wrap
+    uint8_t weekdays;
+    uint8_t channel;
+};
+
+// Function declarations
+void initEmissionSchedule();
+bool setScheduleEntry(byte index, const ScheduleEntry& entry);
+void clearSchedule();
+void rebuildSchedule();
+void updateEmissionSchedule();
+bool isScheduleWindowOpen(byte channel);
+
+#endif // EMISSION_SCHEDULE_H
@@ -0,0 +1,146 @@
+// emission_timer.cpp
+#include "emission_timer.h"
+
+static EmissionTimingStats timingStats = {0, 0, 0, 0, 0};
+
+#if EMISSION_TIMER_HARDWARE
+
+static uint32_t durationToTicks(unsigned long duration) {
+    // 31.25 ticks per ms, kept exact with integer math
+    return (uint32_t)((duration * 125ULL) / 4);
+}
+
+void initEmissionTimer() {
+    debugPrintln(DEBUG_TIMING, "Initializing hardware emission timer");
+    CUTOFF_TIMER->TASKS_STOP = 1;
+    CUTOFF_TIMER->MODE = TIMER_MODE_MODE_Timer;
+    CUTOFF_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    CUTOFF_TIMER->PRESCALER = CUTOFF_TIMER_PRESCALER;
+    CUTOFF_TIMER->TASKS_CLEAR = 1;
+    CUTOFF_TIMER->TASKS_START = 1;
+}
+
+static void armCompare(byte channel, unsigned long duration) {
+    CUTOFF_TIMER->TASKS_CAPTURE[CUTOFF_CAPTURE_CC] = 1;
+    uint32_t now = CUTOFF_TIMER->CC[CUTOFF_CAPTURE_CC];
+    CUTOFF_TIMER->EVENTS_COMPARE[channel] = 0;
+    CUTOFF_TIMER->CC[channel] = now + durationToTicks(duration);
+}
+
+void armEmissionCutoff(byte channel, byte pin, unsigned long duration) {
+    uint32_t gpioteChannel = CUTOFF_GPIOTE_BASE + channel;
+    uint32_t ppiChannel = CUTOFF_PPI_BASE + channel;
+    uint32_t pinNumber = digitalPinToPinName(pin);
+
+    armCompare(channel, duration);
+
+    // Task mode takes the pin over from the GPIO latch; OUTINIT low turns
+    // the (active-low) emitter on and the OUT task drives it high again
+    NRF_GPIOTE->CONFIG[gpioteChannel] =
+        (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+        ((pinNumber & 0x1F) << GPIOTE_CONFIG_PSEL_Pos) |
+        ((pinNumber >> 5) << GPIOTE_CONFIG_PORT_Pos) |
+        (GPIOTE_CONFIG_POLARITY_LoToHi << GPIOTE_CONFIG_POLARITY_Pos) |
+        (GPIOTE_CONFIG_OUTINIT_Low << GPIOTE_CONFIG_OUTINIT_Pos);
+
+    NRF_PPI->CH[ppiChannel].EEP = (uint32_t)&CUTOFF_TIMER->EVENTS_COMPARE[channel];
+    NRF_PPI->CH[ppiChannel].TEP = (uint32_t)&NRF_GPIOTE->TASKS_OUT[gpioteChannel];
+    NRF_PPI->FORK[ppiChannel].TEP = 0;
+    NRF_PPI->CHENSET = (1UL << ppiChannel);
+}
+
+void armEmissionCutoffTask(byte channel, unsigned long duration, uint32_t task, uint32_t forkTask) {
+    uint32_t ppiChannel = CUTOFF_PPI_BASE + channel;
+
+    armCompare(channel, duration);
+
+    NRF_PPI->CH[ppiChannel].EEP = (uint32_t)&CUTOFF_TIMER->EVENTS_COMPARE[channel];
+    NRF_PPI->CH[ppiChannel].TEP = task;
+    NRF_PPI->FORK[ppiChannel].TEP = forkTask;
+    NRF_PPI->CHENSET = (1UL << ppiChannel);
+}
+
+// Moves the cutoff of a running emission; the PPI routing stays as armed
+void rearmEmissionCutoff(byte channel, unsigned long duration) {
+    armCompare(channel, duration);
+}
+
+bool hasEmissionCutoffFired(byte channel) {
+    return CUTOFF_TIMER->EVENTS_COMPARE[channel] != 0;
+}
+
+void releaseEmissionCutoff(byte channel) {
+    uint32_t gpioteChannel = CUTOFF_GPIOTE_BASE + channel;
+    uint32_t ppiChannel = CUTOFF_PPI_BASE + channel;
+
+    if (CUTOFF_TIMER->EVENTS_COMPARE[channel]) {
+        timingStats.hardwareCutoffs++;
+    }
+
+    // The caller has already latched the pin off, so handing it back to
+    // the GPIO peripheral doesn't glitch the emitter
+    NRF_PPI->CHENCLR = (1UL << ppiChannel);
+    NRF_PPI->FORK[ppiChannel].TEP = 0;
+    NRF_GPIOTE->CONFIG[gpioteChannel] = 0;
+    CUTOFF_TIMER->EVENTS_COMPARE[channel] = 0;
+}
+
+// The compare turned the emitter off on its tick; if it never fired, the
+// loop did. Must run before releaseEmissionCutoff(), which clears the event.
+static unsigned long measureOvershoot(byte channel, unsigned long lateness) {
+    return CUTOFF_TIMER->EVENTS_COMPARE[channel] ? 0 : lateness;
+}
+
+#else
+
+// Simulated timer: the cutoff is whenever the loop notices the deadline
+
+void initEmissionTimer() {
+    debugPrintln(DEBUG_TIMING, "Initializing simulated emission timer");
+}
+
+void armEmissionCutoff(byte channel, byte pin, unsigned long duration) {
+}
+
+void armEmissionCutoffTask(byte channel, unsigned long duration, uint32_t task, uint32_t forkTask) {
+}
+
+void rearmEmissionCutoff(byte channel, unsigned long duration) {
+}
+
+bool hasEmissionCutoffFired(byte channel) {
+    return false;
+}
+
+void releaseEmissionCutoff(byte channel) {
+}
+
+// The emitter stays on until the loop turns it off
+static unsigned long measureOvershoot(byte channel, unsigned long lateness) {
+    return lateness;
+}
+
+#endif
+
+// Called when the loop ends an emission that ran its full duration
+void recordEmissionCutoff(byte channel, unsigned long elapsed, unsigned long duration) {
+    unsigned long lateness = elapsed - duration;
+    unsigned long overshoot = measureOvershoot(channel, lateness);
+
+    timingStats.emissions++;
+    timingStats.totalOvershoot += overshoot;
+    if (overshoot > timingStats.maxOvershoot) {
+        timingStats.maxOvershoot = overshoot;
+    }
+    if (lateness > timingStats.maxLoopLateness) {
+        timingStats.maxLoopLateness = lateness;
+    }
+}
+
+void getEmissionTimingStats(EmissionTimingStats& stats) {
+    stats = timingStats;
+}
+
+void resetEmissionTimingStats() {
+    timingStats = EmissionTimingStats{0, 0, 0, 0, 0};
+}
@@ -0,0 +1,50 @@
+// emission_timer.h
+#ifndef EMISSION_TIMER_H
+#define EMISSION_TIMER_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// On the nRF52840 each emission channel's cutoff is a TIMER4 compare event
+// routed through PPI to a GPIOTE task on the emitter pin, so the emitter
+// turns off on the exact tick regardless of loop latency. Other targets use
+// a simulated timer that is only checked when the loop polls it. Channels
+// driven by a PWM profile route the compare event to their own task
+// (the decay tail) instead of the GPIOTE pin task.
+#if defined(NRF52840_XXAA)
+#define EMISSION_TIMER_HARDWARE 1
+#define CUTOFF_TIMER NRF_TIMER4
+#define CUTOFF_TIMER_PRESCALER 9   // 16 MHz / 2^9 = 31.25 kHz, 32 us ticks
+#define CUTOFF_CAPTURE_CC 5        // Compare register used to read the counter
+#define CUTOFF_GPIOTE_BASE 6       // GPIOTE channels 6.. (one per emission channel)
+#define CUTOFF_PPI_BASE 16         // PPI channels 16.. (one per emission channel)
+#else
+#define EMISSION_TIMER_HARDWARE 0
+#endif
+
+// Emission timing accuracy. Overshoot is how long the emitter stayed on
+// past the requested duration; loop lateness is how long after the cutoff
+// the loop noticed it (with the hardware timer this no longer stretches
+// the emission). A compare event switches the emitter off on its tick, so
+// on hardware only a cutoff whose compare never fired overshoots, by the
+// loop's lateness.
+struct EmissionTimingStats {
+    uint32_t emissions;          // Emissions that ran to their full duration
+    uint32_t hardwareCutoffs;    // Ended by the compare event
+    uint32_t totalOvershoot;     // ms
+    uint32_t maxOvershoot;       // ms
+    uint32_t maxLoopLateness;    // ms
+};
+
+// Function declarations
+void initEmissionTimer();
+void armEmissionCutoff(byte channel, byte pin, unsigned long duration);
+void armEmissionCutoffTask(byte channel, unsigned long duration, uint32_t task, uint32_t forkTask);
+void rearmEmissionCutoff(byte channel, unsigned long duration);
+bool hasEmissionCutoffFired(byte channel);
+void releaseEmissionCutoff(byte channel);
+void recordEmissionCutoff(byte channel, unsigned long elapsed, unsigned long duration);
+void getEmissionTimingStats(EmissionTimingStats& stats);
+void resetEmissionTimingStats();
+
+#endif // EMISSION_TIMER_H
@@ -0,0 +1,214 @@
+// emitter_pwm.cpp
+#include "emitter_pwm.h"
+#include "settings.h"
+#include "led_control.h"
+#include "emission_timer.h"
+#include "energy_model.h"
+
+// Stored profiles
+static constexpr uint8_t SOFT_START_LEVELS[] = {
+    5, 10, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60,
+    65, 70, 75, 80, 85, 90, 95, 100
+};
+static constexpr uint8_t PULSE_LEVELS[] = {
+    40, 50, 60, 70, 80, 90, 100, 100,
+    90, 80, 70, 60, 50, 40, 40, 40
+};
+static constexpr uint8_t DECAY_LEVELS[] = {
+    90, 80, 70, 60, 50, 42, 35, 28, 22, 17, 12, 8, 5, 3, 1, 0
+};
+static constexpr uint8_t SOLID_LEVELS[] = {100};
+
+static constexpr IntensityProfile PROFILES[PROFILE_COUNT] = {
+    {SOLID_LEVELS, sizeof(SOLID_LEVELS), 1, false},
+    {SOFT_START_LEVELS, sizeof(SOFT_START_LEVELS), 25, false},  // 500 ms ramp
+    {PULSE_LEVELS, sizeof(PULSE_LEVELS), 60, true},             // ~1 s period
+};
+static constexpr IntensityProfile DECAY_TAIL = {DECAY_LEVELS, sizeof(DECAY_LEVELS), 50, false};  // 800 ms
+
+static_assert(sizeof(SOFT_START_LEVELS) <= PROFILE_MAX_STEPS, "Soft start profile too long");
+static_assert(sizeof(PULSE_LEVELS) <= PROFILE_MAX_STEPS, "Pulse profile too long");
+static_assert(sizeof(DECAY_LEVELS) <= PROFILE_MAX_STEPS, "Decay tail too long");
+
+unsigned long getDecayTailLength() {
+    return (unsigned long)DECAY_TAIL.stepCount * DECAY_TAIL.stepTime;
+}
+
+// Average duty of the channel's emission for the energy model, in
+// thousandths of fully on: a looping profile averages over its steps, a
+// ramp is short next to an emission and counts at the level it holds
+uint16_t getEmitterPowerLevel(byte channel) {
+    const IntensityProfile& profile = PROFILES[emissionProfile[channel] < PROFILE_COUNT ? emissionProfile[channel] : PROFILE_SOLID];
+    uint32_t percent;
+    if (profile.loop) {
+        uint32_t sum = 0;
+        for (byte i = 0; i < profile.stepCount; i++) {
+            sum += profile.levels[i];
+        }
+        percent = sum / profile.stepCount;
+    } else {
+        percent = profile.levels[profile.stepCount - 1];
+    }
+    return (uint16_t)(percent * emissionIntensity[channel] * POWER_LEVEL_FULL / 10000);
+}
+
+#if EMITTER_PWM_HARDWARE
+
+// One PWM instance per emission channel
+static NRF_PWM_Type* const EMITTER_PWM[EMISSION_CHANNEL_COUNT] = {NRF_PWM2, NRF_PWM3};
+
+// EasyDMA reads sequences from RAM, so profiles are expanded into these
+// buffers (scaled to the channel intensity) before playback
+static uint16_t profileBuffer[EMISSION_CHANNEL_COUNT][PROFILE_MAX_STEPS];
+static uint16_t decayBuffer[EMISSION_CHANNEL_COUNT][PROFILE_MAX_STEPS];
+static bool pwmActive[EMISSION_CHANNEL_COUNT];
+
+// Bit 15 clear selects a rising first edge: the output starts each period
+// low and rises at the compare value, so the active-low emitter is on for
+// the first `value` counts. Setting it (falling edge) would invert the duty.
+static const uint16_t PWM_POLARITY_RISING_EDGE = 0x0000;
+
+static void fillSequence(uint16_t* buffer, const IntensityProfile& profile, byte intensity) {
+    for (byte i = 0; i < profile.stepCount; i++) {
+        uint32_t value = (uint32_t)profile.levels[i] * intensity * EMITTER_PWM_TOP / 10000;
+        buffer[i] = (uint16_t)value | PWM_POLARITY_RISING_EDGE;
+    }
+}
+
+void initEmitterPwm() {
+    debugPrintln(DEBUG_LED, "Initializing emitter PWM");
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        pwmActive[channel] = false;
+    }
+}
+
+static void startPwmProfile(byte channel, const IntensityProfile& profile, unsigned long duration) {
+    NRF_PWM_Type* pwm = EMITTER_PWM[channel];
+    uint32_t pinNumber = digitalPinToPinName(getEmitterPin(channel));
+    byte intensity = emissionIntensity[channel];
+
+    fillSequence(profileBuffer[channel], profile, intensity);
+    fillSequence(decayBuffer[channel], DECAY_TAIL, intensity);
+
+    pwm->PSEL.OUT[0] = ((pinNumber & 0x1F) << PWM_PSEL_OUT_PIN_Pos) | ((pinNumber >> 5) << PWM_PSEL_OUT_PORT_Pos);
+    pwm->MODE = PWM_MODE_UPDOWN_Up;
+    pwm->PRESCALER = PWM_PRESCALER_PRESCALER_DIV_16;
+    pwm->COUNTERTOP = EMITTER_PWM_TOP;
+    pwm->DECODER = (PWM_DECODER_LOAD_Common << PWM_DECODER_LOAD_Pos) | (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
+    pwm->LOOP = 0;
+
+    // REFRESH counts extra periods per step; one period is 1 ms
+    pwm->SEQ[0].PTR = (uint32_t)profileBuffer[channel];
+    pwm->SEQ[0].CNT = profile.stepCount;
+    pwm->SEQ[0].REFRESH = profile.stepTime - 1;
+    pwm->SEQ[0].ENDDELAY = 0;
+    pwm->SEQ[1].PTR = (uint32_t)decayBuffer[channel];
+    pwm->SEQ[1].CNT = DECAY_TAIL.stepCount;
+    pwm->SEQ[1].REFRESH = DECAY_TAIL.stepTime - 1;
+    pwm->SEQ[1].ENDDELAY = 0;
+
+    // Once the decay tail ends the peripheral stops with the emitter off;
+    // a finished one-shot profile keeps playing its last level
+    pwm->SHORTS = PWM_SHORTS_SEQEND1_STOP_Msk;
+    pwm->EVENTS_SEQEND[0] = 0;
+    pwm->EVENTS_SEQEND[1] = 0;
+    pwm->EVENTS_STOPPED = 0;
+
+    // Looping profiles restart themselves over PPI. The channel sits in a
+    // group that the cutoff disables as it starts the decay tail.
+    uint32_t loopChannel = EMITTER_PWM_LOOP_PPI_BASE + channel;
+    uint32_t group = EMITTER_PWM_PPI_GROUP_BASE + channel;
+    uint32_t forkTask = 0;
+    if (profile.loop) {
+        NRF_PPI->CH[loopChannel].EEP = (uint32_t)&pwm->EVENTS_SEQEND[0];
+        NRF_PPI->CH[loopChannel].TEP = (uint32_t)&pwm->TASKS_SEQSTART[0];
+        NRF_PPI->CHG[group] = (1UL << loopChannel);
+        NRF_PPI->TASKS_CHG[group].EN = 1;
+        forkTask = (uint32_t)&NRF_PPI->TASKS_CHG[group].DIS;
+    } else {
+        NRF_PPI->CHENCLR = (1UL << loopChannel);
+    }
+
+    // The tail is part of the emission, so it starts before the deadline
+    unsigned long tailLength = getDecayTailLength();
+    unsigned long decayStart = (duration > tailLength) ? duration - tailLength : 1;
+    armEmissionCutoffTask(channel, decayStart, (uint32_t)&pwm->TASKS_SEQSTART[1], forkTask);
+
+    pwm->ENABLE = PWM_ENABLE_ENABLE_Enabled;
+    pwm->TASKS_SEQSTART[0] = 1;
+    pwmActive[channel] = true;
+}
+
+static void stopPwmProfile(byte channel) {
+    NRF_PWM_Type* pwm = EMITTER_PWM[channel];
+
+    NRF_PPI->TASKS_CHG[EMITTER_PWM_PPI_GROUP_BASE + channel].DIS = 1;
+    pwm->TASKS_STOP = 1;
+    pwm->ENABLE = 0;
+    pwm->PSEL.OUT[0] = PWM_PSEL_OUT_CONNECT_Msk;  // Disconnected
+    pwmActive[channel] = false;
+}
+
+void startEmitter(byte channel, unsigned long duration) {
+    byte profile = emissionProfile[channel];
+    if (profile == PROFILE_SOLID || profile >= PROFILE_COUNT) {
+        setEmitterOutput(channel, true);
+        armEmissionCutoff(channel, getEmitterPin(channel), duration);
+        return;
+    }
+
+    // The GPIO latch isn't touched here: the PWM takes the pin without a
+    // full-on glitch before the first ramp step
+    debugPrintf(DEBUG_LED, "Emitter %d playing profile %d at %d%%\n", channel, profile, emissionIntensity[channel]);
+    startPwmProfile(channel, PROFILES[profile], duration);
+}
+
+// Pushes the cutoff of a running emission out to `remaining` ms from now.
+// If the cutoff already fired (the emitter is off or decaying) the
+// emission is started again for the remaining time.
+void extendEmitter(byte channel, unsigned long remaining) {
+    if (hasEmissionCutoffFired(channel)) {
+        startEmitter(channel, remaining);
+        return;
+    }
+
+    if (pwmActive[channel]) {
+        unsigned long tailLength = getDecayTailLength();
+        rearmEmissionCutoff(channel, (remaining > tailLength) ? remaining - tailLength : 1);
+    } else {
+        rearmEmissionCutoff(channel, remaining);
+    }
+}
+
+void stopEmitter(byte channel) {
+    // Latch the pin off first so releasing the peripheral can't glitch it
+    setEmitterOutput(channel, false);
+    if (pwmActive[channel]) {
+        stopPwmProfile(channel);
+    }
+    releaseEmissionCutoff(channel);
+}
+
+#else
+
+// Without a PWM peripheral the emitter is simply switched on and off
+
+void initEmitterPwm() {
+    debugPrintln(DEBUG_LED, "Emitter PWM not available, using on/off output");
+}
+
+void startEmitter(byte channel, unsigned long duration) {
+    setEmitterOutput(channel, true);
+    armEmissionCutoff(channel, getEmitterPin(channel), duration);
+}
+
+void stopEmitter(byte channel) {
+    setEmitterOutput(channel, false);
+    releaseEmissionCutoff(channel);
+}
+
+void extendEmitter(byte channel, unsigned long remaining) {
+    rearmEmissionCutoff(channel, remaining);
+}
+
+#endif
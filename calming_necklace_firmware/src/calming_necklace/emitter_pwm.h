@@ -0,0 +1,47 @@
+// emitter_pwm.h
+#ifndef EMITTER_PWM_H
+#define EMITTER_PWM_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Intensity profiles
+#define PROFILE_SOLID 0       // Fully on, same as the original on/off output
+#define PROFILE_SOFT_START 1  // Ramp up, then hold
+#define PROFILE_PULSE 2       // Repeating swell between a low and high level
+#define PROFILE_COUNT 3
+
+// Longest stored profile, in steps
+#define PROFILE_MAX_STEPS 24
+
+// On the nRF52840 profiles play from RAM through the PWM peripheral's
+// EasyDMA sequences: sequence 0 is the profile, sequence 1 the decay tail.
+// The emission timer's compare event starts the decay tail, so the whole
+// emission runs without the CPU touching the duty cycle.
+#if defined(NRF52840_XXAA)
+#define EMITTER_PWM_HARDWARE 1
+#define EMITTER_PWM_TOP 1000            // 1 MHz clock / 1000 = 1 kHz PWM
+#define EMITTER_PWM_LOOP_PPI_BASE 14    // PPI channels 14.. restart looping profiles
+#define EMITTER_PWM_PPI_GROUP_BASE 4    // PPI groups 4.. hold the loop channels
+#else
+#define EMITTER_PWM_HARDWARE 0
+#endif
+
+// Profile definition. Levels are percent of the channel's intensity
+// setting; each step lasts stepTime ms.
+struct IntensityProfile {
+    const uint8_t* levels;
+    uint8_t stepCount;
+    uint8_t stepTime;
+    bool loop;
+};
+
+// Function declarations
+void initEmitterPwm();
+void startEmitter(byte channel, unsigned long duration);
+void stopEmitter(byte channel);
+void extendEmitter(byte channel, unsigned long remaining);
+unsigned long getDecayTailLength();
+uint16_t getEmitterPowerLevel(byte channel);
+
+#endif // EMITTER_PWM_H
@@ -0,0 +1,99 @@
+// energy_model.cpp
+#include "energy_model.h"
+#include "time_service.h"
+
+// Default draw per component at full level, in uA. Rough figures for the
+// Nano 33 BLE with a small fan; the app can replace them.
+static uint32_t powerCoefficient[POWER_COMPONENT_COUNT] = {
+    3500,   // POWER_CPU: nRF52840 running from flash, plus the board
+    600,    // POWER_ADVERTISING: averaged over the advertising interval
+    400,    // POWER_CONNECTED: averaged over connection events, LED included
+    80000,  // POWER_EMITTER
+    2000,   // POWER_LED
+};
+
+static uint16_t powerLevel[POWER_COMPONENT_COUNT];
+static uint64_t levelTime[POWER_COMPONENT_COUNT];  // Level x us
+static uint64_t lastUpdateMicros = 0;
+static uint64_t accountingStart = 0;
+static unsigned long lastReportTime = 0;
+
+// Charges every component for the time since the last update
+static void accumulate() {
+    uint64_t now = getLoopMicros();
+    uint64_t elapsed = now - lastUpdateMicros;
+    lastUpdateMicros = now;
+    for (byte component = 0; component < POWER_COMPONENT_COUNT; component++) {
+        levelTime[component] += (uint64_t)powerLevel[component] * elapsed;
+    }
+}
+
+void resetEnergyStats() {
+    accumulate();
+    for (byte component = 0; component < POWER_COMPONENT_COUNT; component++) {
+        levelTime[component] = 0;
+    }
+    accountingStart = lastUpdateMicros;
+}
+
+void initEnergyModel() {
+    for (byte component = 0; component < POWER_COMPONENT_COUNT; component++) {
+        powerLevel[component] = 0;
+    }
+    // The loop never sleeps, so the CPU is always active
+    powerLevel[POWER_CPU] = POWER_LEVEL_FULL;
+    lastUpdateMicros = getLoopMicros();
+    lastReportTime = getLoopMillis();
+    resetEnergyStats();
+}
+
+void setPowerLevel(byte component, uint16_t level) {
+    if (component >= POWER_COMPONENT_COUNT || powerLevel[component] == level) {
+        return;
+    }
+    accumulate();
+    powerLevel[component] = level;
+}
+
+bool setPowerCoefficient(byte component, uint32_t current) {
+    if (component >= POWER_COMPONENT_COUNT) {
+        debugPrintf(DEBUG_SETTINGS, "Invalid power component: %d\n", component);
+        return false;
+    }
+    powerCoefficient[component] = current;
+    debugPrintf(DEBUG_SETTINGS, "Power component %d: %lu uA\n", component, (unsigned long)current);
+    return true;
+}
+
+void getEnergyStats(EnergyStats& stats) {
+    accumulate();
+    uint64_t elapsed = lastUpdateMicros - accountingStart;
+    stats.elapsed = (uint32_t)(elapsed / 1000000);
+
+    // Average level first; level x time x current would overflow 64 bits
+    // within days for the emitters
+    uint32_t totalCurrent = 0;
+    for (byte component = 0; component < POWER_COMPONENT_COUNT; component++) {
+        float averageLevel = elapsed == 0 ? 0.0f : (float)levelTime[component] / (float)elapsed;
+        uint32_t current = (uint32_t)(averageLevel * powerCoefficient[component] / POWER_LEVEL_FULL);
+        stats.averageCurrent[component] = current;
+        totalCurrent += current;
+    }
+    // uA x 24 h = uAh per day; report in 0.01 mAh
+    stats.chargePerDay = totalCurrent * 24 / 10;
+}
+
+void updateEnergyModel(unsigned long now) {
+    if (now - lastReportTime < ENERGY_REPORT_INTERVAL) {
+        return;
+    }
+    lastReportTime = now;
+
+    EnergyStats stats;
+    getEnergyStats(stats);
+    debugPrintf(DEBUG_POWER, "Energy: %lu.%02lu mAh/day over %lu s (CPU %lu uA, radio %lu uA, emitters %lu uA, LEDs %lu uA)\n",
+                (unsigned long)(stats.chargePerDay / 100), (unsigned long)(stats.chargePerDay % 100), (unsigned long)stats.elapsed,
+                (unsigned long)stats.averageCurrent[POWER_CPU],
+                (unsigned long)(stats.averageCurrent[POWER_ADVERTISING] + stats.averageCurrent[POWER_CONNECTED]),
+                (unsigned long)stats.averageCurrent[POWER_EMITTER], (unsigned long)stats.averageCurrent[POWER_LED]);
+}
@@ -0,0 +1,48 @@
+// energy_model.h
+#ifndef ENERGY_MODEL_H
+#define ENERGY_MODEL_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Estimated energy use. Each power-relevant component reports its current
+// level (in thousandths of its full draw, so two emitters fully on are 2000
+// and an LED breathing at 30% average brightness is 300); the model integrates
+// level over time and weights it with a configurable current coefficient
+// to estimate the average draw and charge used per day.
+//
+// The loop never sleeps, so the estimate counts the CPU as active all the
+// time; it only compares settings that change the other components.
+#define POWER_CPU 0
+#define POWER_ADVERTISING 1
+#define POWER_CONNECTED 2     // Includes the connection LED
+#define POWER_EMITTER 3       // Per active emitter at full duty
+#define POWER_LED 4           // Per fully lit status LED
+#define POWER_COMPONENT_COUNT 5
+
+#define POWER_LEVEL_FULL 1000
+
+// Logged under DEBUG_POWER this often
+#define ENERGY_REPORT_INTERVAL 3600000  // 1 hour
+
+// Energy config record: [component][current uA, LE32]. Writing component
+// ENERGY_RESET clears the accumulated times.
+#define ENERGY_CONFIG_LENGTH 5
+#define ENERGY_RESET 0xFF
+
+// Estimate since the last reset
+struct EnergyStats {
+    uint32_t elapsed;         // s
+    uint32_t chargePerDay;    // 0.01 mAh per day at the average draw
+    uint32_t averageCurrent[POWER_COMPONENT_COUNT];  // uA
+};
+
+// Function declarations
+void initEnergyModel();
+void setPowerLevel(byte component, uint16_t level);
+bool setPowerCoefficient(byte component, uint32_t current);
+void getEnergyStats(EnergyStats& stats);
+void resetEnergyStats();
+void updateEnergyModel(unsigned long now);
+
+#endif // ENERGY_MODEL_H
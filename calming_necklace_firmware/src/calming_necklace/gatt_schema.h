@@ -0,0 +1,93 @@
+// gatt_schema.h
+// Generated by tools/generate_gatt.py from tools/gatt_schema.json;
+// edit the schema and regenerate instead of changing this file.
+#ifndef GATT_SCHEMA_H
+#define GATT_SCHEMA_H
+
+#include <ArduinoBLE.h>
+
+// One custom service holds every characteristic
+#define GATT_SERVICE_UUID "19B10000-E8F2-537E-4F6C-D104768A1214"
+
+// Characteristics, indexing GATT_CHARACTERISTICS
+#define GATT_SWITCH                    0
+#define GATT_KEEPALIVE                 1
+#define GATT_EMISSION                  2
+#define GATT_INTERVAL                  3
+#define GATT_PERIODIC                  4
+#define GATT_HEART_RATE                5
+#define GATT_HEART_RATE_ENABLED        6
+#define GATT_HIGH_HEART_RATE_THRESHOLD 7
+#define GATT_LOW_HEART_RATE_THRESHOLD  8
+#define GATT_PREDICTIVE_ENABLED        9
+#define GATT_PREDICTION_HORIZON        10
+#define GATT_PREDICTION_HYSTERESIS     11
+#define GATT_DIAGNOSTICS               12
+#define GATT_HEART_RATE_MIN_INTERVAL   13
+#define GATT_HEART_RATE_MAX_INTERVAL   14
+#define GATT_CHANNEL_CONFIG            15
+#define GATT_ARBITRATION_CONFIG        16
+#define GATT_BUDGET_CONFIG             17
+#define GATT_CURRENT_TIME              18
+#define GATT_SCHEDULE                  19
+#define GATT_RULE                      20
+#define GATT_ANALYTICS                 21
+#define GATT_ADAPTIVE_CONFIG           22
+#define GATT_ENERGY_CONFIG             23
+#define GATT_DFU_CONTROL               24
+#define GATT_DFU_DATA                  25
+#define GATT_POWER_POLICY              26
+#define GATT_CHARACTERISTIC_COUNT 27
+
+struct GattCharacteristicInfo {
+    const char* uuid;
+    uint8_t properties;
+};
+
+constexpr GattCharacteristicInfo GATT_CHARACTERISTICS[] = {
+    {"19B10001-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLEWriteWithoutResponse},  // switch: Emission commands (CMD_*)
+    {"19B10014-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // keepalive: Optional heartbeat, counts as activity
+    {"19B10015-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify},  // emission: Channel 0 emission duration, ms
+    {"19B10016-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify},  // interval: Channel 0 release interval, ms
+    {"19B10017-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify},  // periodic: Channel 0 periodic emission enabled
+    {"19B10018-E8F2-537E-4F6C-D104768A1214", BLERead | BLENotify},  // heart_rate: Current heart rate, BPM
+    {"19B10002-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // heart_rate_enabled: Heart rate based release enabled
+    {"19B10003-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // high_heart_rate_threshold: High heart rate threshold, BPM
+    {"19B10004-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // low_heart_rate_threshold: Low heart rate threshold, BPM
+    {"19B10005-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // predictive_enabled: Predictive release enabled
+    {"19B10006-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // prediction_horizon: Prediction horizon, seconds
+    {"19B10007-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // prediction_hysteresis: Prediction hysteresis, BPM
+    {"19B10008-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify},  // diagnostics: Write a page id, the page comes back as [page][payload]
+    {"19B10009-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // heart_rate_min_interval: Shortest heart rate sampling interval, seconds
+    {"19B1000A-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // heart_rate_max_interval: Longest heart rate sampling interval, seconds
+    {"19B1000B-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // channel_config: Channel config record
+    {"19B1000C-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // arbitration_config: Arbitration record
+    {"19B1000D-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // budget_config: Budget record
+    {"19B1000E-E8F2-537E-4F6C-D104768A1214", BLEWrite},  // current_time: Current Time Service format
+    {"19B1000F-E8F2-537E-4F6C-D104768A1214", BLEWrite},  // schedule: Schedule entry
+    {"19B10010-E8F2-537E-4F6C-D104768A1214", BLEWrite},  // rule: Trigger rule record
+    {"19B10011-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite | BLENotify},  // analytics: Effectiveness per trigger source, write to reset
+    {"19B10012-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // adaptive_config: Adaptive duration record
+    {"19B10013-E8F2-537E-4F6C-D104768A1214", BLEWrite},  // energy_config: Energy coefficient record
+    {"19B10019-E8F2-537E-4F6C-D104768A1214", BLEWrite | BLENotify},  // dfu_control: Firmware update commands and receipts (DFU_CMD_*)
+    {"19B1001A-E8F2-537E-4F6C-D104768A1214", BLEWriteWithoutResponse},  // dfu_data: Firmware update stream chunks
+    {"19B1001B-E8F2-537E-4F6C-D104768A1214", BLERead | BLEWrite},  // power_policy: Power policy thresholds: [reduced %][low %][critical %]
+};
+static_assert(sizeof(GATT_CHARACTERISTICS) / sizeof(GATT_CHARACTERISTICS[0]) == GATT_CHARACTERISTIC_COUNT,
+              "GATT table out of step with its indexes");
+
+#define GATT_UUID(characteristic) (GATT_CHARACTERISTICS[characteristic].uuid)
+#define GATT_PROPERTIES(characteristic) (GATT_CHARACTERISTICS[characteristic].properties)
+
+// Attribute table entries for the service: its declaration, then a
+// declaration and a value per characteristic and a CCCD for each one
+// that notifies
+constexpr uint16_t gattAttributeCount() {
+    uint16_t count = 1;
+    for (const GattCharacteristicInfo& characteristic : GATT_CHARACTERISTICS) {
+        count += (characteristic.properties & (BLENotify | BLEIndicate)) ? 3 : 2;
+    }
+    return count;
+}
+
+#endif // GATT_SCHEMA_H
@@ -0,0 +1,100 @@
+// gpio_hal.cpp
+#include "gpio_hal.h"
+
+#if GPIO_HAL_HARDWARE
+
+// Transitions aren't recorded on hardware
+byte getGpioTraceCount() {
+    return 0;
+}
+
+bool getGpioTransition(byte index, GpioTransition& transition) {
+    (void)index;
+    (void)transition;
+    return false;
+}
+
+void clearGpioTrace() {
+}
+
+#else
+
+static uint32_t portOut = 0;
+static uint32_t portDir = 0;
+
+// Oldest transitions are overwritten once the trace is full
+static GpioTransition trace[GPIO_TRACE_CAPACITY];
+static byte traceNext = 0;
+static byte traceCount = 0;
+
+// Applies a new port value: records what changed, then mirrors each
+// changed output pin onto the real pin
+static void updatePort(uint32_t value) {
+    uint32_t changed = (value ^ portOut) & portDir;
+    portOut = value;
+    if (changed == 0) {
+        return;
+    }
+
+    GpioTransition& transition = trace[traceNext];
+    transition.time = micros();
+    transition.raised = changed & value;
+    transition.lowered = changed & ~value;
+    traceNext = (traceNext + 1) % GPIO_TRACE_CAPACITY;
+    if (traceCount < GPIO_TRACE_CAPACITY) {
+        traceCount++;
+    }
+
+    for (byte pin = 0; pin < 32; pin++) {
+        if (changed & (1UL << pin)) {
+            digitalWrite(pin, (value & (1UL << pin)) ? HIGH : LOW);
+        }
+    }
+}
+
+void gpioConfigureOutputs(uint32_t mask) {
+    for (byte pin = 0; pin < 32; pin++) {
+        if ((mask & ~portDir) & (1UL << pin)) {
+            pinMode(pin, OUTPUT);
+            digitalWrite(pin, (portOut & (1UL << pin)) ? HIGH : LOW);
+        }
+    }
+    portDir |= mask;
+}
+
+void gpioSet(uint32_t mask) {
+    updatePort(portOut | mask);
+}
+
+void gpioClear(uint32_t mask) {
+    updatePort(portOut & ~mask);
+}
+
+void gpioWrite(uint32_t mask, uint32_t high) {
+    updatePort((portOut & ~mask) | (high & mask));
+}
+
+uint32_t gpioRead() {
+    return portOut;
+}
+
+byte getGpioTraceCount() {
+    return traceCount;
+}
+
+// Index 0 is the oldest recorded transition
+bool getGpioTransition(byte index, GpioTransition& transition) {
+    if (index >= traceCount) {
+        return false;
+    }
+    byte oldest = (traceNext + GPIO_TRACE_CAPACITY - traceCount) % GPIO_TRACE_CAPACITY;
+    transition = trace[(oldest + index) % GPIO_TRACE_CAPACITY];
+    return true;
+}
+
+void clearGpioTrace() {
+    traceNext = 0;
+    traceCount = 0;
+}
+
+#endif
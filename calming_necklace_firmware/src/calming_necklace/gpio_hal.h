@@ -0,0 +1,137 @@
+// gpio_hal.h
+#ifndef GPIO_HAL_H
+#define GPIO_HAL_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Thin GPIO layer for the board's LEDs and emitter outputs. Pins are
+// resolved to port bit masks at compile time, so changing any set of pins
+// is one or two register stores instead of a digitalWrite() pin lookup
+// per pin.
+//
+// On the nRF52840 the stores go straight to port 0. Elsewhere a simulated
+// port records each transition with its timestamp, then forwards the
+// change to digitalWrite() so the outputs still work.
+#if defined(NRF52840_XXAA)
+#define GPIO_HAL_HARDWARE 1
+#else
+#define GPIO_HAL_HARDWARE 0
+#endif
+
+// Board pins as port 0 bit numbers. On the Nano 33 BLE all of them sit on
+// port 0; the simulated port reuses the Arduino pin numbers.
+#if GPIO_HAL_HARDWARE
+constexpr uint8_t PIN_LED_RED = 24;      // P0.24
+constexpr uint8_t PIN_LED_GREEN = 16;    // P0.16
+constexpr uint8_t PIN_LED_BLUE = 6;      // P0.06
+constexpr uint8_t PIN_LED_BUILTIN = 13;  // P0.13
+#else
+constexpr uint8_t PIN_LED_RED = LEDR;
+constexpr uint8_t PIN_LED_GREEN = LEDG;
+constexpr uint8_t PIN_LED_BLUE = LEDB;
+constexpr uint8_t PIN_LED_BUILTIN = LED_BUILTIN;
+#endif
+
+// Recorded transitions kept by the simulated port
+#define GPIO_TRACE_CAPACITY 64
+
+struct GpioTransition {
+    uint32_t time;     // micros()
+    uint32_t raised;   // Pins driven high
+    uint32_t lowered;  // Pins driven low
+};
+
+constexpr uint32_t pinMask() {
+    return 0;
+}
+
+template <typename... Rest>
+constexpr uint32_t pinMask(uint8_t pin, Rest... rest) {
+    return (pin < 32 ? (1UL << pin) : 0) | pinMask(rest...);
+}
+
+constexpr bool pinsOnPort() {
+    return true;
+}
+
+template <typename... Rest>
+constexpr bool pinsOnPort(uint8_t pin, Rest... rest) {
+    return pin < 32 && pinsOnPort(rest...);
+}
+
+// Port access
+#if GPIO_HAL_HARDWARE
+
+inline void gpioConfigureOutputs(uint32_t mask) {
+    NRF_P0->DIRSET = mask;
+}
+
+inline void gpioSet(uint32_t mask) {
+    NRF_P0->OUTSET = mask;
+}
+
+inline void gpioClear(uint32_t mask) {
+    NRF_P0->OUTCLR = mask;
+}
+
+// Drives every pin in the mask at once: one store to OUT, guarded so an
+// interrupt can't change other port 0 pins between the read and the write
+inline void gpioWrite(uint32_t mask, uint32_t high) {
+    noInterrupts();
+    NRF_P0->OUT = (NRF_P0->OUT & ~mask) | (high & mask);
+    interrupts();
+}
+
+inline uint32_t gpioRead() {
+    return NRF_P0->OUT;
+}
+
+#else
+
+void gpioConfigureOutputs(uint32_t mask);
+void gpioSet(uint32_t mask);
+void gpioClear(uint32_t mask);
+void gpioWrite(uint32_t mask, uint32_t high);
+uint32_t gpioRead();
+
+#endif
+
+// A fixed set of pins driven together
+template <uint8_t... Pins>
+struct PinGroup {
+    static_assert(pinsOnPort(Pins...), "Pin group must sit on port 0");
+    static constexpr uint32_t MASK = pinMask(Pins...);
+
+    static void configureOutput() {
+        gpioConfigureOutputs(MASK);
+    }
+
+    static void set() {
+        gpioSet(MASK);
+    }
+
+    static void clear() {
+        gpioClear(MASK);
+    }
+
+    // Pins in `high` go high, the rest of the group low, in the same cycle
+    static void write(uint32_t high) {
+        gpioWrite(MASK, high);
+    }
+};
+
+// The RGB LED is active low: a color lists the LEDs to light
+using RgbLed = PinGroup<PIN_LED_RED, PIN_LED_GREEN, PIN_LED_BLUE>;
+using BuiltinLed = PinGroup<PIN_LED_BUILTIN>;
+
+inline void writeRgbColor(uint32_t lit) {
+    RgbLed::write(~lit);
+}
+
+// Function declarations
+byte getGpioTraceCount();
+bool getGpioTransition(byte index, GpioTransition& transition);
+void clearGpioTrace();
+
+#endif // GPIO_HAL_H
@@ -1,26 +1,72 @@
 // heart_rate.cpp
 #include "heart_rate.h"
 #include <math.h>
+#include "heart_rate_trend.h"
+#include "settings.h"
+#include "timing.h"
+#include "time_service.h"
 #include "emission_control.h"
+#include "rule_engine.h"
+#include "emission_analytics.h"
 #include "debug.h"
 #include "led_control.h"
+#include "battery.h"
 
 // Variables for heart rate simulation
 byte currentHeartRate = MIN_HEART_RATE;
 unsigned long lastHeartRateUpdateTime = 0;
-static const unsigned long HEART_RATE_UPDATE_INTERVAL = 10000; // 10 seconds
 extern bool heartRateBasedReleaseEnabled;
 extern int highHeartRateThreshold;
 extern int lowHeartRateThreshold;
 
+// Sampling counters, bucketed per hour of uptime
+static const unsigned long SAMPLING_STATS_PERIOD = 3600000; // 1 hour
+static unsigned long samplingPeriodStart = 0;
+static SamplingStats samplingStats = {0, 0, 0, 0};
+
 void initHeartRate() {
     debugPrintln(DEBUG_HEART, "Initializing heart rate simulation");
-    lastHeartRateUpdateTime = millis();
+    lastHeartRateUpdateTime = getLoopMillis();
     currentHeartRate = MIN_HEART_RATE;
+    initHeartRateTrend();
+    resetSamplingStats();
 }
 
-void updateHeartRate() {
-    unsigned long currentTime = millis();
+static void countSample(unsigned long currentTime) {
+    if (currentTime - samplingPeriodStart >= SAMPLING_STATS_PERIOD) {
+        samplingStats.samplesLastHour = samplingStats.samplesThisHour;
+        samplingStats.samplesThisHour = 0;
+        samplingPeriodStart = currentTime;
+    }
+    samplingStats.totalSamples++;
+    samplingStats.samplesThisHour++;
+}
+
+// Picks the next sampling interval: the floor when the value is close to a
+// threshold or moving fast, otherwise doubling up to the ceiling
+static void adaptSamplingInterval(byte heartRate) {
+    // Both bounds stretch as the battery runs down
+    unsigned long floorInterval = scaleHeartRateInterval(heartRateMinInterval);
+    unsigned long ceilingInterval = max(scaleHeartRateInterval(heartRateMaxInterval), floorInterval);
+
+    int distanceToHigh = highHeartRateThreshold - heartRate;
+    int distanceToLow = heartRate - lowHeartRateThreshold;
+    bool nearThreshold = distanceToHigh <= HEART_RATE_NEAR_BAND || distanceToLow <= HEART_RATE_NEAR_BAND;
+    bool changingFast = isHeartRateTrendValid() && fabsf(getHeartRateSlope()) >= HEART_RATE_FAST_SLOPE;
+
+    unsigned long interval;
+    if (nearThreshold || changingFast) {
+        interval = floorInterval;
+    } else {
+        interval = constrain(getHeartRateUpdateInterval() * 2, floorInterval, ceilingInterval);
+    }
+
+    setHeartRateUpdateInterval(interval);
+    samplingStats.currentInterval = interval;
+}
+
+void updateHeartRate(unsigned long now) {
+    unsigned long currentTime = now;
 
     // This creates a smooth transition between MIN and MAX heart rates
     float amplitude = (MAX_HEART_RATE - MIN_HEART_RATE) / 2.0;
@@ -34,12 +80,25 @@ void updateHeartRate() {
     // Log the updated heart rate
     debugPrintf(DEBUG_HEART, "Heart rate: %d BPM\n", currentHeartRate);
 
+    // Feed the trend predictor
+    addHeartRateSample(currentTime, currentHeartRate);
+    countSample(currentTime);
+    onAnalyticsSample(currentTime, currentHeartRate);
+
     // Check if heart rate based release is enabled
     if (heartRateBasedReleaseEnabled) {
         // Trigger emission if heart rate is outside the threshold range
         checkHeartRateBasedEmission(currentHeartRate);
+        // Trigger early if the trend projects a crossing within the horizon
+        checkPredictiveEmission(currentHeartRate);
     }
 
+    // User rules see every sample
+    evaluateRules();
+
+    // Schedule the next sample
+    adaptSamplingInterval(currentHeartRate);
+
     // Update the last update time
     lastHeartRateUpdateTime = currentTime;
 
@@ -50,3 +109,12 @@ void updateHeartRate() {
 byte getCurrentHeartRate() {
     return currentHeartRate;
 }
+
+void getSamplingStats(SamplingStats& stats) {
+    stats = samplingStats;
+}
+
+void resetSamplingStats() {
+    samplingStats = SamplingStats{0, (uint32_t)getHeartRateUpdateInterval(), 0, 0};
+    samplingPeriodStart = getLoopMillis();
+}
@@ -10,6 +10,19 @@
 #define MAX_HEART_RATE 100
 #define OSCILLATION_PERIOD 30000  // Time for one complete oscillation (30 seconds)
 
+// Adaptive sampling: sample at the floor interval when within this many BPM
+// of a threshold or changing faster than the slope limit, otherwise back off
+#define HEART_RATE_NEAR_BAND 10
+#define HEART_RATE_FAST_SLOPE 0.5f  // BPM per second
+
+// Sampling counters
+struct SamplingStats {
+    uint32_t totalSamples;
+    uint32_t currentInterval;  // ms
+    uint16_t samplesThisHour;
+    uint16_t samplesLastHour;
+};
+
 // Variables for heart rate simulation
 extern byte currentHeartRate;
 extern unsigned long lastHeartRateUpdateTime;
@@ -19,7 +32,9 @@ extern int lowHeartRateThreshold;
 
 // Function declarations
 void initHeartRate();
-void updateHeartRate();
+void updateHeartRate(unsigned long now);
 byte getCurrentHeartRate();
+void getSamplingStats(SamplingStats& stats);
+void resetSamplingStats();
 
 #endif // HEART_RATE_H
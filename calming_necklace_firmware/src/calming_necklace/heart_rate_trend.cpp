@@ -0,0 +1,86 @@
+// heart_rate_trend.cpp
+#include "heart_rate_trend.h"
+
+// Ring buffer of recent samples
+static unsigned long sampleTimes[TREND_WINDOW_SIZE];
+static byte sampleValues[TREND_WINDOW_SIZE];
+static byte sampleHead = 0;
+static byte sampleCount = 0;
+
+// Least-squares fit, refreshed on every new sample
+static float trendSlope = 0;      // BPM per second
+static float trendIntercept = 0;  // Fitted BPM at the newest sample
+
+static void updateTrendFit() {
+    if (sampleCount < TREND_MIN_SAMPLES) {
+        return;
+    }
+
+    // Times are taken relative to the newest sample (in seconds) to keep the
+    // float arithmetic well conditioned regardless of uptime
+    byte newest = (sampleHead + TREND_WINDOW_SIZE - 1) % TREND_WINDOW_SIZE;
+    unsigned long referenceTime = sampleTimes[newest];
+
+    float sumX = 0, sumY = 0;
+    for (byte i = 0; i < sampleCount; i++) {
+        sumX -= (referenceTime - sampleTimes[i]) / 1000.0f;
+        sumY += sampleValues[i];
+    }
+    float meanX = sumX / sampleCount;
+    float meanY = sumY / sampleCount;
+
+    float sumXY = 0, sumXX = 0;
+    for (byte i = 0; i < sampleCount; i++) {
+        float dx = -((referenceTime - sampleTimes[i]) / 1000.0f) - meanX;
+        sumXY += dx * (sampleValues[i] - meanY);
+        sumXX += dx * dx;
+    }
+
+    trendSlope = (sumXX > 0) ? sumXY / sumXX : 0;
+    trendIntercept = meanY - trendSlope * meanX;
+}
+
+void initHeartRateTrend() {
+    debugPrintln(DEBUG_HEART, "Initializing heart rate trend predictor");
+    resetHeartRateTrend();
+}
+
+void resetHeartRateTrend() {
+    sampleHead = 0;
+    sampleCount = 0;
+    trendSlope = 0;
+    trendIntercept = 0;
+}
+
+void addHeartRateSample(unsigned long timestamp, byte heartRate) {
+    sampleTimes[sampleHead] = timestamp;
+    sampleValues[sampleHead] = heartRate;
+    sampleHead = (sampleHead + 1) % TREND_WINDOW_SIZE;
+    if (sampleCount < TREND_WINDOW_SIZE) {
+        sampleCount++;
+    }
+
+    updateTrendFit();
+}
+
+byte getHeartRateSamples(unsigned long* timestamps, byte* heartRates) {
+    byte oldest = (sampleHead + TREND_WINDOW_SIZE - sampleCount) % TREND_WINDOW_SIZE;
+    for (byte i = 0; i < sampleCount; i++) {
+        byte index = (oldest + i) % TREND_WINDOW_SIZE;
+        timestamps[i] = sampleTimes[index];
+        heartRates[i] = sampleValues[index];
+    }
+    return sampleCount;
+}
+
+bool isHeartRateTrendValid() {
+    return sampleCount >= TREND_MIN_SAMPLES;
+}
+
+float getHeartRateSlope() {
+    return trendSlope;
+}
+
+int getProjectedHeartRate(unsigned long horizon) {
+    return (int)lroundf(trendIntercept + trendSlope * (horizon / 1000.0f));
+}
@@ -0,0 +1,22 @@
+// heart_rate_trend.h
+#ifndef HEART_RATE_TREND_H
+#define HEART_RATE_TREND_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Number of recent samples used for the linear trend fit
+#define TREND_WINDOW_SIZE 6
+// Minimum samples before the trend is considered valid
+#define TREND_MIN_SAMPLES 3
+
+// Function declarations
+void initHeartRateTrend();
+void resetHeartRateTrend();
+void addHeartRateSample(unsigned long timestamp, byte heartRate);
+bool isHeartRateTrendValid();
+float getHeartRateSlope();  // BPM per second
+int getProjectedHeartRate(unsigned long horizon);
+byte getHeartRateSamples(unsigned long* timestamps, byte* heartRates);  // Oldest first, returns the count
+
+#endif // HEART_RATE_TREND_H
@@ -0,0 +1,154 @@
+// latency_trace.cpp
+#include "latency_trace.h"
+#include "time_service.h"
+
+static LatencyHistogram histograms[LATENCY_HISTOGRAM_COUNT];
+static uint32_t maxLatency[LATENCY_HISTOGRAM_COUNT];
+static uint32_t completedTraces = 0;
+static uint32_t abandonedTraces = 0;
+
+// The command in flight. Points are read straight from the timer rather
+// than the loop timestamp, which would fold a whole pass into one value.
+static uint64_t pointTime[LATENCY_POINT_COUNT];
+static byte markedPoints = 0;  // Bit per point stamped
+static bool tracing = false;
+
+static byte bucketFor(uint32_t micros) {
+    byte bucket = 0;
+    micros >>= LATENCY_FIRST_BUCKET_SHIFT;
+    while (micros > 0 && bucket < LATENCY_BUCKET_COUNT - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void recordLatency(byte histogram, uint64_t elapsed) {
+    uint32_t micros = elapsed > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)elapsed;
+    uint16_t& count = histograms[histogram].buckets[bucketFor(micros)];
+    if (count < 0xFFFF) {
+        count++;
+    }
+    if (micros > maxLatency[histogram]) {
+        maxLatency[histogram] = micros;
+    }
+}
+
+// Each stage runs from the previous stamped point, so a command that
+// skips a point (an LED command never enters triggerEmission()) only
+// adds to the stages it went through
+static void completeTrace() {
+    uint64_t previous = pointTime[LATENCY_POINT_ARRIVAL];
+    for (byte point = LATENCY_POINT_DISPATCH; point < LATENCY_POINT_COUNT; point++) {
+        if (markedPoints & (1 << point)) {
+            recordLatency(point - 1, pointTime[point] - previous);
+            previous = pointTime[point];
+        }
+    }
+    uint64_t total = pointTime[LATENCY_POINT_ACTUATION] - pointTime[LATENCY_POINT_ARRIVAL];
+    recordLatency(LATENCY_TOTAL, total);
+    completedTraces++;
+    tracing = false;
+
+    debugPrintf(DEBUG_BLE, "Command latency: %lu us\n", (unsigned long)total);
+}
+
+void beginLatencyTrace() {
+    if (tracing) {
+        abandonedTraces++;
+    }
+    pointTime[LATENCY_POINT_ARRIVAL] = readMonotonicMicros();
+    markedPoints = 1 << LATENCY_POINT_ARRIVAL;
+    tracing = true;
+}
+
+void markLatencyPoint(byte point) {
+    if (point == LATENCY_POINT_ARRIVAL) {
+        beginLatencyTrace();
+        return;
+    }
+    if (point >= LATENCY_POINT_COUNT) {
+        return;
+    }
+    if (!tracing) {
+        // Without a write event the trace starts when the command is seen
+        if (point != LATENCY_POINT_DISPATCH) {
+            return;
+        }
+        beginLatencyTrace();
+        pointTime[LATENCY_POINT_DISPATCH] = pointTime[LATENCY_POINT_ARRIVAL];
+        markedPoints |= 1 << LATENCY_POINT_DISPATCH;
+        return;
+    }
+    // The first channel to react ends the trace
+    if (markedPoints & (1 << point)) {
+        return;
+    }
+    // Something else turning an emitter on before the command was picked
+    // up isn't the command's doing
+    if (point == LATENCY_POINT_ACTUATION && !(markedPoints & (1 << LATENCY_POINT_DISPATCH))) {
+        return;
+    }
+
+    pointTime[point] = readMonotonicMicros();
+    markedPoints |= 1 << point;
+    if (point == LATENCY_POINT_ACTUATION) {
+        completeTrace();
+    }
+}
+
+void abandonLatencyTrace() {
+    if (tracing) {
+        abandonedTraces++;
+        tracing = false;
+    }
+}
+
+uint32_t getLatencyPercentile(byte histogram, byte percent) {
+    if (histogram >= LATENCY_HISTOGRAM_COUNT) {
+        return 0;
+    }
+    const LatencyHistogram& h = histograms[histogram];
+    uint32_t total = 0;
+    for (byte i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        total += h.buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t cumulative = 0;
+    for (byte i = 0; i < LATENCY_BUCKET_COUNT - 1; i++) {
+        cumulative += h.buckets[i];
+        if (cumulative >= target) {
+            return min(1UL << (i + LATENCY_FIRST_BUCKET_SHIFT), (unsigned long)maxLatency[histogram]);
+        }
+    }
+    return maxLatency[histogram];
+}
+
+void getLatencyStats(LatencyStats& stats) {
+    stats.traces = completedTraces;
+    stats.abandoned = abandonedTraces;
+    for (byte i = 0; i < LATENCY_HISTOGRAM_COUNT; i++) {
+        stats.p50[i] = getLatencyPercentile(i, 50);
+        stats.p99[i] = getLatencyPercentile(i, 99);
+        stats.maxMicros[i] = maxLatency[i];
+    }
+}
+
+void getLatencyHistogram(byte histogram, LatencyHistogram& result) {
+    if (histogram >= LATENCY_HISTOGRAM_COUNT) {
+        result = LatencyHistogram{};
+        return;
+    }
+    result = histograms[histogram];
+}
+
+void resetLatencyStats() {
+    memset(histograms, 0, sizeof(histograms));
+    memset(maxLatency, 0, sizeof(maxLatency));
+    completedTraces = 0;
+    abandonedTraces = 0;
+}
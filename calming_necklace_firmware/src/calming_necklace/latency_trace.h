@@ -0,0 +1,58 @@
+// latency_trace.h
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Command latency tracing. A command written to the switch characteristic
+// is timestamped at each point on its way to the emitter; when it reaches
+// the output the time spent between points goes into fixed-bucket
+// histograms, from which p50/p99 are read out over diagnostics.
+//
+// Only one command is traced at a time. A command that doesn't change the
+// output in the pass that handles it (dropped, merged, queued, waiting out
+// the minimum gap or extending an emission already running) is abandoned
+// there, as is one still in flight when the next command arrives.
+#define LATENCY_POINT_ARRIVAL 0    // BLE write received
+#define LATENCY_POINT_DISPATCH 1   // Picked up in handlePeripheralLoop()
+#define LATENCY_POINT_TRIGGER 2    // Entered triggerEmission()
+#define LATENCY_POINT_ACTUATION 3  // Emitter output changed
+#define LATENCY_POINT_COUNT 4
+
+// Histograms: the stage ending at each point, plus arrival to actuation
+#define LATENCY_STAGE_DISPATCH 0
+#define LATENCY_STAGE_TRIGGER 1
+#define LATENCY_STAGE_ACTUATION 2
+#define LATENCY_TOTAL 3
+#define LATENCY_HISTOGRAM_COUNT 4
+
+// Bucket 0 holds everything under 256 us; each following bucket doubles,
+// and the last collects everything from about 4.2 s up
+#define LATENCY_BUCKET_COUNT 16
+#define LATENCY_FIRST_BUCKET_SHIFT 8
+
+struct LatencyHistogram {
+    uint16_t buckets[LATENCY_BUCKET_COUNT];  // Saturate at 0xFFFF
+};
+
+// Percentiles are the upper edge of the bucket they fall in (the largest
+// latency seen for the last bucket), in microseconds
+struct LatencyStats {
+    uint32_t traces;     // Commands that reached the output
+    uint32_t abandoned;  // Never reached the output
+    uint32_t p50[LATENCY_HISTOGRAM_COUNT];
+    uint32_t p99[LATENCY_HISTOGRAM_COUNT];
+    uint32_t maxMicros[LATENCY_HISTOGRAM_COUNT];
+};
+
+// Function declarations
+void beginLatencyTrace();
+void markLatencyPoint(byte point);
+void abandonLatencyTrace();
+uint32_t getLatencyPercentile(byte histogram, byte percent);
+void getLatencyStats(LatencyStats& stats);
+void getLatencyHistogram(byte histogram, LatencyHistogram& result);
+void resetLatencyStats();
+
+#endif // LATENCY_TRACE_H
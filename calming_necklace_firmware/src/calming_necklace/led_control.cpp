@@ -1,17 +1,14 @@
 // led_control.cpp
 #include "led_control.h"
 #include "debug.h"
+#include "gpio_hal.h"
 
 void setupPins() {
-    pinMode(LEDR, OUTPUT);
-    pinMode(LEDG, OUTPUT);
-    pinMode(LEDB, OUTPUT);
-    pinMode(LED_BUILTIN, OUTPUT);
-
-    digitalWrite(LED_BUILTIN, LOW);
-    digitalWrite(LEDR, HIGH);
-    digitalWrite(LEDG, HIGH);
-    digitalWrite(LEDB, HIGH);
+    // Latch the off levels before the pins become outputs
+    RgbLed::set();
+    BuiltinLed::clear();
+    RgbLed::configureOutput();
+    BuiltinLed::configureOutput();
 }
 
 void handleLEDs(byte command) {
@@ -21,18 +18,35 @@ void handleLEDs(byte command) {
     switch (command) {
         case CMD_LED_ON:
             debugPrintln(DEBUG_LED, "Red LED on");
-            digitalWrite(LEDR, LOW);
-            digitalWrite(LEDG, HIGH);
-            digitalWrite(LEDB, HIGH);
+            writeRgbColor(pinMask(PIN_LED_RED));
             break;
         case CMD_LED_OFF:
             debugPrintln(DEBUG_LED, "LEDs off");
-            digitalWrite(LEDR, HIGH);
-            digitalWrite(LEDG, HIGH);
-            digitalWrite(LEDB, HIGH);
+            RgbLed::set();
             break;
         default:
             debugPrintln(DEBUG_LED, "Ignoring unsupported LED command");
             break;
     }
-}
\ No newline at end of file
+}
+
+// Emitter outputs per channel. Channel 0 is the original fan output, shown
+// on the red LED; channel 1 uses the blue LED. Each is switched on its own
+// mask, so one channel never touches the other's pin.
+static const byte EMITTER_PINS[] = {LEDR, LEDB};
+static constexpr uint32_t EMITTER_MASKS[] = {pinMask(PIN_LED_RED), pinMask(PIN_LED_BLUE)};
+
+void setEmitterOutput(byte channel, bool on) {
+    if (channel < sizeof(EMITTER_PINS)) {
+        debugPrintf(DEBUG_LED, "Emitter %d %s\n", channel, on ? "on" : "off");
+        if (on) {
+            gpioClear(EMITTER_MASKS[channel]);
+        } else {
+            gpioSet(EMITTER_MASKS[channel]);
+        }
+    }
+}
+
+byte getEmitterPin(byte channel) {
+    return EMITTER_PINS[channel];
+}
@@ -7,5 +7,7 @@
 
 void setupPins();
 void handleLEDs(byte command);
+void setEmitterOutput(byte channel, bool on);
+byte getEmitterPin(byte channel);
 
 #endif // LED_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,321 @@
+// led_patterns.cpp
+#include "led_patterns.h"
+#include "emission_control.h"
+#include "led_control.h"
+#include "gpio_hal.h"
+#include "time_service.h"
+#include "energy_model.h"
+
+// Pattern tables, one per LED_STATUS_*
+static constexpr LedKeyframe ADVERTISING_KEYFRAMES[] = {
+    {0, 0, 40, 75, true}, {0, 0, 0, 75, true}  // Slow blue breathing
+};
+static constexpr LedKeyframe CONNECTED_KEYFRAMES[] = {
+    {0, 40, 0, 5, false}, {0, 0, 0, 10, false},  // Green double blink every 3 s
+    {0, 40, 0, 5, false}, {0, 0, 0, 130, false}
+};
+static constexpr LedKeyframe EMITTING_KEYFRAMES[] = {
+    {0, 40, 0, 50, true}, {0, 0, 0, 50, true}  // Green breathing
+};
+static constexpr LedKeyframe LOW_BATTERY_KEYFRAMES[] = {
+    {60, 20, 0, 5, false}, {0, 0, 0, 95, false}  // Amber flash every 2 s
+};
+static constexpr LedKeyframe BLE_FAILURE_KEYFRAMES[] = {
+    {60, 0, 0, 10, false}, {0, 0, 0, 10, false},  // Red blink code 3
+    {60, 0, 0, 10, false}, {0, 0, 0, 10, false},
+    {60, 0, 0, 10, false}, {0, 0, 0, 60, false}
+};
+
+template <size_t N>
+static constexpr LedPattern makePattern(const LedKeyframe (&keyframes)[N]) {
+    return {keyframes, (uint8_t)N};
+}
+
+static constexpr LedPattern PATTERNS[LED_STATUS_COUNT] = {
+    makePattern(ADVERTISING_KEYFRAMES),
+    makePattern(CONNECTED_KEYFRAMES),
+    makePattern(EMITTING_KEYFRAMES),
+    makePattern(LOW_BATTERY_KEYFRAMES),
+    makePattern(BLE_FAILURE_KEYFRAMES),
+};
+
+template <size_t N>
+static constexpr unsigned patternFrames(const LedKeyframe (&keyframes)[N]) {
+    unsigned frames = 0;
+    for (size_t i = 0; i < N; i++) {
+        frames += keyframes[i].frames;
+    }
+    return frames;
+}
+
+static_assert(patternFrames(ADVERTISING_KEYFRAMES) <= LED_PATTERN_MAX_FRAMES, "Advertising pattern too long");
+static_assert(patternFrames(CONNECTED_KEYFRAMES) <= LED_PATTERN_MAX_FRAMES, "Connected pattern too long");
+static_assert(patternFrames(EMITTING_KEYFRAMES) <= LED_PATTERN_MAX_FRAMES, "Emitting pattern too long");
+static_assert(patternFrames(LOW_BATTERY_KEYFRAMES) <= LED_PATTERN_MAX_FRAMES, "Low battery pattern too long");
+static_assert(patternFrames(BLE_FAILURE_KEYFRAMES) <= LED_PATTERN_MAX_FRAMES, "BLE failure pattern too long");
+
+// RGB LED pins in pattern color order
+static const byte LED_PINS[3] = {LEDR, LEDG, LEDB};
+
+static byte activeStatuses = 0;       // Bit per LED_STATUS_*
+static byte shownStatus = LED_STATUS_NONE;
+static byte blockedLeds = 0;          // Bit per LED currently driven by an emitter
+static byte patternLeds = 0;          // Bit per LED the shown pattern drives
+
+// Color of the frame-th frame of a pattern, each component in percent
+static void frameColor(const LedPattern& pattern, unsigned frame, uint8_t* color) {
+    const LedKeyframe* previous = &pattern.keyframes[pattern.keyframeCount - 1];
+    for (byte i = 0; i < pattern.keyframeCount; i++) {
+        const LedKeyframe& keyframe = pattern.keyframes[i];
+        if (frame < keyframe.frames) {
+            const uint8_t from[3] = {previous->red, previous->green, previous->blue};
+            const uint8_t to[3] = {keyframe.red, keyframe.green, keyframe.blue};
+            for (byte led = 0; led < 3; led++) {
+                color[led] = keyframe.fade
+                    ? from[led] + ((int)to[led] - from[led]) * (int)(frame + 1) / keyframe.frames
+                    : to[led];
+            }
+            return;
+        }
+        frame -= keyframe.frames;
+        previous = &keyframe;
+    }
+    color[0] = color[1] = color[2] = 0;
+}
+
+static unsigned totalFrames(const LedPattern& pattern) {
+    unsigned frames = 0;
+    for (byte i = 0; i < pattern.keyframeCount; i++) {
+        frames += pattern.keyframes[i].frames;
+    }
+    return frames;
+}
+
+// LEDs a pattern ever lights
+static byte usedLeds(const LedPattern& pattern) {
+    byte leds = 0;
+    for (byte i = 0; i < pattern.keyframeCount; i++) {
+        const LedKeyframe& keyframe = pattern.keyframes[i];
+        leds |= (keyframe.red ? 1 : 0) | (keyframe.green ? 2 : 0) | (keyframe.blue ? 4 : 0);
+    }
+    return leds;
+}
+
+// Average drive of the given LEDs over the pattern, for the energy model
+static uint16_t patternPowerLevel(const LedPattern& pattern, byte leds) {
+    unsigned frames = totalFrames(pattern);
+    uint32_t levelSum = 0;
+    for (unsigned frame = 0; frame < frames; frame++) {
+        uint8_t color[3];
+        frameColor(pattern, frame, color);
+        for (byte led = 0; led < 3; led++) {
+            if (leds & (1 << led)) {
+                levelSum += color[led];
+            }
+        }
+    }
+    return frames ? levelSum * (POWER_LEVEL_FULL / 100) / frames : 0;
+}
+
+// Emitters share the RGB pins on this board; an active emitter keeps its pin
+static byte emitterLeds() {
+    byte leds = 0;
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        if (!isChannelActive(channel)) {
+            continue;
+        }
+        for (byte led = 0; led < 3; led++) {
+            if (LED_PINS[led] == getEmitterPin(channel)) {
+                leds |= (1 << led);
+            }
+        }
+    }
+    return leds;
+}
+
+#if LED_PATTERN_HARDWARE
+
+static NRF_PWM_Type* const LED_PWM = NRF_PWM1;
+
+// Individual decoder mode reads four values per frame, one per output
+static uint16_t frameBuffer[LED_PATTERN_MAX_FRAMES][4];
+
+// Bit 15 clear selects a rising first edge: the output starts each period
+// low and rises at the compare value, so the active-low LED is on for the
+// first `value` counts and shows the level the energy model is given
+static const uint16_t PWM_POLARITY_RISING_EDGE = 0x0000;
+
+static void stopPattern() {
+    LED_PWM->SHORTS = 0;
+    LED_PWM->TASKS_STOP = 1;
+    LED_PWM->ENABLE = 0;
+    for (byte led = 0; led < 3; led++) {
+        LED_PWM->PSEL.OUT[led] = PWM_PSEL_OUT_CONNECT_Msk;  // Disconnected
+    }
+}
+
+static void startPattern(const LedPattern& pattern) {
+    unsigned frames = totalFrames(pattern);
+    for (unsigned frame = 0; frame < frames; frame++) {
+        uint8_t color[3];
+        frameColor(pattern, frame, color);
+        for (byte led = 0; led < 3; led++) {
+            frameBuffer[frame][led] = (uint16_t)(color[led] * LED_PATTERN_PWM_TOP / 100) | PWM_POLARITY_RISING_EDGE;
+        }
+        frameBuffer[frame][3] = PWM_POLARITY_RISING_EDGE;
+    }
+
+    for (byte led = 0; led < 3; led++) {
+        uint32_t pinNumber = digitalPinToPinName(LED_PINS[led]);
+        LED_PWM->PSEL.OUT[led] = (patternLeds & (1 << led))
+            ? ((pinNumber & 0x1F) << PWM_PSEL_OUT_PIN_Pos) | ((pinNumber >> 5) << PWM_PSEL_OUT_PORT_Pos)
+            : PWM_PSEL_OUT_CONNECT_Msk;
+    }
+    LED_PWM->MODE = PWM_MODE_UPDOWN_Up;
+    LED_PWM->PRESCALER = PWM_PRESCALER_PRESCALER_DIV_16;
+    LED_PWM->COUNTERTOP = LED_PATTERN_PWM_TOP;
+    LED_PWM->DECODER = (PWM_DECODER_LOAD_Individual << PWM_DECODER_LOAD_Pos) | (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
+
+    // Both sequences play the same frames and the LOOPSDONE short starts
+    // over, so the pattern repeats with no CPU involvement. REFRESH counts
+    // extra 1 ms periods per frame.
+    for (byte seq = 0; seq < 2; seq++) {
+        LED_PWM->SEQ[seq].PTR = (uint32_t)frameBuffer;
+        LED_PWM->SEQ[seq].CNT = frames * 4;
+        LED_PWM->SEQ[seq].REFRESH = LED_FRAME_TIME - 1;
+        LED_PWM->SEQ[seq].ENDDELAY = 0;
+    }
+    LED_PWM->LOOP = 1;
+    LED_PWM->SHORTS = PWM_SHORTS_LOOPSDONE_SEQSTART0_Msk;
+
+    LED_PWM->ENABLE = PWM_ENABLE_ENABLE_Enabled;
+    LED_PWM->TASKS_SEQSTART[0] = 1;
+}
+
+void updateLedPatterns(unsigned long now) {
+    // Frames advance in hardware
+}
+
+#else
+
+static unsigned currentFrame = 0;
+static unsigned frameCount = 0;
+static unsigned long lastFrameTime = 0;
+static uint32_t litPins = 0;  // Port bits currently switched on by the pattern
+
+// Port bits of the RGB LED in pattern color order
+static constexpr uint32_t LED_MASKS[3] = {
+    pinMask(PIN_LED_RED), pinMask(PIN_LED_GREEN), pinMask(PIN_LED_BLUE)
+};
+
+// Level at which an LED counts as on without PWM
+static const uint8_t LED_ON_LEVEL = 20;
+
+static uint32_t ledPins(byte leds) {
+    uint32_t pins = 0;
+    for (byte led = 0; led < 3; led++) {
+        if (leds & (1 << led)) {
+            pins |= LED_MASKS[led];
+        }
+    }
+    return pins;
+}
+
+static void writeFrame() {
+    uint8_t color[3];
+    frameColor(PATTERNS[shownStatus], currentFrame, color);
+    uint32_t lit = 0;
+    for (byte led = 0; led < 3; led++) {
+        if (color[led] >= LED_ON_LEVEL) {
+            lit |= LED_MASKS[led];
+        }
+    }
+    lit &= ledPins(patternLeds);
+
+    // Only touch the port when the color changes, and then in one write
+    if (lit != litPins) {
+        gpioWrite(ledPins(patternLeds), ~lit);
+        litPins = lit;
+    }
+}
+
+static void stopPattern() {
+    gpioSet(litPins & ~ledPins(blockedLeds));
+    litPins = 0;
+    frameCount = 0;
+}
+
+static void startPattern(const LedPattern& pattern) {
+    frameCount = totalFrames(pattern);
+    currentFrame = 0;
+    lastFrameTime = getLoopMillis();
+    writeFrame();
+}
+
+void updateLedPatterns(unsigned long now) {
+    if (frameCount == 0 || now - lastFrameTime < LED_FRAME_TIME) {
+        return;
+    }
+    lastFrameTime += LED_FRAME_TIME;
+    currentFrame = (currentFrame + 1) % frameCount;
+    writeFrame();
+}
+
+#endif
+
+// Restarts playback when the shown pattern or the LEDs it may use change
+static void applyLedStatus() {
+    byte status = LED_STATUS_NONE;
+    for (byte i = LED_STATUS_COUNT; i-- > 0;) {
+        if (activeStatuses & (1 << i)) {
+            status = i;
+            break;
+        }
+    }
+
+    byte blocked = emitterLeds();
+    if (status == shownStatus && blocked == blockedLeds) {
+        return;
+    }
+
+    // Pins an emitter just took are left alone when the old pattern stops
+    blockedLeds = blocked;
+    stopPattern();
+    shownStatus = status;
+    if (status == LED_STATUS_NONE) {
+        patternLeds = 0;
+        setPowerLevel(POWER_LED, 0);
+        return;
+    }
+
+    patternLeds = usedLeds(PATTERNS[status]) & ~blocked;
+    setPowerLevel(POWER_LED, patternPowerLevel(PATTERNS[status], patternLeds));
+    debugPrintf(DEBUG_LED, "LED pattern %d on LEDs 0x%02X\n", status, patternLeds);
+    if (patternLeds != 0) {
+        startPattern(PATTERNS[status]);
+    }
+}
+
+void initLedPatterns() {
+    activeStatuses = 0;
+    shownStatus = LED_STATUS_NONE;
+    blockedLeds = 0;
+    patternLeds = 0;
+    stopPattern();
+}
+
+void setLedStatus(byte status, bool active) {
+    if (status >= LED_STATUS_COUNT) {
+        return;
+    }
+    if (active) {
+        activeStatuses |= (1 << status);
+    } else {
+        activeStatuses &= ~(1 << status);
+    }
+    applyLedStatus();
+}
+
+byte getLedStatus() {
+    return shownStatus;
+}
@@ -0,0 +1,54 @@
+// led_patterns.h
+#ifndef LED_PATTERNS_H
+#define LED_PATTERNS_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Device states shown on the RGB LED. Several can be set at once; the
+// highest numbered one is shown.
+#define LED_STATUS_ADVERTISING 0
+#define LED_STATUS_CONNECTED 1
+#define LED_STATUS_EMITTING 2
+#define LED_STATUS_LOW_BATTERY 3
+#define LED_STATUS_BLE_FAILURE 4
+#define LED_STATUS_COUNT 5
+#define LED_STATUS_NONE 0xFF
+
+// Patterns are stored as keyframes and expanded into fixed-rate frames
+#define LED_FRAME_TIME 20          // ms per frame
+#define LED_PATTERN_MAX_FRAMES 160
+
+// On the nRF52840 the expanded pattern loops from RAM through a PWM
+// instance's EasyDMA sequences, so frames advance without the CPU.
+// Elsewhere updateLedPatterns() steps frames from the loop and switches
+// each LED fully on or off.
+#if defined(NRF52840_XXAA)
+#define LED_PATTERN_HARDWARE 1
+#define LED_PATTERN_PWM_TOP 1000  // 1 MHz clock / 1000 = 1 kHz PWM
+#else
+#define LED_PATTERN_HARDWARE 0
+#endif
+
+// Reach the keyframe's color over `frames` frames, fading from the
+// previous keyframe or stepping to it and holding. Levels are percent.
+struct LedKeyframe {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t frames;
+    bool fade;
+};
+
+struct LedPattern {
+    const LedKeyframe* keyframes;
+    uint8_t keyframeCount;
+};
+
+// Function declarations
+void initLedPatterns();
+void setLedStatus(byte status, bool active);
+void updateLedPatterns(unsigned long now);
+byte getLedStatus();
+
+#endif // LED_PATTERNS_H
@@ -0,0 +1,244 @@
+// memory_monitor.cpp
+#include "memory_monitor.h"
+
+static unsigned long lastReportTime = 0;
+static uint16_t reportedLateAllocations = 0;
+
+#if ALLOCATION_GUARD
+static volatile bool allocationsSealed = false;
+static volatile uint16_t lateAllocations = 0;
+
+static void noteAllocation() {
+    if (!allocationsSealed) {
+        return;
+    }
+#if MEMORY_MONITOR_HARDWARE
+    if (lateAllocations < 0xFFFF) {
+        lateAllocations++;
+    }
+#else
+    debugPrintln(DEBUG_GENERAL, "Allocation after setup");
+    Serial.flush();
+    abort();
+#endif
+}
+
+// Linked with -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc, every call
+// to these from the sketch and the libraries linked into it lands here
+// first, String's buffers included
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_realloc(void* memory, size_t size);
+void* __real_calloc(size_t count, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    noteAllocation();
+    return __real_malloc(size);
+}
+
+void* __wrap_realloc(void* memory, size_t size) {
+    noteAllocation();
+    return __real_realloc(memory, size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    noteAllocation();
+    return __real_calloc(count, size);
+}
+}
+
+// The C++ runtime may come as a shared library, whose calls the wrap
+// doesn't see, so new goes through the wrapped malloc explicitly
+static void* guardedAllocate(size_t size) {
+    void* memory = malloc(size ? size : 1);
+    if (memory == nullptr) {
+        abort();
+    }
+    return memory;
+}
+
+void* operator new(size_t size) {
+    return guardedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return guardedAllocate(size);
+}
+
+void sealAllocations() {
+    allocationsSealed = true;
+    debugPrintln(DEBUG_MEMORY, "Allocation guard armed");
+}
+
+static uint16_t getLateAllocations() {
+    return lateAllocations;
+}
+#else
+void sealAllocations() {
+}
+
+static uint16_t getLateAllocations() {
+    return 0;
+}
+#endif
+
+#if MEMORY_MONITOR_HARDWARE
+#include <cmsis_os2.h>
+#include <rtx_os.h>
+#include <malloc.h>
+
+// Linker script symbols
+extern "C" char __data_start__, __data_end__, __bss_start__, __bss_end__;
+extern "C" char __end__, __HeapLimit;
+
+#define MEMORY_MAX_THREADS 8
+
+static osRtxThread_t* mainThread = nullptr;
+static osRtxThread_t* bleThread = nullptr;
+
+// Threads running before BLE starts; the one that appears after it is
+// ArduinoBLE's
+static osThreadId_t startupThreads[MEMORY_MAX_THREADS];
+static uint32_t startupThreadCount = 0;
+
+// RTX keeps its overflow check word at the bottom of each stack, so the
+// paint starts above it
+static uint32_t* stackBottom(osRtxThread_t* thread) {
+    return (uint32_t*)thread->stack_mem + 1;
+}
+
+static void paintStack(osRtxThread_t* thread, uintptr_t top) {
+    uint32_t* word = stackBottom(thread);
+    uint32_t* end = (uint32_t*)(top - STACK_PAINT_MARGIN);
+    while (word < end) {
+        *word++ = STACK_PAINT_PATTERN;
+    }
+}
+
+// Bytes between the top of the stack and the deepest overwritten word.
+// The margin left unpainted counts as used.
+static uint32_t stackPeak(osRtxThread_t* thread) {
+    if (thread == nullptr) {
+        return 0;
+    }
+    uint32_t* word = stackBottom(thread);
+    uint32_t* end = (uint32_t*)((uint8_t*)thread->stack_mem + thread->stack_size);
+    while (word < end && *word == STACK_PAINT_PATTERN) {
+        word++;
+    }
+    return (uint8_t*)end - (uint8_t*)word;
+}
+
+static void paintMainStack() {
+    uint32_t marker = 0;
+    paintStack(mainThread, (uintptr_t)&marker);
+}
+
+// The BLE thread is blocked whenever this runs, so everything below its
+// saved stack pointer is free; the kernel lock keeps it from waking
+// while its stack is painted
+static void paintBleStack() {
+    if (bleThread == nullptr) {
+        return;
+    }
+    int32_t lock = osKernelLock();
+    paintStack(bleThread, bleThread->sp);
+    osKernelRestoreLock(lock);
+}
+
+void initMemoryMonitor() {
+    mainThread = (osRtxThread_t*)osThreadGetId();
+    startupThreadCount = osThreadEnumerate(startupThreads, MEMORY_MAX_THREADS);
+    paintMainStack();
+}
+
+void attachBleStack() {
+    osThreadId_t threads[MEMORY_MAX_THREADS];
+    uint32_t count = osThreadEnumerate(threads, MEMORY_MAX_THREADS);
+    for (uint32_t i = 0; i < count; i++) {
+        bool existing = false;
+        for (uint32_t j = 0; j < startupThreadCount; j++) {
+            existing |= threads[i] == startupThreads[j];
+        }
+        if (!existing) {
+            bleThread = (osRtxThread_t*)threads[i];
+            paintBleStack();
+            debugPrintf(DEBUG_MEMORY, "BLE stack: %lu bytes\n", (unsigned long)bleThread->stack_size);
+            return;
+        }
+    }
+    debugPrintln(DEBUG_MEMORY, "No BLE thread found, its stack is not watched");
+}
+
+void getMemoryStats(MemoryStats& stats) {
+    stats.mainStackSize = mainThread ? mainThread->stack_size : 0;
+    stats.mainStackPeak = stackPeak(mainThread);
+    stats.bleStackSize = bleThread ? bleThread->stack_size : 0;
+    stats.bleStackPeak = stackPeak(bleThread);
+    stats.staticRam = (&__data_end__ - &__data_start__) + (&__bss_end__ - &__bss_start__);
+
+    // The heap grows up from __end__; what the allocator hasn't claimed yet
+    // is one contiguous block up to __HeapLimit
+    struct mallinfo info = mallinfo();
+    uint32_t heapSize = &__HeapLimit - &__end__;
+    uint32_t unclaimed = heapSize > info.arena ? heapSize - info.arena : 0;
+    stats.heapUsed = info.uordblks;
+    stats.heapFree = info.fordblks + unclaimed;
+    stats.heapFreeChunks = min((unsigned long)info.ordblks, 0xFFFFUL);
+    stats.lateAllocations = getLateAllocations();
+    stats.heapFragmentation = stats.heapFree ? (uint64_t)info.fordblks * 100 / stats.heapFree : 0;
+}
+
+void resetMemoryStats() {
+    paintMainStack();
+    paintBleStack();
+}
+
+#else
+
+void initMemoryMonitor() {
+}
+
+void attachBleStack() {
+}
+
+void getMemoryStats(MemoryStats& stats) {
+    stats = MemoryStats{0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    stats.lateAllocations = getLateAllocations();
+}
+
+void resetMemoryStats() {
+}
+
+#endif
+
+static void reportStack(const char* name, uint32_t size, uint32_t peak) {
+    if (size == 0) {
+        return;
+    }
+    debugPrintf(DEBUG_MEMORY, "%s stack: %lu of %lu bytes used at peak\n", name,
+                (unsigned long)peak, (unsigned long)size);
+    if (size - peak < MEMORY_STACK_WARNING) {
+        debugPrintf(DEBUG_GENERAL, "WARNING: %s stack has only %lu bytes left\n", name,
+                    (unsigned long)(size - peak));
+    }
+}
+
+void updateMemoryMonitor(unsigned long now) {
+    if (now - lastReportTime < MEMORY_REPORT_INTERVAL) {
+        return;
+    }
+    lastReportTime = now;
+
+    MemoryStats stats;
+    getMemoryStats(stats);
+    reportStack("Main", stats.mainStackSize, stats.mainStackPeak);
+    reportStack("BLE", stats.bleStackSize, stats.bleStackPeak);
+    debugPrintf(DEBUG_MEMORY, "RAM: %lu static, heap %lu used, %lu free in %u chunks (%u%% fragmented)\n",
+                (unsigned long)stats.staticRam, (unsigned long)stats.heapUsed, (unsigned long)stats.heapFree,
+                stats.heapFreeChunks, stats.heapFragmentation);
+    if (stats.lateAllocations != reportedLateAllocations) {
+        debugPrintf(DEBUG_GENERAL, "WARNING: %u allocations since setup\n", stats.lateAllocations);
+        reportedLateAllocations = stats.lateAllocations;
+    }
+}
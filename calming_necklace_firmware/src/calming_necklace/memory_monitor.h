@@ -0,0 +1,68 @@
+// memory_monitor.h
+#ifndef MEMORY_MONITOR_H
+#define MEMORY_MONITOR_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// RAM usage. The unused part of each watched thread stack is painted with
+// a known word; the deepest point a stack has reached is found later by
+// scanning up from its bottom for the first overwritten word. The main
+// stack runs setup() and loop(); ArduinoBLE runs its HCI callbacks on a
+// thread of its own, which is picked up once BLE has started.
+//
+// Heap figures come from the allocator. Memory freed back into the middle
+// of the heap can only be reused by allocations that fit the holes, so
+// fragmentation is the share of free memory that sits in such holes.
+//
+// Static RAM per module is a build-time figure; see tools/memory_report.py.
+//
+// Nothing should be allocated once setup() has finished. Debug builds can
+// define ALLOCATION_GUARD to count allocations made after
+// sealAllocations(); off the nRF52840, which includes the host tests, such
+// an allocation stops the program instead. The guard replaces operator new
+// and wraps malloc, realloc and calloc, so the build has to link with
+//   -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc
+// (compiler.c.elf.extra_flags in platform.local.txt for the Arduino IDE).
+#if defined(NRF52840_XXAA)
+#define MEMORY_MONITOR_HARDWARE 1
+#else
+#define MEMORY_MONITOR_HARDWARE 0
+#endif
+
+#ifndef ALLOCATION_GUARD
+#define ALLOCATION_GUARD 0
+#endif
+
+#define STACK_PAINT_PATTERN 0xA5A5A5A5UL
+#define STACK_PAINT_MARGIN 256  // Bytes left unpainted below the live stack
+
+// Logged under DEBUG_MEMORY this often. A stack with less than
+// MEMORY_STACK_WARNING bytes of headroom left is also reported under
+// DEBUG_GENERAL, which is on by default.
+#define MEMORY_REPORT_INTERVAL 60000  // 1 minute
+#define MEMORY_STACK_WARNING 512      // Bytes
+
+// Stack figures are zero where stacks can't be watched
+struct MemoryStats {
+    uint32_t mainStackSize;
+    uint32_t mainStackPeak;
+    uint32_t bleStackSize;
+    uint32_t bleStackPeak;
+    uint32_t staticRam;       // .data + .bss
+    uint32_t heapUsed;
+    uint32_t heapFree;        // Free chunks plus heap never claimed
+    uint16_t heapFreeChunks;
+    uint16_t lateAllocations;   // Since sealAllocations(), with ALLOCATION_GUARD
+    uint8_t heapFragmentation;  // Percent of free heap held in freed chunks
+};
+
+// Function declarations
+void initMemoryMonitor();
+void attachBleStack();
+void sealAllocations();
+void getMemoryStats(MemoryStats& stats);
+void resetMemoryStats();
+void updateMemoryMonitor(unsigned long now);
+
+#endif // MEMORY_MONITOR_H
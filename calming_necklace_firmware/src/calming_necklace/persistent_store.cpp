@@ -0,0 +1,213 @@
+// persistent_store.cpp
+#include "persistent_store.h"
+
+// Record layout: a header word [magic][id][length][checksum] followed by
+// the data padded to whole words. Erased flash reads 0xFF, so the first
+// header without the magic byte marks the end of the log.
+static const byte RECORD_MAGIC = 0xA5;
+static const uint32_t ERASED_WORD = 0xFFFFFFFF;
+
+static uint32_t writeOffset = 0;
+
+#if STORE_FLASH_HARDWARE
+
+static uint32_t readWord(uint32_t offset) {
+    return *(volatile uint32_t*)(STORE_FLASH_ADDRESS + offset);
+}
+
+static void writeWord(uint32_t offset, uint32_t value) {
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen;
+    while (!NRF_NVMC->READY) {}
+    *(volatile uint32_t*)(STORE_FLASH_ADDRESS + offset) = value;
+    while (!NRF_NVMC->READY) {}
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+}
+
+// Stalls the CPU for ~85 ms, which is why saves append instead
+static void erasePage() {
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een;
+    while (!NRF_NVMC->READY) {}
+    NRF_NVMC->ERASEPAGE = STORE_FLASH_ADDRESS;
+    while (!NRF_NVMC->READY) {}
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+}
+
+#else
+
+// Simulated flash: writes can only clear bits, like the real thing
+static uint32_t simulatedFlash[STORE_PAGE_SIZE / 4];
+static bool simulatedFlashErased = false;
+
+static void erasePage() {
+    for (uint32_t i = 0; i < STORE_PAGE_SIZE / 4; i++) {
+        simulatedFlash[i] = ERASED_WORD;
+    }
+    simulatedFlashErased = true;
+}
+
+static uint32_t readWord(uint32_t offset) {
+    if (!simulatedFlashErased) {
+        erasePage();
+    }
+    return simulatedFlash[offset / 4];
+}
+
+static void writeWord(uint32_t offset, uint32_t value) {
+    simulatedFlash[offset / 4] &= value;
+}
+
+#endif
+
+static uint32_t paddedLength(byte length) {
+    return (length + 3) & ~3UL;
+}
+
+static byte checksum(byte id, const uint8_t* data, byte length) {
+    byte sum = id ^ length;
+    for (byte i = 0; i < length; i++) {
+        sum = (byte)((sum << 1) | (sum >> 7)) ^ data[i];
+    }
+    return sum;
+}
+
+static void readBytes(uint32_t offset, uint8_t* data, byte length) {
+    for (byte i = 0; i < length; i += 4) {
+        uint32_t word = readWord(offset + i);
+        for (byte j = 0; j < 4 && i + j < length; j++) {
+            data[i + j] = (word >> (8 * j)) & 0xFF;
+        }
+    }
+}
+
+static void writeBytes(uint32_t offset, const uint8_t* data, byte length) {
+    for (byte i = 0; i < length; i += 4) {
+        uint32_t word = ERASED_WORD;
+        for (byte j = 0; j < 4 && i + j < length; j++) {
+            word &= ~(0xFFUL << (8 * j));
+            word |= (uint32_t)data[i + j] << (8 * j);
+        }
+        writeWord(offset + i, word);
+    }
+}
+
+static bool isErased(uint32_t offset, uint32_t end) {
+    for (; offset < end; offset += 4) {
+        if (readWord(offset) != ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void appendRecord(byte id, const uint8_t* data, byte length) {
+    uint32_t header = RECORD_MAGIC | (id << 8) | (length << 16) | ((uint32_t)checksum(id, data, length) << 24);
+    writeBytes(writeOffset + 4, data, length);
+    // The header goes last so a record cut short by a reset is never valid
+    writeWord(writeOffset, header);
+    writeOffset += 4 + paddedLength(length);
+}
+
+// Finds the latest valid copy of a record, returning its data offset
+static bool findRecord(byte id, byte length, uint32_t& dataOffset) {
+    bool found = false;
+    uint32_t offset = 0;
+    while (offset + 4 <= STORE_PAGE_SIZE) {
+        uint32_t header = readWord(offset);
+        if ((header & 0xFF) != RECORD_MAGIC) {
+            break;
+        }
+        byte recordId = (header >> 8) & 0xFF;
+        byte recordLength = (header >> 16) & 0xFF;
+        if (recordId == id && recordLength == length) {
+            uint8_t data[STORE_MAX_RECORD_LENGTH];
+            readBytes(offset + 4, data, length);
+            if (checksum(id, data, length) == (header >> 24)) {
+                dataOffset = offset + 4;
+                found = true;
+            }
+        }
+        offset += 4 + paddedLength(recordLength);
+    }
+    return found;
+}
+
+// Rewrites the page with only the latest copy of each record
+static void compactPage() {
+    static uint8_t latestData[STORE_MAX_RECORD_ID][STORE_MAX_RECORD_LENGTH];
+    byte latestLength[STORE_MAX_RECORD_ID] = {0};
+
+    uint32_t offset = 0;
+    while (offset + 4 <= STORE_PAGE_SIZE) {
+        uint32_t header = readWord(offset);
+        if ((header & 0xFF) != RECORD_MAGIC) {
+            break;
+        }
+        byte recordId = (header >> 8) & 0xFF;
+        byte recordLength = (header >> 16) & 0xFF;
+        if (recordId < STORE_MAX_RECORD_ID && recordLength <= STORE_MAX_RECORD_LENGTH) {
+            uint8_t data[STORE_MAX_RECORD_LENGTH];
+            readBytes(offset + 4, data, recordLength);
+            if (checksum(recordId, data, recordLength) == (header >> 24)) {
+                memcpy(latestData[recordId], data, recordLength);
+                latestLength[recordId] = recordLength;
+            }
+        }
+        offset += 4 + paddedLength(recordLength);
+    }
+
+    debugPrintln(DEBUG_SETTINGS, "Compacting persistent store");
+    erasePage();
+    writeOffset = 0;
+    for (byte id = 0; id < STORE_MAX_RECORD_ID; id++) {
+        if (latestLength[id] > 0) {
+            appendRecord(id, latestData[id], latestLength[id]);
+        }
+    }
+}
+
+void initPersistentStore() {
+    writeOffset = 0;
+    while (writeOffset + 4 <= STORE_PAGE_SIZE) {
+        uint32_t header = readWord(writeOffset);
+        if ((header & 0xFF) != RECORD_MAGIC) {
+            break;
+        }
+        writeOffset += 4 + paddedLength((header >> 16) & 0xFF);
+    }
+
+    // Anything but erased flash past the log is a torn write, possibly data
+    // programmed under a header that never was; the next save would land on
+    // it and fail its checksum, so start clean
+    if (!isErased(writeOffset, STORE_PAGE_SIZE)) {
+        compactPage();
+    }
+    debugPrintf(DEBUG_SETTINGS, "Persistent store: %lu bytes used\n", (unsigned long)writeOffset);
+}
+
+bool loadRecord(byte id, void* data, byte length) {
+    uint32_t dataOffset;
+    if (length > STORE_MAX_RECORD_LENGTH || !findRecord(id, length, dataOffset)) {
+        return false;
+    }
+    readBytes(dataOffset, (uint8_t*)data, length);
+    return true;
+}
+
+bool saveRecord(byte id, const void* data, byte length) {
+    if (id >= STORE_MAX_RECORD_ID || length > STORE_MAX_RECORD_LENGTH) {
+        return false;
+    }
+
+    uint32_t end = writeOffset + 4 + paddedLength(length);
+    if (end > STORE_PAGE_SIZE || !isErased(writeOffset, end)) {
+        compactPage();
+    }
+    appendRecord(id, (const uint8_t*)data, length);
+    return true;
+}
+
+#if !STORE_FLASH_HARDWARE
+void simulateTornSave(byte id, const void* data, byte length) {
+    writeBytes(writeOffset + 4, (const uint8_t*)data, length);
+}
+#endif
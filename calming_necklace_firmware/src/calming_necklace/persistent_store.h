@@ -0,0 +1,34 @@
+// persistent_store.h
+#ifndef PERSISTENT_STORE_H
+#define PERSISTENT_STORE_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Small records kept in one flash page. Saves append a new copy of the
+// record, so a page erase is only needed when the page fills up and the
+// latest copy of each record is compacted back into it.
+#define STORE_PAGE_SIZE 4096
+#define STORE_MAX_RECORD_LENGTH 32
+#define STORE_MAX_RECORD_ID 8
+
+#if defined(NRF52840_XXAA)
+#define STORE_FLASH_HARDWARE 1
+#define STORE_FLASH_ADDRESS 0x000FF000  // Last page of the 1 MB flash
+#else
+#define STORE_FLASH_HARDWARE 0
+#endif
+
+// Record ids
+#define STORE_RECORD_BUDGET 1
+
+// Function declarations
+void initPersistentStore();
+bool loadRecord(byte id, void* data, byte length);
+bool saveRecord(byte id, const void* data, byte length);
+#if !STORE_FLASH_HARDWARE
+// Programs a save's data but not its header, as a reset between the two would
+void simulateTornSave(byte id, const void* data, byte length);
+#endif
+
+#endif // PERSISTENT_STORE_H
@@ -0,0 +1,289 @@
+// recovery.cpp
+#include "recovery.h"
+#include "settings.h"
+#include "emission_control.h"
+#include "duration_controller.h"
+#include "heart_rate.h"
+#include "heart_rate_trend.h"
+#include "time_service.h"
+
+// Every setting in settings.h
+struct SettingsSnapshot {
+    uint32_t emissionDuration[EMISSION_CHANNEL_COUNT];
+    uint32_t releaseInterval[EMISSION_CHANNEL_COUNT];
+    uint32_t adaptiveDurationMin[EMISSION_CHANNEL_COUNT];
+    uint32_t adaptiveDurationMax[EMISSION_CHANNEL_COUNT];
+    uint32_t recoveryTarget[EMISSION_CHANNEL_COUNT];
+    uint32_t minEmissionGap;
+    uint32_t emissionBudget;
+    uint32_t emissionBudgetPeriod;
+    uint32_t predictionHorizon;
+    uint32_t heartRateMinInterval;
+    uint32_t heartRateMaxInterval;
+    int16_t highHeartRateThreshold;
+    int16_t lowHeartRateThreshold;
+    int16_t predictionHysteresis;
+    byte channelTriggers[EMISSION_CHANNEL_COUNT];
+    byte channelPriority[EMISSION_CHANNEL_COUNT];
+    byte emissionProfile[EMISSION_CHANNEL_COUNT];
+    byte emissionIntensity[EMISSION_CHANNEL_COUNT];
+    byte triggerPolicy[TRIGGER_SOURCE_COUNT];
+    byte batteryThresholds[3];
+    bool periodicEmissionEnabled[EMISSION_CHANNEL_COUNT];
+    bool adaptiveDurationEnabled[EMISSION_CHANNEL_COUNT];
+    bool emissionBudgetEnabled;
+    bool manualBudgetExempt;
+    bool heartRateBasedReleaseEnabled;
+    bool predictiveReleaseEnabled;
+};
+
+struct RetainedState {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t resets;
+    uint32_t watchdogResets;
+    uint32_t settingsGeneration;
+    uint32_t settingsHash;
+    SettingsSnapshot settings;
+    uint32_t adaptedDuration[EMISSION_CHANNEL_COUNT];  // What the duration controller has learned
+    EmissionSnapshot emission;
+    uint32_t heartRateAges[TREND_WINDOW_SIZE];  // ms before the capture
+    byte heartRateValues[TREND_WINDOW_SIZE];
+    byte heartRateSamples;
+    byte heartRate;
+    uint32_t checksum;  // Over everything before it
+};
+
+// Hashed a word at a time, so everything before the checksum must be
+// whole words
+static_assert(offsetof(RetainedState, checksum) % 4 == 0, "retained state must end on a word");
+static_assert(sizeof(SettingsSnapshot) % 4 == 0, "settings snapshot must be whole words");
+
+// The core's linker script keeps .noinit out of the startup zeroing and
+// copying, so its contents survive any reset that keeps RAM powered
+#if RECOVERY_HARDWARE
+static RetainedState retained __attribute__((section(".noinit")));
+#else
+static RetainedState retained;
+#endif
+
+static bool retainedValid = false;
+static byte lastResetReason = RESET_REASON_POWER_ON;
+static byte restoredParts = 0;
+static uint32_t recoveryMicros = 0;
+static uint32_t startMicros = 0;
+
+static const char* const RESET_REASON_NAMES[] = {"power on", "reset pin", "watchdog", "software", "lockup", "wake"};
+
+// FNV-1a over 32-bit words; a few microseconds for the whole block
+static uint32_t hashWords(const void* data, size_t length) {
+    const uint32_t* words = (const uint32_t*)data;
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length / 4; i++) {
+        hash ^= words[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static uint32_t retainedChecksum() {
+    return hashWords(&retained, offsetof(RetainedState, checksum));
+}
+
+static void captureSettings(SettingsSnapshot& snapshot) {
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        snapshot.emissionDuration[channel] = emissionDuration[channel];
+        snapshot.releaseInterval[channel] = releaseInterval[channel];
+        snapshot.adaptiveDurationMin[channel] = adaptiveDurationMin[channel];
+        snapshot.adaptiveDurationMax[channel] = adaptiveDurationMax[channel];
+        snapshot.recoveryTarget[channel] = recoveryTarget[channel];
+        snapshot.channelTriggers[channel] = channelTriggers[channel];
+        snapshot.channelPriority[channel] = channelPriority[channel];
+        snapshot.emissionProfile[channel] = emissionProfile[channel];
+        snapshot.emissionIntensity[channel] = emissionIntensity[channel];
+        snapshot.periodicEmissionEnabled[channel] = periodicEmissionEnabled[channel];
+        snapshot.adaptiveDurationEnabled[channel] = adaptiveDurationEnabled[channel];
+    }
+    memcpy(snapshot.triggerPolicy, triggerPolicy, sizeof(snapshot.triggerPolicy));
+    snapshot.batteryThresholds[0] = batteryReducedThreshold;
+    snapshot.batteryThresholds[1] = batteryLowThreshold;
+    snapshot.batteryThresholds[2] = batteryCriticalThreshold;
+    snapshot.minEmissionGap = minEmissionGap;
+    snapshot.emissionBudget = emissionBudget;
+    snapshot.emissionBudgetPeriod = emissionBudgetPeriod;
+    snapshot.predictionHorizon = predictionHorizon;
+    snapshot.heartRateMinInterval = heartRateMinInterval;
+    snapshot.heartRateMaxInterval = heartRateMaxInterval;
+    snapshot.highHeartRateThreshold = highHeartRateThreshold;
+    snapshot.lowHeartRateThreshold = lowHeartRateThreshold;
+    snapshot.predictionHysteresis = predictionHysteresis;
+    snapshot.emissionBudgetEnabled = emissionBudgetEnabled;
+    snapshot.manualBudgetExempt = manualBudgetExempt;
+    snapshot.heartRateBasedReleaseEnabled = heartRateBasedReleaseEnabled;
+    snapshot.predictiveReleaseEnabled = predictiveReleaseEnabled;
+}
+
+static void restoreSettings(const SettingsSnapshot& snapshot) {
+    for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+        emissionDuration[channel] = snapshot.emissionDuration[channel];
+        releaseInterval[channel] = snapshot.releaseInterval[channel];
+        adaptiveDurationMin[channel] = snapshot.adaptiveDurationMin[channel];
+        adaptiveDurationMax[channel] = snapshot.adaptiveDurationMax[channel];
+        recoveryTarget[channel] = snapshot.recoveryTarget[channel];
+        channelTriggers[channel] = snapshot.channelTriggers[channel];
+        channelPriority[channel] = snapshot.channelPriority[channel];
+        emissionProfile[channel] = snapshot.emissionProfile[channel];
+        emissionIntensity[channel] = snapshot.emissionIntensity[channel];
+        periodicEmissionEnabled[channel] = snapshot.periodicEmissionEnabled[channel];
+        adaptiveDurationEnabled[channel] = snapshot.adaptiveDurationEnabled[channel];
+    }
+    memcpy(triggerPolicy, snapshot.triggerPolicy, sizeof(snapshot.triggerPolicy));
+    batteryReducedThreshold = snapshot.batteryThresholds[0];
+    batteryLowThreshold = snapshot.batteryThresholds[1];
+    batteryCriticalThreshold = snapshot.batteryThresholds[2];
+    minEmissionGap = snapshot.minEmissionGap;
+    emissionBudget = snapshot.emissionBudget;
+    emissionBudgetPeriod = snapshot.emissionBudgetPeriod;
+    predictionHorizon = snapshot.predictionHorizon;
+    heartRateMinInterval = snapshot.heartRateMinInterval;
+    heartRateMaxInterval = snapshot.heartRateMaxInterval;
+    highHeartRateThreshold = snapshot.highHeartRateThreshold;
+    lowHeartRateThreshold = snapshot.lowHeartRateThreshold;
+    predictionHysteresis = snapshot.predictionHysteresis;
+    emissionBudgetEnabled = snapshot.emissionBudgetEnabled;
+    manualBudgetExempt = snapshot.manualBudgetExempt;
+    heartRateBasedReleaseEnabled = snapshot.heartRateBasedReleaseEnabled;
+    predictiveReleaseEnabled = snapshot.predictiveReleaseEnabled;
+}
+
+static byte readResetReason() {
+#if RECOVERY_HARDWARE
+    uint32_t reasons = NRF_POWER->RESETREAS;
+    NRF_POWER->RESETREAS = reasons;  // Write one to clear
+    if (reasons & POWER_RESETREAS_DOG_Msk) {
+        return RESET_REASON_WATCHDOG;
+    }
+    if (reasons & POWER_RESETREAS_LOCKUP_Msk) {
+        return RESET_REASON_LOCKUP;
+    }
+    if (reasons & POWER_RESETREAS_SREQ_Msk) {
+        return RESET_REASON_SOFT;
+    }
+    if (reasons & POWER_RESETREAS_RESETPIN_Msk) {
+        return RESET_REASON_PIN;
+    }
+    if (reasons & POWER_RESETREAS_OFF_Msk) {
+        return RESET_REASON_WAKE;
+    }
+    return RESET_REASON_POWER_ON;
+#else
+    return retainedValid ? RESET_REASON_WATCHDOG : RESET_REASON_POWER_ON;
+#endif
+}
+
+// First thing in setup(): only looks, restoreRetainedState() acts
+void initRecovery() {
+    startMicros = readMonotonicMicros();
+    // A pin or software reset leaves a running watchdog running
+    feedWatchdog();
+    retainedValid = retained.magic == RETAINED_MAGIC && retained.version == RETAINED_VERSION &&
+                    retained.length == sizeof(RetainedState) && retained.checksum == retainedChecksum();
+    lastResetReason = readResetReason();
+}
+
+// Called once the modules are initialised and before BLE starts
+void restoreRetainedState() {
+    updateLoopTime();
+    unsigned long now = getLoopMillis();
+    restoredParts = 0;
+
+    if (!retainedValid) {
+        memset(&retained, 0, sizeof(retained));
+        retained.magic = RETAINED_MAGIC;
+        retained.version = RETAINED_VERSION;
+        retained.length = sizeof(RetainedState);
+    } else {
+        retained.resets++;
+        if (lastResetReason == RESET_REASON_WATCHDOG) {
+            retained.watchdogResets++;
+        }
+        restoreSettings(retained.settings);
+        restoreAdaptedDurations(retained.adaptedDuration);
+        restoredParts |= RESTORED_SETTINGS;
+
+        if (lastResetReason == RESET_REASON_WATCHDOG || lastResetReason == RESET_REASON_LOCKUP) {
+            for (byte i = 0; i < retained.heartRateSamples && i < TREND_WINDOW_SIZE; i++) {
+                addHeartRateSample(now - retained.heartRateAges[i], retained.heartRateValues[i]);
+            }
+            currentHeartRate = retained.heartRate;
+            restoredParts |= RESTORED_HEART_RATE;
+            if (restoreEmissionState(retained.emission, now) > 0) {
+                restoredParts |= RESTORED_EMISSION;
+            }
+        }
+    }
+
+    recoveryMicros = readMonotonicMicros() - startMicros;
+    debugPrintf(DEBUG_GENERAL, "Reset by %s; restored 0x%02x in %lu us, settings generation %lu\n",
+                RESET_REASON_NAMES[lastResetReason], restoredParts, (unsigned long)recoveryMicros,
+                (unsigned long)retained.settingsGeneration);
+}
+
+void startWatchdog() {
+#if RECOVERY_HARDWARE
+    // Once running it can't be reconfigured, e.g. after a software reset
+    if (!NRF_WDT->RUNSTATUS) {
+        NRF_WDT->CONFIG = (WDT_CONFIG_SLEEP_Run << WDT_CONFIG_SLEEP_Pos) | (WDT_CONFIG_HALT_Pause << WDT_CONFIG_HALT_Pos);
+        NRF_WDT->CRV = (WATCHDOG_TIMEOUT * 32768UL) / 1000 - 1;
+        NRF_WDT->RREN = WDT_RREN_RR0_Msk;
+        NRF_WDT->TASKS_START = 1;
+    }
+#endif
+    feedWatchdog();
+    debugPrintf(DEBUG_GENERAL, "Watchdog armed: %d ms\n", WATCHDOG_TIMEOUT);
+}
+
+void feedWatchdog() {
+#if RECOVERY_HARDWARE
+    NRF_WDT->RR[0] = WDT_RR_RR_Reload;
+#endif
+}
+
+// Runs at the end of every loop pass, which is also what feeds the
+// watchdog: a pass that never finishes lets it bite
+void updateRetainedState(unsigned long now) {
+    captureSettings(retained.settings);
+    uint32_t settingsHash = hashWords(&retained.settings, sizeof(retained.settings));
+    if (settingsHash != retained.settingsHash) {
+        retained.settingsHash = settingsHash;
+        retained.settingsGeneration++;
+    }
+
+    captureAdaptedDurations(retained.adaptedDuration);
+    captureEmissionState(retained.emission, now);
+
+    unsigned long timestamps[TREND_WINDOW_SIZE];
+    retained.heartRateSamples = getHeartRateSamples(timestamps, retained.heartRateValues);
+    for (byte i = 0; i < retained.heartRateSamples; i++) {
+        retained.heartRateAges[i] = now - timestamps[i];
+    }
+    retained.heartRate = getCurrentHeartRate();
+
+    retained.checksum = retainedChecksum();
+    feedWatchdog();
+}
+
+void getRecoveryStats(RecoveryStats& stats) {
+    stats.resets = retained.resets;
+    stats.watchdogResets = retained.watchdogResets;
+    stats.settingsGeneration = retained.settingsGeneration;
+    stats.recoveryMicros = recoveryMicros;
+    stats.lastResetReason = lastResetReason;
+    stats.restored = restoredParts;
+}
+
+void resetRecoveryStats() {
+    retained.resets = 0;
+    retained.watchdogResets = 0;
+}
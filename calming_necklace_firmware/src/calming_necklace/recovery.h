@@ -0,0 +1,66 @@
+// recovery.h
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Watchdog and fast recovery. The hardware watchdog resets the board when
+// the main loop stops feeding it, e.g. when it hangs in a blocking BLE
+// call. Every loop pass copies the settings, the emission state and the
+// head of the heart rate history into RAM that startup code leaves alone,
+// sealed with a checksum. After a reset the copy is checked and put back
+// before BLE starts, so the device carries on without the app.
+//
+// Settings come back after any reset that kept RAM. Emissions and heart
+// rate history only come back after a watchdog or lockup reset: those
+// follow a fault within WATCHDOG_TIMEOUT, while a reset button press or a
+// firmware update may have been meant to stop things.
+//
+// The host build has no reset register; a second setup() in a simulation
+// finds the retained copy intact and counts as a watchdog reset.
+#if defined(NRF52840_XXAA)
+#define RECOVERY_HARDWARE 1
+#else
+#define RECOVERY_HARDWARE 0
+#endif
+
+// Long enough for setup(), which feeds it at the start and the end
+#define WATCHDOG_TIMEOUT 8000  // ms
+
+#define RETAINED_MAGIC 0x52544E44UL  // "DNTR"
+#define RETAINED_VERSION 3
+
+// Reset reasons
+#define RESET_REASON_POWER_ON 0
+#define RESET_REASON_PIN 1
+#define RESET_REASON_WATCHDOG 2
+#define RESET_REASON_SOFT 3       // Software request, including a firmware update
+#define RESET_REASON_LOCKUP 4
+#define RESET_REASON_WAKE 5       // Wake from system off
+
+// What the last startup restored
+#define RESTORED_SETTINGS 0x01
+#define RESTORED_EMISSION 0x02
+#define RESTORED_HEART_RATE 0x04
+
+// Counters survive resets as long as the retained copy does
+struct RecoveryStats {
+    uint32_t resets;              // Resets that kept the retained copy
+    uint32_t watchdogResets;
+    uint32_t settingsGeneration;  // Bumped on every settings change
+    uint32_t recoveryMicros;      // From the start of setup() to restored
+    uint8_t lastResetReason;      // RESET_REASON_*
+    uint8_t restored;             // RESTORED_* bits
+};
+
+// Function declarations
+void initRecovery();
+void restoreRetainedState();
+void startWatchdog();
+void feedWatchdog();
+void updateRetainedState(unsigned long now);
+void getRecoveryStats(RecoveryStats& stats);
+void resetRecoveryStats();
+
+#endif // RECOVERY_H
@@ -0,0 +1,351 @@
+// rule_engine.cpp
+#include "rule_engine.h"
+#include "emission_control.h"
+#include "heart_rate.h"
+#include "heart_rate_trend.h"
+#include "wall_clock.h"
+#include "time_service.h"
+
+struct Rule {
+    uint8_t code[RULE_MAX_CODE];
+    uint8_t length;
+    uint8_t channelMask;
+    unsigned long holdSince[RULE_HOLD_SLOTS];
+};
+
+static Rule rules[RULE_CAPACITY];
+static byte usedRules = 0;       // Bit per rule slot
+static byte ruleResults = 0;     // Bit per rule, result of the last evaluation
+static byte holdingSlots[RULE_CAPACITY];  // Bit per hold slot whose condition is currently true
+
+static unsigned long lastEvaluationTime = 0;
+static RuleStats ruleStats = {0, 0, 0, 0, 0};
+
+// Operand bytes following each opcode
+static byte operandLength(byte op) {
+    switch (op) {
+        case RULE_OP_PUSH:
+            return 2;
+        case RULE_OP_LOAD:
+            return 1;
+        case RULE_OP_HOLD:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+// Values each opcode takes off the stack, or -1 for an unknown opcode
+static int stackPops(byte op) {
+    switch (op) {
+        case RULE_OP_PUSH:
+        case RULE_OP_LOAD:
+            return 0;
+        case RULE_OP_NOT:
+        case RULE_OP_HOLD:
+            return 1;
+        case RULE_OP_GT:
+        case RULE_OP_LT:
+        case RULE_OP_GE:
+        case RULE_OP_LE:
+        case RULE_OP_EQ:
+        case RULE_OP_AND:
+        case RULE_OP_OR:
+            return 2;
+        case RULE_OP_BETWEEN:
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+bool validateRule(const uint8_t* code, byte length) {
+    if (length == 0 || length > RULE_MAX_CODE) {
+        return false;
+    }
+
+    int depth = 0;
+    byte slotsUsed = 0;
+    byte pc = 0;
+    while (pc < length && code[pc] != RULE_OP_END) {
+        byte op = code[pc];
+        if (pc + 1 + operandLength(op) > length) {
+            debugPrintf(DEBUG_SETTINGS, "Rule truncated at %d\n", pc);
+            return false;
+        }
+
+        int pops = stackPops(op), pushes = 1;
+        if (pops < 0) {
+            debugPrintf(DEBUG_SETTINGS, "Rule has unknown opcode 0x%02X at %d\n", op, pc);
+            return false;
+        }
+        if (op == RULE_OP_LOAD && code[pc + 1] >= RULE_VAR_COUNT) {
+            debugPrintf(DEBUG_SETTINGS, "Rule reads unknown variable %d\n", code[pc + 1]);
+            return false;
+        }
+        if (op == RULE_OP_HOLD) {
+            // Each slot keeps one timer, so it may only appear once
+            if (code[pc + 1] >= RULE_HOLD_SLOTS || (slotsUsed & (1 << code[pc + 1]))) {
+                debugPrintf(DEBUG_SETTINGS, "Rule uses invalid hold slot %d\n", code[pc + 1]);
+                return false;
+            }
+            slotsUsed |= 1 << code[pc + 1];
+        }
+
+        if (depth < pops || depth - pops + pushes > RULE_STACK_DEPTH) {
+            debugPrintf(DEBUG_SETTINGS, "Rule stack out of bounds at %d\n", pc);
+            return false;
+        }
+        depth += pushes - pops;
+        pc += 1 + operandLength(op);
+    }
+
+    return depth == 1;
+}
+
+bool setRule(byte index, byte channelMask, const uint8_t* code, byte length) {
+    if (index >= RULE_CAPACITY) {
+        return false;
+    }
+
+    if (length == 0) {
+        usedRules &= ~(1 << index);
+        ruleResults &= ~(1 << index);
+        debugPrintf(DEBUG_SETTINGS, "Rule %d deleted\n", index);
+        return true;
+    }
+
+    if (channelMask == 0 || channelMask >= (1 << EMISSION_CHANNEL_COUNT) || !validateRule(code, length)) {
+        debugPrintf(DEBUG_SETTINGS, "Rule %d rejected\n", index);
+        return false;
+    }
+
+    Rule& rule = rules[index];
+    memcpy(rule.code, code, length);
+    rule.length = length;
+    rule.channelMask = channelMask;
+    usedRules |= 1 << index;
+    // Start low so a rule that is already true fires on its first evaluation
+    ruleResults &= ~(1 << index);
+    holdingSlots[index] = 0;
+    debugPrintf(DEBUG_SETTINGS, "Rule %d set: %d bytes, channels 0x%02X\n", index, length, channelMask);
+    return true;
+}
+
+void clearRules() {
+    usedRules = 0;
+    ruleResults = 0;
+}
+
+void initRuleEngine() {
+    clearRules();
+    lastEvaluationTime = getLoopMillis();
+}
+
+// Snapshot of the inputs, taken once per pass so every rule sees the same
+// values. Returns a bit per variable that has no value yet.
+static byte loadVariables(int32_t* variables, unsigned long currentTime) {
+    byte unknownVariables = 0;
+    variables[RULE_VAR_HEART_RATE] = getCurrentHeartRate();
+    variables[RULE_VAR_HEART_RATE_SLOPE] = isHeartRateTrendValid() ? (int32_t)(getHeartRateSlope() * 60) : 0;
+    variables[RULE_VAR_PROJECTED_HEART_RATE] = isHeartRateTrendValid()
+        ? getProjectedHeartRate(predictionHorizon) : getCurrentHeartRate();
+
+    if (isWallClockSynced()) {
+        uint64_t wallMillis = getWallClockMillis();
+        variables[RULE_VAR_MINUTE_OF_DAY] = getMinuteOfDay(wallMillis);
+        variables[RULE_VAR_WEEKDAY] = getWeekday(wallMillis);
+    } else {
+        variables[RULE_VAR_MINUTE_OF_DAY] = -1;
+        variables[RULE_VAR_WEEKDAY] = -1;
+        unknownVariables |= (1 << RULE_VAR_MINUTE_OF_DAY) | (1 << RULE_VAR_WEEKDAY);
+    }
+
+    unsigned long lastEmission = getLastEmissionTime();
+    variables[RULE_VAR_SECONDS_SINCE_EMISSION] = lastEmission == 0 ? INT32_MAX : (currentTime - lastEmission) / 1000;
+    variables[RULE_VAR_EMISSION_ACTIVE] = isEmissionActive();
+
+    BudgetStats budget;
+    getBudgetStats(budget);
+    variables[RULE_VAR_BUDGET_REMAINING] = budget.remaining / 1000;
+    return unknownVariables;
+}
+
+// Runs a validated program. Validation guarantees the stack bounds and
+// operands, so the loop does no checking of its own.
+//
+// Each stack slot carries an unknown bit alongside its value. Comparisons,
+// BETWEEN, NOT and HOLD on an unknown operand give unknown without looking
+// at the value, so neither the -1 placeholder of an unsynced clock nor its
+// negation can satisfy a rule; AND and OR follow three-valued logic.
+static bool runRule(byte index, const int32_t* variables, byte unknownVariables,
+                    unsigned long currentTime, uint16_t& instructions) {
+    Rule& rule = rules[index];
+    int32_t stack[RULE_STACK_DEPTH];
+    byte unknown = 0;  // Bit per stack slot
+    byte top = 0;
+    byte pc = 0;
+
+    while (pc < rule.length && rule.code[pc] != RULE_OP_END) {
+        const uint8_t* instruction = &rule.code[pc];
+        pc += 1 + operandLength(instruction[0]);
+        instructions++;
+
+        int pops = stackPops(instruction[0]);
+        byte operands = ((1 << pops) - 1) << (top - pops);
+        bool logical = instruction[0] == RULE_OP_AND || instruction[0] == RULE_OP_OR;
+        if ((unknown & operands) && !logical) {
+            if (instruction[0] == RULE_OP_HOLD) {
+                holdingSlots[index] &= ~(1 << instruction[1]);
+            }
+            top -= pops;
+            unknown = (unknown & ~operands) | (1 << top);
+            stack[top++] = 0;
+            continue;
+        }
+
+        switch (instruction[0]) {
+            case RULE_OP_PUSH:
+                unknown &= ~(1 << top);
+                stack[top++] = (int16_t)(instruction[1] | (instruction[2] << 8));
+                break;
+            case RULE_OP_LOAD:
+                if (unknownVariables & (1 << instruction[1])) {
+                    unknown |= 1 << top;
+                } else {
+                    unknown &= ~(1 << top);
+                }
+                stack[top++] = variables[instruction[1]];
+                break;
+            case RULE_OP_GT:
+                top--;
+                stack[top - 1] = stack[top - 1] > stack[top];
+                break;
+            case RULE_OP_LT:
+                top--;
+                stack[top - 1] = stack[top - 1] < stack[top];
+                break;
+            case RULE_OP_GE:
+                top--;
+                stack[top - 1] = stack[top - 1] >= stack[top];
+                break;
+            case RULE_OP_LE:
+                top--;
+                stack[top - 1] = stack[top - 1] <= stack[top];
+                break;
+            case RULE_OP_EQ:
+                top--;
+                stack[top - 1] = stack[top - 1] == stack[top];
+                break;
+            case RULE_OP_AND:
+            case RULE_OP_OR: {
+                // A known false decides AND and a known true decides OR;
+                // otherwise an unknown side leaves the result unknown
+                top--;
+                bool decider = instruction[0] == RULE_OP_OR;
+                bool decided = (!(unknown & (1 << (top - 1))) && (stack[top - 1] != 0) == decider) ||
+                               (!(unknown & (1 << top)) && (stack[top] != 0) == decider);
+                bool undecided = unknown & (3 << (top - 1));
+                unknown &= ~(3 << (top - 1));
+                if (decided) {
+                    stack[top - 1] = decider;
+                } else if (undecided) {
+                    unknown |= 1 << (top - 1);
+                    stack[top - 1] = 0;
+                } else {
+                    stack[top - 1] = !decider;
+                }
+                break;
+            }
+            case RULE_OP_NOT:
+                stack[top - 1] = !stack[top - 1];
+                break;
+            case RULE_OP_HOLD: {
+                byte slot = instruction[1];
+                unsigned long holdTime = (instruction[2] | (instruction[3] << 8)) * 1000UL;
+                if (!stack[top - 1]) {
+                    holdingSlots[index] &= ~(1 << slot);
+                } else {
+                    if (!(holdingSlots[index] & (1 << slot))) {
+                        holdingSlots[index] |= 1 << slot;
+                        rule.holdSince[slot] = currentTime;
+                    }
+                    stack[top - 1] = currentTime - rule.holdSince[slot] >= holdTime;
+                }
+                break;
+            }
+            case RULE_OP_BETWEEN: {
+                top -= 2;
+                int32_t value = stack[top - 1], low = stack[top], high = stack[top + 1];
+                // A wrapped range such as 22:00-06:00 covers both ends
+                stack[top - 1] = low <= high ? (value >= low && value <= high)
+                                             : (value >= low || value <= high);
+                break;
+            }
+        }
+    }
+
+    return !(unknown & 1) && stack[0] != 0;
+}
+
+void evaluateRules() {
+    if (usedRules == 0) {
+        return;
+    }
+
+    unsigned long currentTime = getLoopMillis();
+    lastEvaluationTime = currentTime;
+
+    int32_t variables[RULE_VAR_COUNT];
+    byte unknownVariables = loadVariables(variables, currentTime);
+
+    for (byte index = 0; index < RULE_CAPACITY; index++) {
+        if (!(usedRules & (1 << index))) {
+            continue;
+        }
+
+        uint16_t instructions = 0;
+        unsigned long startMicros = micros();
+        bool result = runRule(index, variables, unknownVariables, currentTime, instructions);
+        unsigned long elapsed = micros() - startMicros;
+
+        ruleStats.evaluations++;
+        ruleStats.totalMicros += elapsed;
+        ruleStats.maxMicros = max(ruleStats.maxMicros, (uint16_t)min(elapsed, 0xFFFFUL));
+        ruleStats.maxInstructions = max(ruleStats.maxInstructions, instructions);
+
+        // Fire on the rising edge only; arbitration handles repeats from there
+        bool wasTrue = ruleResults & (1 << index);
+        if (result) {
+            ruleResults |= 1 << index;
+        } else {
+            ruleResults &= ~(1 << index);
+        }
+        if (!result || wasTrue) {
+            continue;
+        }
+
+        debugPrintf(DEBUG_GENERAL, "Rule %d fired\n", index);
+        ruleStats.fired++;
+        for (byte channel = 0; channel < EMISSION_CHANNEL_COUNT; channel++) {
+            if (rules[index].channelMask & (1 << channel)) {
+                triggerChannelEmission(channel, TRIGGER_RULE);
+            }
+        }
+    }
+}
+
+// Timer-driven evaluation, so time-based conditions fire between samples
+void updateRuleEngine(unsigned long now) {
+    if (now - lastEvaluationTime >= RULE_EVALUATION_INTERVAL) {
+        evaluateRules();
+    }
+}
+
+void getRuleStats(RuleStats& stats) {
+    stats = ruleStats;
+}
+
+void resetRuleStats() {
+    ruleStats = RuleStats{0, 0, 0, 0, 0};
+}
@@ -0,0 +1,76 @@
+// rule_engine.h
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// User-defined trigger rules. The app compiles each rule to a short
+// stack-machine program; the device validates it once on upload and then
+// evaluates it on every heart rate sample and on a one second tick. A rule
+// fires a TRIGGER_RULE emission on its channels when its result turns true.
+//
+// Programs have no jumps, so an evaluation runs at most RULE_MAX_CODE
+// instructions on a fixed RULE_STACK_DEPTH stack. A variable without a
+// value is unknown, and so is anything computed from it, except that a
+// known false decides AND and a known true decides OR. A rule whose result
+// is unknown doesn't fire, so a time-based rule, or one that negates a
+// time-based condition, stays quiet until the wall clock has been synced.
+#define RULE_CAPACITY 8
+#define RULE_MAX_CODE 32
+#define RULE_STACK_DEPTH 8
+#define RULE_HOLD_SLOTS 2
+#define RULE_EVALUATION_INTERVAL 1000  // 1 second
+
+// Rule record: [index][channel mask][bytecode...]. A record with no
+// bytecode deletes the rule; index RULE_CLEAR deletes all of them.
+#define RULE_HEADER_LENGTH 2
+#define RULE_RECORD_LENGTH (RULE_HEADER_LENGTH + RULE_MAX_CODE)
+#define RULE_CLEAR 0xFF
+
+// Opcodes
+#define RULE_OP_END 0x00      // Stop; the top of the stack is the result
+#define RULE_OP_PUSH 0x01     // [value, LE16 signed] -> value
+#define RULE_OP_LOAD 0x02     // [variable] -> value
+#define RULE_OP_GT 0x03       // a b -> a > b
+#define RULE_OP_LT 0x04       // a b -> a < b
+#define RULE_OP_GE 0x05       // a b -> a >= b
+#define RULE_OP_LE 0x06       // a b -> a <= b
+#define RULE_OP_EQ 0x07       // a b -> a == b
+#define RULE_OP_AND 0x08      // a b -> a && b
+#define RULE_OP_OR 0x09       // a b -> a || b
+#define RULE_OP_NOT 0x0A      // a -> !a
+#define RULE_OP_HOLD 0x0B     // [slot][seconds, LE16] a -> a has held for the duration
+#define RULE_OP_BETWEEN 0x0C  // x low high -> low <= x <= high, wrapping when low > high
+
+// Variables readable with RULE_OP_LOAD
+#define RULE_VAR_HEART_RATE 0                // BPM
+#define RULE_VAR_HEART_RATE_SLOPE 1          // BPM per minute
+#define RULE_VAR_PROJECTED_HEART_RATE 2      // BPM at the prediction horizon
+#define RULE_VAR_MINUTE_OF_DAY 3             // Unknown until the clock is synced
+#define RULE_VAR_WEEKDAY 4                   // 0 = Monday, unknown until synced
+#define RULE_VAR_SECONDS_SINCE_EMISSION 5
+#define RULE_VAR_EMISSION_ACTIVE 6
+#define RULE_VAR_BUDGET_REMAINING 7          // Seconds
+#define RULE_VAR_COUNT 8
+
+// Evaluation cost, for sizing rules against the sampling budget
+struct RuleStats {
+    uint32_t evaluations;  // Rule programs run
+    uint32_t fired;
+    uint32_t totalMicros;  // Summed over evaluations
+    uint16_t maxMicros;
+    uint16_t maxInstructions;
+};
+
+// Function declarations
+void initRuleEngine();
+bool setRule(byte index, byte channelMask, const uint8_t* code, byte length);
+void clearRules();
+bool validateRule(const uint8_t* code, byte length);
+void evaluateRules();
+void updateRuleEngine(unsigned long now);
+void getRuleStats(RuleStats& stats);
+void resetRuleStats();
+
+#endif // RULE_ENGINE_H
@@ -3,30 +3,74 @@
 #include "ble_config.h"
 #include "led_control.h"
 #include "emission_control.h"
+#include "emitter_pwm.h"
+#include "time_service.h"
 #include "debug.h"
 
-// Settings storage
-unsigned long emission1Duration = 10000;  // 10 seconds
-unsigned long releaseInterval1 = 30000;  // 30 seconds
-bool periodicEmissionEnabled = false;
+// Settings storage. Channel 0 answers every trigger source; further
+// channels stay unbound until configured over BLE.
+unsigned long emissionDuration[EMISSION_CHANNEL_COUNT] = {10000, 10000};  // 10 seconds
+unsigned long releaseInterval[EMISSION_CHANNEL_COUNT] = {30000, 30000};   // 30 seconds
+bool periodicEmissionEnabled[EMISSION_CHANNEL_COUNT] = {false, false};
+byte channelTriggers[EMISSION_CHANNEL_COUNT] = {TRIGGER_BIT(TRIGGER_MANUAL) | TRIGGER_BIT(TRIGGER_PERIODIC) |
+                                                TRIGGER_BIT(TRIGGER_HEART_RATE) | TRIGGER_BIT(TRIGGER_HEART_RATE_PREDICTED) |
+                                                TRIGGER_BIT(TRIGGER_SCHEDULED), 0};
+byte channelPriority[EMISSION_CHANNEL_COUNT] = {1, 0};
+byte emissionProfile[EMISSION_CHANNEL_COUNT] = {PROFILE_SOLID, PROFILE_SOLID};
+byte emissionIntensity[EMISSION_CHANNEL_COUNT] = {100, 100};
+
+// Overlapping trigger handling: a repeated manual press extends the
+// emission, heart-rate, scheduled and rule triggers get their own dose after
+// the gap, and periodic or predicted triggers fold into whatever is running
+byte triggerPolicy[TRIGGER_SOURCE_COUNT] = {
+    TRIGGER_POLICY_EXTEND,  // TRIGGER_MANUAL
+    TRIGGER_POLICY_MERGE,   // TRIGGER_PERIODIC
+    TRIGGER_POLICY_QUEUE,   // TRIGGER_HEART_RATE
+    TRIGGER_POLICY_MERGE,   // TRIGGER_HEART_RATE_PREDICTED
+    TRIGGER_POLICY_QUEUE,   // TRIGGER_SCHEDULED
+    TRIGGER_POLICY_QUEUE    // TRIGGER_RULE
+};
+unsigned long minEmissionGap = 5000;  // 5 seconds
+
+// Emission budget: at most 15 minutes of emission per rolling hour
+bool emissionBudgetEnabled = true;
+bool manualBudgetExempt = true;
+unsigned long emissionBudget = 900000;         // 15 minutes
+unsigned long emissionBudgetPeriod = 3600000;  // 1 hour
 bool heartRateBasedReleaseEnabled = false;
 int highHeartRateThreshold = 100;        // Default: 100 BPM
 int lowHeartRateThreshold = 60;          // Default: 60 BPM
+bool predictiveReleaseEnabled = false;
+unsigned long predictionHorizon = 30000; // 30 seconds
+int predictionHysteresis = 5;            // Default: 5 BPM
+unsigned long heartRateMinInterval = 2000;  // 2 seconds, used near thresholds
+unsigned long heartRateMaxInterval = 30000; // 30 seconds, used when calm
+
+// Closed-loop emission duration, off until the app sets bounds
+bool adaptiveDurationEnabled[EMISSION_CHANNEL_COUNT] = {false, false};
+unsigned long adaptiveDurationMin[EMISSION_CHANNEL_COUNT] = {5000, 5000};    // 5 seconds
+unsigned long adaptiveDurationMax[EMISSION_CHANNEL_COUNT] = {30000, 30000};  // 30 seconds
+unsigned long recoveryTarget[EMISSION_CHANNEL_COUNT] = {60000, 60000};  // 1 minute
+
+// Power policy steps down at 40%, 20% and 10% charge
+byte batteryReducedThreshold = 40;
+byte batteryLowThreshold = 20;
+byte batteryCriticalThreshold = 10;
 
 // Timing variables for periodic emissions
 static unsigned long lastEmission1Time = 0;
 
 // Getters
 unsigned long getEmission1Duration() {
-    return emission1Duration;
+    return emissionDuration[0];
 }
 
 unsigned long getInterval1() {
-    return releaseInterval1;
+    return releaseInterval[0];
 }
 
 bool getPeriodic1Enabled() {
-    return periodicEmissionEnabled;
+    return periodicEmissionEnabled[0];
 }
 
 bool getHeartRateBasedReleaseEnabled() {
@@ -41,20 +85,96 @@ int getLowHeartRateThreshold() {
     return lowHeartRateThreshold;
 }
 
+bool getPredictiveReleaseEnabled() {
+    return predictiveReleaseEnabled;
+}
+
+unsigned long getPredictionHorizon() {
+    return predictionHorizon;
+}
+
+int getPredictionHysteresis() {
+    return predictionHysteresis;
+}
+
+unsigned long getHeartRateMinInterval() {
+    return heartRateMinInterval;
+}
+
+unsigned long getHeartRateMaxInterval() {
+    return heartRateMaxInterval;
+}
+
+bool setChannelConfig(byte channel, unsigned long duration, unsigned long interval,
+                      bool periodic, byte triggers, byte priority) {
+    if (channel >= EMISSION_CHANNEL_COUNT || duration == 0 || interval == 0) {
+        debugPrintf(DEBUG_SETTINGS, "Invalid config for emission channel %d\n", channel);
+        return false;
+    }
+
+    emissionDuration[channel] = duration;
+    releaseInterval[channel] = interval;
+    periodicEmissionEnabled[channel] = periodic;
+    channelTriggers[channel] = triggers;
+    channelPriority[channel] = priority;
+    debugPrintf(DEBUG_SETTINGS, "Channel %d: duration %lu ms, interval %lu ms, periodic %d, triggers 0x%02X, priority %d\n",
+                channel, duration, interval, periodic, triggers, priority);
+    return true;
+}
+
+bool setTriggerPolicy(byte triggerSource, byte policy) {
+    if (triggerSource < 1 || triggerSource > TRIGGER_SOURCE_COUNT || policy >= TRIGGER_POLICY_COUNT) {
+        debugPrintf(DEBUG_SETTINGS, "Invalid policy %d for trigger source %d\n", policy, triggerSource);
+        return false;
+    }
+
+    triggerPolicy[triggerSource - 1] = policy;
+    debugPrintf(DEBUG_SETTINGS, "Trigger source %d policy: %d\n", triggerSource, policy);
+    return true;
+}
+
+bool setAdaptiveDuration(byte channel, bool enabled, unsigned long minDuration, unsigned long maxDuration,
+                         unsigned long target) {
+    if (channel >= EMISSION_CHANNEL_COUNT || minDuration == 0 || minDuration > maxDuration || target == 0) {
+        debugPrintf(DEBUG_SETTINGS, "Invalid adaptive duration bounds for channel %d\n", channel);
+        return false;
+    }
+
+    adaptiveDurationEnabled[channel] = enabled;
+    adaptiveDurationMin[channel] = minDuration;
+    adaptiveDurationMax[channel] = maxDuration;
+    recoveryTarget[channel] = target;
+    debugPrintf(DEBUG_SETTINGS, "Channel %d: adaptive duration %s, %lu-%lu ms, recovery target %lu ms\n", channel,
+                enabled ? "enabled" : "disabled", minDuration, maxDuration, target);
+    return true;
+}
+
+bool setChannelProfile(byte channel, byte profile, byte intensity) {
+    if (channel >= EMISSION_CHANNEL_COUNT || profile >= PROFILE_COUNT) {
+        debugPrintf(DEBUG_SETTINGS, "Invalid profile %d for channel %d\n", profile, channel);
+        return false;
+    }
+
+    emissionProfile[channel] = profile;
+    emissionIntensity[channel] = min(intensity, (byte)100);
+    debugPrintf(DEBUG_SETTINGS, "Channel %d: profile %d at %d%%\n", channel, profile, emissionIntensity[channel]);
+    return true;
+}
+
 void handleSettingsUpdate() {
     if (emission1Characteristic.written()) {
-        emission1Duration = emission1Characteristic.value() * 1000; // Convert seconds to milliseconds
-        debugPrintf(DEBUG_SETTINGS, "Emission duration updated: %lu ms\n", emission1Duration);
+        emissionDuration[0] = emission1Characteristic.value() * 1000; // Convert seconds to milliseconds
+        debugPrintf(DEBUG_SETTINGS, "Emission duration updated: %lu ms\n", emissionDuration[0]);
     }
 
     if (interval1Characteristic.written()) {
-        releaseInterval1 = interval1Characteristic.value() * 1000; // Convert seconds to milliseconds
-        debugPrintf(DEBUG_SETTINGS, "Release interval updated: %lu ms\n", releaseInterval1);
+        releaseInterval[0] = interval1Characteristic.value() * 1000; // Convert seconds to milliseconds
+        debugPrintf(DEBUG_SETTINGS, "Release interval updated: %lu ms\n", releaseInterval[0]);
     }
 
     if (periodic1Characteristic.written()) {
-        periodicEmissionEnabled = (periodic1Characteristic.value() == 1);
-        debugPrintf(DEBUG_SETTINGS, "Periodic emission %s\n", periodicEmissionEnabled ? "enabled" : "disabled");
+        periodicEmissionEnabled[0] = (periodic1Characteristic.value() == 1);
+        debugPrintf(DEBUG_SETTINGS, "Periodic emission %s\n", periodicEmissionEnabled[0] ? "enabled" : "disabled");
     }
 
     if (heartRateEnabledCharacteristic.written()) {
@@ -74,9 +194,9 @@ void handleSettingsUpdate() {
 }
 
 void checkPeriodicEmissions() {
-    unsigned long currentTime = millis();
+    unsigned long currentTime = getLoopMillis();
 
-    if (periodicEmissionEnabled && (currentTime - lastEmission1Time >= releaseInterval1)) {
+    if (periodicEmissionEnabled[0] && (currentTime - lastEmission1Time >= releaseInterval[0])) {
         triggerEmission(TRIGGER_PERIODIC);
     }
 }
@@ -85,16 +205,16 @@ void handleSwitchCommand(int command, int value) {
     debugPrintf(DEBUG_SETTINGS, "Received command: %d with value: %d\n", command, value);
     switch (command) {
         case CMD_EMISSION_DURATION:
-            emission1Duration = value * 1000;  // Convert seconds to milliseconds
-            debugPrintf(DEBUG_SETTINGS, "Switch command: Emission duration updated: %lu ms\n", emission1Duration);
+            emissionDuration[0] = value * 1000;  // Convert seconds to milliseconds
+            debugPrintf(DEBUG_SETTINGS, "Switch command: Emission duration updated: %lu ms\n", emissionDuration[0]);
             break;
         case CMD_INTERVAL:
-            releaseInterval1 = value * 1000;  // Convert seconds to milliseconds
-            debugPrintf(DEBUG_SETTINGS, "Switch command: Release interval updated: %lu ms\n", releaseInterval1);
+            releaseInterval[0] = value * 1000;  // Convert seconds to milliseconds
+            debugPrintf(DEBUG_SETTINGS, "Switch command: Release interval updated: %lu ms\n", releaseInterval[0]);
             break;
         case CMD_PERIODIC_ENABLED:
-            periodicEmissionEnabled = (value == 1);
-            debugPrintf(DEBUG_SETTINGS, "Switch command: Periodic emission %s\n", periodicEmissionEnabled ? "enabled" : "disabled");
+            periodicEmissionEnabled[0] = (value == 1);
+            debugPrintf(DEBUG_SETTINGS, "Switch command: Periodic emission %s\n", periodicEmissionEnabled[0] ? "enabled" : "disabled");
             break;
         case CMD_HEART_RATE_ENABLED:
             heartRateBasedReleaseEnabled = (value == 1);
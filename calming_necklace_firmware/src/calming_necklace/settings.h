@@ -5,13 +5,39 @@
 #include <Arduino.h>
 #include "debug.h"
 
-// Settings variables
-extern unsigned long emission1Duration;
-extern unsigned long releaseInterval1;
-extern bool periodicEmissionEnabled;
+// Number of independent emitters (scents or fans). Channel 0 is the
+// original emitter configured by the emission1/interval1 characteristics.
+#define EMISSION_CHANNEL_COUNT 2
+
+// Settings variables, per-channel settings are indexed by channel
+extern unsigned long emissionDuration[EMISSION_CHANNEL_COUNT];
+extern unsigned long releaseInterval[EMISSION_CHANNEL_COUNT];
+extern bool periodicEmissionEnabled[EMISSION_CHANNEL_COUNT];
+extern byte channelTriggers[EMISSION_CHANNEL_COUNT];  // Bitmask of TRIGGER_BIT(source)
+extern byte channelPriority[EMISSION_CHANNEL_COUNT];  // Higher wins when channels compete
+extern byte emissionProfile[EMISSION_CHANNEL_COUNT];  // PROFILE_* intensity profile
+extern byte emissionIntensity[EMISSION_CHANNEL_COUNT];  // Percent of full drive
+extern byte triggerPolicy[];            // TRIGGER_POLICY_* per trigger source, indexed by source - 1
+extern unsigned long minEmissionGap;    // Minimum time between emissions on a channel
+extern bool emissionBudgetEnabled;
+extern bool manualBudgetExempt;
+extern unsigned long emissionBudget;        // Emission time allowed per budget period
+extern unsigned long emissionBudgetPeriod;
 extern bool heartRateBasedReleaseEnabled;
 extern int highHeartRateThreshold;
 extern int lowHeartRateThreshold;
+extern bool predictiveReleaseEnabled;
+extern unsigned long predictionHorizon;
+extern int predictionHysteresis;
+extern unsigned long heartRateMinInterval;
+extern unsigned long heartRateMaxInterval;
+extern bool adaptiveDurationEnabled[EMISSION_CHANNEL_COUNT];
+extern unsigned long adaptiveDurationMin[EMISSION_CHANNEL_COUNT];
+extern unsigned long adaptiveDurationMax[EMISSION_CHANNEL_COUNT];
+extern unsigned long recoveryTarget[EMISSION_CHANNEL_COUNT];  // Time an emission should take to bring heart rate under threshold
+extern byte batteryReducedThreshold;   // Charge in percent at which each power policy level starts
+extern byte batteryLowThreshold;
+extern byte batteryCriticalThreshold;
 
 // Function declarations
 void handleSettingsUpdate();
@@ -21,6 +47,17 @@ bool getPeriodic1Enabled();
 bool getHeartRateBasedReleaseEnabled();
 int getHighHeartRateThreshold();
 int getLowHeartRateThreshold();
+bool getPredictiveReleaseEnabled();
+unsigned long getPredictionHorizon();
+int getPredictionHysteresis();
+unsigned long getHeartRateMinInterval();
+unsigned long getHeartRateMaxInterval();
+bool setChannelConfig(byte channel, unsigned long duration, unsigned long interval,
+                      bool periodic, byte triggers, byte priority);
+bool setChannelProfile(byte channel, byte profile, byte intensity);
+bool setTriggerPolicy(byte triggerSource, byte policy);
+bool setAdaptiveDuration(byte channel, bool enabled, unsigned long minDuration, unsigned long maxDuration,
+                         unsigned long target);
 
 // Settings handlers
 void handleSettingsUpdate();
@@ -0,0 +1,127 @@
+// sha256.cpp
+#include "sha256.h"
+
+static const uint32_t ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint8_t HMAC_INNER_PAD = 0x36;
+static const uint8_t HMAC_OUTER_PAD = 0x5c;
+
+static inline uint32_t rotateRight(uint32_t value, byte count) {
+    return (value >> count) | (value << (32 - count));
+}
+
+static void compressBlock(uint32_t* state, const uint8_t* block) {
+    uint32_t schedule[64];
+    for (byte i = 0; i < 16; i++) {
+        schedule[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+                      ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    for (byte i = 16; i < 64; i++) {
+        uint32_t s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+        uint32_t s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+        schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (byte i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) +
+                      ((e & f) ^ (~e & g)) + ROUND_CONSTANTS[i] + schedule[i];
+        uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void sha256Init(Sha256& context) {
+    static const uint32_t INITIAL_STATE[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(context.state, INITIAL_STATE, sizeof(INITIAL_STATE));
+    context.length = 0;
+    context.blockLength = 0;
+}
+
+void sha256Update(Sha256& context, const uint8_t* data, size_t length) {
+    context.length += length;
+    while (length > 0) {
+        size_t take = min(length, (size_t)(SHA256_BLOCK_SIZE - context.blockLength));
+        memcpy(context.block + context.blockLength, data, take);
+        context.blockLength += take;
+        data += take;
+        length -= take;
+        if (context.blockLength == SHA256_BLOCK_SIZE) {
+            compressBlock(context.state, context.block);
+            context.blockLength = 0;
+        }
+    }
+}
+
+void sha256Final(Sha256& context, uint8_t* digest) {
+    uint64_t bitLength = context.length * 8;
+    uint8_t padding = 0x80;
+    sha256Update(context, &padding, 1);
+    padding = 0;
+    while (context.blockLength != SHA256_BLOCK_SIZE - 8) {
+        sha256Update(context, &padding, 1);
+    }
+    uint8_t lengthBytes[8];
+    for (byte i = 0; i < 8; i++) {
+        lengthBytes[i] = (uint8_t)(bitLength >> (56 - 8 * i));
+    }
+    sha256Update(context, lengthBytes, sizeof(lengthBytes));
+
+    for (byte i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(context.state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(context.state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(context.state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)context.state[i];
+    }
+}
+
+// Hashes the key padded to a block and XORed with the pad byte
+static void hashPaddedKey(Sha256& context, const uint8_t* key, size_t keyLength, uint8_t pad) {
+    uint8_t block[SHA256_BLOCK_SIZE];
+    for (byte i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        block[i] = (i < keyLength ? key[i] : 0) ^ pad;
+    }
+    sha256Update(context, block, sizeof(block));
+}
+
+void hmacSha256Init(Sha256& context, const uint8_t* key, size_t keyLength) {
+    sha256Init(context);
+    hashPaddedKey(context, key, keyLength, HMAC_INNER_PAD);
+}
+
+void hmacSha256Final(Sha256& context, const uint8_t* key, size_t keyLength, uint8_t* mac) {
+    uint8_t innerDigest[SHA256_DIGEST_SIZE];
+    sha256Final(context, innerDigest);
+    sha256Init(context);
+    hashPaddedKey(context, key, keyLength, HMAC_OUTER_PAD);
+    sha256Update(context, innerDigest, sizeof(innerDigest));
+    sha256Final(context, mac);
+}
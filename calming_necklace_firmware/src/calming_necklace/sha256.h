@@ -0,0 +1,31 @@
+// sha256.h
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <Arduino.h>
+
+// SHA-256 and HMAC-SHA256 (FIPS 180-4, RFC 2104), streaming, for
+// authenticating firmware updates. Plain C++ rather than the CryptoCell,
+// whose driver isn't part of the Arduino core; hashing the largest image
+// the update bank holds takes well under a second.
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_DIGEST_SIZE 32
+
+struct Sha256 {
+    uint32_t state[8];
+    uint64_t length;  // Bytes hashed so far
+    uint8_t block[SHA256_BLOCK_SIZE];
+    uint8_t blockLength;
+};
+
+// Function declarations
+void sha256Init(Sha256& context);
+void sha256Update(Sha256& context, const uint8_t* data, size_t length);
+void sha256Final(Sha256& context, uint8_t* digest);
+
+// HMAC: Init, then sha256Update() with the message, then Final with the
+// same key. Keys may be at most SHA256_BLOCK_SIZE bytes.
+void hmacSha256Init(Sha256& context, const uint8_t* key, size_t keyLength);
+void hmacSha256Final(Sha256& context, const uint8_t* key, size_t keyLength, uint8_t* mac);
+
+#endif // SHA256_H
@@ -0,0 +1,55 @@
+// spsc_queue.h
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <Arduino.h>
+
+// Fixed-size ring buffer for exactly one producer and one consumer, e.g. an
+// interrupt handler handing events to the main loop. The producer only
+// writes writeIndex and the consumer only readIndex, so neither side needs
+// to mask interrupts. The indices run freely and wrap at 256, which is why
+// the capacity must be a power of two no larger than 128.
+//
+// The nRF52840 has a single core, so a compiler barrier is enough to keep
+// the slot write ahead of the index that publishes it.
+template <typename T, uint8_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && Capacity <= 128 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two up to 128");
+
+public:
+    // Producer side; false when full, leaving the queue unchanged
+    bool push(const T& item) {
+        uint8_t index = writeIndex;
+        if ((uint8_t)(index - readIndex) == Capacity) {
+            return false;
+        }
+        items[index & (Capacity - 1)] = item;
+        __asm__ volatile("" ::: "memory");
+        writeIndex = index + 1;
+        return true;
+    }
+
+    // Consumer side; false when empty
+    bool pop(T& item) {
+        uint8_t index = readIndex;
+        if (index == writeIndex) {
+            return false;
+        }
+        item = items[index & (Capacity - 1)];
+        __asm__ volatile("" ::: "memory");
+        readIndex = index + 1;
+        return true;
+    }
+
+    uint8_t size() const {
+        return writeIndex - readIndex;
+    }
+
+private:
+    T items[Capacity];
+    volatile uint8_t writeIndex = 0;
+    volatile uint8_t readIndex = 0;
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,41 @@
+// time_service.cpp
+#include "time_service.h"
+
+static TimeSource timeSource = micros;
+static unsigned long lastRawMicros = 0;
+static uint64_t monotonicMicros = 0;
+
+static uint64_t loopMicros = 0;
+static unsigned long loopMillis = 0;
+
+void initTimeService(TimeSource source) {
+    timeSource = source;
+    lastRawMicros = timeSource();
+    monotonicMicros = lastRawMicros;
+    updateLoopTime();
+}
+
+uint64_t readMonotonicMicros() {
+    unsigned long rawMicros = timeSource();
+    // Unsigned subtraction gives the elapsed time across a wrap of the source
+    monotonicMicros += (unsigned long)(rawMicros - lastRawMicros);
+    lastRawMicros = rawMicros;
+    return monotonicMicros;
+}
+
+void updateLoopTime() {
+    loopMicros = readMonotonicMicros();
+    loopMillis = (unsigned long)(loopMicros / 1000);
+}
+
+uint64_t getLoopMicros() {
+    return loopMicros;
+}
+
+uint64_t getLoopMillis64() {
+    return loopMicros / 1000;
+}
+
+unsigned long getLoopMillis() {
+    return loopMillis;
+}
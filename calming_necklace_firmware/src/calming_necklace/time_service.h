@@ -0,0 +1,29 @@
+// time_service.h
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Monotonic time. The 32-bit micros() counter (71 minute wrap) is extended
+// to 64 bits by accumulating the wrap-safe difference between reads, which
+// is exact as long as it is read at least once per wrap; the main loop
+// reads it every pass.
+//
+// updateLoopTime() captures "now" once at the top of each loop pass and
+// the subsystems work from that value instead of reading the timer again.
+// 32-bit millisecond values handed out here wrap together, so code that
+// compares them as unsigned differences stays correct across the wrap.
+
+// Microsecond source; the host simulation can swap in its virtual clock
+typedef unsigned long (*TimeSource)();
+
+// Function declarations
+void initTimeService(TimeSource source = micros);
+uint64_t readMonotonicMicros();
+void updateLoopTime();
+uint64_t getLoopMicros();
+uint64_t getLoopMillis64();
+unsigned long getLoopMillis();
+
+#endif // TIME_SERVICE_H
@@ -2,44 +2,46 @@
 
 #include "timing.h"
 #include "debug.h"
+#include "time_service.h"
 
-static unsigned long lastActivityTime = 0;
-static unsigned long lastKeepAliveTime = 0;
+static unsigned long lastActivityTime[MAX_CENTRALS] = {0};
 unsigned long lastHeartRateTime = 0;
 static const unsigned long DISCONNECT_TIMEOUT = 180000; // 3 minutes
-static const unsigned long KEEPALIVE_TIMEOUT = 120000;  // 10 minutes
-static const unsigned long HEARTRATE_UPDATE_INTERVAL = 5000; // Changed to 5 seconds as per requirements
+static unsigned long heartRateUpdateInterval = 5000; // Adapted after each sample, starts at 5 seconds
 
-void resetActivityTimer() {
-    debugPrintln(DEBUG_TIMING, "Activity timer reset");
-    lastActivityTime = millis();
-}
-
-void resetKeepAliveTimer() {
-    debugPrintln(DEBUG_TIMING, "Keep-alive timer reset");
-    lastKeepAliveTime = millis();
+void resetActivityTimer(uint8_t slot) {
+    debugPrintf(DEBUG_TIMING, "Activity timer %d reset\n", slot);
+    lastActivityTime[slot] = getLoopMillis();
 }
 
 void resetHeartRateTimer() {
     debugPrintln(DEBUG_TIMING, "Heart rate timer reset");
-    lastHeartRateTime = millis();
-}
-
-bool isConnectionTimedOut() {
-    debugPrintf(DEBUG_TIMING, "Connection time elapsed: %lu ms\n", millis() - lastActivityTime);
-    return (millis() - lastActivityTime > DISCONNECT_TIMEOUT);
+    lastHeartRateTime = getLoopMillis();
 }
 
-bool isKeepAliveTimedOut() {
-    return (millis() - lastKeepAliveTime > KEEPALIVE_TIMEOUT);
+// Elapsed times are unsigned differences, which stay correct across a wrap
+bool isConnectionTimedOut(uint8_t slot, unsigned long now) {
+    debugPrintf(DEBUG_TIMING, "Connection %d time elapsed: %lu ms\n", slot, now - lastActivityTime[slot]);
+    return (now - lastActivityTime[slot] > DISCONNECT_TIMEOUT);
 }
 
-bool isHeartRateUpdateTime() {
-    unsigned long currentTime = millis();
+bool isHeartRateUpdateTime(unsigned long now) {
+    unsigned long elapsed = now - lastHeartRateTime;
 
-    debugPrintf(DEBUG_TIMING, "Current time: %lu ms\n", currentTime);
+    debugPrintf(DEBUG_TIMING, "Current time: %lu ms\n", now);
     debugPrintf(DEBUG_TIMING, "Last heart rate time: %lu ms\n", lastHeartRateTime);
-    debugPrintf(DEBUG_TIMING, "Difference: %lu ms\n", abs(currentTime - lastHeartRateTime));
+    debugPrintf(DEBUG_TIMING, "Difference: %lu ms\n", elapsed);
+
+    return (elapsed >= heartRateUpdateInterval);
+}
+
+void setHeartRateUpdateInterval(unsigned long interval) {
+    if (interval != heartRateUpdateInterval) {
+        debugPrintf(DEBUG_TIMING, "Heart rate interval: %lu ms\n", interval);
+    }
+    heartRateUpdateInterval = interval;
+}
 
-    return (abs(currentTime - lastHeartRateTime) >= HEARTRATE_UPDATE_INTERVAL);
+unsigned long getHeartRateUpdateInterval() {
+    return heartRateUpdateInterval;
 }
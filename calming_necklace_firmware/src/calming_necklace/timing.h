@@ -4,12 +4,16 @@
 #include <Arduino.h>
 #include "debug.h"
 
+// Centrals that may be connected at once, each with its own activity
+// timer. ArduinoBLE itself allows up to ATT_MAX_PEERS.
+#define MAX_CENTRALS 3
+
 extern unsigned long lastHeartRateTime;
-void resetActivityTimer();
-void resetKeepAliveTimer();
+void resetActivityTimer(uint8_t slot);
 void resetHeartRateTimer();
-bool isConnectionTimedOut();
-bool isKeepAliveTimedOut();
-bool isHeartRateUpdateTime();
+bool isConnectionTimedOut(uint8_t slot, unsigned long now);
+bool isHeartRateUpdateTime(unsigned long now);
+void setHeartRateUpdateInterval(unsigned long interval);
+unsigned long getHeartRateUpdateInterval();
 
 #endif // TIMING_H
@@ -0,0 +1,83 @@
+// wall_clock.cpp
+#include "wall_clock.h"
+#include "time_service.h"
+
+static bool clockSynced = false;
+static uint64_t anchorWallMillis = 0;   // Wall time at the anchor
+static uint64_t anchorMillis = 0;       // Monotonic time at the anchor
+static uint64_t lastSyncWallMillis = 0;
+static long driftPpm = 0;               // Local clock error, positive when the local clock runs slow
+
+// Days from 2000-01-01 to the given date (valid for 2000-2099)
+static uint32_t daysSinceEpoch(uint16_t year, byte month, byte day) {
+    static const uint16_t DAYS_BEFORE_MONTH[] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    uint32_t years = year - 2000;
+    uint32_t days = years * 365 + (years + 3) / 4;
+    days += DAYS_BEFORE_MONTH[month - 1] + (day - 1);
+    if (month > 2 && (years % 4) == 0) {
+        days++;
+    }
+    return days;
+}
+
+static uint64_t estimateWallMillis(uint64_t currentMillis) {
+    uint64_t elapsed = currentMillis - anchorMillis;
+    return anchorWallMillis + elapsed + ((int64_t)elapsed * driftPpm) / 1000000;
+}
+
+bool syncWallClock(const uint8_t* currentTime, int length) {
+    if (length < CURRENT_TIME_LENGTH) {
+        return false;
+    }
+
+    uint16_t year = currentTime[0] | (currentTime[1] << 8);
+    byte month = currentTime[2];
+    byte day = currentTime[3];
+    if (year < 2000 || year > 2099 || month < 1 || month > 12 || day < 1 || day > 31 ||
+        currentTime[4] > 23 || currentTime[5] > 59 || currentTime[6] > 59) {
+        debugPrintln(DEBUG_TIMING, "Invalid current time, ignoring");
+        return false;
+    }
+
+    uint64_t currentMillis = getLoopMillis64();
+    uint64_t syncedWallMillis = (uint64_t)daysSinceEpoch(year, month, day) * MILLIS_PER_DAY +
+                                currentTime[4] * 3600000UL + currentTime[5] * MILLIS_PER_MINUTE +
+                                currentTime[6] * 1000UL + (currentTime[8] * 1000UL) / 256;
+
+    // Refine the drift from how far the estimate wandered since the last sync
+    if (clockSynced && syncedWallMillis > lastSyncWallMillis + DRIFT_MIN_SYNC_INTERVAL) {
+        int64_t error = (int64_t)syncedWallMillis - (int64_t)estimateWallMillis(currentMillis);
+        long correction = (long)((error * 1000000) / (int64_t)(syncedWallMillis - lastSyncWallMillis));
+        driftPpm = constrain(driftPpm + correction / 2, -DRIFT_MAX_PPM, DRIFT_MAX_PPM);
+        debugPrintf(DEBUG_TIMING, "Clock error %ld ms, drift now %ld ppm\n", (long)error, driftPpm);
+    }
+
+    anchorWallMillis = syncedWallMillis;
+    anchorMillis = currentMillis;
+    lastSyncWallMillis = syncedWallMillis;
+    clockSynced = true;
+    debugPrintf(DEBUG_TIMING, "Wall clock synced: %04d-%02d-%02d %02d:%02d:%02d\n",
+                year, month, day, currentTime[4], currentTime[5], currentTime[6]);
+    return true;
+}
+
+bool isWallClockSynced() {
+    return clockSynced;
+}
+
+uint64_t getWallClockMillis() {
+    return estimateWallMillis(getLoopMillis64());
+}
+
+byte getWeekday(uint64_t wallMillis) {
+    // 2000-01-01 was a Saturday
+    return (byte)((wallMillis / MILLIS_PER_DAY + 5) % 7);
+}
+
+uint16_t getMinuteOfDay(uint64_t wallMillis) {
+    return (uint16_t)((wallMillis % MILLIS_PER_DAY) / MILLIS_PER_MINUTE);
+}
+
+long getClockDriftPpm() {
+    return driftPpm;
+}
@@ -0,0 +1,33 @@
+// wall_clock.h
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <Arduino.h>
+#include "debug.h"
+
+// Local wall-clock time, synced from the app. Between syncs it runs on the
+// 64-bit monotonic clock corrected by the drift measured across previous
+// syncs.
+// Times are ms since 2000-01-01 00:00 local time.
+
+// Current Time record (same layout as the SIG Current Time characteristic):
+// [year, LE16][month][day][hours][minutes][seconds][day of week][fractions/256][adjust reason]
+#define CURRENT_TIME_LENGTH 10
+
+#define MILLIS_PER_MINUTE 60000UL
+#define MILLIS_PER_DAY 86400000UL
+#define MINUTES_PER_DAY 1440
+
+// Syncs closer together than this don't update the drift estimate
+#define DRIFT_MIN_SYNC_INTERVAL 600000  // 10 minutes
+#define DRIFT_MAX_PPM 500
+
+// Function declarations
+bool syncWallClock(const uint8_t* currentTime, int length);
+bool isWallClockSynced();
+uint64_t getWallClockMillis();
+byte getWeekday(uint64_t wallMillis);  // 0 = Monday .. 6 = Sunday
+uint16_t getMinuteOfDay(uint64_t wallMillis);
+long getClockDriftPpm();
+
+#endif // WALL_CLOCK_H
@@ -0,0 +1,39 @@
+// dfu_host.cpp
+// C entry points into the firmware's update code, for tools/dfu.py bench
+// to load with ctypes. Nothing else of the firmware is linked.
+#include <Arduino.h>
+#include "dfu.h"
+#include "time_service.h"
+#include "host_test.h"
+
+extern "C" {
+
+// key may be null for an unprovisioned device
+void dfuHostInit(DfuResponder responder, const uint8_t* key) {
+    debugCategories = 0;
+    initTimeService();
+    setDfuKey(key);
+    initDfu(responder);
+}
+
+void dfuHostControl(const uint8_t* data, size_t length) {
+    onDfuControl(data, length);
+}
+
+void dfuHostData(const uint8_t* data, size_t length) {
+    onDfuData(data, length);
+}
+
+void dfuHostAdvance(unsigned long ms) {
+    advanceMicros(ms * 1000UL);
+    updateLoopTime();
+    updateDfu(getLoopMillis());
+}
+
+void dfuHostReadBank(uint8_t* buffer, uint32_t offset, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        buffer[i] = readDfuBankByte(offset + i);
+    }
+}
+
+}
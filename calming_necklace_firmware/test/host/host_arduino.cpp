@@ -0,0 +1,63 @@
+// host_arduino.cpp
+// Arduino core and BLE globals for host builds, on a simulated clock that
+// only moves when a test advances it.
+#include <Arduino.h>
+#include <ArduinoBLE.h>
+#include "host_test.h"
+
+HostSerial Serial;
+BLELocalDevice BLE;
+
+static uint64_t simulatedMicros = 0;
+static int pinLevels[64];
+
+void advanceMicros(unsigned long us) {
+    simulatedMicros += us;
+}
+
+unsigned long millis() {
+    return (unsigned long)(simulatedMicros / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)simulatedMicros;
+}
+
+void delay(unsigned long ms) {
+    simulatedMicros += ms * 1000ULL;
+}
+
+void delayMicroseconds(unsigned int us) {
+    simulatedMicros += us;
+}
+
+void pinMode(int pin, int mode) {
+}
+
+void digitalWrite(int pin, int value) {
+    pinLevels[pin & 63] = value;
+}
+
+int digitalRead(int pin) {
+    return pinLevels[pin & 63];
+}
+
+void analogWrite(int pin, int value) {
+}
+
+int analogRead(int pin) {
+    return 0;
+}
+
+void attachInterrupt(int interrupt, void (*handler)(), int mode) {
+}
+
+int digitalPinToInterrupt(int pin) {
+    return pin;
+}
+
+void noInterrupts() {
+}
+
+void interrupts() {
+}
@@ -0,0 +1,26 @@
+// host_test.cpp
+#include "host_test.h"
+
+static unsigned checks = 0;
+static unsigned failures = 0;
+
+void runLoop(unsigned long ms, unsigned long stepMicros) {
+    for (unsigned long elapsed = 0; elapsed < ms * 1000UL; elapsed += stepMicros) {
+        advanceMicros(stepMicros);
+        loop();
+    }
+}
+
+void checkCondition(bool passed, const char* condition, const char* file, int line) {
+    checks++;
+    if (!passed) {
+        failures++;
+        printf("%s:%d: CHECK failed: %s\n", file, line, condition);
+        fflush(stdout);
+    }
+}
+
+int finishTests() {
+    printf("%u checks, %u failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+// host_test.h
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <Arduino.h>
+
+// The sketch
+void setup();
+void loop();
+
+// Simulated time
+void advanceMicros(unsigned long us);
+void runLoop(unsigned long ms, unsigned long stepMicros = 10000);  // loop() once per step
+
+// Each failed CHECK is reported; finishTests() gives the exit status
+#define CHECK(condition) checkCondition((condition), #condition, __FILE__, __LINE__)
+void checkCondition(bool passed, const char* condition, const char* file, int line);
+int finishTests();
+
+#endif // HOST_TEST_H
@@ -0,0 +1,96 @@
+// Arduino.h
+// Host stand-in for the parts of the Arduino core the firmware uses. Time
+// comes from a simulated clock that tests advance; see host_arduino.cpp.
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define LED_BUILTIN 13
+#define LEDR 22
+#define LEDG 23
+#define LEDB 24
+#define A0 14
+
+#define PI 3.1415926535897932384626433832795
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef abs
+#define abs(x) ((x) > 0 ? (x) : -(x))
+#endif
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void analogWrite(int pin, int value);
+int analogRead(int pin);
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+int digitalPinToInterrupt(int pin);
+void noInterrupts();
+void interrupts();
+
+// Heap string, allocating like the core's, so the allocation guard sees it
+class String {
+public:
+    String(const char* text = "") : buffer(copy(text)) {}
+    String(const String& other) : buffer(copy(other.buffer)) {}
+    ~String() { free(buffer); }
+    String& operator=(const String& other) {
+        if (this != &other) {
+            free(buffer);
+            buffer = copy(other.buffer);
+        }
+        return *this;
+    }
+    const char* c_str() const { return buffer; }
+    unsigned int length() const { return strlen(buffer); }
+
+private:
+    static char* copy(const char* text) {
+        size_t length = strlen(text) + 1;
+        char* result = (char*)malloc(length);
+        memcpy(result, text, length);
+        return result;
+    }
+    char* buffer;
+};
+
+// Writes to stdout
+class HostSerial {
+public:
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+    void print(const char* text) { fputs(text, stdout); }
+    void print(int value) { printf("%d", value); }
+    void println(const char* text) { puts(text); }
+    void println(int value) { printf("%d\n", value); }
+    void println() { puts(""); }
+    void flush() { fflush(stdout); }
+};
+extern HostSerial Serial;
+
+#endif // ARDUINO_H
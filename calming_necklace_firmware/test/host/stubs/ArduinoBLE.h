@@ -0,0 +1,168 @@
+// ArduinoBLE.h
+// Host stand-in for ArduinoBLE. Characteristics keep their value and
+// handlers like the library's; the host* calls stand in for the radio, so
+// a test can connect centrals and write characteristics.
+#ifndef ARDUINO_BLE_H
+#define ARDUINO_BLE_H
+
+#include <Arduino.h>
+
+enum { BLEBroadcast = 0x01, BLERead = 0x02, BLEWriteWithoutResponse = 0x04, BLEWrite = 0x08,
+       BLENotify = 0x10, BLEIndicate = 0x20 };
+
+enum BLEDeviceEvent { BLEConnected = 0, BLEDisconnected = 1, BLEDeviceEventLast };
+enum BLECharacteristicEvent { BLESubscribed = 0, BLEUnsubscribed = 1, BLEWritten = 3, BLECharacteristicEventLast };
+
+class BLEDevice {
+public:
+    BLEDevice() : _address{} {}
+    // Host only: a central with the given address, most significant byte last
+    explicit BLEDevice(const uint8_t* address) { memcpy(_address, address, sizeof(_address)); }
+
+    bool operator==(const BLEDevice& other) const { return memcmp(_address, other._address, 6) == 0; }
+    bool operator!=(const BLEDevice& other) const { return !(*this == other); }
+    operator bool() const { return *this != BLEDevice(); }
+    bool connected() const { return (bool)*this; }
+    bool disconnect() { return true; }
+
+    // Formatted into a heap String, as in the library
+    String address() const {
+        char text[18];
+        snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 _address[5], _address[4], _address[3], _address[2], _address[1], _address[0]);
+        return String(text);
+    }
+
+private:
+    uint8_t _address[6];
+};
+
+typedef void (*BLEDeviceEventHandler)(BLEDevice device);
+
+class BLECharacteristic;
+typedef void (*BLECharacteristicEventHandler)(BLEDevice device, BLECharacteristic characteristic);
+
+// Copies, such as the one an event handler gets, share the original's value
+class BLECharacteristic {
+public:
+    BLECharacteristic() : BLECharacteristic(nullptr, 0, 0) {}
+    BLECharacteristic(const char* uuid, uint8_t properties, int valueSize, bool fixedLength = false)
+        : origin(this), size(min(valueSize, (int)sizeof(data))), length(0), wasWritten(false), handlers{} {}
+    BLECharacteristic(const char* uuid, uint8_t properties, const char* value)
+        : BLECharacteristic(uuid, properties, (int)strlen(value)) {
+        writeValue((const uint8_t*)value, strlen(value));
+    }
+    BLECharacteristic(const BLECharacteristic& other) : origin(other.origin) {}
+    BLECharacteristic& operator=(const BLECharacteristic& other) {
+        origin = other.origin;
+        return *this;
+    }
+
+    int writeValue(const uint8_t* value, int valueLength) {
+        origin->length = min(valueLength, origin->size);
+        memcpy(origin->data, value, origin->length);
+        return 1;
+    }
+    int writeValue(const char* value) { return writeValue((const uint8_t*)value, strlen(value)); }
+    const uint8_t* value() const { return origin->data; }
+    int valueLength() const { return origin->length; }
+    int valueSize() const { return origin->size; }
+    bool written() {
+        bool result = origin->wasWritten;
+        origin->wasWritten = false;
+        return result;
+    }
+    bool subscribed() { return false; }
+    void setEventHandler(int event, BLECharacteristicEventHandler handler) { origin->handlers[event] = handler; }
+
+    // Host only: a central writes the characteristic
+    void hostWrite(const BLEDevice& central, const uint8_t* value, int valueLength) {
+        writeValue(value, valueLength);
+        origin->wasWritten = true;
+        if (origin->handlers[BLEWritten]) {
+            origin->handlers[BLEWritten](central, *this);
+        }
+    }
+    void hostSubscribe(const BLEDevice& central, bool subscribe) {
+        BLECharacteristicEventHandler handler = origin->handlers[subscribe ? BLESubscribed : BLEUnsubscribed];
+        if (handler) {
+            handler(central, *this);
+        }
+    }
+
+private:
+    BLECharacteristic* origin;
+    int size;
+    int length;
+    bool wasWritten;
+    uint8_t data[512];
+    BLECharacteristicEventHandler handlers[BLECharacteristicEventLast];
+};
+
+template <typename T>
+class BLETypedCharacteristic : public BLECharacteristic {
+public:
+    BLETypedCharacteristic(const char* uuid, uint8_t properties) : BLECharacteristic(uuid, properties, sizeof(T), true) {}
+    int writeValue(T value) { return BLECharacteristic::writeValue((const uint8_t*)&value, sizeof(T)); }
+    T value() {
+        T result = T();
+        memcpy(&result, BLECharacteristic::value(), min((size_t)valueLength(), sizeof(T)));
+        return result;
+    }
+    void hostWrite(const BLEDevice& central, T value) {
+        BLECharacteristic::hostWrite(central, (const uint8_t*)&value, sizeof(T));
+    }
+};
+
+typedef BLETypedCharacteristic<bool> BLEBoolCharacteristic;
+typedef BLETypedCharacteristic<uint8_t> BLEByteCharacteristic;
+typedef BLETypedCharacteristic<short> BLEShortCharacteristic;
+typedef BLETypedCharacteristic<unsigned short> BLEUnsignedShortCharacteristic;
+typedef BLETypedCharacteristic<int> BLEIntCharacteristic;
+typedef BLETypedCharacteristic<unsigned int> BLEUnsignedIntCharacteristic;
+typedef BLETypedCharacteristic<long> BLELongCharacteristic;
+typedef BLETypedCharacteristic<unsigned long> BLEUnsignedLongCharacteristic;
+
+class BLEService {
+public:
+    BLEService(const char* uuid) {}
+    void addCharacteristic(BLECharacteristic& characteristic) {}
+};
+
+class BLELocalDevice {
+public:
+    int begin() { return 1; }
+    void end() {}
+    void poll(unsigned long timeout = 0) {}
+    bool setDeviceName(const char* name) { return true; }
+    bool setLocalName(const char* name) { return true; }
+    bool setAdvertisedService(const BLEService& service) { return true; }
+    void addService(BLEService& service) {}
+    int advertise() {
+        advertising = true;
+        return 1;
+    }
+    void stopAdvertise() { advertising = false; }
+    void setAdvertisingInterval(uint16_t interval) { advertisingInterval = interval; }
+    void setConnectionInterval(uint16_t minimum, uint16_t maximum) {}
+    void setSupervisionTimeout(uint16_t timeout) {}
+    void setEventHandler(BLEDeviceEvent event, BLEDeviceEventHandler handler) { handlers[event] = handler; }
+
+    // Host only: a central connects or drops
+    void hostConnect(const BLEDevice& central) { raise(BLEConnected, central); }
+    void hostDisconnect(const BLEDevice& central) { raise(BLEDisconnected, central); }
+
+    bool advertising = false;
+    uint16_t advertisingInterval = 0;
+
+private:
+    void raise(BLEDeviceEvent event, const BLEDevice& central) {
+        if (handlers[event]) {
+            handlers[event](central);
+        }
+    }
+    BLEDeviceEventHandler handlers[BLEDeviceEventLast] = {};
+};
+extern BLELocalDevice BLE;
+
+#endif // ARDUINO_BLE_H
@@ -0,0 +1,45 @@
+// test_analytics.cpp
+// The baseline has to cover the whole pre window at the fastest sampling
+// rate, not just the last few samples before the emission.
+#include "host_test.h"
+#include "emission_analytics.h"
+#include "settings.h"
+
+#define BASE 1000000UL  // ms, on a span boundary
+
+int main() {
+    setup();
+    resetEmissionAnalytics();
+
+    // A minute sampled every second: calm, then up for the last 8 s
+    for (unsigned long t = 0; t < ANALYTICS_PRE_WINDOW; t += 1000) {
+        onAnalyticsSample(BASE + t, t < ANALYTICS_PRE_WINDOW - 8000 ? 70 : 110);
+    }
+    unsigned long start = BASE + ANALYTICS_PRE_WINDOW;
+    onAnalyticsEmissionStart(0, TRIGGER_MANUAL, start);
+    for (unsigned long t = 1000; t <= ANALYTICS_POST_WINDOW + 1000; t += 1000) {
+        onAnalyticsSample(start + t, 70);
+    }
+
+    // The oldest span has just left the window: 47 calm samples and 8 high
+    // ones, a baseline of 75.8 BPM against a 70.0 BPM post window
+    SourceEffectiveness stats;
+    getSourceEffectiveness(TRIGGER_MANUAL, stats);
+    CHECK(stats.emissions == 1);
+    CHECK(stats.deltaSum == -58);
+    CHECK(stats.lowered == 1);
+
+    // Samples older than the window don't count
+    resetEmissionAnalytics();
+    start += ANALYTICS_POST_WINDOW + 10 * ANALYTICS_PRE_WINDOW;
+    onAnalyticsSample(start - ANALYTICS_PRE_WINDOW - ANALYTICS_BUCKET_SPAN, 150);
+    onAnalyticsSample(start - 1000, 80);
+    onAnalyticsEmissionStart(0, TRIGGER_MANUAL, start);
+    onAnalyticsSample(start + 1000, 80);
+    onAnalyticsSample(start + ANALYTICS_POST_WINDOW + 1000, 80);
+    getSourceEffectiveness(TRIGGER_MANUAL, stats);
+    CHECK(stats.emissions == 1);
+    CHECK(stats.deltaSum == 0);
+
+    return finishTests();
+}
@@ -0,0 +1,94 @@
+// test_battery.cpp
+// The power policy over a scripted ten-hour discharge and a recharge: each
+// level starts at its threshold, is left only BATTERY_POLICY_HYSTERESIS
+// above it, and scales the heart rate interval, emission duration and
+// advertising interval as the table in battery.h says.
+#include "host_test.h"
+#include "battery.h"
+#include "led_patterns.h"
+#include "settings.h"
+#include "debug.h"
+
+#define HOUR 3600000UL
+#define STEP 1000000  // us; the battery is measured once a minute
+
+static const unsigned long INTERVAL_AT_LEVEL[POWER_POLICY_LEVEL_COUNT] = {1000, 2000, 4000, 8000};
+static const unsigned long DURATION_AT_LEVEL[POWER_POLICY_LEVEL_COUNT] = {10000, 7500, 5000, 2500};
+static const uint16_t ADVERTISING_AT_LEVEL[POWER_POLICY_LEVEL_COUNT] = {160, 400, 800, 1600};
+
+static BatteryCurvePoint curve[2];
+
+// Threshold at which each level starts
+static byte threshold(byte level) {
+    const byte thresholds[POWER_POLICY_LEVEL_COUNT] = {100, batteryReducedThreshold, batteryLowThreshold,
+                                                       batteryCriticalThreshold};
+    return thresholds[level];
+}
+
+static void checkPolicy(byte level) {
+    CHECK(getPowerPolicyLevel() == level);
+    CHECK(scaleHeartRateInterval(1000) == INTERVAL_AT_LEVEL[level]);
+    CHECK(scaleEmissionDuration(10000) == DURATION_AT_LEVEL[level]);
+    CHECK(getPolicyAdvertisingInterval() == ADVERTISING_AT_LEVEL[level]);
+    CHECK((getLedStatus() == LED_STATUS_LOW_BATTERY) == (level >= POWER_POLICY_LOW));
+}
+
+// Runs a linear stretch of the curve a minute at a time, up to a minute
+// past its end, and returns the percentage at each level change, indexed
+// by the level that was entered
+static void runCurve(uint16_t fromMillivolts, uint16_t toMillivolts, unsigned long length, byte* changedAt) {
+    curve[0] = {(uint32_t)millis(), fromMillivolts};
+    curve[1] = {(uint32_t)(millis() + length), toMillivolts};
+    setSimulatedBatteryCurve(curve, 2);
+
+    byte level = getPowerPolicyLevel();
+    for (unsigned long elapsed = 0; elapsed <= length; elapsed += BATTERY_SAMPLE_INTERVAL) {
+        runLoop(BATTERY_SAMPLE_INTERVAL, STEP);
+        byte next = getPowerPolicyLevel();
+        if (next != level) {
+            CHECK(next == level + 1 || next + 1 == level);  // One step per reading
+            changedAt[next] = getBatteryPercent();
+            level = next;
+            checkPolicy(level);
+        }
+    }
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+    runLoop(1000);
+    checkPolicy(POWER_POLICY_NORMAL);
+
+    // Full to empty in ten hours: each level starts at its threshold
+    byte enteredAt[POWER_POLICY_LEVEL_COUNT] = {0, 0, 0, 0};
+    runCurve(4200, 3300, 10 * HOUR, enteredAt);
+    CHECK(getBatteryPercent() == 0);
+    checkPolicy(POWER_POLICY_CRITICAL);
+    for (byte level = POWER_POLICY_REDUCED; level < POWER_POLICY_LEVEL_COUNT; level++) {
+        CHECK(enteredAt[level] == threshold(level));
+    }
+
+    // Recharged in four hours: each level is left only above its threshold
+    // plus the hysteresis
+    byte leftAt[POWER_POLICY_LEVEL_COUNT] = {0, 0, 0, 0};
+    runCurve(3300, 4200, 4 * HOUR, leftAt);
+    CHECK(getBatteryPercent() == 100);
+    checkPolicy(POWER_POLICY_NORMAL);
+    for (byte level = POWER_POLICY_NORMAL; level < POWER_POLICY_CRITICAL; level++) {
+        CHECK(leftAt[level] == threshold(level + 1) + BATTERY_POLICY_HYSTERESIS + 1);
+    }
+
+    // A cell sagging to the threshold under load and recovering inside the
+    // hysteresis band keeps the lower level
+    byte unused[POWER_POLICY_LEVEL_COUNT];
+    runCurve(3751, 3750, 2 * BATTERY_SAMPLE_INTERVAL, unused);
+    checkPolicy(POWER_POLICY_REDUCED);
+    runCurve(3765, 3765, 10 * BATTERY_SAMPLE_INTERVAL, unused);
+    CHECK(getBatteryPercent() == batteryReducedThreshold + BATTERY_POLICY_HYSTERESIS);
+    checkPolicy(POWER_POLICY_REDUCED);
+    runCurve(3770, 3770, 2 * BATTERY_SAMPLE_INTERVAL, unused);
+    checkPolicy(POWER_POLICY_NORMAL);
+
+    return finishTests();
+}
@@ -0,0 +1,71 @@
+// test_ble.cpp
+// Commands and connections as the app drives them. Off stops the emission
+// itself, not just the LED latch the emitter pin may no longer follow.
+// Dropping connections changes the link status only; an emission runs on.
+#include <ArduinoBLE.h>
+#include "host_test.h"
+#include "ble_config.h"
+#include "emission_control.h"
+#include "gpio_hal.h"
+#include "led_patterns.h"
+#include "settings.h"
+
+static const uint8_t CENTRAL_ADDRESS[6] = {0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+static const uint8_t SECOND_ADDRESS[6] = {0x16, 0x15, 0x14, 0x13, 0x12, 0x11};
+
+static void command(byte value) {
+    switchCharacteristic.hostWrite(BLEDevice(CENTRAL_ADDRESS), value);
+    runLoop(20);
+}
+
+int main() {
+    setup();
+    BLE.hostConnect(BLEDevice(CENTRAL_ADDRESS));
+    runLoop(1000);
+
+    // Off ends a running emission and its emitter
+    command(CMD_LED_ON);
+    CHECK(isEmissionActive());
+    CHECK(digitalRead(getEmitterPin(0)) == LOW);
+    command(CMD_LED_OFF);
+    CHECK(!isEmissionActive());
+    CHECK(digitalRead(getEmitterPin(0)) == HIGH);
+
+    // Off also drops one waiting out the minimum gap, and nothing comes
+    // back once the stopped duration would have run out
+    command(CMD_LED_ON);
+    CHECK(!isEmissionActive());
+    command(CMD_LED_OFF);
+    runLoop(max(minEmissionGap, emissionDuration[0]) + 100);
+    CHECK(!isEmissionActive());
+
+    // Two centrals; the first to leave changes nothing but the count
+    BLE.hostConnect(BLEDevice(SECOND_ADDRESS));
+    runLoop(20);
+    CHECK(getConnectedCentralCount() == 2);
+    command(CMD_LED_ON);
+    CHECK(isEmissionActive());
+    BLE.hostDisconnect(BLEDevice(CENTRAL_ADDRESS));
+    runLoop(20);
+    CHECK(getConnectedCentralCount() == 1);
+    CHECK(digitalRead(LED_BUILTIN) == HIGH);
+    CHECK(isEmissionActive());
+    CHECK(getLedStatus() == LED_STATUS_EMITTING);
+
+    // The last one takes the link status with it, not the emission
+    BLE.hostDisconnect(BLEDevice(SECOND_ADDRESS));
+    runLoop(20);
+    CHECK(getConnectedCentralCount() == 0);
+    CHECK(digitalRead(LED_BUILTIN) == LOW);
+    CHECK(isEmissionActive());
+    CHECK(digitalRead(getEmitterPin(0)) == LOW);
+    CHECK(getLedStatus() == LED_STATUS_EMITTING);
+
+    // It still ends on its own cutoff, after which advertising shows
+    runLoop(emissionDuration[0]);
+    CHECK(!isEmissionActive());
+    CHECK(digitalRead(getEmitterPin(0)) == HIGH);
+    CHECK(getLedStatus() == LED_STATUS_ADVERTISING);
+
+    return finishTests();
+}
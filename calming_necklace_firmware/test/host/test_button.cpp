@@ -0,0 +1,119 @@
+// test_button.cpp
+// Edges go in where the pin interrupt would put them; the gestures have to
+// be decided at the debounce deadline, not whenever the loop comes round.
+#include "host_test.h"
+#include "button.h"
+#include "emission_control.h"
+#include "settings.h"
+
+#define BOUNCE_GAP 500     // us between the edges of a bouncing contact
+#define LOOP_STEP 5000     // us; coarser than a bounce, finer than the debounce
+
+// One clean edge, or one preceded by contact bounce
+static void edge(bool pressed, byte bounces = 0) {
+    for (byte i = 0; i < bounces; i++) {
+        injectButtonEdge(pressed, micros());
+        advanceMicros(BOUNCE_GAP);
+        injectButtonEdge(!pressed, micros());
+        advanceMicros(BOUNCE_GAP);
+    }
+    injectButtonEdge(pressed, micros());
+}
+
+static void press(unsigned long holdMs, byte bounces = 0) {
+    edge(true, bounces);
+    runLoop(holdMs, LOOP_STEP);
+    edge(false, bounces);
+}
+
+static ButtonStats stats() {
+    ButtonStats result;
+    getButtonStats(result);
+    return result;
+}
+
+// Idle, and past the minimum gap, so the next press starts at once
+static void reset() {
+    runLoop(500, LOOP_STEP);
+    stopEmission();
+    runLoop(minEmissionGap + 500, LOOP_STEP);
+    resetButtonStats();
+}
+
+int main() {
+    setup();
+    reset();
+
+    // Bounce: one press, however many edges the contact makes
+    press(100, 3);
+    runLoop(500, LOOP_STEP);
+    CHECK(stats().shortPresses == 1);
+    CHECK(stats().bounces == 12);
+    CHECK(stats().doublePresses == 0);
+    // Decided BUTTON_DEBOUNCE after the last bounce, not on a loop pass
+    CHECK(stats().maxDecisionMicros == 6 * BOUNCE_GAP + BUTTON_DEBOUNCE);
+    CHECK(isEmissionActive());
+    CHECK(stats().maxLatencyMicros >= stats().maxDecisionMicros);
+    CHECK(stats().maxLatencyMicros < stats().maxDecisionMicros + LOOP_STEP);
+    reset();
+
+    // Short press starts an emission
+    press(100);
+    runLoop(500, LOOP_STEP);
+    CHECK(stats().shortPresses == 1);
+    CHECK(stats().bounces == 0);
+    CHECK(stats().lastDecisionMicros == BUTTON_DEBOUNCE);
+    CHECK(isEmissionActive());
+    CHECK(stats().lastLatencyMicros >= BUTTON_DEBOUNCE);
+    reset();
+
+    // Double press stops it again
+    press(100);
+    runLoop(150, LOOP_STEP);
+    CHECK(isEmissionActive());
+    press(100);
+    runLoop(500, LOOP_STEP);
+    CHECK(stats().shortPresses == 1);
+    CHECK(stats().doublePresses == 1);
+    CHECK(!isEmissionActive());
+    reset();
+
+    // Presses further apart than the window are two short presses
+    press(100);
+    runLoop(BUTTON_DOUBLE_PRESS_WINDOW / 1000 + 100, LOOP_STEP);
+    press(100);
+    runLoop(500, LOOP_STEP);
+    CHECK(stats().shortPresses == 2);
+    CHECK(stats().doublePresses == 0);
+    reset();
+
+    // Long press: decided while still held, and not a short press on release
+    edge(true);
+    runLoop(BUTTON_LONG_PRESS / 1000 + 50, LOOP_STEP);
+    CHECK(isButtonPressed());
+    CHECK(stats().longPresses == 1);
+    CHECK(isEmissionActive());
+    edge(false);
+    runLoop(500, LOOP_STEP);
+    CHECK(stats().longPresses == 1);
+    CHECK(stats().shortPresses == 0);
+    reset();
+
+    // Overflow: the loop doesn't run, so gestures pile up in the queue while
+    // the interrupts still decide every one of them
+    for (byte i = 0; i < BUTTON_QUEUE_CAPACITY + 2; i++) {
+        edge(true);
+        advanceMicros(50000);
+        runButtonTimers(micros());
+        edge(false);
+        advanceMicros(BUTTON_DOUBLE_PRESS_WINDOW + 50000);
+        runButtonTimers(micros());
+    }
+    CHECK(stats().shortPresses == BUTTON_QUEUE_CAPACITY + 2);
+    CHECK(stats().overflows == 2);
+    runLoop(100, LOOP_STEP);
+    CHECK(isEmissionActive());
+    CHECK(!isButtonPressed());
+
+    return finishTests();
+}
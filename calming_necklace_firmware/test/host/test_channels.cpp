@@ -0,0 +1,50 @@
+// test_channels.cpp
+// Channels emit side by side, each switching only its own pin, and a
+// channel config with no duration or interval is refused.
+#include "host_test.h"
+#include "emission_control.h"
+#include "led_control.h"
+#include "settings.h"
+#include "debug.h"
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+    runLoop(minEmissionGap + 100);
+
+    // Channel 0 switching doesn't touch channel 1's pin
+    setEmitterOutput(1, true);
+    setEmitterOutput(0, true);
+    CHECK(digitalRead(getEmitterPin(0)) == LOW);
+    CHECK(digitalRead(getEmitterPin(1)) == LOW);
+    setEmitterOutput(0, false);
+    CHECK(digitalRead(getEmitterPin(0)) == HIGH);
+    CHECK(digitalRead(getEmitterPin(1)) == LOW);
+    setEmitterOutput(1, false);
+    CHECK(digitalRead(getEmitterPin(1)) == HIGH);
+
+    // Both channels run at once and each ends on its own duration
+    CHECK(setChannelConfig(0, 4000, 60000, false, TRIGGER_BIT(TRIGGER_MANUAL), 1));
+    CHECK(setChannelConfig(1, 8000, 60000, false, TRIGGER_BIT(TRIGGER_MANUAL), 0));
+    CHECK(triggerChannelEmission(0, TRIGGER_MANUAL));
+    CHECK(triggerChannelEmission(1, TRIGGER_MANUAL));
+    CHECK(isChannelActive(0));
+    CHECK(isChannelActive(1));
+    runLoop(4100);
+    CHECK(!isChannelActive(0));
+    CHECK(isChannelActive(1));
+    CHECK(digitalRead(getEmitterPin(0)) == HIGH);
+    CHECK(digitalRead(getEmitterPin(1)) == LOW);
+    runLoop(4000);
+    CHECK(!isEmissionActive());
+    CHECK(digitalRead(getEmitterPin(1)) == HIGH);
+
+    // No duration or no interval is refused, and the old config stays
+    CHECK(!setChannelConfig(0, 0, 60000, false, TRIGGER_BIT(TRIGGER_MANUAL), 1));
+    CHECK(!setChannelConfig(0, 4000, 0, true, TRIGGER_BIT(TRIGGER_MANUAL), 1));
+    CHECK(!setChannelConfig(EMISSION_CHANNEL_COUNT, 4000, 60000, false, 0, 0));
+    CHECK(emissionDuration[0] == 4000);
+    CHECK(releaseInterval[0] == 60000);
+
+    return finishTests();
+}
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Runs tools/dfu.py's encoder and protocol against the firmware's dfu.cpp
+built for the host: every image has to come back out of the C decoder byte
+for byte, and the device has to refuse what it should."""
+
+import os
+import random
+import struct
+import sys
+import zlib
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools"))
+import dfu  # noqa: E402
+
+KEY = bytes(range(dfu.KEY_LENGTH))
+failures = 0
+
+
+def check(condition, what):
+    global failures
+    if not condition:
+        failures += 1
+        print(f"FAILED: {what}")
+
+
+def application(body):
+    """An image whose vector table fits the application region."""
+    return struct.pack("<II", dfu.RAM_END, dfu.PRIMARY_ADDRESS + 9) + body  # Reset right after the table
+
+
+def images():
+    generator = random.Random(7)
+    yield "one byte", application(b"\x00")
+    yield "zeros", application(bytes(20000))
+    yield "random", application(bytes(generator.getrandbits(8) for _ in range(20000)))
+    yield "text", application(b"the calming necklace " * 2000)
+    # Runs longer than the lookahead and back-references at the edge of the window
+    pattern = bytes(generator.getrandbits(8) for _ in range(1 << dfu.WINDOW_BITS))
+    yield "window edge", application(pattern + bytes(100) + pattern + pattern[:17])
+
+
+def transfer(image, key=KEY, device_key=KEY, mtu=247, receipt_interval=4):
+    link = dfu.StandInLink(mtu, device_key)
+    stream = dfu.compress(image)
+    chunks = (len(stream) + dfu.payload_size(mtu) - 1) // dfu.payload_size(mtu)
+    link.drop_chunks = {chunks // 3}
+    link.disconnect_at = 2 * chunks // 3
+    try:
+        dfu.transfer(link, len(image), zlib.crc32(image), dfu.image_mac(image, key), stream, receipt_interval)
+        status = dfu.OK
+    except RuntimeError as error:
+        status = dfu.STATUS_NAMES.index(str(error).split(": ")[-1])
+    return link, status
+
+
+def request(link, data):
+    return link.request(data)[1]
+
+
+for name, image in images():
+    for receipt_interval in (1, 4, 0):
+        link, status = transfer(image, receipt_interval=receipt_interval)
+        check(status == dfu.OK, f"{name}, receipt interval {receipt_interval}: verify returned {status}")
+        check(link.device.bank(len(image)) == image, f"{name}, receipt interval {receipt_interval}: bank differs")
+
+image = application(b"firmware" * 1000)
+
+# Apply only goes ahead after the device has verified the image itself
+link, status = transfer(image)
+check(request(link, bytes([dfu.CMD_APPLY])) == dfu.OK, "apply after verify")
+
+link, status = transfer(image, key=bytes(dfu.KEY_LENGTH))
+check(status == dfu.UNAUTHORIZED, f"image signed with another key: {status}")
+check(request(link, bytes([dfu.CMD_APPLY])) == dfu.NOT_READY, "apply after failed authentication")
+
+link, status = transfer(image, device_key=None)
+check(status == dfu.UNAUTHORIZED, f"device without a key: {status}")
+
+bad_stack = struct.pack("<II", 0x10000000, dfu.PRIMARY_ADDRESS + 9) + image[8:]
+check(transfer(bad_stack)[1] == dfu.BAD_IMAGE, "stack pointer outside RAM")
+bad_reset = struct.pack("<II", dfu.RAM_END, dfu.BANK_ADDRESS + 0x101) + image[8:]
+check(transfer(bad_reset)[1] == dfu.BAD_IMAGE, "reset handler outside the image")
+arm_reset = struct.pack("<II", dfu.RAM_END, dfu.PRIMARY_ADDRESS + 8) + image[8:]
+check(transfer(arm_reset)[1] == dfu.BAD_IMAGE, "reset handler without the Thumb bit")
+
+# Chunk errors each get their own status
+link = dfu.StandInLink(247, KEY)
+stream = dfu.compress(image)
+start = dfu.start_command(len(image), len(stream), zlib.crc32(image), dfu.image_mac(image, KEY), 1)
+check(request(link, start) == dfu.OK, "start")
+corrupt = bytearray(dfu.chunk(0, stream[:100]))
+corrupt[-1] ^= 1
+link.device.data(bytes(corrupt))
+check(link.flush()[-1][1] == dfu.BAD_CRC, "corrupt chunk")
+link.device.data(dfu.chunk(0, stream + b"\x00"))
+check(link.flush()[-1][1] == dfu.TOO_LARGE, "chunk past the end of the stream")
+
+print(f"{failures} failed")
+sys.exit(1 if failures else 0)
@@ -0,0 +1,94 @@
+// test_duration.cpp
+// Replays the same episode over and over: the heart rate is high when an
+// emission starts and back under the threshold 20 s later however long the
+// emission runs. The controller should spend less emission time on each
+// episode without any of them recovering worse, and leave the user's own
+// duration setting alone.
+#include "host_test.h"
+#include "duration_controller.h"
+#include "emission_analytics.h"
+#include "settings.h"
+
+#define EPISODES 40
+#define EPISODE_SPACING 600000  // ms, well past the post window
+#define SAMPLE_INTERVAL 5000    // ms
+#define RECOVERY_AFTER 20000    // ms from the emission start
+
+static unsigned long clock = 0;
+
+// Runs one episode on a channel and returns the emission time it used
+static unsigned long replayEpisode(byte channel) {
+    unsigned long duration = getEmissionDuration(channel);
+    byte high = highHeartRateThreshold + 10;
+    byte calm = highHeartRateThreshold - 20;
+    for (unsigned long t = 0; t < ANALYTICS_PRE_WINDOW; t += SAMPLE_INTERVAL) {
+        onAnalyticsSample(clock + t, high);
+    }
+    clock += ANALYTICS_PRE_WINDOW;
+    onAnalyticsEmissionStart(channel, TRIGGER_HEART_RATE, clock);
+    for (unsigned long t = SAMPLE_INTERVAL; t <= ANALYTICS_POST_WINDOW + SAMPLE_INTERVAL; t += SAMPLE_INTERVAL) {
+        onAnalyticsSample(clock + t, t < RECOVERY_AFTER ? high : calm);
+    }
+    clock += EPISODE_SPACING;
+    return duration;
+}
+
+int main() {
+    setup();
+    resetEmissionAnalytics();
+    unsigned long userDuration = emissionDuration[0];
+
+    // Channel 0 aims for 60 s and recovers in 20 s: room to shorten
+    CHECK(setAdaptiveDuration(0, true, 2000, 30000, 60000));
+    unsigned long firstHalf = 0;
+    unsigned long secondHalf = 0;
+    unsigned long previous = getEmissionDuration(0);
+    bool neverLonger = true;
+    for (int episode = 0; episode < EPISODES; episode++) {
+        unsigned long used = replayEpisode(0);
+        (episode < EPISODES / 2 ? firstHalf : secondHalf) += used;
+        neverLonger = neverLonger && used <= previous;
+        previous = used;
+    }
+    printf("Emission time: first %d episodes %lu ms, last %d episodes %lu ms\n",
+           EPISODES / 2, firstHalf, EPISODES / 2, secondHalf);
+    CHECK(neverLonger);
+    CHECK(secondHalf < firstHalf);
+    CHECK(getEmissionDuration(0) < userDuration);
+
+    // Equal effectiveness: every episode still recovered
+    SourceEffectiveness effectiveness;
+    getSourceEffectiveness(TRIGGER_HEART_RATE, effectiveness);
+    CHECK(effectiveness.needRecovery == EPISODES);
+    CHECK(effectiveness.recovered == EPISODES);
+    CHECK(effectiveness.recoverySum == (uint32_t)EPISODES * RECOVERY_AFTER);
+
+    // The setting itself is untouched, and applies again once adaptation is off
+    CHECK(emissionDuration[0] == userDuration);
+    unsigned long adapted = getEmissionDuration(0);
+    CHECK(setAdaptiveDuration(0, false, 2000, 30000, 60000));
+    CHECK(getEmissionDuration(0) == userDuration);
+    CHECK(setAdaptiveDuration(0, true, 2000, 30000, 60000));
+    CHECK(getEmissionDuration(0) == adapted);
+
+    // Channel 1 has its own target, tighter than the recovery it sees
+    CHECK(setAdaptiveDuration(1, true, 2000, 30000, 10000));
+    CHECK(recoveryTarget[0] == 60000);
+    CHECK(recoveryTarget[1] == 10000);
+    for (int episode = 0; episode < 5; episode++) {
+        replayEpisode(1);
+    }
+    CHECK(getEmissionDuration(1) > emissionDuration[1]);
+    CHECK(getEmissionDuration(0) == adapted);
+
+    // Both survive a watchdog reset
+    unsigned long adaptedOne = getEmissionDuration(1);
+    runLoop(10);
+    setup();
+    CHECK(recoveryTarget[0] == 60000);
+    CHECK(recoveryTarget[1] == 10000);
+    CHECK(getEmissionDuration(0) == adapted);
+    CHECK(getEmissionDuration(1) == adaptedOne);
+
+    return finishTests();
+}
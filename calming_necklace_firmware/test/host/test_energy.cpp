@@ -0,0 +1,62 @@
+// test_energy.cpp
+// Emitter draw follows the duty the PWM actually plays, and a simulated
+// day of the sketch with heart rate release on gives the mAh/day report.
+#include "host_test.h"
+#include "emission_control.h"
+#include "emitter_pwm.h"
+#include "energy_model.h"
+#include "settings.h"
+#include "debug.h"
+#include "heart_rate.h"
+
+#define SIMULATED_HOURS 24
+
+// Average emitter current over 5 s of an emission on channel 0
+static uint32_t emitterCurrent(byte profile, byte intensity) {
+    stopEmission();
+    runLoop(minEmissionGap + 100);
+    CHECK(setChannelProfile(0, profile, intensity));
+    CHECK(triggerChannelEmission(0, TRIGGER_MANUAL));
+    resetEnergyStats();
+    runLoop(5000);
+    CHECK(isChannelActive(0));
+    EnergyStats stats;
+    getEnergyStats(stats);
+    stopEmission();
+    return stats.averageCurrent[POWER_EMITTER];
+}
+
+static bool near(uint32_t value, uint32_t expected) {
+    return value + expected / 100 >= expected && value <= expected + expected / 100;
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+
+    CHECK(near(emitterCurrent(PROFILE_SOLID, 100), 80000));
+    CHECK(near(emitterCurrent(PROFILE_SOLID, 50), 40000));
+    CHECK(near(emitterCurrent(PROFILE_SOFT_START, 50), 40000));
+    CHECK(near(emitterCurrent(PROFILE_PULSE, 100), 80000 * 66 / 100));
+    CHECK(setChannelProfile(0, PROFILE_SOLID, 100));
+
+    // A day of heart rate release on the simulated heart rate, which peaks
+    // at MAX_HEART_RATE: the hourly report, then the day's total
+    heartRateBasedReleaseEnabled = true;
+    highHeartRateThreshold = MAX_HEART_RATE - 5;
+    debugEnable(DEBUG_POWER);
+    resetEnergyStats();
+    runLoop(SIMULATED_HOURS * 3600000UL, 100000);
+    EnergyStats stats;
+    getEnergyStats(stats);
+    printf("Simulated %d h: %lu.%02lu mAh/day\n", SIMULATED_HOURS,
+           (unsigned long)(stats.chargePerDay / 100), (unsigned long)(stats.chargePerDay % 100));
+    for (byte component = 0; component < POWER_COMPONENT_COUNT; component++) {
+        printf("  component %d: %lu uA\n", component, (unsigned long)stats.averageCurrent[component]);
+    }
+    CHECK(stats.elapsed == SIMULATED_HOURS * 3600UL);
+    CHECK(stats.averageCurrent[POWER_EMITTER] > 0);
+    CHECK(stats.averageCurrent[POWER_EMITTER] < 80000);
+
+    return finishTests();
+}
@@ -0,0 +1,63 @@
+// test_gpio.cpp
+// The simulated port records one transition per store, with every pin that
+// changed in it, and mirrors the outputs onto the pins.
+#include "host_test.h"
+#include "gpio_hal.h"
+#include "debug.h"
+
+static GpioTransition transition(byte index) {
+    GpioTransition result = {0, 0, 0};
+    CHECK(getGpioTransition(index, result));
+    return result;
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+    RgbLed::configureOutput();
+    RgbLed::set();
+    clearGpioTrace();
+
+    // All three LEDs change in the same store
+    unsigned long start = micros();
+    writeRgbColor(pinMask(PIN_LED_RED, PIN_LED_BLUE));
+    CHECK(getGpioTraceCount() == 1);
+    GpioTransition both = transition(0);
+    CHECK(both.time == start);
+    CHECK(both.lowered == pinMask(PIN_LED_RED, PIN_LED_BLUE));
+    CHECK(both.raised == 0);
+    CHECK(digitalRead(PIN_LED_RED) == LOW);
+    CHECK(digitalRead(PIN_LED_GREEN) == HIGH);
+    CHECK(digitalRead(PIN_LED_BLUE) == LOW);
+
+    // Rising and falling pins in one store
+    advanceMicros(250);
+    writeRgbColor(pinMask(PIN_LED_GREEN));
+    GpioTransition swap = transition(1);
+    CHECK(swap.time == start + 250);
+    CHECK(swap.raised == pinMask(PIN_LED_RED, PIN_LED_BLUE));
+    CHECK(swap.lowered == pinMask(PIN_LED_GREEN));
+
+    // A store that changes nothing isn't a transition
+    writeRgbColor(pinMask(PIN_LED_GREEN));
+    CHECK(digitalRead(PIN_LED_BUILTIN) == LOW);  // No central connected
+    BuiltinLed::clear();
+    CHECK(getGpioTraceCount() == 2);
+    CHECK(gpioRead() & pinMask(PIN_LED_RED));
+
+    // Once full, the oldest go first and index 0 stays the oldest kept
+    for (byte i = 0; i < GPIO_TRACE_CAPACITY + 3; i++) {
+        advanceMicros(10);
+        RgbLed::write(i & 1 ? RgbLed::MASK : 0);
+    }
+    CHECK(getGpioTraceCount() == GPIO_TRACE_CAPACITY);
+    CHECK(transition(0).time == micros() - 10 * (GPIO_TRACE_CAPACITY - 1));
+    CHECK(transition(GPIO_TRACE_CAPACITY - 1).time == micros());
+    GpioTransition past;
+    CHECK(!getGpioTransition(GPIO_TRACE_CAPACITY, past));
+
+    clearGpioTrace();
+    CHECK(getGpioTraceCount() == 0);
+
+    return finishTests();
+}
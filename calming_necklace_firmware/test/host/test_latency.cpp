@@ -0,0 +1,57 @@
+// test_latency.cpp
+// A manual command is traced only to an emitter it started in the pass
+// that handled it; one merged or queued is abandoned there and then, so a
+// later start can't close it with someone else's latency.
+#include <ArduinoBLE.h>
+#include "host_test.h"
+#include "ble_config.h"
+#include "emission_control.h"
+#include "latency_trace.h"
+#include "settings.h"
+
+static const uint8_t CENTRAL_ADDRESS[6] = {0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+
+static void command(byte value) {
+    switchCharacteristic.hostWrite(BLEDevice(CENTRAL_ADDRESS), value);
+    runLoop(20);
+}
+
+static LatencyStats stats() {
+    LatencyStats result;
+    getLatencyStats(result);
+    return result;
+}
+
+int main() {
+    setup();
+    BLE.hostConnect(BLEDevice(CENTRAL_ADDRESS));
+    runLoop(1000);
+    resetLatencyStats();
+
+    // Starts an emission: traced to the output
+    command(CMD_LED_ON);
+    CHECK(isEmissionActive());
+    CHECK(stats().traces == 1);
+    CHECK(stats().abandoned == 0);
+
+    // Merged into the running emission
+    command(CMD_LED_ON);
+    CHECK(stats().traces == 1);
+    CHECK(stats().abandoned == 1);
+
+    // Queued behind the minimum gap, then started by the loop later on
+    stopEmission();
+    command(CMD_LED_ON);
+    CHECK(!isEmissionActive());
+    CHECK(stats().abandoned == 2);
+    runLoop(minEmissionGap + 100);
+    CHECK(isEmissionActive());
+    CHECK(stats().traces == 1);
+
+    // The next command is timed on its own
+    command(CMD_LED_OFF);
+    CHECK(stats().traces == 2);
+    CHECK(stats().maxMicros[LATENCY_TOTAL] < 20000);
+
+    return finishTests();
+}
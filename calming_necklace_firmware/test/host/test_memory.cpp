@@ -0,0 +1,75 @@
+// test_memory.cpp
+// Nothing may allocate once setup() has sealed the heap, whichever way it
+// asks for memory. Each way is tried in a child process, which the guard
+// has to stop; the connect path has to get through without allocating.
+#include <ArduinoBLE.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "ble_config.h"
+#include "debug.h"
+
+static const uint8_t CENTRAL_ADDRESS[6] = {0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+
+// True when the child was stopped by abort()
+static bool abortsAfterSetup(void (*body)()) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        body();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+static void *volatile keep;
+
+static void callMalloc() {
+    keep = malloc(16);
+}
+
+static void callCalloc() {
+    keep = calloc(4, 4);
+}
+
+static void callRealloc() {
+    keep = realloc(nullptr, 16);
+}
+
+static void callNew() {
+    keep = new uint8_t[16];
+}
+
+static void makeString() {
+    String text("allocates");
+    keep = (void*)text.c_str();
+}
+
+static void connectCentral() {
+    BLE.hostConnect(BLEDevice(CENTRAL_ADDRESS));
+    runLoop(100);
+    BLE.hostDisconnect(BLEDevice(CENTRAL_ADDRESS));
+    runLoop(100);
+}
+
+int main() {
+    setup();
+    runLoop(1000);
+
+    CHECK(abortsAfterSetup(callMalloc));
+    CHECK(abortsAfterSetup(callCalloc));
+    CHECK(abortsAfterSetup(callRealloc));
+    CHECK(abortsAfterSetup(callNew));
+    CHECK(abortsAfterSetup(makeString));
+
+    // BLE logging is on by default, and the address goes into the log
+    CHECK(isDebugEnabled(DEBUG_BLE));
+    CHECK(!abortsAfterSetup(connectCentral));
+    BLE.hostConnect(BLEDevice(CENTRAL_ADDRESS));
+    CHECK(getConnectedCentralCount() == 1);
+
+    return finishTests();
+}
@@ -0,0 +1,122 @@
+// test_prediction.cpp
+// Replays heart rate traces into the trend predictor and both triggers.
+// On a steady rise the predictive trigger fires ahead of the sample where
+// the reactive threshold check would have, and a projection that wobbles
+// inside the hysteresis band below the threshold doesn't fire again.
+#include "host_test.h"
+#include "emission_control.h"
+#include "heart_rate.h"
+#include "heart_rate_trend.h"
+#include "time_service.h"
+#include "settings.h"
+#include "debug.h"
+
+#define SAMPLE_INTERVAL 5000  // ms, the default sampling floor
+
+static unsigned long predictedAt = 0;  // When the predictive trigger fired, 0 if not yet
+static unsigned long crossedAt = 0;    // First sample above the threshold, 0 if not yet
+static bool dippedIntoBand = false;    // Projection fell below the threshold, not below the band
+static bool projectedAboveAgain = false;
+
+// One sample as updateHeartRate() would take it, on the loop's clock
+static void sample(byte heartRate) {
+    advanceMicros(SAMPLE_INTERVAL * 1000UL);
+    updateLoopTime();
+    unsigned long now = getLoopMillis();
+    updateEmissionState(now);
+
+    PredictionStats before;
+    getPredictionStats(before);
+    addHeartRateSample(now, heartRate);
+    checkHeartRateBasedEmission(heartRate);
+    checkPredictiveEmission(heartRate);
+    PredictionStats after;
+    getPredictionStats(after);
+
+    if (after.predictions > before.predictions && predictedAt == 0) {
+        predictedAt = now;
+    }
+    if (heartRate > highHeartRateThreshold && crossedAt == 0) {
+        crossedAt = now;
+    }
+    if (predictedAt != 0 && isHeartRateTrendValid()) {
+        int projected = getProjectedHeartRate(predictionHorizon);
+        if (projected <= highHeartRateThreshold && projected >= highHeartRateThreshold - predictionHysteresis) {
+            dippedIntoBand = true;
+        } else if (dippedIntoBand && projected > highHeartRateThreshold) {
+            projectedAboveAgain = true;
+        }
+    }
+}
+
+static void replay(const byte* trace, byte length) {
+    predictedAt = 0;
+    crossedAt = 0;
+    dippedIntoBand = false;
+    projectedAboveAgain = false;
+    for (byte i = 0; i < length; i++) {
+        sample(trace[i]);
+    }
+}
+
+// Slow enough for each step to settle the trend window
+static void settle(byte heartRate) {
+    for (byte i = 0; i < TREND_WINDOW_SIZE; i++) {
+        sample(heartRate);
+    }
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+
+    // Short emissions with no gap, so every accepted trigger is counted and
+    // none is absorbed by an emission still running
+    heartRateBasedReleaseEnabled = true;
+    predictiveReleaseEnabled = true;
+    highHeartRateThreshold = 100;
+    lowHeartRateThreshold = 40;
+    predictionHorizon = 30000;
+    predictionHysteresis = 5;
+    minEmissionGap = 0;
+    CHECK(setChannelConfig(0, 1000, 3600000, false, channelTriggers[0], 1));
+    settle(80);
+    resetPredictionStats();
+
+    // A steady rise of 1 BPM per sample, 12 BPM a minute
+    static const byte rise[] = {82, 84, 86, 88, 90, 92, 94, 96, 98, 100, 102, 104, 106};
+    replay(rise, sizeof(rise));
+    PredictionStats stats;
+    getPredictionStats(stats);
+    CHECK(predictedAt != 0);
+    CHECK(crossedAt != 0);
+    CHECK((long)(crossedAt - predictedAt) > 0);
+    CHECK(stats.predictions == 1);
+    CHECK(stats.confirmed == 1);
+    CHECK(stats.falseAlarms == 0);
+    CHECK(stats.maxLeadTime == crossedAt - predictedAt);
+    printf("Predictive lead over the reactive trigger: %lu ms\n", (unsigned long)stats.maxLeadTime);
+
+    // Back to rest, which re-arms the predictor
+    settle(70);
+    resetPredictionStats();
+
+    // A rise that stalls below the threshold: the projection falls back into
+    // the hysteresis band and climbs over the threshold again, without a
+    // second trigger, until it drops below the band
+    static const byte stall[] = {74, 78, 82, 86, 90, 94, 96, 97, 97, 97, 97, 96, 97, 98, 99, 98, 97, 97, 97};
+    replay(stall, sizeof(stall));
+    getPredictionStats(stats);
+    CHECK(predictedAt != 0);
+    CHECK(crossedAt == 0);
+    CHECK(dippedIntoBand);
+    CHECK(projectedAboveAgain);
+    CHECK(stats.predictions == 1);
+    CHECK(stats.confirmed == 0);
+    settle(80);
+    getPredictionStats(stats);
+    CHECK(stats.predictions == 1);
+    CHECK(stats.falseAlarms == 1);
+
+    return finishTests();
+}
@@ -0,0 +1,121 @@
+// test_rules.cpp
+// Rules follow three-valued logic: anything computed from a variable
+// without a value is unknown, an unknown result doesn't fire, and only a
+// known false (AND) or a known true (OR) decides past an unknown side.
+// Uploads are validated against the stack and operand limits, and the
+// evaluation cost per rule is measured on the host CPU.
+#include <chrono>
+#include "host_test.h"
+#include "rule_engine.h"
+#include "wall_clock.h"
+#include "settings.h"
+#include "debug.h"
+
+#define PUSH(value) RULE_OP_PUSH, (uint8_t)((value) & 0xFF), (uint8_t)(((value) >> 8) & 0xFF)
+#define LOAD(variable) RULE_OP_LOAD, (variable)
+
+// Quiet hours, 23:00-07:00
+#define QUIET_HOURS LOAD(RULE_VAR_MINUTE_OF_DAY), PUSH(23 * 60), PUSH(7 * 60), RULE_OP_BETWEEN
+
+// Whether the rule fires on its first evaluation
+static bool fires(const uint8_t* code, byte length) {
+    RuleStats before, after;
+    getRuleStats(before);
+    CHECK(setRule(0, 1, code, length));
+    evaluateRules();
+    getRuleStats(after);
+    setRule(0, 1, nullptr, 0);
+    return after.fired > before.fired;
+}
+
+#define FIRES(...) ([] { static const uint8_t code[] = {__VA_ARGS__}; return fires(code, sizeof(code)); }())
+#define VALID(...) ([] { static const uint8_t code[] = {__VA_ARGS__}; return validateRule(code, sizeof(code)); }())
+
+#define BENCHMARK_EVALUATIONS 100000
+
+// Host time per evaluation of the rule on its own, variable snapshot
+// included, and the instructions it ran
+static void benchmark(const char* name, const uint8_t* code, byte length) {
+    CHECK(setRule(0, 1, code, length));
+    resetRuleStats();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < BENCHMARK_EVALUATIONS; i++) {
+        evaluateRules();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    setRule(0, 1, nullptr, 0);
+
+    RuleStats stats;
+    getRuleStats(stats);
+    CHECK(stats.evaluations == BENCHMARK_EVALUATIONS);
+    CHECK(stats.maxInstructions <= RULE_MAX_CODE);
+    printf("Rule %-14s %2d bytes, %2d instructions, %4ld ns per evaluation\n", name, length,
+           stats.maxInstructions, (long)(elapsed.count() / BENCHMARK_EVALUATIONS));
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+    CHECK(!isWallClockSynced());
+
+    // Before a sync, neither quiet hours nor their negation hold
+    CHECK(!FIRES(QUIET_HOURS));
+    CHECK(!FIRES(QUIET_HOURS, RULE_OP_NOT));
+    CHECK(!FIRES(PUSH(1), QUIET_HOURS, RULE_OP_NOT, RULE_OP_AND));
+    CHECK(!FIRES(LOAD(RULE_VAR_WEEKDAY), PUSH(0), RULE_OP_GE, RULE_OP_NOT));
+    CHECK(!FIRES(QUIET_HOURS, RULE_OP_HOLD, 0, 0, 0));
+    CHECK(!FIRES(QUIET_HOURS, RULE_OP_HOLD, 0, 0, 0, RULE_OP_NOT));
+
+    // A known side decides where it can
+    CHECK(!FIRES(PUSH(0), QUIET_HOURS, RULE_OP_NOT, RULE_OP_AND, RULE_OP_NOT, RULE_OP_NOT));
+    CHECK(FIRES(PUSH(0), QUIET_HOURS, RULE_OP_AND, RULE_OP_NOT));
+    CHECK(FIRES(QUIET_HOURS, PUSH(1), RULE_OP_OR));
+    CHECK(!FIRES(QUIET_HOURS, PUSH(1), RULE_OP_OR, RULE_OP_NOT));
+    CHECK(!FIRES(QUIET_HOURS, PUSH(0), RULE_OP_OR));
+    CHECK(!FIRES(QUIET_HOURS, QUIET_HOURS, RULE_OP_NOT, RULE_OP_OR));
+
+    // Known values again once the clock is synced, at noon on a Friday
+    const uint8_t noon[CURRENT_TIME_LENGTH] = {2024 & 0xFF, 2024 >> 8, 1, 5, 12, 0, 0, 0, 0, 0};
+    CHECK(syncWallClock(noon, sizeof(noon)));
+    CHECK(!FIRES(QUIET_HOURS));
+    CHECK(FIRES(QUIET_HOURS, RULE_OP_NOT));
+    CHECK(FIRES(PUSH(1), QUIET_HOURS, RULE_OP_NOT, RULE_OP_AND));
+    CHECK(FIRES(QUIET_HOURS, QUIET_HOURS, RULE_OP_NOT, RULE_OP_OR));
+
+    // Validation: stack bounds, operands and hold slots
+    CHECK(VALID(PUSH(1)));
+    CHECK(VALID(QUIET_HOURS, RULE_OP_END, 0xFF));  // Nothing after END runs
+    CHECK(!validateRule(nullptr, 0));
+    const uint8_t tooLong[RULE_MAX_CODE + 1] = {PUSH(1)};
+    CHECK(!validateRule(tooLong, sizeof(tooLong)));
+    CHECK(!VALID(RULE_OP_PUSH, 1));
+    CHECK(!VALID(PUSH(1), RULE_OP_HOLD, 0, 30));
+    CHECK(!VALID(0x0D));
+    CHECK(!VALID(LOAD(RULE_VAR_COUNT)));
+    CHECK(!VALID(PUSH(1), RULE_OP_HOLD, RULE_HOLD_SLOTS, 1, 0));
+    CHECK(!VALID(PUSH(1), RULE_OP_HOLD, 0, 1, 0, RULE_OP_HOLD, 0, 1, 0));
+    CHECK(VALID(PUSH(1), RULE_OP_HOLD, 0, 1, 0, RULE_OP_HOLD, 1, 1, 0));
+    CHECK(!VALID(PUSH(1), RULE_OP_GT));
+    CHECK(!VALID(PUSH(1), PUSH(1)));
+    CHECK(!VALID(RULE_OP_END));
+    CHECK(!VALID(PUSH(1), PUSH(1), PUSH(1), PUSH(1), PUSH(1), PUSH(1), PUSH(1), PUSH(1), PUSH(1)));
+    static const uint8_t always[] = {PUSH(1)};
+    CHECK(!setRule(0, 0, always, sizeof(always)));
+    CHECK(!setRule(0, 1 << EMISSION_CHANNEL_COUNT, always, sizeof(always)));
+    CHECK(!setRule(RULE_CAPACITY, 1, always, sizeof(always)));
+
+    // Evaluation cost, from a single comparison up to a full-length rule
+    static const uint8_t threshold[] = {LOAD(RULE_VAR_HEART_RATE), PUSH(95), RULE_OP_GT};
+    static const uint8_t quietHours[] = {LOAD(RULE_VAR_HEART_RATE), PUSH(95), RULE_OP_GT,
+                                         QUIET_HOURS, RULE_OP_NOT, RULE_OP_AND};
+    static const uint8_t full[] = {LOAD(RULE_VAR_HEART_RATE), PUSH(95), RULE_OP_GT, RULE_OP_HOLD, 0, 30, 0,
+                                   QUIET_HOURS, RULE_OP_NOT, RULE_OP_AND,
+                                   LOAD(RULE_VAR_SECONDS_SINCE_EMISSION), PUSH(600), RULE_OP_GE, RULE_OP_AND,
+                                   LOAD(RULE_VAR_EMISSION_ACTIVE), RULE_OP_NOT, RULE_OP_AND};
+    static_assert(sizeof(full) == RULE_MAX_CODE, "the full rule uses all the code space");
+    benchmark("threshold", threshold, sizeof(threshold));
+    benchmark("quiet hours", quietHours, sizeof(quietHours));
+    benchmark("full length", full, sizeof(full));
+
+    return finishTests();
+}
@@ -0,0 +1,58 @@
+// test_schedule.cpp
+// A window whose end is before its start runs past midnight into the next
+// day, whether it is entered by the clock running on or found open after
+// a sync.
+#include "host_test.h"
+#include "emission_schedule.h"
+#include "wall_clock.h"
+#include "debug.h"
+
+#define FRIDAY 4
+#define STEP 1000000  // us; the schedule works in minutes
+
+// Friday 2024-01-05, or the day after
+static void syncTo(byte day, byte hour, byte minute) {
+    const uint8_t currentTime[CURRENT_TIME_LENGTH] = {2024 & 0xFF, 2024 >> 8, 1, day, hour, minute, 0, 0, 0, 0};
+    CHECK(syncWallClock(currentTime, sizeof(currentTime)));
+    rebuildSchedule();
+}
+
+static void runMinutes(unsigned long minutes) {
+    runLoop(minutes * 60000, STEP);
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+
+    syncTo(5, 21, 50);
+    CHECK(getWeekday(getWallClockMillis()) == FRIDAY);
+    ScheduleEntry night = {22 * 60, 6 * 60, 1 << FRIDAY, 0};
+    CHECK(setScheduleEntry(0, night));
+    CHECK(!isScheduleWindowOpen(0));
+
+    runMinutes(15);
+    CHECK(isScheduleWindowOpen(0));  // Friday 22:05
+    runMinutes(4 * 60);
+    CHECK(isScheduleWindowOpen(0));  // Saturday 02:05
+    runMinutes(4 * 60);
+    CHECK(!isScheduleWindowOpen(0));  // Saturday 06:05
+
+    // Found open after the sync, from the previous day's entry
+    syncTo(6, 3, 0);
+    CHECK(isScheduleWindowOpen(0));
+    syncTo(6, 23, 0);
+    CHECK(!isScheduleWindowOpen(0));  // Saturday isn't selected
+
+    // A window starting as another ends on the same channel stays open
+    ScheduleEntry morning = {6 * 60, 8 * 60, 1 << (FRIDAY + 1), 0};
+    CHECK(setScheduleEntry(1, morning));
+    syncTo(6, 5, 55);
+    CHECK(isScheduleWindowOpen(0));
+    runMinutes(10);
+    CHECK(isScheduleWindowOpen(0));  // Saturday 06:05
+    runMinutes(2 * 60);
+    CHECK(!isScheduleWindowOpen(0));
+
+    return finishTests();
+}
@@ -0,0 +1,42 @@
+// test_store.cpp
+// A save cut short between its data and its header leaves programmed
+// words past the end of the log. The next boot compacts them away, so the
+// following save lands on erased flash and is the one that loads.
+#include "host_test.h"
+#include "persistent_store.h"
+#include "debug.h"
+
+static uint32_t load() {
+    uint32_t value = 0;
+    CHECK(loadRecord(STORE_RECORD_BUDGET, &value, sizeof(value)));
+    return value;
+}
+
+static void save(uint32_t value) {
+    CHECK(saveRecord(STORE_RECORD_BUDGET, &value, sizeof(value)));
+}
+
+int main() {
+    setup();
+    debugDisable(DEBUG_ALL);
+
+    save(600000);
+    save(450000);
+    CHECK(load() == 450000);
+
+    // Reset after the data of the next save, before its header
+    uint32_t torn = 300000;
+    simulateTornSave(STORE_RECORD_BUDGET, &torn, sizeof(torn));
+    initPersistentStore();
+    CHECK(load() == 450000);
+
+    // Saves after the reboot stick instead of falling back to the larger one
+    save(200000);
+    CHECK(load() == 200000);
+    initPersistentStore();
+    CHECK(load() == 200000);
+    save(100000);
+    CHECK(load() == 100000);
+
+    return finishTests();
+}
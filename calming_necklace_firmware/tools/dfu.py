@@ -0,0 +1,453 @@
+#!/usr/bin/env python3
+"""Builds, benchmarks and sends over-the-air firmware updates.
+
+The image is compressed with heatshrink (window 2^12, lookahead 2^4, the
+same as DFU_WINDOW_BITS and DFU_LOOKAHEAD_BITS in dfu.h) and streamed in
+chunks of [stream offset, LE32][CRC-16/CCITT, LE16][payload].
+
+    tools/dfu.py keygen -o necklace.key
+    tools/dfu.py package build/calming_necklace.ino.bin --key necklace.key -o update.dfu
+    tools/dfu.py bench build/calming_necklace.ino.bin
+    tools/dfu.py send update.dfu --address AA:BB:CC:DD:EE:FF
+
+The device only accepts an image carrying an HMAC-SHA256 under the 32 byte
+key in its UICR CUSTOMER registers; keygen makes a key and prints the
+nrfjprog commands that provision it.
+
+bench runs the whole protocol over a stand-in link against the firmware's
+own dfu.cpp, built for the host by test/host (make -C test/host dfu, which
+bench runs when the library is missing or stale). Chunk sizes and receipt
+intervals can be compared without radios. It drops a chunk and a
+connection on the way and checks the image that lands in the simulated
+bank byte for byte. send needs the bleak package.
+"""
+
+import argparse
+import asyncio
+import ctypes
+import hmac
+import os
+import struct
+import subprocess
+import sys
+import zlib
+
+HOST_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "test", "host")
+HOST_LIBRARY = os.path.join(HOST_DIR, "build", "libdfu_host.so")
+
+WINDOW_BITS = 12
+LOOKAHEAD_BITS = 4
+MIN_MATCH = 2  # A back-reference costs 17 bits, two literals 18
+MAX_MATCH = 1 << LOOKAHEAD_BITS
+MAX_CANDIDATES = 128
+
+BANK_SIZE = 0x70000
+PRIMARY_ADDRESS = 0x10000
+BANK_ADDRESS = 0x80000
+RAM_START, RAM_END = 0x20000000, 0x20040000
+UICR_CUSTOMER = 0x10001080
+KEY_LENGTH = MAC_LENGTH = 32
+CHUNK_HEADER = 6
+MAX_CHUNK_PAYLOAD = 238
+ATT_HEADER = 3
+
+CMD_START, CMD_STATUS, CMD_VERIFY, CMD_APPLY, CMD_ABORT = 1, 2, 3, 4, 5
+RECEIPT = 0x10
+STATUS_NAMES = ["OK", "BAD_REQUEST", "TOO_LARGE", "BAD_OFFSET", "BAD_CRC", "BAD_STREAM",
+                "VERIFY_FAILED", "NOT_READY", "UNAUTHORIZED", "BAD_IMAGE"]
+(OK, BAD_REQUEST, TOO_LARGE, BAD_OFFSET, BAD_CRC, BAD_STREAM, VERIFY_FAILED, NOT_READY,
+ UNAUTHORIZED, BAD_IMAGE) = range(10)
+
+CONTROL_UUID = "19b10019-e8f2-537e-4f6c-d104768a1214"
+DATA_UUID = "19b1001a-e8f2-537e-4f6c-d104768a1214"
+
+PACKAGE_HEADER = struct.Struct("<4sIII32s")  # magic, image size, stream size, image CRC-32, HMAC
+PACKAGE_MAGIC = b"CND2"
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def compress(data):
+    """Greedy heatshrink encoding, tags MSB first: 1 + 8 bit literal, or
+    0 + (distance - 1) + (length - 1)."""
+    out = bytearray()
+    accumulator = 0
+    bits = 0
+
+    def put(value, count):
+        nonlocal accumulator, bits
+        accumulator = (accumulator << count) | value
+        bits += count
+        while bits >= 8:
+            bits -= 8
+            out.append((accumulator >> bits) & 0xFF)
+        accumulator &= (1 << bits) - 1
+
+    window = 1 << WINDOW_BITS
+    chains = {}
+    position = 0
+    while position < len(data):
+        best_length = 0
+        best_distance = 0
+        key = bytes(data[position:position + MIN_MATCH])
+        for candidate in reversed(chains.get(key, [])[-MAX_CANDIDATES:]):
+            distance = position - candidate
+            if distance > window:
+                break
+            length = 0
+            limit = min(MAX_MATCH, len(data) - position)
+            while length < limit and data[candidate + length] == data[position + length]:
+                length += 1
+            if length > best_length:
+                best_length, best_distance = length, distance
+                if length == limit:
+                    break
+
+        step = best_length if best_length >= MIN_MATCH else 1
+        if step == 1:
+            put(1, 1)
+            put(data[position], 8)
+        else:
+            put(0, 1)
+            put(best_distance - 1, WINDOW_BITS)
+            put(best_length - 1, LOOKAHEAD_BITS)
+        for i in range(position, position + step):
+            chain = chains.setdefault(bytes(data[i:i + MIN_MATCH]), [])
+            chain.append(i)
+            if len(chain) > 2 * MAX_CANDIDATES:
+                del chain[:MAX_CANDIDATES]
+        position += step
+
+    if bits:
+        put(0, 8 - bits)
+    return bytes(out)
+
+
+def image_mac(image, key):
+    return hmac.new(key, image, "sha256").digest()
+
+
+def check_vector_table(image):
+    """The same check as checkVectorTable() in dfu.cpp."""
+    if len(image) < 8 or PRIMARY_ADDRESS + len(image) > BANK_ADDRESS:
+        return False
+    stack, reset = struct.unpack_from("<II", image)
+    reset_address = reset & ~1
+    return (RAM_START < stack <= RAM_END and stack % 8 == 0 and reset & 1 == 1
+            and PRIMARY_ADDRESS + 8 <= reset_address < PRIMARY_ADDRESS + len(image))
+
+
+def read_key(path):
+    with open(path, "rb") as f:
+        key = f.read()
+    if len(key) != KEY_LENGTH:
+        sys.exit(f"{path} is not a {KEY_LENGTH} byte key")
+    return key
+
+
+def package(image, key):
+    stream = compress(image)
+    return PACKAGE_HEADER.pack(PACKAGE_MAGIC, len(image), len(stream), zlib.crc32(image),
+                               image_mac(image, key)) + stream
+
+
+def unpack(data):
+    magic, image_size, stream_size, image_crc, mac = PACKAGE_HEADER.unpack_from(data)
+    if magic != PACKAGE_MAGIC:
+        raise ValueError("not an update package")
+    stream = data[PACKAGE_HEADER.size:]
+    if len(stream) != stream_size:
+        raise ValueError("truncated update package")
+    return image_size, image_crc, mac, stream
+
+
+def start_command(image_size, stream_size, image_crc, mac, receipt_interval):
+    return struct.pack("<BIIIB32s", CMD_START, image_size, stream_size, image_crc, receipt_interval, mac)
+
+
+def chunk(offset, payload):
+    return struct.pack("<IH", offset, crc16(payload)) + payload
+
+
+def parse_response(data):
+    command, status, stream_offset, image_offset = struct.unpack("<BBII", bytes(data[:10]))
+    return command, status, stream_offset, image_offset
+
+
+def payload_size(mtu):
+    return max(1, min(MAX_CHUNK_PAYLOAD, mtu - ATT_HEADER - CHUNK_HEADER))
+
+
+class HostDevice:
+    """dfu.cpp built for the host, answering through notify()."""
+
+    library = None
+
+    def __init__(self, notify, key):
+        if HostDevice.library is None:
+            subprocess.run(["make", "-s", "-C", HOST_DIR, "dfu"], check=True)
+            HostDevice.library = ctypes.CDLL(HOST_LIBRARY)
+        responder_type = ctypes.CFUNCTYPE(None, ctypes.POINTER(ctypes.c_uint8), ctypes.c_size_t)
+        # Kept referenced, the library holds on to it
+        self.responder = responder_type(lambda data, length: notify(bytes(data[:length])))
+        self.library.dfuHostInit(self.responder, key)
+
+    def control(self, data):
+        self.library.dfuHostControl(data, len(data))
+
+    def data(self, data):
+        self.library.dfuHostData(data, len(data))
+
+    def advance(self, ms):
+        self.library.dfuHostAdvance(ctypes.c_ulong(ms))
+
+    def bank(self, length):
+        buffer = ctypes.create_string_buffer(length)
+        self.library.dfuHostReadBank(buffer, 0, length)
+        return buffer.raw
+
+
+class StandInLink:
+    """Connection events without a radio. Each event carries up to
+    packets_per_event writes; a notification queued during an event
+    reaches the central at the end of it."""
+
+    def __init__(self, mtu, key, interval_ms=15.0, packets_per_event=6, drop_chunks=(), disconnect_at=None):
+        self.mtu = mtu
+        self.interval_ms = interval_ms
+        self.packets_per_event = packets_per_event
+        self.drop_chunks = set(drop_chunks)
+        self.disconnect_at = disconnect_at
+        self.device = HostDevice(self._notify, key)
+        self.notifications = []
+        self.events = 0
+        self.sent_in_event = 0
+        self.chunks_sent = 0
+        self.connected = True
+
+    def _notify(self, data):
+        self.notifications.append(parse_response(data))
+
+    def _packet(self):
+        if self.sent_in_event == self.packets_per_event:
+            self.events += 1
+            self.sent_in_event = 0
+        self.sent_in_event += 1
+
+    def flush(self):
+        """Ends the current connection event so queued notifications arrive."""
+        if self.sent_in_event:
+            self.events += 1
+            self.sent_in_event = 0
+        received, self.notifications = self.notifications, []
+        return received
+
+    def request(self, data):
+        self._packet()
+        self.device.control(data)
+        self.events += 1  # The response comes back a connection event later
+        self.sent_in_event = 0
+        return self.flush()[-1]
+
+    def write_chunk(self, data):
+        if not self.connected:
+            raise ConnectionError("disconnected")
+        index = self.chunks_sent
+        self.chunks_sent += 1
+        if index == self.disconnect_at:
+            self.connected = False
+            raise ConnectionError("disconnected")
+        self._packet()
+        if index in self.drop_chunks:
+            return
+        self.device.data(data)
+
+    def reconnect(self):
+        self.connected = True
+        self.events += 200 // max(1, int(self.interval_ms))  # Scan and reconnect, ~200 ms
+
+    @property
+    def elapsed_ms(self):
+        return self.events * self.interval_ms
+
+
+def chunks_per_receipt(receipt_interval, stream_size, size):
+    """Chunks to write before waiting for a receipt; interval 0 means the
+    device only answers once the whole stream is in."""
+    return receipt_interval or (stream_size + size - 1) // size
+
+
+def transfer(link, image_size, image_crc, mac, stream, receipt_interval):
+    """Streams the update, resuming on disconnects and rewinding on
+    BAD_OFFSET receipts. Returns the number of resumes."""
+    size = payload_size(link.mtu)
+    start = start_command(image_size, len(stream), image_crc, mac, receipt_interval)
+    resumes = 0
+    while True:
+        _, status, offset, _ = link.request(start)
+        if status != OK:
+            raise RuntimeError(f"START failed: {STATUS_NAMES[status]}")
+        try:
+            while offset < len(stream):
+                for _ in range(chunks_per_receipt(receipt_interval, len(stream), size)):
+                    if offset >= len(stream):
+                        break
+                    link.write_chunk(chunk(offset, stream[offset:offset + size]))
+                    offset += size
+                receipts = link.flush()
+                if not receipts:
+                    link.events += 1  # Waiting for a receipt that was not sent
+                    _, _, offset, _ = link.request(bytes([CMD_STATUS]))
+                    continue
+                _, status, offset, _ = receipts[-1]
+                if status == BAD_STREAM:
+                    raise RuntimeError("device rejected the stream")
+            break
+        except ConnectionError:
+            resumes += 1
+            link.reconnect()
+
+    _, status, _, _ = link.request(bytes([CMD_VERIFY]))
+    if status != OK:
+        raise RuntimeError(f"VERIFY failed: {STATUS_NAMES[status]}")
+    return resumes
+
+
+def command_keygen(args):
+    key = os.urandom(KEY_LENGTH)
+    with open(args.output, "xb") as f:
+        f.write(key)
+    print(f"Key written to {args.output}. Provision a necklace with:")
+    for i in range(0, KEY_LENGTH, 4):
+        print(f"    nrfjprog --memwr 0x{UICR_CUSTOMER + i:08X} --val 0x{struct.unpack_from('<I', key, i)[0]:08X}")
+
+
+def command_package(args):
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if len(image) > BANK_SIZE:
+        sys.exit(f"image of {len(image)} bytes does not fit the {BANK_SIZE} byte bank")
+    if not check_vector_table(image):
+        sys.exit(f"{args.image} is not an application linked for 0x{PRIMARY_ADDRESS:X}")
+    data = package(image, read_key(args.key))
+    with open(args.output, "wb") as f:
+        f.write(data)
+    stream_size = len(data) - PACKAGE_HEADER.size
+    print(f"{len(image)} bytes compressed to {stream_size} ({100 * stream_size / len(image):.1f}%)")
+
+
+def command_bench(args):
+    with open(args.image, "rb") as f:
+        image = f.read()
+    key = os.urandom(KEY_LENGTH)
+    _, image_crc, mac, stream = unpack(package(image, key))
+    print(f"Image {len(image)} bytes, stream {len(stream)} bytes "
+          f"({100 * len(stream) / len(image):.1f}%), the uncompressed image streamed without receipts in brackets")
+    print(f"{'MTU':>5} {'payload':>8} {'receipts':>9} {'time s':>8} {'kB/s':>6} {'resumes':>8}")
+    for mtu in args.mtu:
+        chunks = (len(stream) + payload_size(mtu) - 1) // payload_size(mtu)
+        for interval in args.receipt_interval:
+            link = StandInLink(mtu, key, args.connection_interval, args.packets_per_event,
+                               drop_chunks=[chunks // 3], disconnect_at=2 * chunks // 3)
+            resumes = transfer(link, len(image), image_crc, mac, stream, interval)
+            if link.device.bank(len(image)) != image:
+                sys.exit("image in the bank differs from the original")
+
+            raw_chunks = (len(image) + payload_size(mtu) - 1) // payload_size(mtu)
+            raw_ms = (raw_chunks + args.packets_per_event - 1) // args.packets_per_event * args.connection_interval
+            print(f"{mtu:>5} {payload_size(mtu):>8} {interval or 'end':>9} "
+                  f"{link.elapsed_ms / 1000:>8.1f} {len(image) / link.elapsed_ms:>6.1f} {resumes:>8}"
+                  f"   [{raw_ms / 1000:.1f} s]")
+
+
+async def send(args):
+    from bleak import BleakClient
+
+    with open(args.package, "rb") as f:
+        image_size, image_crc, mac, stream = unpack(f.read())
+
+    responses = asyncio.Queue()
+    async with BleakClient(args.address) as client:
+        await client.start_notify(CONTROL_UUID, lambda _, data: responses.put_nowait(parse_response(data)))
+        size = payload_size(client.mtu_size)
+        print(f"MTU {client.mtu_size}, {size} byte chunks")
+
+        async def request(data):
+            await client.write_gatt_char(CONTROL_UUID, data, response=True)
+            while True:
+                response = await asyncio.wait_for(responses.get(), 5)
+                if response[0] == data[0]:
+                    return response
+
+        _, status, offset, _ = await request(start_command(image_size, len(stream), image_crc, mac,
+                                                           args.receipt_interval))
+        if status != OK:
+            sys.exit(f"START failed: {STATUS_NAMES[status]}")
+        if offset:
+            print(f"Resuming at {offset} of {len(stream)}")
+
+        while offset < len(stream):
+            for _ in range(chunks_per_receipt(args.receipt_interval, len(stream), size)):
+                if offset >= len(stream):
+                    break
+                await client.write_gatt_char(DATA_UUID, chunk(offset, stream[offset:offset + size]), response=False)
+                offset += size
+            try:
+                _, status, offset, _ = await asyncio.wait_for(responses.get(), 5)
+            except asyncio.TimeoutError:
+                _, status, offset, _ = await request(bytes([CMD_STATUS]))
+            if status == BAD_STREAM:
+                sys.exit("device rejected the stream")
+            print(f"\r{100 * offset // len(stream)}%", end="", flush=True)
+        print()
+
+        _, status, _, _ = await request(bytes([CMD_VERIFY]))
+        if status != OK:
+            sys.exit(f"VERIFY failed: {STATUS_NAMES[status]}")
+        _, status, _, _ = await request(bytes([CMD_APPLY]))
+        print("Update verified, device restarting" if status == OK else f"APPLY failed: {STATUS_NAMES[status]}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("keygen", help="make a device key for signing updates")
+    p.add_argument("-o", "--output", required=True)
+    p.set_defaults(run=command_keygen)
+
+    p = commands.add_parser("package", help="compress and sign a firmware image into an update package")
+    p.add_argument("image")
+    p.add_argument("--key", required=True, help="32 byte key file from keygen")
+    p.add_argument("-o", "--output", required=True)
+    p.set_defaults(run=command_package)
+
+    p = commands.add_parser("bench", help="run the protocol over the stand-in link")
+    p.add_argument("image")
+    p.add_argument("--mtu", type=int, nargs="+", default=[23, 185, 247])
+    p.add_argument("--receipt-interval", type=int, nargs="+", default=[1, 4, 16, 0],
+                   help="chunks per receipt, 0 for one at the end")
+    p.add_argument("--connection-interval", type=float, default=15.0, help="ms")
+    p.add_argument("--packets-per-event", type=int, default=6)
+    p.set_defaults(run=command_bench)
+
+    p = commands.add_parser("send", help="send an update package over BLE (needs bleak)")
+    p.add_argument("package")
+    p.add_argument("--address", required=True)
+    p.add_argument("--receipt-interval", type=int, default=8, help="chunks per receipt, 0 for one at the end")
+    p.set_defaults(run=lambda args: asyncio.run(send(args)))
+
+    args = parser.parse_args()
+    args.run(args)
+
+
+if __name__ == "__main__":
+    main()
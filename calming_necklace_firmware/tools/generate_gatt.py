@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""Generates the GATT layout shared by the firmware and the app.
+
+tools/gatt_schema.json is the single definition of the service and its
+characteristics. This script writes
+
+    src/calming_necklace/gatt_schema.h          constexpr table for ble_config.cpp
+    lib/core/data/constants/ble_constants.dart  UUID constants, between the
+                                                GENERATED GATT SCHEMA markers
+
+and prints the attribute count and a model of how many ATT requests a
+central needs to discover the table. Run with --check to only verify the
+generated files are up to date.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+FIRMWARE_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+REPO_DIR = os.path.dirname(FIRMWARE_DIR)
+SCHEMA_PATH = os.path.join(FIRMWARE_DIR, "tools", "gatt_schema.json")
+HEADER_PATH = os.path.join(FIRMWARE_DIR, "src", "calming_necklace", "gatt_schema.h")
+DART_PATH = os.path.join(REPO_DIR, "lib", "core", "data", "constants", "ble_constants.dart")
+
+DART_BEGIN = "  // BEGIN GENERATED GATT SCHEMA"
+DART_END = "  // END GENERATED GATT SCHEMA"
+
+PROPERTIES = {
+    "broadcast": "BLEBroadcast",
+    "read": "BLERead",
+    "write_without_response": "BLEWriteWithoutResponse",
+    "write": "BLEWrite",
+    "notify": "BLENotify",
+    "indicate": "BLEIndicate",
+}
+
+# Services every ArduinoBLE peripheral carries in front of its own: Generic
+# Access (device name, appearance) and Generic Attribute (service changed,
+# indicated), plus the Battery Service (level, notified) that ble_config.cpp
+# adds by hand. Each characteristic is (UUID bits, has a CCCD).
+STANDARD_SERVICES = [
+    (16, [(16, False), (16, False)]),
+    (16, [(16, True)]),
+    (16, [(16, True)]),
+]
+
+
+def load_schema(path):
+    with open(path) as f:
+        schema = json.load(f)
+
+    seen = set()
+    for item in [schema["service"]] + schema["characteristics"]:
+        if not re.fullmatch(r"[0-9A-F]{4}", item["id"]):
+            sys.exit(f"{item['name']}: id must be four upper case hex digits")
+        if item["id"] in seen:
+            sys.exit(f"{item['name']}: id {item['id']} is used twice")
+        seen.add(item["id"])
+    for item in schema["characteristics"]:
+        unknown = set(item["properties"]) - set(PROPERTIES)
+        if unknown:
+            sys.exit(f"{item['name']}: unknown properties {', '.join(sorted(unknown))}")
+    return schema
+
+
+def uuid(schema, item):
+    return schema["uuid_base"].replace("xxxx", item["id"])
+
+
+def has_cccd(item):
+    return "notify" in item["properties"] or "indicate" in item["properties"]
+
+
+def generate_header(schema):
+    chars = schema["characteristics"]
+    lines = [
+        "// gatt_schema.h",
+        "// Generated by tools/generate_gatt.py from tools/gatt_schema.json;",
+        "// edit the schema and regenerate instead of changing this file.",
+        "#ifndef GATT_SCHEMA_H",
+        "#define GATT_SCHEMA_H",
+        "",
+        "#include <ArduinoBLE.h>",
+        "",
+        "// One custom service holds every characteristic",
+        f"#define GATT_SERVICE_UUID \"{uuid(schema, schema['service'])}\"",
+        "",
+        "// Characteristics, indexing GATT_CHARACTERISTICS",
+    ]
+    width = max(len(c["name"]) for c in chars) + len("GATT_") + 1
+    for index, c in enumerate(chars):
+        lines.append(f"#define {('GATT_' + c['name'].upper()).ljust(width)}{index}")
+    lines += [
+        f"#define GATT_CHARACTERISTIC_COUNT {len(chars)}",
+        "",
+        "struct GattCharacteristicInfo {",
+        "    const char* uuid;",
+        "    uint8_t properties;",
+        "};",
+        "",
+        "constexpr GattCharacteristicInfo GATT_CHARACTERISTICS[] = {",
+    ]
+    for c in chars:
+        props = " | ".join(PROPERTIES[p] for p in c["properties"])
+        lines.append(f"    {{\"{uuid(schema, c)}\", {props}}},  // {c['name']}: {c['description']}")
+    lines += [
+        "};",
+        "static_assert(sizeof(GATT_CHARACTERISTICS) / sizeof(GATT_CHARACTERISTICS[0]) == GATT_CHARACTERISTIC_COUNT,",
+        "              \"GATT table out of step with its indexes\");",
+        "",
+        "#define GATT_UUID(characteristic) (GATT_CHARACTERISTICS[characteristic].uuid)",
+        "#define GATT_PROPERTIES(characteristic) (GATT_CHARACTERISTICS[characteristic].properties)",
+        "",
+        "// Attribute table entries for the service: its declaration, then a",
+        "// declaration and a value per characteristic and a CCCD for each one",
+        "// that notifies",
+        "constexpr uint16_t gattAttributeCount() {",
+        "    uint16_t count = 1;",
+        "    for (const GattCharacteristicInfo& characteristic : GATT_CHARACTERISTICS) {",
+        "        count += (characteristic.properties & (BLENotify | BLEIndicate)) ? 3 : 2;",
+        "    }",
+        "    return count;",
+        "}",
+        "",
+        "#endif // GATT_SCHEMA_H",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def generate_dart_block(schema):
+    lines = [
+        DART_BEGIN,
+        "  // Generated by calming_necklace_firmware/tools/generate_gatt.py from",
+        "  // gatt_schema.json; edit the schema and regenerate instead.",
+        f"  static const String {schema['service']['name'].upper()}_SERVICE_UUID = "
+        f"\"{uuid(schema, schema['service']).lower()}\";",
+        "",
+    ]
+    for c in schema["characteristics"]:
+        lines.append(f"  // {c['description']} ({c['type']}, {', '.join(c['properties'])})")
+        lines.append(f"  static const String {c['name'].upper()}_CHARACTERISTIC_UUID = "
+                     f"\"{uuid(schema, c).lower()}\";")
+    lines.append(DART_END)
+    return "\n".join(lines)
+
+
+def replace_dart_block(text, block):
+    start = text.find(DART_BEGIN)
+    end = text.find(DART_END)
+    if start < 0 or end < start:
+        sys.exit(f"{DART_PATH}: GENERATED GATT SCHEMA markers not found")
+    return text[:start] + block + text[end + len(DART_END):]
+
+
+def discovery_requests(services, mtu):
+    """ATT requests for a full primary service, characteristic and
+    descriptor discovery, the way phones run it. Responses only carry
+    entries with one UUID size, as many as fit in the MTU."""
+
+    def runs(sizes, entry_bytes):
+        requests = 0
+        fitted = 0
+        previous = None
+        for size in sizes:
+            per_response = (mtu - 2) // entry_bytes(size)
+            if size != previous or fitted == per_response:
+                requests += 1
+                fitted = 0
+            fitted += 1
+            previous = size
+        return requests + 1  # The final request answered "not found"
+
+    requests = runs([bits // 8 for bits, _ in services], lambda size: 4 + size)
+    for _, chars in services:
+        requests += runs([bits // 8 for bits, _ in chars], lambda size: 5 + size)
+        requests += sum(1 for _, cccd in chars if cccd)
+    return requests
+
+
+def attribute_count(services):
+    return sum(1 + sum(3 if cccd else 2 for _, cccd in chars) for _, chars in services)
+
+
+def report(schema):
+    services = STANDARD_SERVICES + [
+        (128, [(128, has_cccd(c)) for c in schema["characteristics"]])
+    ]
+    print(f"{attribute_count(services)} attributes "
+          f"({attribute_count(services[len(STANDARD_SERVICES):])} in the custom service)")
+    for mtu in (23, 247):
+        print(f"Discovery at MTU {mtu}: {discovery_requests(services, mtu)} ATT requests")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--check", action="store_true", help="fail if the generated files are stale")
+    args = parser.parse_args()
+
+    schema = load_schema(SCHEMA_PATH)
+    header = generate_header(schema)
+    with open(DART_PATH) as f:
+        dart = f.read()
+    new_dart = replace_dart_block(dart, generate_dart_block(schema))
+
+    current_header = ""
+    if os.path.exists(HEADER_PATH):
+        with open(HEADER_PATH) as f:
+            current_header = f.read()
+
+    if args.check:
+        stale = [path for path, old, new in ((HEADER_PATH, current_header, header), (DART_PATH, dart, new_dart))
+                 if old != new]
+        for path in stale:
+            print(f"Out of date: {os.path.relpath(path, REPO_DIR)}")
+        sys.exit(1 if stale else 0)
+
+    with open(HEADER_PATH, "w") as f:
+        f.write(header)
+    with open(DART_PATH, "w") as f:
+        f.write(new_dart)
+    report(schema)
+
+
+if __name__ == "__main__":
+    main()
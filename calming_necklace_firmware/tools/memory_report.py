@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Static RAM and flash use per firmware module, read from the linker map.
+
+Build with a fixed build path so the map file is kept, e.g.
+
+    arduino-cli compile -b arduino:mbed_nano:nano33ble \
+        --build-path build src/calming_necklace
+    tools/memory_report.py build/calming_necklace.ino.map
+
+Sizes are taken after unused sections were discarded, so they are what
+actually ends up in the image. Sketch files are listed by name, libraries
+and the core as a whole.
+
+Pass --save to record a baseline and --baseline to compare against one;
+the script exits with status 1 when any module's RAM grew by more than
+--tolerance bytes.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+FLASH_SECTIONS = {".text", ".rodata", ".ARM.extab", ".ARM.exidx"}
+RAM_SECTIONS = {".bss"}
+BOTH_SECTIONS = {".data"}  # Initialised RAM, copied from flash at startup
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)")
+INPUT_SECTION = re.compile(r"^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+INPUT_NAME_ONLY = re.compile(r"^ (\S+)$")
+INPUT_CONTINUED = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+
+
+def module_name(path):
+    path = path.replace("\\", "/")
+    if "/sketch/" in path:
+        name = os.path.basename(path)
+        for suffix in (".ino.cpp.o", ".cpp.o", ".c.o"):
+            if name.endswith(suffix):
+                return name[: -len(suffix)]
+        return name
+    if "/libraries/" in path:
+        return "lib:" + path.split("/libraries/", 1)[1].split("/", 1)[0]
+    if "/core/" in path or path.endswith("core.a"):
+        return "core"
+    archive = re.match(r"(.*\.a)\(", path)
+    if archive:
+        return "lib:" + os.path.basename(archive.group(1))
+    return os.path.basename(path)
+
+
+def parse_map(lines):
+    modules = {}
+    output = None
+    pending = None
+    in_memory_map = False
+
+    def add(name, size, path):
+        if output is None or name in ("*fill*",):
+            return
+        if output in FLASH_SECTIONS:
+            flash, ram = size, 0
+        elif output in RAM_SECTIONS or name == "COMMON":
+            flash, ram = 0, size
+        elif output in BOTH_SECTIONS:
+            flash, ram = size, size
+        else:
+            return
+        entry = modules.setdefault(module_name(path), {"flash": 0, "ram": 0})
+        entry["flash"] += flash
+        entry["ram"] += ram
+
+    for line in lines:
+        line = line.rstrip("\n")
+        if not in_memory_map:
+            in_memory_map = line.startswith("Linker script and memory map")
+            continue
+
+        match = OUTPUT_SECTION.match(line)
+        if match:
+            output = match.group(1)
+            pending = None
+            continue
+        if pending is not None:
+            match = INPUT_CONTINUED.match(line)
+            if match:
+                add(pending, int(match.group(2), 16), match.group(3))
+            pending = None
+            continue
+        match = INPUT_SECTION.match(line)
+        if match:
+            add(match.group(1), int(match.group(3), 16), match.group(4))
+            continue
+        match = INPUT_NAME_ONLY.match(line)
+        if match:
+            pending = match.group(1)
+    return modules
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--save", help="write the breakdown to this JSON file")
+    parser.add_argument("--baseline", help="compare against a saved breakdown")
+    parser.add_argument("--tolerance", type=int, default=0, help="allowed RAM growth per module in bytes")
+    args = parser.parse_args()
+
+    with open(args.map) as f:
+        modules = parse_map(f)
+    if not modules:
+        sys.exit("No sections found; is this a GNU ld map file?")
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    print(f"{'module':<28}{'flash':>10}{'ram':>10}{'ram change':>12}")
+    regressed = []
+    for name, sizes in sorted(modules.items(), key=lambda item: -item[1]["ram"]):
+        change = ""
+        if name in baseline:
+            delta = sizes["ram"] - baseline[name]["ram"]
+            change = f"{delta:+d}" if delta else ""
+            if delta > args.tolerance:
+                regressed.append(name)
+        print(f"{name:<28}{sizes['flash']:>10}{sizes['ram']:>10}{change:>12}")
+    print(f"{'total':<28}{sum(m['flash'] for m in modules.values()):>10}"
+          f"{sum(m['ram'] for m in modules.values()):>10}")
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(modules, f, indent=2, sort_keys=True)
+
+    if regressed:
+        print("RAM grew in: " + ", ".join(regressed))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
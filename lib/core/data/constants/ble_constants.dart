@@ -10,22 +10,80 @@ class BleConstants {
 
   // Connection settings
   static const Duration CONNECTION_TIMEOUT = Duration(seconds: 600);
-  static const Duration KEEP_ALIVE_INTERVAL = Duration(seconds: 60);
-  static const Duration KEEP_ALIVE_TIMEOUT = Duration(seconds: 120);
+  static const Duration CONNECTION_CHECK_INTERVAL = Duration(seconds: 60);
+  // Dead links are caught by the link layer's supervision timeout. The
+  // necklace's own liveness rides on its notifications; after this long
+  // without one, a single read checks it is still answering.
+  static const Duration LIVENESS_TIMEOUT = Duration(seconds: 120);
+  static const Duration LIVENESS_CHECK_INTERVAL = Duration(seconds: 30);
+  // Optional heartbeat, only for connections that subscribe to nothing;
+  // the necklace drops those after 3 idle minutes
+  static const Duration HEARTBEAT_INTERVAL = Duration(seconds: 90);
   static const Duration RECONNECT_DELAY = Duration(seconds: 2);
   static const int MAX_CONNECTION_RETRIES = 3;
   static const int MIN_RSSI_THRESHOLD = -80;
 
-  // Service UUIDs
-  static const String LED_SERVICE_UUID = "19b10000-e8f2-537e-4f6c-d104768a1214";
-  static const String SETTINGS_SERVICE_UUID = "00001800-0000-1000-8000-00805f9b34fb";
+  // GATT layout
+  // BEGIN GENERATED GATT SCHEMA
+  // Generated by calming_necklace_firmware/tools/generate_gatt.py from
+  // gatt_schema.json; edit the schema and regenerate instead.
+  static const String NECKLACE_SERVICE_UUID = "19b10000-e8f2-537e-4f6c-d104768a1214";
 
-  // Characteristic UUIDs
-  static const String switchCharacteristicUuid = "19b10001-e8f2-537e-4f6c-d104768a1214";
-  static const String KEEPALIVE_CHARACTERISTIC_UUID = "2A3B";
-  static const String EMISSION_CHARACTERISTIC_UUID = "2A19";
-  static const String INTERVAL_CHARACTERISTIC_UUID = "2A1B";
-  static const String PERIODIC_CHARACTERISTIC_UUID = "2A1D";
+  // Emission commands (CMD_*) (uint8, read, write, write_without_response)
+  static const String SWITCH_CHARACTERISTIC_UUID = "19b10001-e8f2-537e-4f6c-d104768a1214";
+  // Optional heartbeat, counts as activity (uint8, read, write)
+  static const String KEEPALIVE_CHARACTERISTIC_UUID = "19b10014-e8f2-537e-4f6c-d104768a1214";
+  // Channel 0 emission duration, ms (int32, read, write, notify)
+  static const String EMISSION_CHARACTERISTIC_UUID = "19b10015-e8f2-537e-4f6c-d104768a1214";
+  // Channel 0 release interval, ms (int32, read, write, notify)
+  static const String INTERVAL_CHARACTERISTIC_UUID = "19b10016-e8f2-537e-4f6c-d104768a1214";
+  // Channel 0 periodic emission enabled (uint8, read, write, notify)
+  static const String PERIODIC_CHARACTERISTIC_UUID = "19b10017-e8f2-537e-4f6c-d104768a1214";
+  // Current heart rate, BPM (uint8, read, notify)
+  static const String HEART_RATE_CHARACTERISTIC_UUID = "19b10018-e8f2-537e-4f6c-d104768a1214";
+  // Heart rate based release enabled (uint8, read, write)
+  static const String HEART_RATE_ENABLED_CHARACTERISTIC_UUID = "19b10002-e8f2-537e-4f6c-d104768a1214";
+  // High heart rate threshold, BPM (uint8, read, write)
+  static const String HIGH_HEART_RATE_THRESHOLD_CHARACTERISTIC_UUID = "19b10003-e8f2-537e-4f6c-d104768a1214";
+  // Low heart rate threshold, BPM (uint8, read, write)
+  static const String LOW_HEART_RATE_THRESHOLD_CHARACTERISTIC_UUID = "19b10004-e8f2-537e-4f6c-d104768a1214";
+  // Predictive release enabled (uint8, read, write)
+  static const String PREDICTIVE_ENABLED_CHARACTERISTIC_UUID = "19b10005-e8f2-537e-4f6c-d104768a1214";
+  // Prediction horizon, seconds (uint16, read, write)
+  static const String PREDICTION_HORIZON_CHARACTERISTIC_UUID = "19b10006-e8f2-537e-4f6c-d104768a1214";
+  // Prediction hysteresis, BPM (uint8, read, write)
+  static const String PREDICTION_HYSTERESIS_CHARACTERISTIC_UUID = "19b10007-e8f2-537e-4f6c-d104768a1214";
+  // Write a page id, the page comes back as [page][payload] (bytes, read, write, notify)
+  static const String DIAGNOSTICS_CHARACTERISTIC_UUID = "19b10008-e8f2-537e-4f6c-d104768a1214";
+  // Shortest heart rate sampling interval, seconds (uint16, read, write)
+  static const String HEART_RATE_MIN_INTERVAL_CHARACTERISTIC_UUID = "19b10009-e8f2-537e-4f6c-d104768a1214";
+  // Longest heart rate sampling interval, seconds (uint16, read, write)
+  static const String HEART_RATE_MAX_INTERVAL_CHARACTERISTIC_UUID = "19b1000a-e8f2-537e-4f6c-d104768a1214";
+  // Channel config record (bytes, read, write)
+  static const String CHANNEL_CONFIG_CHARACTERISTIC_UUID = "19b1000b-e8f2-537e-4f6c-d104768a1214";
+  // Arbitration record (bytes, read, write)
+  static const String ARBITRATION_CONFIG_CHARACTERISTIC_UUID = "19b1000c-e8f2-537e-4f6c-d104768a1214";
+  // Budget record (bytes, read, write)
+  static const String BUDGET_CONFIG_CHARACTERISTIC_UUID = "19b1000d-e8f2-537e-4f6c-d104768a1214";
+  // Current Time Service format (bytes, write)
+  static const String CURRENT_TIME_CHARACTERISTIC_UUID = "19b1000e-e8f2-537e-4f6c-d104768a1214";
+  // Schedule entry (bytes, write)
+  static const String SCHEDULE_CHARACTERISTIC_UUID = "19b1000f-e8f2-537e-4f6c-d104768a1214";
+  // Trigger rule record (bytes, write)
+  static const String RULE_CHARACTERISTIC_UUID = "19b10010-e8f2-537e-4f6c-d104768a1214";
+  // Effectiveness per trigger source, write to reset (bytes, read, write, notify)
+  static const String ANALYTICS_CHARACTERISTIC_UUID = "19b10011-e8f2-537e-4f6c-d104768a1214";
+  // Adaptive duration record (bytes, read, write)
+  static const String ADAPTIVE_CONFIG_CHARACTERISTIC_UUID = "19b10012-e8f2-537e-4f6c-d104768a1214";
+  // Energy coefficient record (bytes, write)
+  static const String ENERGY_CONFIG_CHARACTERISTIC_UUID = "19b10013-e8f2-537e-4f6c-d104768a1214";
+  // Firmware update commands and receipts (DFU_CMD_*) (bytes, write, notify)
+  static const String DFU_CONTROL_CHARACTERISTIC_UUID = "19b10019-e8f2-537e-4f6c-d104768a1214";
+  // Firmware update stream chunks (bytes, write_without_response)
+  static const String DFU_DATA_CHARACTERISTIC_UUID = "19b1001a-e8f2-537e-4f6c-d104768a1214";
+  // Power policy thresholds: [reduced %][low %][critical %] (bytes, read, write)
+  static const String POWER_POLICY_CHARACTERISTIC_UUID = "19b1001b-e8f2-537e-4f6c-d104768a1214";
+  // END GENERATED GATT SCHEMA
 
   // MTU Settings
   static const int DEFAULT_MTU = 23;
@@ -175,9 +175,9 @@ class BleService {
       
       // Find the LED service and characteristic
       for (var service in services) {
-        if (service.uuid.toString().toLowerCase() == BleConstants.LED_SERVICE_UUID.toLowerCase()) {
+        if (service.uuid.toString().toLowerCase() == BleConstants.NECKLACE_SERVICE_UUID.toLowerCase()) {
           for (var char in service.characteristics) {
-            if (char.uuid.toString().toLowerCase() == BleConstants.switchCharacteristicUuid.toLowerCase()) {
+            if (char.uuid.toString().toLowerCase() == BleConstants.SWITCH_CHARACTERISTIC_UUID.toLowerCase()) {
               _switchCharacteristic = char;
               _logger.logBleDebug('Found LED characteristic: ${char.uuid}');
               break;
@@ -4,12 +4,14 @@ import 'package:flutter_blue_plus/flutter_blue_plus.dart';
 import '../../logging_service.dart';
 import '../ble_types.dart';
 import '../../../data/constants/ble_constants.dart';
+import 'keep_alive_manager.dart';
 import 'package:rxdart/rxdart.dart';
 
 class BleConnectionManager {
   final StateChangeCallback onStateChange;
   final Function(int) onReconnectionAttempt;
   final ErrorCallback onError;
+  final bool enableHeartbeat;
   final _retryDelays = [1, 2, 3]; // Seconds between retries
   final _maxRetries = 5;
   final LoggingService _logger = LoggingService.instance;
@@ -18,13 +20,14 @@ class BleConnectionManager {
   final _rssiSubject = BehaviorSubject<int>();
 
   StreamSubscription? _connectionSubscription;
-  StreamSubscription? _keepAliveSubscription;
+  StreamSubscription? _livenessSubscription;
   Timer? _rssiCheckTimer;
-  Timer? _keepAliveTimer;
+  Timer? _connectionCheckTimer;
+  Timer? _livenessTimer;
   Timer? _reconnectTimer;
-  int _keepAliveCounter = 0;
-  BluetoothCharacteristic? _keepAliveCharacteristic;
-  bool _isKeepAliveEnabled = false;
+  DateTime _lastDeviceActivity = DateTime.now();
+  BluetoothCharacteristic? _probeCharacteristic;
+  BleKeepAliveManager? _heartbeat;
   bool _isReconnecting = false;
   BluetoothDevice? _currentDevice;
   int _reconnectAttempts = 0;
@@ -36,6 +39,7 @@ class BleConnectionManager {
     required this.onStateChange,
     required this.onError,
     required this.onReconnectionAttempt,
+    this.enableHeartbeat = false,
   });
 
   Future<bool> connectWithRetry(BluetoothDevice device) async {
@@ -95,7 +99,7 @@ class BleConnectionManager {
   Future<void> maintainConnection(BluetoothDevice device) async {
     _currentDevice = device;
     _logger.logBleInfo('Starting connection maintenance for ${device.platformName}');
-    _startKeepAlive();
+    _startConnectionCheck();
 
     // Monitor connection state
     device.connectionState.listen((BluetoothConnectionState state) {
@@ -106,9 +110,9 @@ class BleConnectionManager {
     });
   }
 
-  void _startKeepAlive() {
-    _keepAliveTimer?.cancel();
-    _keepAliveTimer = Timer.periodic(BleConstants.KEEP_ALIVE_INTERVAL, (_) {
+  void _startConnectionCheck() {
+    _connectionCheckTimer?.cancel();
+    _connectionCheckTimer = Timer.periodic(BleConstants.CONNECTION_CHECK_INTERVAL, (_) {
       _checkConnectionStatus();
     });
   }
@@ -238,52 +242,57 @@ class BleConnectionManager {
       }
     });
 
-    await _setupKeepAlive(device);
+    await _setupLivenessMonitoring(device);
   }
 
-  Future<void> _setupKeepAlive(BluetoothDevice device) async {
+  // The link layer's supervision timeout catches a dead link. Whether the
+  // necklace itself still answers is read off the notifications it sends
+  // anyway, with one read only after a long silence; no periodic writes.
+  Future<void> _setupLivenessMonitoring(BluetoothDevice device) async {
+    _lastDeviceActivity = DateTime.now();
+    _livenessSubscription = FlutterBluePlus.events.onCharacteristicReceived
+        .where((event) => event.device.remoteId == device.remoteId)
+        .listen((_) => _lastDeviceActivity = DateTime.now());
+
     try {
       final services = await device.discoverServices();
       final service = services.firstWhere(
-            (s) => s.uuid.toString().toLowerCase() == BleConstants.LED_SERVICE_UUID.toLowerCase(),
+            (s) => s.uuid.toString().toLowerCase() == BleConstants.NECKLACE_SERVICE_UUID.toLowerCase(),
       );
 
-      _keepAliveCharacteristic = service.characteristics.firstWhere(
-            (c) => c.uuid.toString().toLowerCase() == BleConstants.KEEPALIVE_CHARACTERISTIC_UUID.toLowerCase(),
+      // Heart rate notifies on every sample, so it is the usual sign of life
+      _probeCharacteristic = service.characteristics.firstWhere(
+            (c) => c.uuid.toString().toLowerCase() == BleConstants.HEART_RATE_CHARACTERISTIC_UUID.toLowerCase(),
       );
+      await _probeCharacteristic?.setNotifyValue(true);
 
-      await _keepAliveCharacteristic?.setNotifyValue(true);
-
-      _keepAliveSubscription = _keepAliveCharacteristic?.lastValueStream.listen((value) {
-        if (value.isNotEmpty && value[0] == _keepAliveCounter) {
-          _isKeepAliveEnabled = true;
-        } else {
-          onStateChange(BleConnectionState.keepAliveFailure);
-        }
-      });
-
-      _keepAliveTimer = Timer.periodic(BleConstants.KEEP_ALIVE_INTERVAL, (_) {
-        _sendKeepAlive(device);
+      _livenessTimer = Timer.periodic(BleConstants.LIVENESS_CHECK_INTERVAL, (_) {
+        _checkLiveness();
       });
-
     } catch (e) {
-      onError('Keep-alive setup failed: $e');
+      onError('Liveness monitoring setup failed: $e');
+    }
+
+    if (enableHeartbeat) {
+      _heartbeat = BleKeepAliveManager(
+        onKeepAliveFailed: () => onStateChange(BleConnectionState.keepAliveFailure),
+      );
+      await _heartbeat!.initialize(device);
     }
   }
 
-  Future<void> _sendKeepAlive(BluetoothDevice device) async {
-    if (!_isKeepAliveEnabled || _keepAliveCharacteristic == null) {
-      _logger.logBleDebug('Keep-alive not enabled, skipping');
+  Future<void> _checkLiveness() async {
+    if (_probeCharacteristic == null ||
+        DateTime.now().difference(_lastDeviceActivity) < BleConstants.LIVENESS_TIMEOUT) {
       return;
     }
 
     try {
-      _keepAliveCounter = (_keepAliveCounter + 1) % 256;
-      _logger.logBleDebug('Sending keep-alive counter: $_keepAliveCounter');
-      await _keepAliveCharacteristic!.write([_keepAliveCounter], withoutResponse: false);
+      _logger.logBleDebug('No notifications for ${BleConstants.LIVENESS_TIMEOUT.inSeconds}s, probing');
+      await _probeCharacteristic!.read();
+      _lastDeviceActivity = DateTime.now();
     } catch (e, stackTrace) {
-      _logger.logBleError('Keep-alive failed', e, stackTrace);
-      _isKeepAliveEnabled = false;
+      _logger.logBleError('Liveness probe failed', e, stackTrace);
       onStateChange(BleConnectionState.keepAliveFailure);
     }
   }
@@ -291,18 +300,20 @@ class BleConnectionManager {
   void _cleanupMonitoring() {
     _connectionSubscription?.cancel();
     _rssiCheckTimer?.cancel();
-    _keepAliveSubscription?.cancel();
-    _keepAliveTimer?.cancel();
+    _livenessSubscription?.cancel();
+    _connectionCheckTimer?.cancel();
+    _livenessTimer?.cancel();
     _reconnectTimer?.cancel();
+    _heartbeat?.dispose();
     _connectionSubscription = null;
     _rssiCheckTimer = null;
-    _keepAliveSubscription = null;
-    _keepAliveTimer = null;
+    _livenessSubscription = null;
+    _connectionCheckTimer = null;
+    _livenessTimer = null;
     _reconnectTimer = null;
-    _keepAliveCharacteristic = null;
+    _heartbeat = null;
+    _probeCharacteristic = null;
     _reconnectionSubject.add(0);
-    _keepAliveCounter = 0;
-    _isKeepAliveEnabled = false;
     _isReconnecting = false;
   }
 
@@ -341,10 +352,6 @@ class BleConnectionManager {
 
   Future<void> _disableNotifications() async {
     try {
-      if (_keepAliveCharacteristic != null) {
-        await _keepAliveCharacteristic!.setNotifyValue(false);
-      }
-
       // Cancel any pending GATT operations
       if (_currentDevice != null) {
         await _currentDevice!.requestMtu(23); // Reset MTU to default
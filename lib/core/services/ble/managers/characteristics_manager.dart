@@ -20,15 +20,15 @@ class BleCharacteristicsManager {
       final services = await device.discoverServices();
       _logServiceDiscovery(services);
 
-      loggingService.logBleDebug('Looking for LED service: ${BleConstants.LED_SERVICE_UUID}');
-      final ledService = services.firstWhere(
-            (s) => s.uuid.toString().toLowerCase().contains(BleConstants.LED_SERVICE_UUID.toLowerCase()),
-        orElse: () => throw BleException('LED service not found'),
+      loggingService.logBleDebug('Looking for necklace service: ${BleConstants.NECKLACE_SERVICE_UUID}');
+      final necklaceService = services.firstWhere(
+            (s) => s.uuid.toString().toLowerCase().contains(BleConstants.NECKLACE_SERVICE_UUID.toLowerCase()),
+        orElse: () => throw BleException('Necklace service not found'),
       );
 
-      loggingService.logBleDebug('Found LED service, looking for switch characteristic');
-      _switchCharacteristic = ledService.characteristics.firstWhere(
-            (c) => c.uuid.toString().toLowerCase().contains(BleConstants.switchCharacteristicUuid.toLowerCase()),
+      loggingService.logBleDebug('Found necklace service, looking for switch characteristic');
+      _switchCharacteristic = necklaceService.characteristics.firstWhere(
+            (c) => c.uuid.toString().toLowerCase().contains(BleConstants.SWITCH_CHARACTERISTIC_UUID.toLowerCase()),
         orElse: () => throw BleException('Switch characteristic not found'),
       );
 
@@ -40,13 +40,12 @@ class BleCharacteristicsManager {
   }
 
   Future<void> _validateAndStoreCharacteristics(List<BluetoothService> services) async {
-    // Find required services
-    final ledService = _findService(services, BleConstants.LED_SERVICE_UUID);
-    final settingsService = _findService(services, BleConstants.SETTINGS_SERVICE_UUID);
+    // All characteristics live in the one necklace service
+    final necklaceService = _findService(services, BleConstants.NECKLACE_SERVICE_UUID);
 
     // Store required characteristics
-    await _storeRequiredCharacteristics(ledService);
-    await _storeOptionalCharacteristics(settingsService);
+    await _storeRequiredCharacteristics(necklaceService);
+    await _storeOptionalCharacteristics(necklaceService);
   }
 
   BluetoothService _findService(List<BluetoothService> services, String uuid) {
@@ -60,11 +59,11 @@ class BleCharacteristicsManager {
     // Store switch characteristic
     final switchChar = await _findAndConfigureCharacteristic(
       service,
-      BleConstants.LED_SERVICE_UUID,  // New LED control characteristic UUID
+      BleConstants.SWITCH_CHARACTERISTIC_UUID,
       required: true,
     );
     if (switchChar != null) {
-      _characteristics[BleConstants.switchCharacteristicUuid.toLowerCase()] = switchChar;
+      _characteristics[BleConstants.SWITCH_CHARACTERISTIC_UUID.toLowerCase()] = switchChar;
     }
 
     // Store keep-alive characteristic
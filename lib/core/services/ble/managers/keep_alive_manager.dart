@@ -5,26 +5,32 @@ import 'package:flutter_blue_plus/flutter_blue_plus.dart';
 import '../ble_types.dart';
 import '../../../data/constants/ble_constants.dart';
 
+// Optional low-rate heartbeat. The link layer already supervises the
+// connection and notifications show the necklace is alive, so this is only
+// for connections that subscribe to nothing and would otherwise be dropped
+// as idle. Each beat is a single acknowledged write; nothing is echoed.
 class BleKeepAliveManager {
   final KeepAliveFailedCallback onKeepAliveFailed;
-  Timer? _keepAliveTimer;
-  Timer? _watchdogTimer;
-  int _keepAliveCounter = 0;
+  final Duration interval;
+  Timer? _heartbeatTimer;
+  int _heartbeatCounter = 0;
   BluetoothCharacteristic? _keepAliveCharacteristic;
-  StreamSubscription? _keepAliveSubscription;
   bool _isEnabled = false;
 
-  BleKeepAliveManager({required this.onKeepAliveFailed});
+  BleKeepAliveManager({
+    required this.onKeepAliveFailed,
+    this.interval = BleConstants.HEARTBEAT_INTERVAL,
+  });
 
   Future<void> initialize(BluetoothDevice device) async {
     try {
       await _setupCharacteristic(device);
       if (_keepAliveCharacteristic != null) {
-        _startKeepAlive();
+        _startHeartbeat();
         _isEnabled = true;
       }
     } catch (e) {
-      print('Keep-alive initialization failed: $e');
+      print('Heartbeat initialization failed: $e');
       _isEnabled = false;
     }
   }
@@ -34,90 +40,45 @@ class BleKeepAliveManager {
 
     try {
       final service = services.firstWhere(
-            (s) => s.uuid.toString().toLowerCase() == BleConstants.LED_SERVICE_UUID.toLowerCase(),
+            (s) => s.uuid.toString().toLowerCase() == BleConstants.NECKLACE_SERVICE_UUID.toLowerCase(),
       );
 
       _keepAliveCharacteristic = service.characteristics.firstWhere(
             (c) => c.uuid.toString().toLowerCase() == BleConstants.KEEPALIVE_CHARACTERISTIC_UUID.toLowerCase(),
       );
-
-      await _keepAliveCharacteristic?.setNotifyValue(true);
-
-      _keepAliveSubscription?.cancel();
-      _keepAliveSubscription = _keepAliveCharacteristic?.lastValueStream.listen(
-        _handleKeepAliveResponse,
-        onError: (error) {
-          print('Keep-alive notification error: $error');
-          _isEnabled = false;
-          onKeepAliveFailed();
-        },
-      );
     } catch (e) {
-      print('Keep-alive characteristic setup failed: $e');
+      print('Heartbeat characteristic setup failed: $e');
       _keepAliveCharacteristic = null;
       rethrow;
     }
   }
 
-  void _startKeepAlive() {
-    _keepAliveTimer?.cancel();
-    _keepAliveTimer = Timer.periodic(
-      BleConstants.KEEP_ALIVE_INTERVAL,
-          (_) => _sendKeepAlive(),
-    );
-    _startWatchdog();
-  }
-
-  void _startWatchdog() {
-    _watchdogTimer?.cancel();
-    _watchdogTimer = Timer(
-      BleConstants.KEEP_ALIVE_TIMEOUT,
-          () {
-        if (_isEnabled) {
-          _isEnabled = false;
-          onKeepAliveFailed();
-        }
-      },
-    );
-  }
-
-  void _handleKeepAliveResponse(List<int> value) {
-    if (!_isEnabled) return;
-
-    if (value.isNotEmpty && value[0] == _keepAliveCounter) {
-      _startWatchdog(); // Reset watchdog on successful response
-    } else {
-      print('Invalid keep-alive response');
-      _isEnabled = false;
-      onKeepAliveFailed();
-    }
+  void _startHeartbeat() {
+    _heartbeatTimer?.cancel();
+    _heartbeatTimer = Timer.periodic(interval, (_) => _sendHeartbeat());
   }
 
-  Future<void> _sendKeepAlive() async {
+  Future<void> _sendHeartbeat() async {
     if (!_isEnabled || _keepAliveCharacteristic == null) return;
 
     try {
-      _keepAliveCounter = (_keepAliveCounter + 1) % 256;
+      _heartbeatCounter = (_heartbeatCounter + 1) % 256;
       await _keepAliveCharacteristic!.write(
-        [_keepAliveCounter],
+        [_heartbeatCounter],
         withoutResponse: false,
       );
     } catch (e) {
-      print('Failed to send keep-alive: $e');
+      print('Failed to send heartbeat: $e');
       _isEnabled = false;
       onKeepAliveFailed();
     }
   }
 
   void stop() {
-    _keepAliveTimer?.cancel();
-    _watchdogTimer?.cancel();
-    _keepAliveSubscription?.cancel();
-    _keepAliveTimer = null;
-    _watchdogTimer = null;
-    _keepAliveSubscription = null;
+    _heartbeatTimer?.cancel();
+    _heartbeatTimer = null;
     _keepAliveCharacteristic = null;
-    _keepAliveCounter = 0;
+    _heartbeatCounter = 0;
     _isEnabled = false;
   }
 
@@ -126,4 +87,4 @@ class BleKeepAliveManager {
   }
 
   bool get isEnabled => _isEnabled;
-}
\ No newline at end of file
+}
@@ -0,0 +1,255 @@
+// lib/core/utils/ble/trigger_rule_compiler.dart
+
+import 'dart:typed_data';
+
+/// Values a trigger rule can read on the necklace. Ids match the firmware's
+/// RULE_VAR_* constants in rule_engine.h.
+enum RuleVariable {
+  heartRate(0),
+  heartRateSlope(1),
+  projectedHeartRate(2),
+  minuteOfDay(3),
+  weekday(4),
+  secondsSinceEmission(5),
+  emissionActive(6),
+  budgetRemaining(7);
+
+  final int id;
+  const RuleVariable(this.id);
+}
+
+/// Expression tree for a trigger rule, e.g.
+/// `RuleExpr.variable(RuleVariable.heartRate).greaterThan(95).holdFor(Duration(seconds: 30))
+///    .and(RuleExpr.timeBetween(8 * 60, 18 * 60))
+///    .and(RuleExpr.variable(RuleVariable.secondsSinceEmission).atLeast(600))`
+abstract class RuleExpr {
+  const RuleExpr();
+
+  factory RuleExpr.constant(int value) = _Constant;
+  factory RuleExpr.variable(RuleVariable variable) = _Load;
+
+  /// True while the minute of day is inside the window; wraps past midnight
+  /// when [startMinute] is after [endMinute].
+  factory RuleExpr.timeBetween(int startMinute, int endMinute) => _Between(
+      RuleExpr.variable(RuleVariable.minuteOfDay), RuleExpr.constant(startMinute), RuleExpr.constant(endMinute));
+
+  RuleExpr greaterThan(int value) => _Binary(TriggerRuleCompiler.opGt, this, RuleExpr.constant(value));
+  RuleExpr lessThan(int value) => _Binary(TriggerRuleCompiler.opLt, this, RuleExpr.constant(value));
+  RuleExpr atLeast(int value) => _Binary(TriggerRuleCompiler.opGe, this, RuleExpr.constant(value));
+  RuleExpr atMost(int value) => _Binary(TriggerRuleCompiler.opLe, this, RuleExpr.constant(value));
+  RuleExpr equals(int value) => _Binary(TriggerRuleCompiler.opEq, this, RuleExpr.constant(value));
+  RuleExpr between(int low, int high) => _Between(this, RuleExpr.constant(low), RuleExpr.constant(high));
+  RuleExpr and(RuleExpr other) => _Binary(TriggerRuleCompiler.opAnd, this, other);
+  RuleExpr or(RuleExpr other) => _Binary(TriggerRuleCompiler.opOr, this, other);
+  RuleExpr not() => _Not(this);
+  RuleExpr holdFor(Duration duration) => _Hold(this, duration);
+
+  void _emit(_Emitter out);
+}
+
+class _Constant extends RuleExpr {
+  final int value;
+  const _Constant(this.value);
+
+  @override
+  void _emit(_Emitter out) {
+    // PUSH carries a signed 16-bit operand; anything wider would wrap
+    if (value < TriggerRuleCompiler.minConstant || value > TriggerRuleCompiler.maxConstant) {
+      throw FormatException(
+          'Constant $value outside ${TriggerRuleCompiler.minConstant}..${TriggerRuleCompiler.maxConstant}');
+    }
+    out.op(TriggerRuleCompiler.opPush, [value & 0xFF, (value >> 8) & 0xFF]);
+  }
+}
+
+class _Load extends RuleExpr {
+  final RuleVariable variable;
+  const _Load(this.variable);
+
+  @override
+  void _emit(_Emitter out) => out.op(TriggerRuleCompiler.opLoad, [variable.id]);
+}
+
+class _Binary extends RuleExpr {
+  final int opcode;
+  final RuleExpr left, right;
+  const _Binary(this.opcode, this.left, this.right);
+
+  @override
+  void _emit(_Emitter out) {
+    left._emit(out);
+    right._emit(out);
+    out.op(opcode);
+  }
+}
+
+class _Not extends RuleExpr {
+  final RuleExpr operand;
+  const _Not(this.operand);
+
+  @override
+  void _emit(_Emitter out) {
+    operand._emit(out);
+    out.op(TriggerRuleCompiler.opNot);
+  }
+}
+
+class _Between extends RuleExpr {
+  final RuleExpr value, low, high;
+  const _Between(this.value, this.low, this.high);
+
+  @override
+  void _emit(_Emitter out) {
+    value._emit(out);
+    low._emit(out);
+    high._emit(out);
+    out.op(TriggerRuleCompiler.opBetween);
+  }
+}
+
+class _Hold extends RuleExpr {
+  final RuleExpr condition;
+  final Duration duration;
+  const _Hold(this.condition, this.duration);
+
+  @override
+  void _emit(_Emitter out) {
+    condition._emit(out);
+    final seconds = duration.inSeconds;
+    if (duration.isNegative || seconds > TriggerRuleCompiler.maxHoldSeconds) {
+      throw FormatException('Hold time of $seconds s outside 0..${TriggerRuleCompiler.maxHoldSeconds}');
+    }
+    out.op(TriggerRuleCompiler.opHold, [out.nextHoldSlot++, seconds & 0xFF, (seconds >> 8) & 0xFF]);
+  }
+}
+
+class _Emitter {
+  final List<int> bytes = [];
+  int nextHoldSlot = 0;
+
+  void op(int opcode, [List<int> operands = const []]) {
+    bytes.add(opcode);
+    bytes.addAll(operands);
+  }
+}
+
+/// Compiles trigger rules to the necklace's rule bytecode and checks them
+/// against the same limits the firmware enforces on upload.
+class TriggerRuleCompiler {
+  // Limits, matching rule_engine.h
+  static const int maxCodeLength = 32;
+  static const int stackDepth = 8;
+  static const int holdSlots = 2;
+  static const int ruleCapacity = 8;
+  static const int clearRules = 0xFF;
+
+  // Operand ranges: PUSH is LE16 signed, HOLD seconds LE16 unsigned
+  static const int minConstant = -32768;
+  static const int maxConstant = 32767;
+  static const int maxHoldSeconds = 65535;
+
+  // Opcodes
+  static const int opEnd = 0x00;
+  static const int opPush = 0x01;
+  static const int opLoad = 0x02;
+  static const int opGt = 0x03;
+  static const int opLt = 0x04;
+  static const int opGe = 0x05;
+  static const int opLe = 0x06;
+  static const int opEq = 0x07;
+  static const int opAnd = 0x08;
+  static const int opOr = 0x09;
+  static const int opNot = 0x0A;
+  static const int opHold = 0x0B;
+  static const int opBetween = 0x0C;
+
+  /// Bytecode for [rule]; throws [FormatException] if the firmware would
+  /// reject it or an operand doesn't fit its encoding.
+  static Uint8List compile(RuleExpr rule) {
+    final emitter = _Emitter();
+    rule._emit(emitter);
+    emitter.op(opEnd);
+    final code = Uint8List.fromList(emitter.bytes);
+    final error = validate(code);
+    if (error != null) {
+      throw FormatException(error);
+    }
+    return code;
+  }
+
+  /// Rule characteristic record: [index][channel mask][bytecode].
+  static Uint8List encodeRecord(int index, int channelMask, RuleExpr rule) {
+    if (index < 0 || index >= ruleCapacity) {
+      throw RangeError.range(index, 0, ruleCapacity - 1, 'index');
+    }
+    return Uint8List.fromList([index, channelMask, ...compile(rule)]);
+  }
+
+  /// Record that deletes the rule at [index].
+  static Uint8List deleteRecord(int index) => Uint8List.fromList([index, 0]);
+
+  /// Returns a description of the first problem in [code], or null if the
+  /// firmware will accept it.
+  static String? validate(List<int> code) {
+    if (code.isEmpty || code.length > maxCodeLength) {
+      return 'Rule must be 1 to $maxCodeLength bytes, got ${code.length}';
+    }
+
+    var depth = 0;
+    var slotsUsed = 0;
+    var pc = 0;
+    while (pc < code.length && code[pc] != opEnd) {
+      final op = code[pc];
+      final operands = op == opPush ? 2 : op == opLoad ? 1 : op == opHold ? 3 : 0;
+      if (pc + 1 + operands > code.length) {
+        return 'Truncated instruction at $pc';
+      }
+
+      int pops;
+      switch (op) {
+        case opPush:
+          pops = 0;
+          break;
+        case opLoad:
+          if (code[pc + 1] >= RuleVariable.values.length) {
+            return 'Unknown variable ${code[pc + 1]} at $pc';
+          }
+          pops = 0;
+          break;
+        case opGt:
+        case opLt:
+        case opGe:
+        case opLe:
+        case opEq:
+        case opAnd:
+        case opOr:
+          pops = 2;
+          break;
+        case opNot:
+          pops = 1;
+          break;
+        case opHold:
+          final slot = code[pc + 1];
+          if (slot >= holdSlots || (slotsUsed & (1 << slot)) != 0) {
+            return 'At most $holdSlots hold conditions per rule';
+          }
+          slotsUsed |= 1 << slot;
+          pops = 1;
+          break;
+        case opBetween:
+          pops = 3;
+          break;
+        default:
+          return 'Unknown opcode $op at $pc';
+      }
+
+      if (depth < pops || depth - pops + 1 > stackDepth) {
+        return 'Rule is nested too deeply';
+      }
+      depth += 1 - pops;
+      pc += 1 + operands;
+    }
+
+    return depth == 1 ? null : 'Rule must leave exactly one result';
+  }
+}